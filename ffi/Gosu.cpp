@@ -48,6 +48,15 @@ GOSU_FFI_API Gosu_Image* Gosu_render(int width, int height, void function(void*)
     });
 }
 
+GOSU_FFI_API void Gosu_render_into(Gosu_Image* image, void function(void*), void* data)
+{
+    Gosu_translate_exceptions([=] {
+        Gosu::render_into(image->image, [=] {
+            function(data);
+        });
+    });
+}
+
 GOSU_FFI_API Gosu_Image* Gosu_record(int width, int height, void function(void*), void* data)
 {
     return Gosu_translate_exceptions([=] {
@@ -20,6 +20,7 @@ GOSU_FFI_API void Gosu_gl(void function(void* data), void* data);
 GOSU_FFI_API void Gosu_flush(void);
 GOSU_FFI_API Gosu_Image* Gosu_render(int width, int height, void function(void* data), void* data,
                                      unsigned image_flags);
+GOSU_FFI_API void Gosu_render_into(Gosu_Image* image, void function(void* data), void* data);
 GOSU_FFI_API Gosu_Image* Gosu_record(int width, int height, void function(void* data), void* data);
 GOSU_FFI_API void Gosu_clip_to(double x, double y, double width, double height,
                                void function(void* data), void* data);
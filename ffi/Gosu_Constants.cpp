@@ -46,6 +46,10 @@ GOSU_FFI_API const unsigned Gosu_IF_TILEABLE_RIGHT = Gosu::IF_TILEABLE_RIGHT;
 GOSU_FFI_API const unsigned Gosu_IF_TILEABLE_BOTTOM = Gosu::IF_TILEABLE_BOTTOM;
 GOSU_FFI_API const unsigned Gosu_IF_TILEABLE = Gosu::IF_TILEABLE;
 GOSU_FFI_API const unsigned Gosu_IF_RETRO = Gosu::IF_RETRO;
+GOSU_FFI_API const unsigned Gosu_IF_COMPRESSED = Gosu::IF_COMPRESSED;
+GOSU_FFI_API const unsigned Gosu_IF_NO_DEPTH_BUFFER = Gosu::IF_NO_DEPTH_BUFFER;
+GOSU_FFI_API const unsigned Gosu_IF_TRIM_TRANSPARENT = Gosu::IF_TRIM_TRANSPARENT;
+GOSU_FFI_API const unsigned Gosu_IF_DISTANCE_FIELD = Gosu::IF_DISTANCE_FIELD;
 
 GOSU_FFI_API const unsigned Gosu_KB_ESCAPE = Gosu::KB_ESCAPE;
 GOSU_FFI_API const unsigned Gosu_KB_F1 = Gosu::KB_F1;
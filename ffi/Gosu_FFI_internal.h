@@ -6,6 +6,7 @@
 
 #include "Gosu.h"
 #include <Gosu/Gosu.hpp>
+#include <future>
 #include <stdexcept>
 
 // Error handling
@@ -43,6 +44,12 @@ struct Gosu_Image
     Gosu::Image image;
 };
 
+struct Gosu_ImageReadback
+{
+    std::future<Gosu::Bitmap> future;
+    Gosu::Bitmap bitmap;
+};
+
 struct Gosu_Sample
 {
     Gosu::Sample sample;
@@ -20,6 +20,10 @@ GOSU_FFI_API void Gosu_Font_draw_text(Gosu_Font* font, const char* text, double
 GOSU_FFI_API void Gosu_Font_draw_markup(Gosu_Font* font, const char* markup, double x, double y,
                                         double z, double scale_x, double scale_y, unsigned c,
                                         unsigned mode);
+GOSU_FFI_API void Gosu_Font_draw_markup_dilated(Gosu_Font* font, const char* markup,
+                                                double dilation, double x, double y, double z,
+                                                double scale_x, double scale_y, unsigned c,
+                                                unsigned mode);
 
 GOSU_FFI_API void Gosu_Font_draw_text_rel(Gosu_Font* font, const char* text, double x, double y,
                                           double z, double rel_x, double rel_y, double scale_x,
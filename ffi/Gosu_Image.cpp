@@ -151,6 +151,7 @@ GOSU_FFI_API Gosu_GLTexInfo* Gosu_Image_gl_tex_info_create(Gosu_Image* image)
             .right = info->right,
             .top = info->top,
             .bottom = info->bottom,
+            .layer = info->layer,
         };
     });
 }
@@ -193,6 +194,33 @@ GOSU_FFI_API void Gosu_Image_draw_as_quad(Gosu_Image* image, double x1, double y
     });
 }
 
+GOSU_FFI_API void Gosu_Image_draw_mesh(Gosu_Image* image, const double* vertices,
+                                       int vertices_size, const double* uvs, int uvs_size,
+                                       const unsigned* colors, int colors_size,
+                                       const uint32_t* indices, int indices_size, double z,
+                                       unsigned mode)
+{
+    Gosu_translate_exceptions([=] {
+        if (vertices_size < 0 || uvs_size < 0 || colors_size < 0 || indices_size < 0) {
+            throw std::invalid_argument("Invalid array size for Gosu_Image_draw_mesh");
+        }
+        const int vertex_count = vertices_size / 2;
+        for (int i = 0; i < indices_size; ++i) {
+            if (indices[i] >= static_cast<std::uint32_t>(vertex_count)) {
+                throw std::invalid_argument("Invalid index " + std::to_string(indices[i])
+                                            + " for mesh with " + std::to_string(vertex_count)
+                                            + " vertices");
+            }
+        }
+
+        const std::vector<Gosu::Color> mesh_colors(colors, colors + colors_size);
+        image->image.draw_mesh({ vertices, static_cast<std::size_t>(vertices_size) },
+                               { uvs, static_cast<std::size_t>(uvs_size) }, mesh_colors,
+                               { indices, static_cast<std::size_t>(indices_size) }, z,
+                               static_cast<Gosu::BlendMode>(mode));
+    });
+}
+
 // Image operations
 
 GOSU_FFI_API void Gosu_Image_insert(Gosu_Image* image, Gosu_Image* source, int x, int y)
@@ -212,6 +240,38 @@ GOSU_FFI_API uint8_t* Gosu_Image_to_blob(Gosu_Image* image)
     });
 }
 
+GOSU_FFI_API Gosu_ImageReadback* Gosu_Image_to_blob_async(Gosu_Image* image)
+{
+    return Gosu_translate_exceptions([=] {
+        return new Gosu_ImageReadback { .future = image->image.drawable().to_bitmap_async() };
+    });
+}
+
+GOSU_FFI_API bool Gosu_ImageReadback_ready(Gosu_ImageReadback* readback)
+{
+    return Gosu_translate_exceptions([=] {
+        return !readback->future.valid()
+            || readback->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+}
+
+GOSU_FFI_API uint8_t* Gosu_ImageReadback_blob(Gosu_ImageReadback* readback)
+{
+    return Gosu_translate_exceptions([=] {
+        if (readback->future.valid()) {
+            readback->bitmap = readback->future.get();
+        }
+        return reinterpret_cast<uint8_t*>(readback->bitmap.data());
+    });
+}
+
+GOSU_FFI_API void Gosu_ImageReadback_destroy(Gosu_ImageReadback* readback)
+{
+    Gosu_translate_exceptions([=] {
+        delete readback;
+    });
+}
+
 GOSU_FFI_API void Gosu_Image_save(Gosu_Image* image, const char* filename)
 {
     Gosu_translate_exceptions([=] {
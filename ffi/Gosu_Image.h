@@ -5,11 +5,14 @@
 #include <stdint.h>
 
 typedef struct Gosu_Image Gosu_Image;
+typedef struct Gosu_ImageReadback Gosu_ImageReadback;
 
 typedef struct Gosu_GLTexInfo
 {
     uint32_t tex_name;
     double left, right, top, bottom;
+    // -1 unless tex_name refers to a GL_TEXTURE_2D_ARRAY.
+    int layer;
 } Gosu_GLTexInfo;
 
 // Constructor
@@ -57,10 +60,23 @@ GOSU_FFI_API void Gosu_Image_draw_as_quad(Gosu_Image* image, double x1, double y
                                           double x2, double y2, unsigned color2, double x3,
                                           double y3, unsigned color3, double x4, double y4,
                                           unsigned color4, double z, unsigned mode);
+GOSU_FFI_API void Gosu_Image_draw_mesh(Gosu_Image* image, const double* vertices,
+                                       int vertices_size, const double* uvs, int uvs_size,
+                                       const unsigned* colors, int colors_size,
+                                       const uint32_t* indices, int indices_size, double z,
+                                       unsigned mode);
 
 // Operations
 GOSU_FFI_API void Gosu_Image_insert(Gosu_Image* image, Gosu_Image* source, int x, int y);
 GOSU_FFI_API void Gosu_Image_save(Gosu_Image* image, const char* filename);
 GOSU_FFI_API uint8_t* Gosu_Image_to_blob(Gosu_Image* image);
+// Starts reading the image back from video memory without stalling rendering, for example for
+// screenshots of render targets. The result becomes ready at the end of a later frame.
+GOSU_FFI_API Gosu_ImageReadback* Gosu_Image_to_blob_async(Gosu_Image* image);
+GOSU_FFI_API bool Gosu_ImageReadback_ready(Gosu_ImageReadback* readback);
+// Blocks until the readback is ready. Must not be called from Window::draw before that.
+// The returned pixels stay valid until the readback is destroyed.
+GOSU_FFI_API uint8_t* Gosu_ImageReadback_blob(Gosu_ImageReadback* readback);
+GOSU_FFI_API void Gosu_ImageReadback_destroy(Gosu_ImageReadback* readback);
 GOSU_FFI_API Gosu_GLTexInfo* Gosu_Image_gl_tex_info_create(Gosu_Image* image);
 GOSU_FFI_API void Gosu_Image_gl_tex_info_destroy(Gosu_GLTexInfo* tex_info);
@@ -62,6 +62,20 @@ namespace Gosu
         /// RGB values of transparent pixels will be adjusted to the average of their neighbors.
         void apply_color_key(Color key);
 
+        /// Multiplies the RGB values of all pixels by their alpha value, as expected by textures
+        /// in premultiplied alpha mode, see set_premultiplied_alpha().
+        void premultiply_alpha();
+
+        /// Reverts premultiply_alpha(), as far as 8-bit precision allows. Fully transparent pixels
+        /// become Color::NONE.
+        void unpremultiply_alpha();
+
+        /// Returns true if all pixels have an alpha value of 255.
+        bool opaque() const;
+        /// Returns true if all pixels in the given part of the bitmap have an alpha value of 255.
+        /// @throw std::invalid_argument if rect exceeds the bitmap.
+        bool opaque(const Rect& rect) const;
+
         /// Direct access to the array of color values.
         const Color* data() const { return reinterpret_cast<const Color*>(m_pixels.data()); }
 
@@ -76,6 +90,16 @@ namespace Gosu
     /// Loads an image from memory, in any supported format.
     Bitmap load_image(const Buffer& buffer);
 
+    /// Enables a cache for load_image_file() (and Image's filename constructors) in the given
+    /// directory, which will be created if necessary. The first time an image file is loaded, its
+    /// decoded pixels are written to the cache. Later calls (e.g. on the next launch) map the
+    /// cached pixels into memory instead of decoding the file again. Cache entries are validated
+    /// by the size, modification time and (if the time differs) hash of the source file.
+    /// Image's filename constructor caches the pixels with the border that is added around them on
+    /// a texture atlas, so the cache may contain more than one entry per file.
+    /// Pass an empty string to disable the cache again (the default).
+    void set_image_cache_directory(const std::string& directory);
+
     /// Saves a Bitmap to a file.
     void save_image_file(const Bitmap& bitmap, const std::string& filename);
     /// Saves a Bitmap to an arbitrary resource.
@@ -4,14 +4,34 @@
 #include <Gosu/Color.hpp>
 #include <Gosu/GraphicsBase.hpp>
 #include <Gosu/Utility.hpp>
+#include <cstddef>
 #include <cstdint>
+#include <future>
 #include <memory>
 
 namespace Gosu
 {
-    /// Returns the maximum size of an texture that will be allocated internally by Gosu.
+    /// The size of texture atlases in older versions of Gosu. Please use max_texture_size().
+    GOSU_DEPRECATED const unsigned MAX_TEXTURE_SIZE = 1024;
+
+    /// Returns the maximum size of a texture that will be allocated internally by Gosu.
+    /// This is the smaller of GL_MAX_TEXTURE_SIZE and the limit set by set_max_texture_size().
+    /// Images that are larger than this (minus a 1px border on each side) will be split into tiles.
     /// Useful when extending Gosu using OpenGL.
-    const unsigned MAX_TEXTURE_SIZE = 1024;
+    unsigned max_texture_size();
+
+    /// Limits the size of textures that Gosu allocates internally (default: 4096).
+    /// Texture atlases start out small and grow up to this size as more images are added.
+    /// Only affects textures that are created after calling this function.
+    void set_max_texture_size(unsigned limit);
+
+    /// Places new texture atlases on the layers of one GL_TEXTURE_2D_ARRAY per filtering mode
+    /// (default: false). Images on different atlases can then be drawn without switching textures,
+    /// which keeps the number of OpenGL state changes low when drawing many different images.
+    /// Requires GL_EXT_texture_array and shader support; has no effect if these are missing.
+    /// Only affects texture atlases that are created after calling this function.
+    /// Note: OpenGL code that uses gl_tex_info() must check GLTexInfo::layer.
+    void set_texture_array_atlases(bool enabled);
 
     /// Contains information about the underlying OpenGL texture and the u/v space used for image
     /// data. Can be retrieved from some drawables to use them in OpenGL operations.
@@ -21,6 +41,10 @@ namespace Gosu
         /// Both types must be the same because GLuint is guaranteed to be an unsigned 32-bit type.
         std::uint32_t tex_name;
         double left, right, top, bottom;
+        /// If the image is on a texture array atlas (see set_texture_array_atlases()), tex_name
+        /// refers to a GL_TEXTURE_2D_ARRAY, and this is the layer that contains the image.
+        /// Otherwise, tex_name refers to a GL_TEXTURE_2D, and this is -1.
+        int layer = -1;
     };
 
     /// Abstract base class for a rectangular thing that can be drawn.
@@ -47,6 +71,15 @@ namespace Gosu
 
         virtual Bitmap to_bitmap() const = 0;
 
+        /// Like to_bitmap(), but drawables that are backed by an OpenGL texture start the transfer
+        /// from video memory in the background. The returned future becomes ready at the end of
+        /// a later frame (or in Gosu::flush()) once the GPU has finished, so reading it does not
+        /// stall rendering. The default implementation returns a ready future.
+        /// Any thread may call get(), but on the thread that calls Window::draw, only do so once
+        /// the future is ready (see std::future::wait_for), because the transfer is completed on
+        /// that thread.
+        virtual std::future<Bitmap> to_bitmap_async() const;
+
         virtual std::unique_ptr<Drawable> subimage(const Rect& rect) const = 0;
 
         virtual void insert(const Bitmap& bitmap, int x, int y) = 0;
@@ -55,4 +88,43 @@ namespace Gosu
     /// Turns a portion of a bitmap into something that can be drawn, typically a TexChunk instance.
     std::unique_ptr<Drawable> create_drawable(const Bitmap& source, const Rect& source_rect,
                                               unsigned image_flags);
+
+    /// Moves images from sparsely populated texture atlases onto other texture atlases (using
+    /// copies in video memory), so that the emptied textures can be freed.
+    /// This can be useful in long-running games that create and free many images over time.
+    /// Must not be called while other threads are drawing images.
+    /// @return The number of bytes of video memory that have been released.
+    std::size_t compact_texture_atlases();
+
+    /// Lets Gosu call compact_texture_atlases() automatically when create_drawable needs a new
+    /// texture atlas while the existing atlases are on average less populated than min_occupancy.
+    /// The compaction runs at the end of the next frame on the drawing thread (see
+    /// Viewport::frame()), so images can safely be loaded on other threads.
+    /// @param min_occupancy A value between 0 (never compact, the default) and 1.
+    void set_atlas_compaction_threshold(double min_occupancy);
+
+    /// Limits the video memory used by textures. At the end of each frame, if the textures use
+    /// more memory than this, the textures that have not been drawn for the longest time are moved
+    /// into system memory. They are re-uploaded automatically when they are drawn again, which
+    /// causes a small hitch. Textures that have been drawn in the current frame are never evicted.
+    /// Note: OpenGL code that uses gl_tex_info() directly must draw images through Gosu at least
+    /// once per frame to keep their textures resident. Texture array atlases (see
+    /// set_texture_array_atlases()) are never evicted.
+    /// @param bytes The budget in bytes, or 0 to disable eviction (the default).
+    void set_texture_memory_budget(std::size_t bytes);
+
+    struct TextureMemoryStats
+    {
+        /// Video memory currently used by textures.
+        std::size_t resident_bytes = 0;
+        /// System memory currently used by evicted textures.
+        std::size_t evicted_bytes = 0;
+        /// How often textures have been evicted so far.
+        std::uint64_t evictions = 0;
+        /// How often evicted textures have been uploaded to video memory again.
+        std::uint64_t reuploads = 0;
+    };
+
+    /// Returns statistics about texture memory usage, see set_texture_memory_budget().
+    TextureMemoryStats texture_memory_stats();
 }
@@ -11,6 +11,36 @@
 
 namespace Gosu
 {
+    /// Text or markup that has been laid out ahead of time by Font::prepare_text() or
+    /// Font::prepare_markup(). All glyphs have already been looked up and positioned, so drawing
+    /// a TextLayout only has to queue one quad per glyph. This is useful for text that is drawn
+    /// again and again without changes, like labels in a HUD.
+    /// A TextLayout is immutable and keeps its glyphs alive, even if the Font is destroyed or
+    /// Font::set_image() replaces a glyph later.
+    class TextLayout
+    {
+        struct Impl;
+        std::shared_ptr<const Impl> m_impl;
+
+        friend class Font;
+        explicit TextLayout(std::shared_ptr<const Impl> impl);
+
+    public:
+        /// Creates an empty layout.
+        TextLayout();
+
+        /// Returns the width, in pixels, of the widest line.
+        double width() const;
+        /// Returns the height, in pixels, of all lines together.
+        double height() const;
+
+        /// Draws the text so that its top left corner is at (x; y).
+        /// @param c The color that all glyphs are multiplied with, in addition to the colors that
+        ///          were set through markup.
+        void draw(double x, double y, ZPos z, double scale_x = 1, double scale_y = 1,
+                  Color c = Color::WHITE, BlendMode mode = BM_DEFAULT) const;
+    };
+
     /// A simple bitmap font that renders and caches glyphs on demand.
     /// For large, static texts you should use Gosu::layout_text and turn the result into an image.
     class Font
@@ -50,6 +80,20 @@ namespace Gosu
         void draw_markup(const std::string& markup, double x, double y, ZPos z, //
                          double scale_x = 1, double scale_y = 1, Color c = Color::WHITE,
                          BlendMode mode = BM_DEFAULT) const;
+        /// Only for fonts with IF_DISTANCE_FIELD: Draws markup like draw_markup(), but grows each
+        /// glyph by the given number of pixels (before scaling), or shrinks it if the value is
+        /// negative. This is a cheap way to add outlines and shadows: Draw the markup grown by two
+        /// pixels in a dark color, possibly with an offset, and then draw it normally on top.
+        /// Glyphs can grow by at most an eighth of the font height.
+        /// @throw std::logic_error if the font does not use IF_DISTANCE_FIELD.
+        void draw_markup_dilated(const std::string& markup, double dilation, double x, double y,
+                                 ZPos z, double scale_x = 1, double scale_y = 1,
+                                 Color c = Color::WHITE, BlendMode mode = BM_DEFAULT) const;
+
+        /// Lays out text once so that it can be drawn many times without parsing it again.
+        TextLayout prepare_text(const std::string& text) const;
+        /// Lays out markup once so that it can be drawn many times without parsing it again.
+        TextLayout prepare_markup(const std::string& markup) const;
 
         /// Draws text at a position relative to (x; y).
         /// @param rel_x Determines where the text is drawn horizontally. If rel_x is 0.0, the text
@@ -68,6 +112,19 @@ namespace Gosu
                              double rel_x, double rel_y, double scale_x = 1, double scale_y = 1,
                              Color c = Color::WHITE, BlendMode mode = BM_DEFAULT) const;
 
+        /// Renders the glyphs for all characters in a string ahead of time, so that drawing them
+        /// for the first time does not cause a hitch. The glyphs are rendered on several threads,
+        /// and then uploaded to the GPU together.
+        /// @param font_flags The flags that the characters will be drawn with (FontFlags enum).
+        /// Note that markup can change these flags; "<b>" adds FF_BOLD, for example.
+        void preload(std::string_view characters, unsigned font_flags) const;
+        /// A shortcut for preloading characters with the flags that were passed to the constructor.
+        void preload(std::string_view characters) const;
+        /// Renders the glyphs for a range of codepoints ahead of time, e.g. 0x20 to 0xFF for the
+        /// printable characters of Latin-1. See the other overloads of preload().
+        void preload(char32_t first, char32_t last, unsigned font_flags) const;
+        void preload(char32_t first, char32_t last) const;
+
         /// Maps a letter to a specific image, instead of generating one using Gosu's built-in text
         /// rendering.
         void set_image(std::string_view codepoint, unsigned font_flags, const Gosu::Image& image);
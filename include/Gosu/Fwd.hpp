@@ -12,8 +12,11 @@ namespace Gosu
     class Input;
     struct Rect;
     class Sample;
+    class Shape;
     class Song;
     class TextInput;
+    class TextLayout;
+    class TileMap;
     struct Transform;
     class Viewport;
     class Window;
@@ -18,8 +18,10 @@
 #include <Gosu/Input.hpp>
 #include <Gosu/Math.hpp>
 #include <Gosu/Platform.hpp>
+#include <Gosu/Shape.hpp>
 #include <Gosu/Text.hpp>
 #include <Gosu/TextInput.hpp>
+#include <Gosu/TileMap.hpp>
 #include <Gosu/Timing.hpp>
 #include <Gosu/Transform.hpp>
 #include <Gosu/Utility.hpp>
@@ -4,11 +4,60 @@
 #include <Gosu/Color.hpp>
 #include <Gosu/GraphicsBase.hpp>
 #include <Gosu/Utility.hpp>
+#include <cstddef>
 #include <functional>
 #include <memory>
 
 namespace Gosu
 {
+    /// Debug modes for finding out where fill rate and draw calls are spent, see
+    /// Viewport::set_debug_view().
+    enum DebugView
+    {
+        /// Normal rendering.
+        DV_OFF,
+        /// Normal rendering, but FrameStats are collected.
+        DV_STATS,
+        /// Counts how often each pixel is drawn in an off-screen target, then shows the counts
+        /// on top of the frame: Dark red for one layer, bright red for four, yellow for sixteen,
+        /// and white for 64 or more. Pixels that are never drawn are left alone. Custom OpenGL
+        /// code draws into the off-screen target, so its output is not visible in this view.
+        /// Without shader support (e.g. in OpenGL ES), every image and shape is drawn as an
+        /// additive shape in these colors instead.
+        DV_OVERDRAW,
+        /// Draws every image and shape as an untextured shape whose color shows why a new batch
+        /// of draw operations (a new draw call) had to be started for it, following the rules of
+        /// set_shader_pipeline() and set_multi_texture_batching() if they are enabled:
+        /// Gray: no new batch. White: the first operation. Red: a different texture.
+        /// Green: a different transform. Blue: a different clip rect. Yellow: a different blend
+        /// mode. Cyan: lines cannot be batched with triangles. Fuchsia: the previous operation was
+        /// custom OpenGL code.
+        DV_BATCH_BREAKS,
+    };
+
+    /// Statistics about the draw operations of a frame, see Viewport::set_debug_view().
+    struct FrameStats
+    {
+        /// The number of images, shapes and glyphs that have been drawn.
+        std::size_t draw_ops = 0;
+        /// The number of gl() blocks, including macros drawn with Image::draw.
+        std::size_t gl_blocks = 0;
+        /// The number of batches, i.e. runs of draw operations that share OpenGL state.
+        std::size_t batches = 0;
+        /// The reasons why new batches have been started. See DV_BATCH_BREAKS.
+        std::size_t texture_breaks = 0;
+        std::size_t transform_breaks = 0;
+        std::size_t clip_breaks = 0;
+        std::size_t blend_breaks = 0;
+        std::size_t primitive_breaks = 0;
+        std::size_t gl_block_breaks = 0;
+        /// The number of pixels covered by all draw operations, ignoring clip rects.
+        double covered_pixels = 0;
+        /// covered_pixels divided by the number of pixels on the screen: How often each pixel is
+        /// drawn on average.
+        double overdraw = 0;
+    };
+
     /// Serves as the target of all drawing. Usually created internally by Gosu::Window.
     class Viewport : private Noncopyable
     {
@@ -32,8 +81,16 @@ namespace Gosu
         /// For internal use only.
         void set_physical_resolution(int physical_width, int physical_height);
 
-        friend void gl(const std::function<void()>&);
-        friend void gl(ZPos, const std::function<void()>&);
+        /// Enables a debug mode for all following frames. This works without a visible window and
+        /// with software OpenGL, but slows rendering down a little.
+        void set_debug_view(DebugView view);
+        DebugView debug_view() const;
+        /// Returns statistics about the most recent frame, or about the current frame so far if
+        /// called during frame(). All values are zero if the debug view is DV_OFF.
+        const FrameStats& frame_stats() const;
+
+        friend void flush();
+
         friend void clip_to(double, double, double, double, const std::function<void()>&);
     };
 
@@ -42,24 +99,65 @@ namespace Gosu
     /// halves of a game that runs in split-screen mode.
     void flush();
 
+    /// Parts of the OpenGL state that custom OpenGL code (see gl()) can declare as modified.
+    /// With GLS_ALL (the default), Gosu saves and restores the whole attribute stack
+    /// (glPushAttrib/glPushClientAttrib) around the code, as it always has. With a narrower mask,
+    /// Gosu skips that and only resets the declared parts to the state that it depends on.
+    /// Everything else, including the framebuffer binding, must be restored by the custom code.
+    enum GLStateFlags
+    {
+        GLS_NONE = 0,
+        /// Blending, glBlendFunc, glBlendEquation and glColorMask.
+        GLS_BLEND = 1 << 0,
+        /// Texture bindings and the texturing state of all texture units, including the texture
+        /// environment and the GL_TEXTURE matrix.
+        GLS_TEXTURES = 1 << 1,
+        /// The GL_PROJECTION and GL_MODELVIEW matrices, and glViewport.
+        GLS_MATRICES = 1 << 2,
+        /// The scissor test and glScissor.
+        GLS_SCISSOR = 1 << 3,
+        /// The depth and stencil tests, and glDepthMask.
+        GLS_DEPTH_STENCIL = 1 << 4,
+        /// The current shader program, vertex/index buffer bindings and client-side arrays.
+        GLS_SHADERS = 1 << 5,
+        /// Other capabilities that affect drawing, such as face culling, the alpha test,
+        /// lighting, the polygon mode, line width and pixel unpacking.
+        GLS_OTHER = 1 << 6,
+        GLS_ALL = (1 << 7) - 1
+    };
+
     /// Finishes all pending Gosu drawing operations and executes the code in f in a clean
     /// OpenGL environment.
-    void gl(const std::function<void()>& f);
+    /// @param modified_state A bit mask of GLStateFlags. Declaring only the parts of the state
+    ///                       that f modifies makes it cheaper for Gosu to restore its own state,
+    ///                       but state outside of these parts is then no longer saved.
+    void gl(const std::function<void()>& f, unsigned modified_state = GLS_ALL);
 
     /// Schedules a custom GL functor to be executed at a certain Z level.
     /// The functor f is run in a clean GL context.
     /// Note: You may not call any Gosu rendering functions from within the functor.
-    void gl(ZPos z, const std::function<void()>& f);
+    /// @param modified_state See the other overload of gl().
+    void gl(ZPos z, const std::function<void()>& f, unsigned modified_state = GLS_ALL);
 
     /// Renders everything drawn in f clipped to a rectangle on the screen.
     void clip_to(double x, double y, double width, double height, const std::function<void()>& f);
 
     /// Renders everything drawn in f onto a new Image of size (width, height).
+    /// The texture and framebuffer of images that are no longer in use are recycled, so calling
+    /// this every frame with the same size does not allocate new video memory.
     /// @param image_flags Pass Gosu::IF_RETRO if you do not want the resulting image to use
-    /// interpolation when it is scaled or rotated.
+    /// interpolation when it is scaled or rotated, and Gosu::IF_NO_DEPTH_BUFFER if custom OpenGL
+    /// code in f does not need a depth buffer.
     Gosu::Image render(int width, int height, const std::function<void()>& f,
                        unsigned image_flags = 0);
 
+    /// Clears an image that was returned by render() and renders everything drawn in f onto it,
+    /// reusing its texture and framebuffer. All copies and subimages of the image are updated.
+    /// Draw operations that use the image and have been queued but not yet flushed (e.g. earlier
+    /// in the current frame) will also see the new contents.
+    /// @throw std::invalid_argument if the image was not created by render().
+    void render_into(Gosu::Image& image, const std::function<void()>& f);
+
     /// Records a macro and returns it as an Image.
     Gosu::Image record(int width, int height, const std::function<void()>& f);
 
@@ -85,4 +183,38 @@ namespace Gosu
     void draw_rect(double x, double y, double width, double height, Color c, ZPos z,
                    BlendMode mode = BM_DEFAULT);
 
+    /// Lets the renderer bind up to 16 textures at once (default: false). Images on different
+    /// textures, for example tileable images or the results of render(), can then be drawn in
+    /// one draw call until more textures are needed than the GPU has texture units, or until
+    /// the transform, clip rect or blend mode changes. Requires shader support; has no effect
+    /// if it is missing.
+    void set_multi_texture_batching(bool enabled);
+
+    /// Renders through a GLSL program and a vertex buffer instead of OpenGL's fixed-function
+    /// pipeline (default: false). Transforms are then applied on the GPU, and draw operations
+    /// with different textures, transforms or without textures can share a draw call. Requires
+    /// OpenGL 2.1; has no effect if it is not available. Custom OpenGL code (see gl()) still
+    /// runs in the fixed-function pipeline.
+    void set_shader_pipeline(bool enabled);
+
+    /// Stores textures with premultiplied alpha and blends accordingly (default: false). BM_ADD
+    /// then uses the same blend function as BM_DEFAULT, so that images with both blend modes can
+    /// be drawn in one batch. BM_MULTIPLY leaves transparent pixels unchanged in this mode.
+    /// This must be set before any images are created, because it affects how their pixels are
+    /// uploaded. Compressed images from DDS or KTX2 files are uploaded as they are, so their
+    /// colors must already be premultiplied.
+    /// Pixels read back through Drawable::to_bitmap() are converted to straight alpha again.
+    void set_premultiplied_alpha(bool enabled);
+
+    /// Draws opaque images and shapes in a separate pass before everything else (default: false).
+    /// This pass runs front-to-back and fills the depth buffer, so that the GPU can skip pixels
+    /// that are hidden behind opaque images, which saves fill rate in scenes with a lot of
+    /// overdraw. The result is the same as with Z ordering alone.
+    /// Images count as opaque if all their pixels are opaque and they are drawn with BM_DEFAULT
+    /// and opaque colors. Gosu only checks the pixels of uncompressed images that are loaded with
+    /// IF_RETRO or IF_TILEABLE (so that their edges are not interpolated), so other images must
+    /// opt in through one of these flags to benefit from this pass.
+    /// Requires a depth buffer; render() targets created with IF_NO_DEPTH_BUFFER are drawn as
+    /// usual.
+    void set_opaque_pass(bool enabled);
 }
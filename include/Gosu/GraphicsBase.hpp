@@ -51,6 +51,30 @@ namespace Gosu
         IF_TILEABLE = IF_TILEABLE_LEFT | IF_TILEABLE_TOP | IF_TILEABLE_RIGHT | IF_TILEABLE_BOTTOM,
 
         /// Apply nearest-neighbor interpolation when scaling this image up or down.
-        IF_RETRO = 1 << 5
+        IF_RETRO = 1 << 5,
+
+        /// Compress this image to BC3 (DXT5) at load time, using a quarter of the video memory.
+        /// This is lossy and ignored if the GPU does not support S3TC texture compression.
+        /// Images loaded from DDS or KTX2 files always keep their compressed format.
+        IF_COMPRESSED = 1 << 6,
+
+        /// Only used by render(): Do not attach a depth buffer to the render target. Gosu itself
+        /// never uses it; only custom OpenGL code might.
+        IF_NO_DEPTH_BUFFER = 1 << 7,
+
+        /// Only store and draw the smallest rectangle that contains all visible pixels, for
+        /// example to save texture memory and fill rate for animation frames with large
+        /// transparent margins. The image still reports its full width and height. Images with
+        /// this flag have no GLTexInfo if anything has been trimmed. Tileable edges are never
+        /// trimmed. Drawable::insert() cannot write into the trimmed margins, so any pixels that
+        /// fall outside of the stored rectangle are silently dropped.
+        IF_TRIM_TRANSPARENT = 1 << 8,
+
+        /// Only store the alpha channel of this image, and interpret it as a signed distance field
+        /// with the edge of the shape at an alpha value of 128. Such images stay crisp at any
+        /// scale and are drawn in the color passed to draw(). Fonts with this flag render every
+        /// glyph once as a distance field and share it between all font sizes.
+        /// Implies smooth interpolation; IF_RETRO and IF_COMPRESSED are ignored.
+        IF_DISTANCE_FIELD = 1 << 9
     };
 }
@@ -3,7 +3,9 @@
 #include <Gosu/Fwd.hpp>
 #include <Gosu/Color.hpp>
 #include <Gosu/GraphicsBase.hpp>
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -21,6 +23,7 @@ namespace Gosu
         /// Loads an image from a given filename.
         ///
         /// A color key of #ff00ff is automatically applied to BMP image files.
+        /// DDS and KTX2 files that contain BC1, BC3 or BC7 data stay compressed in video memory.
         /// For more flexibility, use the corresponding constructor that uses a Bitmap object.
         explicit Image(const std::string& filename, unsigned image_flags = IF_SMOOTH);
 
@@ -60,6 +63,24 @@ namespace Gosu
                       double center_y = 0.5, double scale_x = 1, double scale_y = 1,
                       Color c = Color::WHITE, BlendMode mode = BM_DEFAULT) const;
 
+        /// Draws textured triangles that show parts of this image, for example to deform it or to
+        /// draw a skinned 2D mesh. All triangles are drawn as a single draw operation.
+        /// @param vertices The positions of the vertices as a flat list: x1, y1, x2, y2, ...
+        /// @param uvs The position of each vertex on this image, in the same format. (0; 0) is
+        ///            the top left corner of the image, (1; 1) its bottom right corner. Values
+        ///            outside of this range are clamped.
+        /// @param colors Either empty (white), a single color for all vertices, or one color per
+        ///               vertex.
+        /// @param indices Three vertex indices per triangle. If empty, every three vertices form a
+        ///                triangle.
+        /// @throw std::invalid_argument if the sizes do not match or an index is out of range.
+        /// @throw std::logic_error if the image is not stored on a single texture, for example
+        ///                         because it is larger than max_texture_size(), or was loaded
+        ///                         with IF_TRIM_TRANSPARENT.
+        void draw_mesh(std::span<const double> vertices, std::span<const double> uvs,
+                       std::span<const Color> colors, std::span<const std::uint32_t> indices,
+                       ZPos z, BlendMode mode = BM_DEFAULT) const;
+
         /// Provides access to the underlying image data object.
         Drawable& drawable() const;
     };
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Color.hpp>
+#include <Gosu/GraphicsBase.hpp>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace Gosu
+{
+    /// How thick lines are joined where two segments meet.
+    enum LineJoin
+    {
+        /// Extends the outer edges until they meet in a sharp corner. Very sharp corners are
+        /// beveled instead.
+        LJ_MITER,
+        /// Cuts the corner off.
+        LJ_BEVEL,
+        LJ_ROUND,
+    };
+
+    /// What the ends of thick lines look like.
+    enum LineCap
+    {
+        /// The line ends exactly at its end points.
+        LC_BUTT,
+        /// The line is extended by half its width.
+        LC_SQUARE,
+        LC_ROUND,
+    };
+
+    /// A collection of vector shapes that are tessellated into triangles when they are added, and
+    /// then drawn as a single draw operation. This is much cheaper than drawing the same shapes
+    /// with many calls to draw_triangle() or draw_line(), and the tessellation can be reused for
+    /// shapes that do not change between frames.
+    ///
+    /// Points are passed as a flat list of coordinates: x1, y1, x2, y2, ... Angles work like
+    /// everywhere else in Gosu, see Math.hpp. Curves are divided into enough segments to look
+    /// smooth when drawn at a scale of 1.
+    class Shape
+    {
+        struct Impl;
+        std::shared_ptr<Impl> m_impl;
+
+        Impl& impl_for_writing();
+
+    public:
+        Shape();
+
+        /// Adds a line with the given width through all points.
+        /// @param closed Whether the last point should be connected to the first one.
+        /// @throw std::invalid_argument if the number of coordinates is odd.
+        void add_polyline(std::span<const double> points, double width, Color c,
+                          LineJoin join = LJ_MITER, LineCap cap = LC_BUTT, bool closed = false);
+
+        /// Adds a filled polygon. It may be concave, but its edges must not intersect each other.
+        /// @throw std::invalid_argument if the number of coordinates is odd.
+        void add_polygon(std::span<const double> points, Color c);
+
+        /// Adds a filled circle.
+        void add_circle(double x, double y, double radius, Color c);
+
+        /// Adds the outline of a circle, or part of it, with the given line width. The arc runs
+        /// clockwise from start_angle to end_angle; a difference of 360 or more draws a ring.
+        void add_arc(double x, double y, double radius, double start_angle, double end_angle,
+                     double width, Color c, LineCap cap = LC_BUTT);
+
+        /// Removes all shapes.
+        void clear();
+
+        std::size_t triangle_count() const;
+
+        /// Draws all shapes, offset by (x; y).
+        void draw(double x, double y, ZPos z, BlendMode mode = BM_DEFAULT) const;
+    };
+
+    /// Draws a thick line through all points. See Shape::add_polyline().
+    void draw_polyline(std::span<const double> points, double width, Color c, ZPos z,
+                       LineJoin join = LJ_MITER, LineCap cap = LC_BUTT, bool closed = false,
+                       BlendMode mode = BM_DEFAULT);
+
+    /// Draws a filled polygon. See Shape::add_polygon().
+    void draw_polygon(std::span<const double> points, Color c, ZPos z,
+                      BlendMode mode = BM_DEFAULT);
+
+    /// Draws a filled circle. See Shape::add_circle().
+    void draw_circle(double x, double y, double radius, Color c, ZPos z,
+                     BlendMode mode = BM_DEFAULT);
+
+    /// Draws the outline of a circle, or part of it. See Shape::add_arc().
+    void draw_arc(double x, double y, double radius, double start_angle, double end_angle,
+                  double width, Color c, ZPos z, LineCap cap = LC_BUTT,
+                  BlendMode mode = BM_DEFAULT);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/GraphicsBase.hpp>
+#include <memory>
+#include <vector>
+
+namespace Gosu
+{
+    /// A grid of tiles that can be drawn with a single call, for example a level made from the
+    /// images returned by load_tiles().
+    ///
+    /// The grid is divided into square chunks of tiles. The vertices of each chunk are only
+    /// compiled when it changes, and are kept in a vertex buffer on the GPU if possible. draw()
+    /// then skips all chunks that are outside the screen, and set_tile() only needs to update the
+    /// chunk that contains the changed tile. This makes large maps cheap to draw and to edit.
+    class TileMap
+    {
+        struct Impl;
+        std::shared_ptr<Impl> m_impl;
+
+    public:
+        /// The tile index of empty cells.
+        static constexpr int NO_TILE = -1;
+
+        /// Creates a map in which all cells are empty.
+        /// @param tiles The images that tile indices refer to. All must have the same size.
+        /// @param chunk_size The width and height of a chunk, in tiles. Larger chunks need fewer
+        ///                   draw calls, smaller chunks are faster to update and to cull.
+        /// @throw std::invalid_argument if tiles is empty, the tiles have different sizes, or any
+        ///                              size is negative.
+        TileMap(std::vector<Image> tiles, int columns, int rows, int chunk_size = 16);
+
+        int columns() const;
+        int rows() const;
+        int tile_width() const;
+        int tile_height() const;
+
+        /// Returns the index of the tile at the given cell, or NO_TILE.
+        /// @throw std::invalid_argument if the cell is outside the map.
+        int tile(int column, int row) const;
+        /// Changes the tile at the given cell. This takes effect on the next call of draw().
+        /// @param tile An index into the tiles passed to the constructor, or NO_TILE.
+        /// @throw std::invalid_argument if the cell is outside the map or the index is invalid.
+        void set_tile(int column, int row, int tile);
+
+        /// Draws the map so that its upper left corner is at (x; y).
+        /// Like macros (see record()), tile maps are drawn as custom OpenGL code and cannot be
+        /// tinted.
+        void draw(double x, double y, ZPos z, double scale_x = 1, double scale_y = 1) const;
+    };
+}
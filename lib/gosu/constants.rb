@@ -314,6 +314,10 @@ module GosuFFI
     "IF_TILEABLE_BOTTOM",
     "IF_TILEABLE",
     "IF_RETRO",
+    "IF_COMPRESSED",
+    "IF_NO_DEPTH_BUFFER",
+    "IF_TRIM_TRANSPARENT",
+    "IF_DISTANCE_FIELD",
   ]
 
   constants.each do |const|
@@ -344,10 +348,13 @@ module GosuFFI
     end
   end
 
-  def self.image_flags(retro: false, tileable: false)
+  def self.image_flags(retro: false, tileable: false, compressed: false, trim: false, distance_field: false)
     flags = 0
     flags |= GosuFFI.IF_RETRO if retro
     flags |= GosuFFI.IF_TILEABLE if tileable
+    flags |= GosuFFI.IF_COMPRESSED if compressed
+    flags |= GosuFFI.IF_TRIM_TRANSPARENT if trim
+    flags |= GosuFFI.IF_DISTANCE_FIELD if distance_field
     flags
   end
 
@@ -38,6 +38,7 @@ module GosuFFI
   attach_function :Gosu_gl_z, [:double, :_callback], :void
   attach_function :Gosu_gl, [:_callback], :void
   attach_function :Gosu_render, [:int, :int, :_callback, :uint32], :pointer
+  attach_function :Gosu_render_into, [:pointer, :_callback], :void
   attach_function :Gosu_record, [:int, :int, :_callback], :pointer
 
   attach_function :Gosu_button_down, [:uint32], :bool
@@ -125,6 +126,8 @@ module GosuFFI
                                          :double, :double, :uint32, :uint32], :void
   attach_function :Gosu_Font_draw_markup, [:pointer, :string, :double, :double, :double,
                                            :double, :double, :uint32, :uint32], :void
+  attach_function :Gosu_Font_draw_markup_dilated, [:pointer, :string, :double, :double, :double, :double,
+                                                   :double, :double, :uint32, :uint32], :void
 
   attach_function :Gosu_Font_draw_text_rel, [:pointer, :string, :double, :double, :double,
                                              :double, :double, :double, :double, :uint32, :uint32], :void
@@ -152,6 +155,8 @@ module GosuFFI
                                          :double, :double, :uint32, :uint32], :void
   attach_function :Gosu_Image_draw_as_quad, [:pointer, :double, :double, :uint32, :double, :double, :uint32,
                                              :double, :double, :uint32, :double, :double, :uint32, :double, :uint32], :void
+  attach_function :Gosu_Image_draw_mesh, [:pointer, :pointer, :int, :pointer, :int, :pointer, :int,
+                                          :pointer, :int, :double, :uint32], :void
 
   attach_function :Gosu_Image_save, [:pointer, :string], :void
   attach_function :Gosu_Image_to_blob, [:pointer], :pointer
@@ -1,7 +1,8 @@
 module Gosu
   class Font
-    def initialize(height, name: Gosu.default_font_name, bold: false, italic: false, underline: false)
-      __font = GosuFFI.Gosu_Font_create(height, name, GosuFFI.font_flags(bold, italic, underline), 0)
+    def initialize(height, name: Gosu.default_font_name, bold: false, italic: false, underline: false, distance_field: false)
+      image_flags = GosuFFI.image_flags(distance_field: distance_field)
+      __font = GosuFFI.Gosu_Font_create(height, name, GosuFFI.font_flags(bold, italic, underline), image_flags)
       GosuFFI.check_last_error
       @memory_pointer = FFI::AutoPointer.new(__font, GosuFFI.method(:Gosu_Font_destroy))
     end
@@ -36,6 +37,11 @@ module Gosu
       GosuFFI.check_last_error
     end
 
+    def draw_markup_dilated(text, dilation, x, y, z, scale_x = 1, scale_y = 1, c = Gosu::Color::WHITE, mode = :default)
+      GosuFFI.Gosu_Font_draw_markup_dilated(__pointer, text.to_s, dilation, x, y, z, scale_x, scale_y, GosuFFI.color_to_uint32(c), GosuFFI.blend_mode(mode))
+      GosuFFI.check_last_error
+    end
+
     def draw_text_rel(text, x, y, z, rel_x, rel_y, scale_x = 1, scale_y = 1, c = Gosu::Color::WHITE, mode = :default)
       GosuFFI.Gosu_Font_draw_text_rel(__pointer, text.to_s, x, y, z, rel_x, rel_y, scale_x, scale_y, GosuFFI.color_to_uint32(c), GosuFFI.blend_mode(mode))
       GosuFFI.check_last_error
@@ -4,7 +4,8 @@ module Gosu
            :left, :double,
            :right, :double,
            :top, :double,
-           :bottom, :double
+           :bottom, :double,
+           :layer, :int
 
     def tex_name
       self[:tex_name]
@@ -26,6 +27,10 @@ module Gosu
       self[:bottom]
     end
 
+    def layer
+      self[:layer]
+    end
+
     def self.release(pointer)
       GosuFFI.Gosu_Image_gl_tex_info_destroy(pointer)
     end
@@ -40,13 +40,21 @@ module Gosu
     GosuFFI.check_last_error
   end
 
-  def self.render(width, height, retro: false, tileable: false, &block)
+  def self.render(width, height, retro: false, tileable: false, depth_buffer: true, &block)
     # TODO: Exception translation from inner block
-    __image = GosuFFI.Gosu_render(width, height, block, GosuFFI.image_flags(retro: retro, tileable: tileable))
+    flags = GosuFFI.image_flags(retro: retro, tileable: tileable)
+    flags |= GosuFFI.IF_NO_DEPTH_BUFFER unless depth_buffer
+    __image = GosuFFI.Gosu_render(width, height, block, flags)
     GosuFFI.check_last_error
     Gosu::Image.new(__image)
   end
 
+  def self.render_into(image, &block)
+    # TODO: Exception translation from inner block
+    GosuFFI.Gosu_render_into(image.__pointer, block)
+    GosuFFI.check_last_error
+  end
+
   def self.record(width, height, &block)
     # TODO: Exception translation from inner block
     __image = GosuFFI.Gosu_record(width, height, block)
@@ -47,12 +47,13 @@ module Gosu
       return images
     end
 
-    def initialize(object, retro: false, tileable: false, rect: nil)
+    def initialize(object, retro: false, tileable: false, compressed: false, trim: false, distance_field: false, rect: nil)
       if rect and rect.size != 4
         raise ArgumentError, "Expected 4-element array as rect"
       end
 
-      flags = GosuFFI.image_flags(retro: retro, tileable: tileable)
+      flags = GosuFFI.image_flags(retro: retro, tileable: tileable, compressed: compressed, trim: trim,
+                                  distance_field: distance_field)
 
       if object.is_a? String
         if rect
@@ -114,6 +115,18 @@ module Gosu
       GosuFFI.check_last_error
     end
 
+    def draw_mesh(vertices, uvs, colors, indices = [], z = 0, mode = :default)
+      colors = [colors] unless colors.is_a?(Array)
+      vertices_ptr = FFI::MemoryPointer.new(:double, vertices.size).put_array_of_double(0, vertices)
+      uvs_ptr = FFI::MemoryPointer.new(:double, uvs.size).put_array_of_double(0, uvs)
+      colors_ptr = FFI::MemoryPointer.new(:uint32, colors.size)
+                                     .put_array_of_uint32(0, colors.map { |c| GosuFFI.color_to_uint32(c) })
+      indices_ptr = FFI::MemoryPointer.new(:uint32, indices.size).put_array_of_uint32(0, indices)
+      GosuFFI.Gosu_Image_draw_mesh(__pointer, vertices_ptr, vertices.size, uvs_ptr, uvs.size,
+                                   colors_ptr, colors.size, indices_ptr, indices.size, z, GosuFFI.blend_mode(mode))
+      GosuFFI.check_last_error
+    end
+
     def save(filename)
       GosuFFI.Gosu_Image_save(__pointer, filename)
       GosuFFI.check_last_error
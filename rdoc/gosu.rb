@@ -271,6 +271,7 @@ module Gosu
     # @option options [bool] :italic (false)
     # @option options [bool] :underline (false)
     # @option options [bool] :retro (false) see Gosu::Image
+    # @option options [bool] :distance_field (false) if true, each glyph is rendered only once as a signed distance field and shared between all font sizes. The glyphs stay crisp at any scale, and {#draw_markup_dilated} can be used for outlines and shadows.
     #
     # @overload initialize(height, options = {})
     # @overload initialize(window, font_name, height)
@@ -311,6 +312,15 @@ module Gosu
     # Like {#draw_text}, but supports the following markup tags: `<b>bold</b>`, `<i>italic</i>`, `<c=rrggbb>colors</c>`.
     def draw_markup(markup, x, y, z, scale_x=1, scale_y=1, color=0xff_ffffff, mode=:default); end
 
+    ##
+    # Like {#draw_markup}, but grows each glyph by the given number of pixels (before scaling), or shrinks it if the value is negative. Drawing the markup grown by two pixels in a dark color, and then drawing it normally on top, adds an outline.
+    #
+    # This only works for fonts that were created with +distance_field: true+.
+    #
+    # @return [void]
+    # @param dilation [Float] how many pixels each glyph grows by, at most an eighth of the font height.
+    def draw_markup_dilated(markup, dilation, x, y, z, scale_x=1, scale_y=1, color=0xff_ffffff, mode=:default); end
+
     ##
     # Draws a single line of text relative to (x, y).
     #
@@ -370,6 +380,9 @@ module Gosu
     # @param [Hash] options
     # @option options [true, false] :tileable (false) if true, the Image will not have soft edges when scaled
     # @option options [true, false] :retro (false) if true, the image will not be interpolated when it is scaled up or down. When :retro it set, :tileable has no effect.
+    # @option options [true, false] :compressed (false) if true, the image will be stored in a compressed (BC3/DXT5) texture that uses a quarter of the video memory. DDS and KTX2 files are always stored in their compressed format.
+    # @option options [true, false] :trim (false) if true, only the smallest rectangle that contains all visible pixels will be stored and drawn. The image still has its full width and height. Useful for animation frames with large transparent margins.
+    # @option options [true, false] :distance_field (false) if true, only the alpha channel is stored, and interpreted as a signed distance field with the edge of the shape at an alpha value of 128. The image stays crisp at any scale and is drawn in the color passed to {#draw}.
     # @option options [Array] :rect ([0, 0, image_width, image_height]) the source rectangle in the image
     #
     # @overload initialize(source, options = {})
@@ -503,6 +516,22 @@ module Gosu
     # @see https://github.com/gosu/gosu/wiki/Basic-Concepts#z-ordering Z-ordering explained in the Gosu Wiki
     def draw_as_quad(x1, y1, c1, x2, y2, c2, x3, y3, c3, x4, y4, c4, z, mode=:default); end
 
+    ##
+    # Draws textured triangles that show parts of the image, e.g., to deform it or to draw a skinned 2D mesh. All triangles are drawn as a single draw operation.
+    #
+    # This only works for images that are stored on a single texture, i.e., not for images larger than the maximum texture size or images that were loaded with +trim: true+.
+    #
+    # @return [void]
+    # @param vertices [Array<Float>] the positions of the vertices as a flat list: [x1, y1, x2, y2, ...].
+    # @param uvs [Array<Float>] the position of each vertex on the image, in the same format. (0, 0) is the top left corner of the image, (1, 1) its bottom right corner.
+    # @param colors [Gosu::Color, Array<Gosu::Color>] one color for all vertices, or one color per vertex.
+    # @param indices [Array<Integer>] three vertex indices per triangle. If empty, every three vertices form a triangle.
+    # @param z [Float] the Z-order.
+    # @param mode [:default, :additive] the blending mode to use.
+    #
+    # @see #draw_as_quad
+    def draw_mesh(vertices, uvs, colors, indices=[], z=0, mode=:default); end
+
     # @!endgroup
 
     ##
@@ -996,6 +1025,10 @@ module Gosu
     ##
     # @return [Float] the V coordinate of the bottom edge of the image.
     attr_reader :bottom
+
+    ##
+    # @return [Integer] the layer of the image if {#tex_name} refers to a GL_TEXTURE_2D_ARRAY, or -1 for a GL_TEXTURE_2D.
+    attr_reader :layer
   end
 
   class << self
@@ -1212,12 +1245,24 @@ module Gosu
     # @param height [Integer] the height of the recorded image.
     # @param [Hash] options
     # @option options [true, false] :retro (false) if true, the resulting image will not be interpolated when it is scaled up or down.
+    # @option options [true, false] :depth_buffer (true) if false, no depth buffer will be created for custom OpenGL code in the block.
     # @yield rendering code.
     #
     # @see Window#record
     # @see Gosu::Image
     def render(width, height); end
 
+    ##
+    # Clears an image that was returned by {render} and renders all drawing operations inside the block onto it.
+    # This reuses the image's video memory, which makes it a cheap way to update e.g. a minimap every frame.
+    #
+    # @return [void]
+    # @param image [Gosu::Image] an image that was returned by {render}.
+    # @yield rendering code.
+    #
+    # @see render
+    def render_into(image); end
+
     ##
     # Rotates all drawing operations inside the block.
     #
@@ -1,20 +1,66 @@
 #include <Gosu/Utility.hpp>
 #include "BinPacker.hpp"
 #include <algorithm>
+#include <stdexcept>
 
 #ifndef NDEBUG
 #include <cassert>
 #endif
 
-Gosu::BinPacker::BinPacker(int width, int height)
+Gosu::BinPacker::BinPacker(int width, int height, int alignment)
     : m_width(width),
       m_height(height),
+      m_alignment(alignment),
       m_free_rects { Rect { 0, 0, width, height } }
 {
+    if (alignment <= 0 || width % alignment != 0 || height % alignment != 0) {
+        throw std::invalid_argument("Gosu::BinPacker size must be a multiple of its alignment");
+    }
+}
+
+Gosu::BinPacker::BinPacker(int width, int height, BinPacker& smaller)
+    : m_width(width),
+      m_height(height),
+      m_alignment(smaller.alignment())
+{
+    if (width < smaller.width() || height < smaller.height()) {
+        throw std::invalid_argument("Gosu::BinPacker cannot shrink");
+    }
+    if (width % m_alignment != 0 || height % m_alignment != 0) {
+        throw std::invalid_argument("Gosu::BinPacker size must be a multiple of its alignment");
+    }
+
+    {
+        const std::scoped_lock lock(smaller.m_mutex);
+        m_free_rects = smaller.m_free_rects;
+    }
+
+    // Add the newly gained space to the right of and below the smaller bin.
+    const Rect right { smaller.width(), 0, width - smaller.width(), smaller.height() };
+    if (!right.empty()) {
+        add_free_rect(right);
+    }
+    const Rect below { 0, smaller.height(), width, height - smaller.height() };
+    if (!below.empty()) {
+        add_free_rect(below);
+    }
+}
+
+std::shared_ptr<const Gosu::Rect> Gosu::BinPacker::adopt(const Rect& rect)
+{
+    return std::shared_ptr<const Rect>(new Rect { rect },
+                                       [this](const Rect* p) {
+                                           add_free_rect(*p);
+                                           delete p;
+                                       });
 }
 
 std::shared_ptr<const Gosu::Rect> Gosu::BinPacker::alloc(int width, int height)
 {
+    // As long as all sizes are aligned, all positions will be aligned as well.
+    width = (width + m_alignment - 1) / m_alignment * m_alignment;
+    height = (height + m_alignment - 1) / m_alignment * m_alignment;
+
     std::unique_lock lock(m_mutex);
 
     const Rect* best_rect = best_free_rect(width, height);
@@ -28,7 +74,10 @@ std::shared_ptr<const Gosu::Rect> Gosu::BinPacker::alloc(int width, int height)
     // (Also make sure that the pointer's deleter returns the rectangle. Note: Even though
     // shared_ptr may call its deleter with a nullptr in general, it will not do so here.)
     std::shared_ptr<const Rect> result(new Rect { best_rect->x, best_rect->y, width, height },
-                                       [this](const Rect* p) { add_free_rect(*p); });
+                                       [this](const Rect* p) {
+                                           add_free_rect(*p);
+                                           delete p;
+                                       });
 
     // We need to split the remaining rectangle into two. We use the axis with the longer side.
     // (Called "Longer Axis Split Rule", "-LAS" in the paper.)
@@ -90,6 +139,17 @@ void Gosu::BinPacker::add_free_rect(const Rect& rect)
     merge_neighbors(static_cast<int>(m_free_rects.size() - 1));
 }
 
+long long Gosu::BinPacker::free_area()
+{
+    const std::scoped_lock lock(m_mutex);
+
+    long long area = 0;
+    for (const Rect& free_rect : m_free_rects) {
+        area += static_cast<long long>(free_rect.width) * free_rect.height;
+    }
+    return area;
+}
+
 const Gosu::Rect* Gosu::BinPacker::best_free_rect(int width, int height) const
 {
     // The rect wouldn't even fit onto the texture!
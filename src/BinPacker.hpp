@@ -23,19 +23,35 @@ namespace Gosu
     class BinPacker : private Noncopyable
     {
         const int m_width, m_height;
+        const int m_alignment;
         std::vector<Rect> m_free_rects;
         std::mutex m_mutex;
 
     public:
-        BinPacker(int width, int height);
+        /// @param alignment All allocated rectangles will have a position and size that is a
+        ///                  multiple of this value. This is used for block-compressed textures.
+        BinPacker(int width, int height, int alignment = 1);
+        /// Creates a larger bin that continues where the given (smaller) bin left off: All
+        /// rectangles that are allocated in the smaller bin are also considered allocated here.
+        /// Use adopt() to take over the ownership of these rectangles.
+        BinPacker(int width, int height, BinPacker& smaller);
 
         int width() const { return m_width; }
         int height() const { return m_height; }
+        int alignment() const { return m_alignment; }
+
+        /// Returns the number of pixels that are not part of any allocated rectangle.
+        long long free_area();
 
         /// Finds a free rectangle in the bin and marks it as used, or returns nullptr.
+        /// The size of the rectangle will be rounded up to a multiple of alignment().
         /// The returned shared_ptr will automatically mark the rectangle as freed through its
         /// deleter. The shared_ptr must not outlive the BinPacker.
         std::shared_ptr<const Rect> alloc(int width, int height);
+        /// Returns a shared_ptr for a rectangle that has been allocated in the smaller bin that was
+        /// passed to the constructor. Like with alloc(), the rectangle will be freed through the
+        /// shared_ptr's deleter.
+        std::shared_ptr<const Rect> adopt(const Rect& rect);
         /// Marks a previously allocated rectangle as free again. This must be called with one of
         /// the rectangles previously returned by alloc().
         void add_free_rect(const Rect& rect);
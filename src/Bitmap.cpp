@@ -1,6 +1,6 @@
 #include <Gosu/Bitmap.hpp>
 #include <Gosu/GraphicsBase.hpp>
-#include <algorithm> // for std::equal, std::fill_n
+#include <algorithm> // for std::all_of, std::equal, std::fill_n, std::min
 #include <cstring> // for std::memcpy
 #include <limits>
 #include <stdexcept> // for std::invalid_argument
@@ -175,6 +175,56 @@ void Gosu::Bitmap::apply_color_key(Color key)
     }
 }
 
+bool Gosu::Bitmap::opaque() const
+{
+    return std::all_of(data(), data() + width() * height(),
+                       [](Color c) { return c.alpha == 255; });
+}
+
+bool Gosu::Bitmap::opaque(const Rect& rect) const
+{
+    if (!Rect::covering(*this).contains(rect)) {
+        throw std::invalid_argument("Gosu::Bitmap::opaque: rect exceeds bitmap");
+    }
+    for (int y = rect.y; y < rect.bottom(); ++y) {
+        const Color* row = data() + y * width() + rect.x;
+        if (!std::all_of(row, row + rect.width, [](Color c) { return c.alpha == 255; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Gosu::Bitmap::premultiply_alpha()
+{
+    for (Color* c = data(), *end = data() + width() * height(); c != end; ++c) {
+        // Rounded division by 255.
+        const auto multiply = [alpha = c->alpha](Color::Channel& channel) {
+            channel = static_cast<Color::Channel>((channel * alpha + 127) / 255);
+        };
+        multiply(c->red);
+        multiply(c->green);
+        multiply(c->blue);
+    }
+}
+
+void Gosu::Bitmap::unpremultiply_alpha()
+{
+    for (Color* c = data(), *end = data() + width() * height(); c != end; ++c) {
+        if (c->alpha == 0) {
+            *c = Color::NONE;
+            continue;
+        }
+        const auto divide = [alpha = c->alpha](Color::Channel& channel) {
+            channel = static_cast<Color::Channel>(std::min((channel * 255 + alpha / 2) / alpha,
+                                                           255));
+        };
+        divide(c->red);
+        divide(c->green);
+        divide(c->blue);
+    }
+}
+
 Gosu::Bitmap Gosu::apply_border_flags(unsigned image_flags, const Bitmap& source, Rect source_rect)
 {
     // Add one extra pixel around all four sides of the image.
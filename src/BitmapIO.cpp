@@ -1,5 +1,6 @@
 #include <Gosu/Bitmap.hpp>
 #include <Gosu/Utility.hpp>
+#include "ImageCache.hpp"
 #include <stdexcept> // for std::runtime_error
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -37,7 +38,14 @@ namespace
 
 Gosu::Bitmap Gosu::load_image_file(const std::string& filename)
 {
-    return load_image(load_file(filename));
+    if (std::optional<Bitmap> cached_bitmap = load_cached_image(filename)) {
+        return std::move(*cached_bitmap);
+    }
+
+    const Buffer buffer = load_file(filename);
+    Bitmap bitmap = load_image(buffer);
+    store_cached_image(filename, buffer, bitmap);
+    return bitmap;
 }
 
 Gosu::Bitmap Gosu::load_image(const Buffer& buffer)
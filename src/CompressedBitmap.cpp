@@ -0,0 +1,235 @@
+#include "CompressedBitmap.hpp"
+#include <Gosu/Buffer.hpp>
+#include <algorithm>
+#include <cstring> // for std::memcmp, std::memcpy
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    constexpr std::uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB,
+                                                   '\r', '\n', 0x1A, '\n' };
+
+    std::uint32_t read_u32(const Gosu::Buffer& buffer, std::size_t offset)
+    {
+        if (offset + 4 > buffer.size()) {
+            throw std::runtime_error("Cannot load compressed image: Unexpected end of file");
+        }
+        const std::uint8_t* p = buffer.data() + offset;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    std::uint64_t read_u64(const Gosu::Buffer& buffer, std::size_t offset)
+    {
+        return read_u32(buffer, offset) | (std::uint64_t { read_u32(buffer, offset + 4) } << 32);
+    }
+
+    /// Reads the first mipmap level of an image whose pixel data starts at the given offset.
+    Gosu::CompressedBitmap read_blocks(const Gosu::Buffer& buffer, std::size_t offset,
+                                       std::uint32_t width, std::uint32_t height,
+                                       Gosu::TextureFormat format)
+    {
+        if (width == 0 || height == 0 || width > 65'536 || height > 65'536) {
+            throw std::runtime_error("Cannot load compressed image: Invalid image size");
+        }
+        const std::size_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        const std::size_t size = blocks_x * blocks_y * Gosu::bytes_per_block(format);
+        if (offset > buffer.size() || buffer.size() - offset < size) {
+            throw std::runtime_error("Cannot load compressed image: Unexpected end of file");
+        }
+        std::vector<std::uint8_t> blocks(buffer.data() + offset, buffer.data() + offset + size);
+        return Gosu::CompressedBitmap(static_cast<int>(width), static_cast<int>(height), format,
+                                      std::move(blocks));
+    }
+
+    Gosu::CompressedBitmap load_dds(const Gosu::Buffer& buffer)
+    {
+        // https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+        constexpr std::size_t HEADER_SIZE = 4 + 124, DX10_HEADER_SIZE = 20;
+
+        const std::uint32_t height = read_u32(buffer, 12);
+        const std::uint32_t width = read_u32(buffer, 16);
+        const std::uint32_t four_cc = read_u32(buffer, 84);
+
+        const auto four_cc_is = [four_cc](const char (&code)[5]) {
+            return std::memcmp(&four_cc, code, 4) == 0;
+        };
+        if (four_cc_is("DXT1")) {
+            return read_blocks(buffer, HEADER_SIZE, width, height, Gosu::TextureFormat::BC1);
+        }
+        if (four_cc_is("DXT5")) {
+            return read_blocks(buffer, HEADER_SIZE, width, height, Gosu::TextureFormat::BC3);
+        }
+        if (four_cc_is("DX10")) {
+            Gosu::TextureFormat format;
+            switch (read_u32(buffer, HEADER_SIZE)) {
+            case 71: // DXGI_FORMAT_BC1_UNORM
+            case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+                format = Gosu::TextureFormat::BC1;
+                break;
+            case 77: // DXGI_FORMAT_BC3_UNORM
+            case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+                format = Gosu::TextureFormat::BC3;
+                break;
+            case 98: // DXGI_FORMAT_BC7_UNORM
+            case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+                format = Gosu::TextureFormat::BC7;
+                break;
+            default:
+                throw std::runtime_error("Cannot load DDS file: Unsupported DXGI format");
+            }
+            return read_blocks(buffer, HEADER_SIZE + DX10_HEADER_SIZE, width, height, format);
+        }
+        throw std::runtime_error("Cannot load DDS file: Unsupported pixel format");
+    }
+
+    Gosu::CompressedBitmap load_ktx2(const Gosu::Buffer& buffer)
+    {
+        // https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+        const std::uint32_t vk_format = read_u32(buffer, 12);
+        const std::uint32_t width = read_u32(buffer, 20);
+        const std::uint32_t height = read_u32(buffer, 24);
+        const std::uint32_t supercompression_scheme = read_u32(buffer, 44);
+        // The level index starts at offset 80. The first entry describes the base level.
+        const std::uint64_t level_offset = read_u64(buffer, 80);
+
+        if (supercompression_scheme != 0) {
+            throw std::runtime_error("Cannot load KTX2 file: Supercompression is not supported");
+        }
+        if (read_u32(buffer, 28) > 1 || read_u32(buffer, 32) > 1 || read_u32(buffer, 36) > 1) {
+            throw std::runtime_error("Cannot load KTX2 file: Only 2D textures are supported");
+        }
+
+        Gosu::TextureFormat format;
+        switch (vk_format) {
+        case 131: // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132: // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+        case 133: // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+        case 134: // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+            format = Gosu::TextureFormat::BC1;
+            break;
+        case 137: // VK_FORMAT_BC3_UNORM_BLOCK
+        case 138: // VK_FORMAT_BC3_SRGB_BLOCK
+            format = Gosu::TextureFormat::BC3;
+            break;
+        case 145: // VK_FORMAT_BC7_UNORM_BLOCK
+        case 146: // VK_FORMAT_BC7_SRGB_BLOCK
+            format = Gosu::TextureFormat::BC7;
+            break;
+        default:
+            throw std::runtime_error("Cannot load KTX2 file: Unsupported vkFormat "
+                                     + std::to_string(vk_format));
+        }
+        if (level_offset > buffer.size()) {
+            throw std::runtime_error("Cannot load KTX2 file: Unexpected end of file");
+        }
+        return read_blocks(buffer, static_cast<std::size_t>(level_offset), width, height, format);
+    }
+}
+
+std::size_t Gosu::bytes_per_block(TextureFormat format)
+{
+    switch (format) {
+    case TextureFormat::RGBA8:
+        return 4;
+    case TextureFormat::DISTANCE_FIELD:
+        return 1;
+    case TextureFormat::BC1:
+        return 8;
+    case TextureFormat::BC3:
+    case TextureFormat::BC7:
+        return 16;
+    }
+    throw std::invalid_argument("Unknown Gosu::TextureFormat");
+}
+
+Gosu::CompressedBitmap::CompressedBitmap(int width, int height, TextureFormat format)
+    : m_width(width),
+      m_height(height),
+      m_format(format)
+{
+    if (!is_block_compressed(format) || width < 0 || height < 0) {
+        throw std::invalid_argument("Invalid Gosu::CompressedBitmap size or format");
+    }
+
+    // For BC3 and BC7, a block of zeros is fully transparent. (BC7 treats the invalid mode 0 as
+    // transparent black.) BC1 needs the "three-color" mode, and all indices set to 3.
+    const std::size_t block_size = bytes_per_block(format);
+    m_blocks.resize(static_cast<std::size_t>(blocks_x()) * blocks_y() * block_size);
+    if (format == TextureFormat::BC1) {
+        for (std::size_t offset = 0; offset < m_blocks.size(); offset += block_size) {
+            std::fill_n(m_blocks.begin() + static_cast<std::ptrdiff_t>(offset + 4), 4, 0xff);
+        }
+    }
+}
+
+Gosu::CompressedBitmap::CompressedBitmap(int width, int height, TextureFormat format,
+                                         std::vector<std::uint8_t> blocks)
+    : m_width(width),
+      m_height(height),
+      m_format(format),
+      m_blocks(std::move(blocks))
+{
+    if (!is_block_compressed(format) || width < 0 || height < 0
+        || m_blocks.size()
+            != static_cast<std::size_t>(blocks_x()) * blocks_y() * bytes_per_block(format)) {
+        throw std::invalid_argument("Invalid Gosu::CompressedBitmap size or format");
+    }
+}
+
+void Gosu::CompressedBitmap::insert(const CompressedBitmap& source, int block_x, int block_y)
+{
+    if (source.m_format != m_format) {
+        throw std::invalid_argument("Gosu::CompressedBitmap::insert: Formats must match");
+    }
+    if (block_x < 0 || block_y < 0 || block_x + source.blocks_x() > blocks_x()
+        || block_y + source.blocks_y() > blocks_y()) {
+        throw std::invalid_argument("Gosu::CompressedBitmap::insert: Source exceeds bounds");
+    }
+
+    const std::size_t block_size = bytes_per_block(m_format);
+    const std::size_t row_size = source.blocks_x() * block_size;
+    for (int y = 0; y < source.blocks_y(); ++y) {
+        std::memcpy(m_blocks.data() + ((block_y + y) * blocks_x() + block_x) * block_size,
+                    source.m_blocks.data() + y * row_size, row_size);
+    }
+}
+
+Gosu::CompressedBitmap Gosu::CompressedBitmap::subimage(const Rect& rect) const
+{
+    if (!Rect::covering(*this).contains(rect) || rect.x % COMPRESSION_BLOCK_SIZE != 0
+        || rect.y % COMPRESSION_BLOCK_SIZE != 0) {
+        throw std::invalid_argument("Gosu::CompressedBitmap::subimage: Invalid rect");
+    }
+
+    CompressedBitmap result(rect.width, rect.height, m_format);
+    const std::size_t block_size = bytes_per_block(m_format);
+    const std::size_t row_size = result.blocks_x() * block_size;
+    const int block_x = rect.x / COMPRESSION_BLOCK_SIZE, block_y = rect.y / COMPRESSION_BLOCK_SIZE;
+    for (int y = 0; y < result.blocks_y(); ++y) {
+        std::memcpy(result.m_blocks.data() + y * row_size,
+                    m_blocks.data() + ((block_y + y) * blocks_x() + block_x) * block_size,
+                    row_size);
+    }
+    return result;
+}
+
+bool Gosu::is_compressed_image(const Buffer& buffer)
+{
+    if (buffer.size() >= 4 && std::memcmp(buffer.data(), "DDS ", 4) == 0) {
+        return true;
+    }
+    return buffer.size() >= sizeof KTX2_IDENTIFIER
+        && std::memcmp(buffer.data(), KTX2_IDENTIFIER, sizeof KTX2_IDENTIFIER) == 0;
+}
+
+Gosu::CompressedBitmap Gosu::load_compressed_image(const Buffer& buffer)
+{
+    if (buffer.size() >= 4 && std::memcmp(buffer.data(), "DDS ", 4) == 0) {
+        return load_dds(buffer);
+    }
+    if (is_compressed_image(buffer)) {
+        return load_ktx2(buffer);
+    }
+    throw std::runtime_error("Cannot load compressed image: Not a DDS or KTX2 file");
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Utility.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Gosu
+{
+    /// The internal storage format of a Texture.
+    enum class TextureFormat
+    {
+        RGBA8,
+        /// 4x4 blocks of 8 bytes each (4 bits per pixel), with 1-bit alpha. Also known as DXT1.
+        BC1,
+        /// 4x4 blocks of 16 bytes each (8 bits per pixel), with interpolated alpha. Also known as
+        /// DXT5.
+        BC3,
+        /// 4x4 blocks of 16 bytes each (8 bits per pixel), with higher quality than BC3.
+        BC7,
+        /// One byte per pixel: The alpha channel of a signed distance field, where 128 is the edge
+        /// of the shape (see IF_DISTANCE_FIELD). Drawn through a special fragment shader.
+        DISTANCE_FIELD,
+    };
+
+    /// Block-compressed formats store pixels in 4x4 blocks.
+    constexpr int COMPRESSION_BLOCK_SIZE = 4;
+
+    inline bool is_block_compressed(TextureFormat format)
+    {
+        return format == TextureFormat::BC1 || format == TextureFormat::BC3
+            || format == TextureFormat::BC7;
+    }
+
+    /// Returns the number of bytes per 4x4 block, or the number of bytes per pixel for uncompressed
+    /// formats.
+    std::size_t bytes_per_block(TextureFormat format);
+
+    /// Image data in a block-compressed format, as loaded from DDS or KTX2 files.
+    /// Only the first mipmap level is stored.
+    class CompressedBitmap
+    {
+        int m_width = 0, m_height = 0;
+        TextureFormat m_format = TextureFormat::BC1;
+        std::vector<std::uint8_t> m_blocks;
+
+    public:
+        CompressedBitmap() = default;
+        /// Creates a fully transparent image.
+        CompressedBitmap(int width, int height, TextureFormat format);
+        /// @param blocks Must contain exactly blocks_x() * blocks_y() blocks.
+        CompressedBitmap(int width, int height, TextureFormat format,
+                         std::vector<std::uint8_t> blocks);
+
+        /// The size of the image in pixels. This is not necessarily a multiple of 4.
+        int width() const { return m_width; }
+        int height() const { return m_height; }
+        TextureFormat format() const { return m_format; }
+
+        int blocks_x() const { return (m_width + 3) / COMPRESSION_BLOCK_SIZE; }
+        int blocks_y() const { return (m_height + 3) / COMPRESSION_BLOCK_SIZE; }
+
+        const std::uint8_t* data() const { return m_blocks.data(); }
+        std::size_t size() const { return m_blocks.size(); }
+
+        /// Copies all blocks of another image (in the same format) into this one.
+        /// @param block_x Horizontal offset, in blocks.
+        /// @param block_y Vertical offset, in blocks.
+        void insert(const CompressedBitmap& source, int block_x, int block_y);
+        /// Copies the blocks that cover a portion of this image.
+        /// rect.x and rect.y must be multiples of 4.
+        CompressedBitmap subimage(const Rect& rect) const;
+    };
+
+    /// Returns true if the given buffer contains a DDS or KTX2 file.
+    bool is_compressed_image(const Buffer& buffer);
+    /// Loads the first mipmap level of a DDS or KTX2 file that contains BC1, BC3 or BC7 data.
+    /// KTX2 files must not use supercompression.
+    CompressedBitmap load_compressed_image(const Buffer& buffer);
+
+    /// Like create_drawable(), but stores the image in a texture atlas with the same compressed
+    /// format. Compressed images never have tileable edges, unless they are square, have a
+    /// power-of-two size, and IF_TILEABLE is set; then they get a dedicated texture.
+    /// Images that exceed max_texture_size(), and all images while premultiplied alpha is enabled,
+    /// are decompressed and passed to the regular create_drawable() with IF_COMPRESSED instead.
+    std::unique_ptr<Drawable> create_drawable(const CompressedBitmap& source, unsigned image_flags);
+}
@@ -5,7 +5,10 @@
 #include "TexChunk.hpp"
 #include <Gosu/Color.hpp>
 #include <Gosu/GraphicsBase.hpp>
+#include <algorithm>
 #include <cassert>
+#include <memory>
+#include <vector>
 
 namespace Gosu
 {
@@ -17,8 +20,18 @@ namespace Gosu
         RenderState render_state;
         // Only valid if render_state.tex_name != NO_TEXTURE
         GLfloat top, left, bottom, right;
+        // The layer if render_state.texture is part of a texture array, passed as the third
+        // texture coordinate so that images on different layers can be drawn in one batch.
+        // Distance field textures are never part of a texture array; for them, this is the
+        // distance value at the edge of the shape instead (see FragmentShader::DISTANCE_FIELD).
+        GLfloat layer = 0;
         // Used to keep TexChunk rectangles on shared textures alive until the end of the frame.
         std::shared_ptr<const Rect> rect_handle;
+        // Whether this op covers all of its pixels without blending. Drawables set this if their
+        // texture is opaque, and DrawOpQueue clears it for translucent colors and blend modes.
+        bool opaque = false;
+        // The Z coordinate of all vertices, only used by the opaque pass (see set_opaque_pass()).
+        GLfloat depth = 0;
 
         // TODO: Merge with Gosu::ArrayVertex.
         struct Vertex
@@ -29,10 +42,36 @@ namespace Gosu
             Vertex(float x, float y, Color c) : x(x), y(y), c(c) {}
         };
         Vertex vertices[4];
+        // If set, this op draws these untextured triangles (three vertices each) instead of
+        // `vertices`, so that a whole Shape only needs one entry in the queue. Ops with
+        // triangles have a vertices_or_block_index of 3.
+        // With set_premultiplied_alpha(), the triangles must already be premultiplied for the
+        // op's blend mode (see premultiply()), because DrawOpQueue does not copy them.
+        std::shared_ptr<const std::vector<Vertex>> triangles;
+        // If set along with `triangles`, these are the texture coordinates of each triangle
+        // vertex, already mapped into the texture (see Image::draw_mesh()).
+        struct TexCoord
+        {
+            GLfloat u, v;
+        };
+        std::shared_ptr<const std::vector<TexCoord>> triangle_tex_coords;
         
         // Number of vertices used, or: complement index of code block
         int vertices_or_block_index;
 
+        // Converts a vertex color for set_premultiplied_alpha(). Additive blending is the same as
+        // normal blending with an alpha value of zero, so that both blend modes can share a batch.
+        static void premultiply(Vertex& vertex, bool additive)
+        {
+            Color& c = vertex.c;
+            c.red = static_cast<Color::Channel>((c.red * c.alpha + 127) / 255);
+            c.green = static_cast<Color::Channel>((c.green * c.alpha + 127) / 255);
+            c.blue = static_cast<Color::Channel>((c.blue * c.alpha + 127) / 255);
+            if (additive) {
+                c.alpha = 0;
+            }
+        }
+
         void perform(const DrawOp* next) const
         {
             // This should not be called on GL code ops.
@@ -97,6 +136,21 @@ namespace Gosu
                 sprite_counter = 0;
             }
             #else
+            if (triangles) {
+                glBegin(GL_TRIANGLES);
+                for (std::size_t i = 0; i < triangles->size(); ++i) {
+                    const Vertex& vertex = (*triangles)[i];
+                    glColor4ubv(reinterpret_cast<const GLubyte*>(&vertex.c));
+                    if (triangle_tex_coords) {
+                        const TexCoord& tex_coord = (*triangle_tex_coords)[i];
+                        glTexCoord3f(tex_coord.u, tex_coord.v, layer);
+                    }
+                    glVertex3f(vertex.x, vertex.y, depth);
+                }
+                glEnd();
+                return;
+            }
+
             if (vertices_or_block_index == 2) {
                 glBegin(GL_LINES);
             }
@@ -112,61 +166,119 @@ namespace Gosu
                 if (render_state.texture) {
                     switch (i) {
                     case 0:
-                        glTexCoord2f(left, top);
+                        glTexCoord3f(left, top, layer);
                         break;
                     case 1:
-                        glTexCoord2f(right, top);
+                        glTexCoord3f(right, top, layer);
                         break;
                     case 2:
-                        glTexCoord2f(right, bottom);
+                        glTexCoord3f(right, bottom, layer);
                         break;
                     case 3:
-                        glTexCoord2f(left, bottom);
+                        glTexCoord3f(left, bottom, layer);
                         break;
                     }
                 }
-                glVertex2f(vertices[i].x, vertices[i].y);
+                glVertex3f(vertices[i].x, vertices[i].y, depth);
             }
             
             glEnd();
             #endif
         }
         
+        // Adds this op to a multi-texture batch (see RenderStateManager::batch()) as triangles.
+        // This should not be called on lines or GL code ops.
+        void append_to_batch(std::vector<BatchVertex>& batch, GLfloat unit) const
+        {
+            const auto append = [&](const Vertex& vertex, GLfloat u, GLfloat v) {
+                batch.push_back(BatchVertex { { u, v, layer }, unit, vertex.c.abgr(),
+                                              { vertex.x, vertex.y, depth } });
+            };
+
+            if (triangles) {
+                for (std::size_t i = 0; i < triangles->size(); ++i) {
+                    const TexCoord tex_coord
+                        = triangle_tex_coords ? (*triangle_tex_coords)[i] : TexCoord {};
+                    append((*triangles)[i], tex_coord.u, tex_coord.v);
+                }
+                return;
+            }
+
+            const GLfloat u[4] = { left, right, right, left };
+            const GLfloat v[4] = { top, top, bottom, bottom };
+            // Quads are split into two triangles along the 0-2 diagonal, like GL_QUADS does.
+            static constexpr int QUAD_ORDER[] = { 0, 1, 2, 0, 2, 3 };
+            const int count = vertices_or_block_index == 4 ? 6 : 3;
+            for (int i = 0; i < count; ++i) {
+                const int index = QUAD_ORDER[i];
+                append(vertices[index], render_state.texture ? u[index] : 0,
+                       render_state.texture ? v[index] : 0);
+            }
+        }
+
         void compile_to(VertexArrays& vas) const
         {
-            // Copy vertex data and apply & forget about the transform.
-            // This is important because the pointed-to transform will be gone by the next
-            // frame anyway.
             ArrayVertex result[4];
-            for (int i = 0; i < 4; ++i) {
-                result[i].vertices[0] = vertices[i].x;
-                result[i].vertices[1] = vertices[i].y;
-                result[i].vertices[2] = 0;
-                result[i].color       = vertices[i].c.abgr();
-                double x = result[i].vertices[0];
-                double y = result[i].vertices[1];
-                render_state.transform->apply(x, y);
-                result[i].vertices[0] = static_cast<float>(x);
-                result[i].vertices[1] = static_cast<float>(y);
+
+            if (triangles) {
+                // Macros only consist of quads, so turn each triangle into a degenerate quad.
+                for (std::size_t i = 0; i + 2 < triangles->size(); i += 3) {
+                    for (std::size_t j = 0; j < 4; ++j) {
+                        const std::size_t index = i + std::min<std::size_t>(j, 2);
+                        const TexCoord tex_coord = triangle_tex_coords
+                            ? (*triangle_tex_coords)[index] : TexCoord {};
+                        result[j] = array_vertex((*triangles)[index], tex_coord.u, tex_coord.v);
+                    }
+                    append_quad(vas, result);
+                }
+                return;
             }
+
+            result[0] = array_vertex(vertices[0], left, top);
+            result[1] = array_vertex(vertices[1], right, top);
+            result[2] = array_vertex(vertices[2], right, bottom);
+            result[3] = array_vertex(vertices[3], left, bottom);
+            append_quad(vas, result);
+        }
+
+    private:
+        // Copies vertex data and applies & forgets about the transform.
+        // This is important because the pointed-to transform will be gone by the next frame
+        // anyway.
+        ArrayVertex array_vertex(const Vertex& vertex, GLfloat u, GLfloat v) const
+        {
+            double x = vertex.x;
+            double y = vertex.y;
+            render_state.transform->apply(x, y);
+
+            ArrayVertex result;
+            result.tex_coords[0] = u;
+            result.tex_coords[1] = v;
+            result.tex_coords[2] = layer;
+            result.color = vertex.c.abgr();
+            result.vertices[0] = static_cast<float>(x);
+            result.vertices[1] = static_cast<float>(y);
+            result.vertices[2] = 0;
+            return result;
+        }
+
+        void append_quad(VertexArrays& vas, const ArrayVertex (&quad)[4]) const
+        {
             RenderState va_render_state = render_state;
             va_render_state.transform   = 0;
             
-            result[0].tex_coords[0] = left;
-            result[0].tex_coords[1] = top;
-            result[1].tex_coords[0] = right;
-            result[1].tex_coords[1] = top;
-            result[2].tex_coords[0] = right;
-            result[2].tex_coords[1] = bottom;
-            result[3].tex_coords[0] = left;
-            result[3].tex_coords[1] = bottom;
-            
             if (vas.empty() || !(vas.back().render_state == va_render_state)) {
                 vas.push_back(VertexArray());
                 vas.back().render_state = va_render_state;
             }
+            else if (vas.back().render_state.texture != render_state.texture
+                     && std::ranges::find(vas.back().other_layers, render_state.texture)
+                            == vas.back().other_layers.end()) {
+                // Another layer of the same texture array; keep it alive along with the macro.
+                vas.back().other_layers.push_back(render_state.texture);
+            }
             
-            vas.back().vertices.insert(vas.back().vertices.end(), result, result + 4);
+            vas.back().vertices.insert(vas.back().vertices.end(), quad, quad + 4);
         }
     };
 }
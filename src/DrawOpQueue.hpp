@@ -2,13 +2,18 @@
 
 #include "ClipRectStack.hpp"
 #include "DrawOp.hpp"
+#include "GLShadowState.hpp"
 #include "GraphicsImpl.hpp"
+#include "OffScreenTarget.hpp"
+#include "ShaderPipeline.hpp"
 #include "TransformStack.hpp"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <functional>
 #include <map>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -20,7 +25,231 @@ class Gosu::DrawOpQueue
     ClipRectStack clip_rect_stack;
 
     std::vector<DrawOp> ops;
-    std::vector<std::function<void ()>> gl_blocks;
+    // Custom OpenGL code and the GLStateFlags that it modifies.
+    std::vector<std::pair<std::function<void ()>, unsigned>> gl_blocks;
+
+    // The opaque pass needs a distinct depth value for each op. Even a 16-bit depth buffer can
+    // hold this many.
+    static constexpr std::size_t MAX_OPAQUE_PASS_OPS = 1 << 15;
+
+    static bool is_gl_block(const DrawOp& op)
+    {
+        return op.vertices_or_block_index < 0;
+    }
+
+    // Returns true if the opaque pass should be used after sorting the queue, see
+    // set_opaque_pass(). If so, assigns each op a depth so that later ops are in front of
+    // earlier ones, and clears the depth buffer.
+    bool prepare_opaque_pass()
+    {
+    #ifdef GOSU_IS_OPENGLES
+        return false;
+    #else
+        if (!opaque_pass() || !GLShadowState::current().depth_buffer
+            || ops.size() > MAX_OPAQUE_PASS_OPS || std::ranges::none_of(ops, &DrawOp::opaque)) {
+            return false;
+        }
+        // Spread the ops evenly between the far (-1) and near (+1) plane, exclusively.
+        const double step = 2.0 / static_cast<double>(ops.size() + 1);
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            ops[i].depth = static_cast<GLfloat>(-1 + step * static_cast<double>(i + 1));
+        }
+        glClear(GL_DEPTH_BUFFER_BIT);
+        return true;
+    #endif
+    }
+
+    // Draws a range of ops without GL code. In the opaque pass, opaque ops are drawn first,
+    // front-to-back, and write their depth. The other ops are then drawn back-to-front as usual,
+    // but skip pixels that are covered by opaque ops in front of them.
+    template<typename Iterator, typename Draw, typename Flush>
+    static void perform_range(Iterator begin, Iterator end, bool with_opaque_pass,
+                              const Draw& draw, const Flush& flush)
+    {
+        if (!with_opaque_pass) {
+            std::for_each(begin, end, draw);
+            return;
+        }
+    #ifndef GOSU_IS_OPENGLES
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        // Blending makes no difference for opaque pixels, but costs fill rate.
+        glDisable(GL_BLEND);
+        for (auto op = end; op != begin;) {
+            if ((--op)->opaque) {
+                draw(*op);
+            }
+        }
+        flush();
+        glEnable(GL_BLEND);
+        glDepthMask(GL_FALSE);
+        for (auto op = begin; op != end; ++op) {
+            if (!op->opaque) {
+                draw(*op);
+            }
+        }
+        flush();
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+    #endif
+    }
+
+    // Predicts where the submission path of perform_draw_ops_and_code() starts a new batch, for
+    // DV_BATCH_BREAKS and FrameStats. These are the same checks as in ShaderPipeline::draw() and
+    // (with or without multi-texture batching) in RenderStateManager::set_render_state().
+    class BatchPredictor
+    {
+        const bool shader_pipeline = ShaderPipeline::enabled();
+        const int max_texture_units = shader_pipeline ? ShaderPipeline::max_texture_units()
+                                                      : multi_texture_units();
+        // The render state and vertex count of the previous op. Copies are needed because
+        // apply_debug_view() modifies the ops after adding them.
+        std::optional<RenderState> previous;
+        int previous_vertices = 0;
+        bool after_gl_block = false;
+        // The textures on texture units 0, 1, 2..., and the texture array of the shader pipeline.
+        std::vector<const Texture*> texture_units;
+        const TextureArray* texture_array = nullptr;
+
+        // Assigns a texture unit to the texture. Returns false if all units were in use, which
+        // ends the current batch.
+        bool bind_to_texture_unit(const Texture* texture)
+        {
+            if (std::ranges::find(texture_units, texture) != texture_units.end()) {
+                return true;
+            }
+            const bool free_unit = static_cast<int>(texture_units.size()) < max_texture_units;
+            if (!free_unit) {
+                texture_units.clear();
+            }
+            texture_units.push_back(texture);
+            return free_unit;
+        }
+
+        // Returns true if op can use its texture in the current batch.
+        bool keeps_texture(const DrawOp& op)
+        {
+            const std::shared_ptr<Texture>& texture = op.render_state.texture;
+            if (shader_pipeline) {
+                // Untextured vertices are drawn by the same program as textured ones.
+                if (!texture) {
+                    return true;
+                }
+                if (texture->array()) {
+                    const bool same_array = texture->array().get() == texture_array;
+                    texture_array = texture->array().get();
+                    return same_array;
+                }
+                return bind_to_texture_unit(texture.get());
+            }
+
+            const std::shared_ptr<Texture> last_texture
+                = previous ? previous->texture : nullptr;
+            if (RenderState::same_binding(texture, last_texture)) {
+                return true;
+            }
+            if (!texture) {
+                return false;
+            }
+            if (max_texture_units > 0 && RenderState::uses_texture_units(*texture)) {
+                return bind_to_texture_unit(texture.get()) && last_texture
+                    && RenderState::uses_texture_units(*last_texture);
+            }
+            if (!texture->array()) {
+                // This replaces the texture on texture unit 0.
+                texture_units.clear();
+            }
+            return false;
+        }
+
+        bool keeps_transform(const DrawOp& op) const
+        {
+            // The shader pipeline compares transforms by value.
+            return op.render_state.transform == previous->transform
+                || (shader_pipeline && *op.render_state.transform == *previous->transform);
+        }
+
+        bool keeps_primitive(const DrawOp& op) const
+        {
+            if (shader_pipeline) {
+                return (op.vertices_or_block_index == 2) == (previous_vertices == 2);
+            }
+            // Multi-texture batching only collects triangles and quads, everything else is drawn
+            // on its own. Without batching, every op is drawn on its own anyway.
+            return max_texture_units == 0
+                || (op.vertices_or_block_index >= 3 && previous_vertices >= 3);
+        }
+
+    public:
+        // Custom OpenGL code ends the current batch and resets all state.
+        void add_gl_block()
+        {
+            previous.reset();
+            after_gl_block = true;
+            texture_units.clear();
+            texture_array = nullptr;
+        }
+
+        // Adds op to the statistics, and returns its color for DV_BATCH_BREAKS.
+        Color add(const DrawOp& op, FrameStats& stats)
+        {
+            // This also updates the texture units, so it must be called for every op.
+            const bool same_texture = keeps_texture(op);
+
+            Color color = Color::GRAY;
+            std::size_t* reason = nullptr;
+            bool new_batch = true;
+            if (!previous) {
+                color = after_gl_block ? Color::FUCHSIA : Color::WHITE;
+                reason = after_gl_block ? &stats.gl_block_breaks : nullptr;
+                after_gl_block = false;
+            }
+            else if (!same_texture) {
+                color = Color::RED;
+                reason = &stats.texture_breaks;
+            }
+            else if (!keeps_transform(op)) {
+                color = Color::GREEN;
+                reason = &stats.transform_breaks;
+            }
+            else if (op.render_state.clip_rect != previous->clip_rect) {
+                color = Color::BLUE;
+                reason = &stats.clip_breaks;
+            }
+            else if (op.render_state.mode != previous->mode) {
+                color = Color::YELLOW;
+                reason = &stats.blend_breaks;
+            }
+            else if (!keeps_primitive(op)) {
+                color = Color::CYAN;
+                reason = &stats.primitive_breaks;
+            }
+            else {
+                new_batch = false;
+            }
+
+            if (new_batch) {
+                ++stats.batches;
+                if (reason) {
+                    ++*reason;
+                }
+            }
+            previous = op.render_state;
+            previous_vertices = op.vertices_or_block_index;
+            return color;
+        }
+    };
+
+    // Returns true if DV_OVERDRAW can count the layers of each pixel in an off-screen target.
+    static bool overdraw_counting_supported()
+    {
+    #ifdef GOSU_IS_OPENGLES
+        return false;
+    #else
+        static const bool supported = fragment_shader_supported(FragmentShader::OVERDRAW);
+        return supported;
+    #endif
+    }
 
 public:
     explicit DrawOpQueue(QueueMode mode)
@@ -40,15 +269,37 @@ public:
         assert(op.vertices_or_block_index == 4);
 #endif
 
+        if (premultiplied_alpha()) {
+            const bool additive = op.render_state.mode == BM_ADD;
+            // Triangles are premultiplied when they are created, see DrawOp::triangles.
+            if (!op.triangles) {
+                for (int i = 0; i < op.vertices_or_block_index; ++i) {
+                    DrawOp::premultiply(op.vertices[i], additive);
+                }
+            }
+            if (additive) {
+                op.render_state.mode = BM_DEFAULT;
+            }
+        }
+
+        if (op.opaque) {
+            const auto is_opaque = [](const DrawOp::Vertex& v) { return v.c.alpha == 255; };
+            op.opaque = op.render_state.mode == BM_DEFAULT && op.vertices_or_block_index >= 3
+                && (op.triangles ? std::ranges::all_of(*op.triangles, is_opaque)
+                                 : std::all_of(op.vertices,
+                                               op.vertices + op.vertices_or_block_index,
+                                               is_opaque));
+        }
+
         op.render_state.transform = &transform_stack.current();
         op.render_state.clip_rect = clip_rect_stack.effective_rect();
         ops.push_back(op);
     }
 
-    void gl(std::function<void ()> gl_block, ZPos z)
+    void gl(std::function<void ()> gl_block, ZPos z, unsigned modified_state)
     {
         int complement_of_block_index = ~(int)gl_blocks.size();
-        gl_blocks.push_back(std::move(gl_block));
+        gl_blocks.emplace_back(std::move(gl_block), modified_state);
 
         DrawOp op;
         op.vertices_or_block_index = complement_of_block_index;
@@ -104,7 +355,83 @@ public:
         transform_stack.pop();
     }
 
-    void perform_draw_ops_and_code()
+    // Adds statistics about the sorted queue to stats. Unless the debug view is DV_STATS, also
+    // replaces all draw ops by untextured copies that visualize it.
+    // @param count_overdraw Whether perform_overdraw_view() will be used for DV_OVERDRAW.
+    void apply_debug_view(DebugView view, FrameStats& stats, bool count_overdraw)
+    {
+        BatchPredictor batch_predictor;
+        for (auto& op : ops) {
+            if (is_gl_block(op)) {
+                ++stats.gl_blocks;
+                batch_predictor.add_gl_block();
+                continue;
+            }
+            ++stats.draw_ops;
+
+            // Shoelace formula; lines have no area.
+            if (op.triangles) {
+                for (std::size_t i = 0; i + 2 < op.triangles->size(); i += 3) {
+                    double x[3], y[3];
+                    for (int j = 0; j < 3; ++j) {
+                        x[j] = (*op.triangles)[i + j].x;
+                        y[j] = (*op.triangles)[i + j].y;
+                        op.render_state.transform->apply(x[j], y[j]);
+                    }
+                    stats.covered_pixels
+                        += std::abs((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]))
+                        / 2;
+                }
+            }
+            else if (op.vertices_or_block_index > 2) {
+                std::array<int, 4> corners { 0, 1, 2, 3 };
+    #ifdef GOSU_IS_OPENGLES
+                // The vertices of quads are in triangle strip order.
+                corners = { 0, 1, 3, 2 };
+    #endif
+                double area = 0;
+                for (int i = 0; i < op.vertices_or_block_index; ++i) {
+                    const auto& a = op.vertices[corners[i]];
+                    const auto& b = op.vertices[corners[(i + 1) % op.vertices_or_block_index]];
+                    double ax = a.x, ay = a.y, bx = b.x, by = b.y;
+                    op.render_state.transform->apply(ax, ay);
+                    op.render_state.transform->apply(bx, by);
+                    area += ax * by - bx * ay;
+                }
+                stats.covered_pixels += std::abs(area) / 2;
+            }
+
+            const Color batch_color = batch_predictor.add(op, stats);
+
+            if (view == DV_OVERDRAW || view == DV_BATCH_BREAKS) {
+                // Overdraw is either counted in steps of 1/255 in the red channel, or shown
+                // directly through additive blending.
+                Color color = view == DV_BATCH_BREAKS ? batch_color
+                    : count_overdraw                 ? Color(0xff'010000)
+                                                     : Color(0xff'401004);
+                op.render_state.mode = view == DV_BATCH_BREAKS ? BM_DEFAULT : BM_ADD;
+                if (view == DV_OVERDRAW && premultiplied_alpha()) {
+                    // Like in schedule_draw_op.
+                    color.alpha = 0;
+                    op.render_state.mode = BM_DEFAULT;
+                }
+                op.render_state.texture = nullptr;
+                op.opaque = false;
+                for (auto& vertex : op.vertices) {
+                    vertex.c = color;
+                }
+                if (op.triangles) {
+                    auto triangles = std::make_shared<std::vector<DrawOp::Vertex>>(*op.triangles);
+                    for (auto& vertex : *triangles) {
+                        vertex.c = color;
+                    }
+                    op.triangles = std::move(triangles);
+                }
+            }
+        }
+    }
+
+    void perform_draw_ops_and_code(DebugView debug_view = DV_OFF, FrameStats* stats = nullptr)
     {
         if (mode() == QM_RECORD_MACRO) {
             throw std::logic_error("Flushing to the screen is not allowed while recording a macro");
@@ -114,6 +441,32 @@ public:
         std::stable_sort(ops.begin(), ops.end(),
                          [](const DrawOp& lhs, const DrawOp& rhs) { return lhs.z < rhs.z; });
 
+        const bool count_overdraw
+            = debug_view == DV_OVERDRAW && stats != nullptr && overdraw_counting_supported();
+        if (debug_view != DV_OFF && stats != nullptr) {
+            apply_debug_view(debug_view, *stats, count_overdraw);
+        }
+
+    #ifndef GOSU_IS_OPENGLES
+        if (count_overdraw) {
+            perform_overdraw_view();
+            return;
+        }
+    #endif
+        perform_ops();
+    }
+
+    void perform_ops()
+    {
+        const bool with_opaque_pass = prepare_opaque_pass();
+
+    #ifndef GOSU_IS_OPENGLES
+        if (ShaderPipeline::enabled()) {
+            perform_with_shader_pipeline(with_opaque_pass);
+            return;
+        }
+    #endif
+
         RenderStateManager manager;
         
     #ifdef GOSU_IS_OPENGLES
@@ -127,21 +480,103 @@ public:
         manager.set_render_state(last->render_state);
         last->perform(nullptr);
     #else
-        for (const auto& op : ops) {
+        const auto draw = [&](const DrawOp& op) {
             manager.set_render_state(op.render_state);
-            if (op.vertices_or_block_index >= 0) {
-                op.perform(nullptr);
+            // With multi-texture batching, ops are collected and drawn together where possible.
+            if (std::vector<BatchVertex>* batch = manager.batch();
+                batch && op.vertices_or_block_index >= 3) {
+                op.append_to_batch(*batch, manager.texture_unit_for_batch());
             }
             else {
-                // GL code
-                int block_index = ~op.vertices_or_block_index;
+                manager.flush_batch();
+                op.perform(nullptr);
+            }
+        };
+        const auto flush = [&] { manager.flush_batch(); };
+        // GL code splits the queue into ranges that are drawn one after another, so that the
+        // opaque pass never draws anything before GL code that should be drawn after it.
+        for (auto begin = ops.begin();; ) {
+            const auto end = std::find_if(begin, ops.end(), is_gl_block);
+            perform_range(begin, end, with_opaque_pass, draw, flush);
+            if (end == ops.end()) {
+                break;
+            }
+            // GL code
+            manager.flush_batch();
+            manager.set_render_state(end->render_state);
+            int block_index = ~end->vertices_or_block_index;
+            assert (block_index >= 0);
+            assert (block_index < gl_blocks.size());
+            gl_blocks[block_index].first();
+            manager.enforce_after_untrusted_gL(gl_blocks[block_index].second);
+            begin = end + 1;
+        }
+    #endif
+    }
+
+    #ifndef GOSU_IS_OPENGLES
+    // Implements DV_OVERDRAW: Draws the ops into an off-screen target where each layer adds 1/255
+    // to the red channel, then maps these counts to colors on top of the frame.
+    void perform_overdraw_view()
+    {
+        const int width = GLShadowState::current().viewport_width;
+        const int height = GLShadowState::current().viewport_height;
+        // The target has the size of the current framebuffer, so that the viewport, projection
+        // and clip rects stay valid while drawing into it.
+        const std::shared_ptr<OffScreenTarget> target
+            = OffScreenTarget::acquire(width, height, IF_RETRO | IF_NO_DEPTH_BUFFER);
+        target->render([&] {
+            glClearColor(0, 0, 0, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+            perform_ops();
+        });
+
+        RenderState().apply_alpha_mode();
+        use_fragment_shader(FragmentShader::OVERDRAW);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, target->texture()->tex_name());
+        glColor4ub(255, 255, 255, 255);
+        // Unlike render() targets, the counts have been drawn with the framebuffer's projection,
+        // which flips them vertically.
+        glBegin(GL_QUADS);
+        glTexCoord2f(0, 1);
+        glVertex2i(0, 0);
+        glTexCoord2f(1, 1);
+        glVertex2i(width, 0);
+        glTexCoord2f(1, 0);
+        glVertex2i(width, height);
+        glTexCoord2f(0, 0);
+        glVertex2i(0, height);
+        glEnd();
+        RenderState::unbind_texture();
+    }
+    #endif
+
+    void perform_with_shader_pipeline(bool with_opaque_pass)
+    {
+        std::optional<ShaderPipeline> pipeline(std::in_place);
+        const auto draw = [&](const DrawOp& op) { pipeline->draw(op); };
+        const auto flush = [&] { pipeline->flush(); };
+        for (auto begin = ops.begin();; ) {
+            const auto end = std::find_if(begin, ops.end(), is_gl_block);
+            perform_range(begin, end, with_opaque_pass, draw, flush);
+            if (end == ops.end()) {
+                break;
+            }
+            // GL code runs in the fixed-function pipeline, with the same state that
+            // RenderStateManager would set up for it.
+            pipeline.reset();
+            {
+                RenderStateManager manager;
+                manager.set_render_state(end->render_state);
+                int block_index = ~end->vertices_or_block_index;
                 assert (block_index >= 0);
                 assert (block_index < gl_blocks.size());
-                gl_blocks[block_index]();
-                manager.enforce_after_untrusted_gL();
+                gl_blocks[block_index].first();
             }
+            pipeline.emplace();
+            begin = end + 1;
         }
-    #endif
     }
 
     void compile_to(VertexArrays& vas)
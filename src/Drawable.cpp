@@ -1,16 +1,362 @@
+#include <Gosu/Bitmap.hpp>
 #include <Gosu/Drawable.hpp>
 #include <Gosu/Utility.hpp>
+#include "CompressedBitmap.hpp"
 #include "EmptyDrawable.hpp"
+#include "GraphicsImpl.hpp"
+#include "OpenGLContext.hpp"
+#include "TexChunk.hpp"
 #include "Texture.hpp"
 #include "TiledDrawable.hpp"
+#include "TrimmedDrawable.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <list>
 #include <mutex>
+#include <vector>
 
 namespace Gosu
 {
     // This variable has been declared in multiple places. Define it here, where it will be used.
     // This is a compatibility hack for old versions of Ruby/Gosu that didn't yet support :retro.
     bool undocumented_retrofication = false; // NOLINT(*-avoid-non-const-global-variables)
+
+    namespace
+    {
+        /// All texture atlases that have been allocated by create_drawable. Each texture will be
+        /// deleted once all images on it have been freed.
+        std::list<std::weak_ptr<Texture>> texture_pool;
+        std::mutex texture_pool_mutex;
+
+        double atlas_compaction_threshold = 0;
+        /// Set by create_drawable when the texture pool has become sparse. The compaction itself
+        /// is deferred to the drawing thread, see compact_texture_atlases_if_requested().
+        std::atomic<bool> atlas_compaction_requested = false;
+
+        std::atomic<unsigned> max_texture_size_limit = 4096;
+
+        bool texture_array_atlases = false;
+        /// The texture arrays for smooth (index 0) and retro (index 1) images. Each texture array
+        /// is kept alive by the Textures on its layers.
+        std::weak_ptr<TextureArray> texture_arrays[2];
+
+        /// Layers of texture arrays cannot grow, and a layer of max_texture_size() would waste a
+        /// lot of memory, so their size is limited to this.
+        constexpr int MAX_TEXTURE_ARRAY_LAYER_SIZE = 2048;
+
+        /// New texture atlases start out with this size (or larger, for larger images), and then
+        /// grow as needed. This keeps the memory footprint of small games low.
+        constexpr int INITIAL_ATLAS_SIZE = 512;
+
+        /// Returns the smallest atlas size that fits a bitmap of the given size.
+        int atlas_size_for(int width, int height, int max_size)
+        {
+#ifdef GOSU_IS_OPENGLES
+            // Growing textures requires copying between textures, which is not yet implemented in
+            // OpenGL ES.
+            return max_size;
+#else
+            int size = INITIAL_ATLAS_SIZE;
+            while (size < width || size < height) {
+                size *= 2;
+            }
+            return std::min(size, max_size);
+#endif
+        }
+
+        /// Returns max_texture_size(), rounded down to whole blocks for compressed formats.
+        int max_atlas_size(TextureFormat format)
+        {
+            const int max_size = static_cast<int>(max_texture_size());
+            if (is_block_compressed(format)) {
+                return max_size / COMPRESSION_BLOCK_SIZE * COMPRESSION_BLOCK_SIZE;
+            }
+            return max_size;
+        }
+
+        /// Images can only share a texture atlas if they use the same interpolation and format.
+        /// Textures that were created before set_premultiplied_alpha() was changed are ignored.
+        bool is_compatible(const Texture& texture, bool retro, TextureFormat format)
+        {
+            return texture.retro() == retro && texture.format() == format
+                && texture.premultiplied() == premultiplied_alpha();
+        }
+
+        /// Returns the textures in the texture pool that match the given retro setting and format,
+        /// ordered from the most populated to the least populated texture.
+        /// Must be called with a locked mutex.
+        std::vector<std::shared_ptr<Texture>> textures_by_occupancy(bool retro,
+                                                                    TextureFormat format)
+        {
+            texture_pool.remove_if([](const auto& weak_ptr) { return weak_ptr.expired(); });
+
+            std::vector<std::pair<double, std::shared_ptr<Texture>>> textures;
+            for (const std::weak_ptr<Texture>& weak_texture : texture_pool) {
+                const auto texture = weak_texture.lock();
+                if (texture && is_compatible(*texture, retro, format)) {
+                    textures.emplace_back(texture->occupancy(), texture);
+                }
+            }
+            std::ranges::stable_sort(textures, std::greater {},
+                                     [](const auto& pair) { return pair.first; });
+
+            std::vector<std::shared_ptr<Texture>> result;
+            result.reserve(textures.size());
+            for (auto& [occupancy, texture] : textures) {
+                result.push_back(std::move(texture));
+            }
+            return result;
+        }
+
+        /// Implements compact_texture_atlases(). Must be called with a locked mutex.
+        std::size_t compact_texture_pool()
+        {
+#ifdef GOSU_IS_OPENGLES
+            // Copying from one texture to another is not yet implemented in OpenGL ES.
+            return 0;
+#else
+            std::size_t reclaimed_bytes = 0;
+
+            for (const TextureFormat format :
+                 { TextureFormat::RGBA8, TextureFormat::BC1, TextureFormat::BC3,
+                   TextureFormat::BC7, TextureFormat::DISTANCE_FIELD }) {
+                for (const bool retro : { false, true }) {
+                    std::vector<std::shared_ptr<Texture>> textures
+                        = textures_by_occupancy(retro, format);
+                    // Empty the least populated textures first, moving their images onto the more
+                    // densely populated textures.
+                    while (textures.size() > 1) {
+                        const std::shared_ptr<Texture> source = textures.back();
+                        textures.pop_back();
+                        if (!source->evacuate_into(textures)) {
+                            // If the emptiest texture can't be moved, the others won't fit either.
+                            break;
+                        }
+                        // The texture itself may still be referenced by the current frame's draw
+                        // queue, but it must not receive any new images.
+                        texture_pool.remove_if([&](const auto& weak_ptr) {
+                            return weak_ptr.expired() || weak_ptr.lock() == source;
+                        });
+                        // Macros, tile maps or draw operations can still keep the texture
+                        // alive, and then its memory has not been released yet.
+                        if (source.use_count() == 1) {
+                            reclaimed_bytes += source->byte_size();
+                        }
+                    }
+                }
+            }
+
+            return reclaimed_bytes;
+#endif
+        }
+
+        /// Returns true if the existing textures for the given retro setting and format are, on
+        /// average, less populated than the threshold set by set_atlas_compaction_threshold.
+        /// Must be called with a locked mutex.
+        bool should_compact_before_allocation(bool retro, TextureFormat format)
+        {
+            if (atlas_compaction_threshold <= 0) {
+                return false;
+            }
+
+            const auto textures = textures_by_occupancy(retro, format);
+            if (textures.size() < 2) {
+                return false;
+            }
+            double total_occupancy = 0;
+            for (const auto& texture : textures) {
+                total_occupancy += texture->occupancy();
+            }
+            return total_occupancy / static_cast<double>(textures.size())
+                < atlas_compaction_threshold;
+        }
+
+        /// Returns true if images with these flags are drawn with nearest-neighbor interpolation.
+        bool wants_retro(unsigned image_flags)
+        {
+            // Distance fields rely on linear interpolation between their samples.
+            return ((image_flags & IF_RETRO) || undocumented_retrofication)
+                && !(image_flags & IF_DISTANCE_FIELD);
+        }
+
+        /// Returns the texture format for uncompressed images with the given flags.
+        TextureFormat texture_format(unsigned image_flags)
+        {
+            // IF_COMPRESSED is only a hint: Fall back to uncompressed textures if S3TC is not
+            // supported.
+            return (image_flags & IF_DISTANCE_FIELD) ? TextureFormat::DISTANCE_FIELD
+                : (image_flags & IF_COMPRESSED) && Texture::supports_format(TextureFormat::BC3)
+                ? TextureFormat::BC3
+                : TextureFormat::RGBA8;
+        }
+
+        /// Special case: If the texture is supposed to be tileable, is quadratic, has a size that
+        /// is at least 64 pixels but no more than max_texture_size() pixels and a power of two,
+        /// create a single texture just for this image.
+        /// This is not just an optimization, but a feature of Gosu so that one can use Gosu for
+        /// loading textures for use in 3D scenes, where it is important that the full u/v range
+        /// is dedicated to a single image so that texture repetition works as expected.
+        bool needs_own_texture(int width, int height, unsigned image_flags)
+        {
+            return (image_flags & IF_TILEABLE) == IF_TILEABLE && width == height
+                && (width & (width - 1)) == 0 && width >= 64
+                && width <= static_cast<int>(max_texture_size());
+        }
+
+        /// Returns true if the given part of the bitmap can be drawn without any translucent
+        /// pixels: It must be fully opaque, and linear interpolation must not blend its edges with
+        /// the transparent border around it.
+        bool is_drawn_opaque(const Bitmap& bitmap, const Rect& rect, unsigned image_flags,
+                             TextureFormat format)
+        {
+            return format == TextureFormat::RGBA8
+                && (wants_retro(image_flags) || (image_flags & IF_TILEABLE) == IF_TILEABLE)
+                && bitmap.opaque(rect);
+        }
+
+        /// Places an image on a texture atlas in the texture pool: On an existing texture if
+        /// possible, then after compacting or growing the existing textures, and finally on a new
+        /// texture. Must be called with a locked mutex.
+        /// @param width The size of the area that try_alloc will allocate, including padding.
+        /// @param height See width.
+        /// @param try_alloc Tries to allocate the image on the given texture.
+        std::unique_ptr<Drawable> alloc_in_texture_pool(
+            bool retro, TextureFormat format, int width, int height, int max_size,
+            const std::function<std::unique_ptr<Drawable>(Texture&)>& try_alloc)
+        {
+            const auto try_alloc_in_pool = [&]() -> std::unique_ptr<Drawable> {
+                texture_pool.remove_if([](const auto& weak_ptr) { return weak_ptr.expired(); });
+
+                for (const std::weak_ptr<Texture>& weak_texture : texture_pool) {
+                    const auto texture = weak_texture.lock();
+                    if (!texture || !is_compatible(*texture, retro, format)) {
+                        continue;
+                    }
+
+                    std::unique_ptr<Drawable> data = try_alloc(*texture);
+                    if (data) {
+                        return data;
+                    }
+                }
+                return nullptr;
+            };
+
+            if (std::unique_ptr<Drawable> data = try_alloc_in_pool()) {
+                return data;
+            }
+
+            // All textures are full: If they are only sparsely populated, compact them at the end
+            // of the frame. Moving images now would race with other threads that draw them.
+            if (should_compact_before_allocation(retro, format)) {
+                atlas_compaction_requested = true;
+            }
+
+#ifndef GOSU_IS_OPENGLES
+            // If the most recently created texture has not reached its maximum size yet, grow it.
+            // (Older textures have either reached the maximum size, or were too fragmented to
+            // grow.)
+            const auto newest = std::ranges::find_if(
+                texture_pool.rbegin(), texture_pool.rend(),
+                [&](const std::weak_ptr<Texture>& weak_ptr) {
+                    const auto texture = weak_ptr.lock();
+                    return texture && is_compatible(*texture, retro, format);
+                });
+            if (newest != texture_pool.rend()) {
+                const std::shared_ptr<Texture> texture = newest->lock();
+                if (texture && !texture->array() && texture->width() < max_size
+                    && texture->supports_copy()) {
+                    const int new_size
+                        = std::min(std::max(texture->width() * 2,
+                                            atlas_size_for(width, height, max_size)),
+                                   max_size);
+                    const std::shared_ptr<Texture> grown_texture
+                        = texture->grow(new_size, new_size);
+                    // The previous texture may still be referenced by queued draw operations or
+                    // macros, but no new images must be placed on it.
+                    *newest = grown_texture;
+                    if (std::unique_ptr<Drawable> data = try_alloc(*grown_texture)) {
+                        return data;
+                    }
+                }
+            }
+#endif
+
+            // Otherwise, create a new texture; preferably on a texture array.
+            if (texture_array_atlases && format == TextureFormat::RGBA8
+                && TextureArray::supported()) {
+                std::shared_ptr<TextureArray> array = texture_arrays[retro ? 1 : 0].lock();
+                if (!array) {
+                    array = std::make_shared<TextureArray>(
+                        std::min(max_size, MAX_TEXTURE_ARRAY_LAYER_SIZE), retro);
+                    texture_arrays[retro ? 1 : 0] = array;
+                }
+                if (width <= array->size() && height <= array->size() && array->has_free_layer()) {
+                    std::shared_ptr<Texture> texture = std::make_shared<Texture>(array);
+                    texture_pool.push_back(texture);
+                    return try_alloc(*texture);
+                }
+            }
+
+            const int size = atlas_size_for(width, height, max_size);
+            std::shared_ptr<Texture> texture = std::make_shared<Texture>(size, size, retro, format);
+            texture_pool.push_back(texture);
+            return try_alloc(*texture);
+        }
+    }
+}
+
+unsigned Gosu::max_texture_size()
+{
+    static const unsigned gl_max_texture_size = [] {
+        const OpenGLContext current_context;
+        GLint size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+        // Never exceed what the driver supports, even if it is less than the usual 1024 pixels.
+        return static_cast<unsigned>(std::max(size, 0));
+    }();
+    return std::min(gl_max_texture_size, max_texture_size_limit.load());
+}
+
+void Gosu::set_max_texture_size(unsigned limit)
+{
+    if (limit < 64) {
+        throw std::invalid_argument("Gosu::set_max_texture_size: Limit is too small");
+    }
+    max_texture_size_limit = limit;
+}
+
+void Gosu::set_texture_array_atlases(bool enabled)
+{
+    const std::scoped_lock lock(texture_pool_mutex);
+    texture_array_atlases = enabled;
+}
+
+std::size_t Gosu::compact_texture_atlases()
+{
+    const std::scoped_lock lock(texture_pool_mutex);
+    return compact_texture_pool();
+}
+
+void Gosu::compact_texture_atlases_if_requested()
+{
+    if (atlas_compaction_requested.exchange(false)) {
+        const std::scoped_lock lock(texture_pool_mutex);
+        compact_texture_pool();
+    }
+}
+
+void Gosu::set_atlas_compaction_threshold(double min_occupancy)
+{
+    const std::scoped_lock lock(texture_pool_mutex);
+    atlas_compaction_threshold = min_occupancy;
+}
+
+std::future<Gosu::Bitmap> Gosu::Drawable::to_bitmap_async() const
+{
+    std::promise<Bitmap> promise;
+    promise.set_value(to_bitmap());
+    return promise.get_future();
 }
 
 std::unique_ptr<Gosu::Drawable> Gosu::create_drawable(const Bitmap& source, const Rect& source_rect,
@@ -32,64 +378,149 @@ std::unique_ptr<Gosu::Drawable> Gosu::create_drawable(const Bitmap& source, cons
         image_flags = IF_TILEABLE;
     }
 
-    bool wants_retro = (image_flags & IF_RETRO) || undocumented_retrofication;
+    if (image_flags & IF_TRIM_TRANSPARENT) {
+        image_flags &= ~IF_TRIM_TRANSPARENT;
+
+        Rect bounds = visible_bounds(source, source_rect);
+        if (bounds.empty()) {
+            return std::make_unique<EmptyDrawable>(source_rect.width, source_rect.height);
+        }
+        // Keep one transparent pixel around smooth images so that their edges are interpolated
+        // with the same neighbors as before, and do not trim tileable edges at all.
+        const int margin = wants_retro(image_flags) ? 0 : 1;
+        const int left = (image_flags & IF_TILEABLE_LEFT) ? source_rect.x : bounds.x - margin;
+        const int top = (image_flags & IF_TILEABLE_TOP) ? source_rect.y : bounds.y - margin;
+        const int right = (image_flags & IF_TILEABLE_RIGHT) ? source_rect.right()
+                                                             : bounds.right() + margin;
+        const int bottom = (image_flags & IF_TILEABLE_BOTTOM) ? source_rect.bottom()
+                                                               : bounds.bottom() + margin;
+        bounds = Rect { left, top, right - left, bottom - top };
+        bounds.clip_to(source_rect);
+
+        if (bounds != source_rect) {
+            const Rect relative_bounds { bounds.x - source_rect.x, bounds.y - source_rect.y,
+                                         bounds.width, bounds.height };
+            return std::make_unique<TrimmedDrawable>(source_rect.width, source_rect.height,
+                                                     relative_bounds,
+                                                     create_drawable(source, bounds, image_flags));
+        }
+    }
 
-    // Special case: If the texture is supposed to be tileable, is quadratic, has a size that is at
-    // least 64 pixels but no more than MAX_TEXTURE_SIZE pixels and a power of two, create a single
-    // texture just for this image.
-    // This is not just an optimization, but a feature of Gosu so that one can use Gosu for loading
-    // textures for use in 3D scenes, where it is important that the full u/v range is dedicated to
-    // a single image so that texture repetition works as expected.
-    if ((image_flags & IF_TILEABLE) == IF_TILEABLE && source_rect.width == source_rect.height
-        && (source_rect.width & (source_rect.width - 1)) == 0 && source_rect.width >= 64
-        && source_rect.width <= MAX_TEXTURE_SIZE) {
+    const TextureFormat format = texture_format(image_flags);
 
-        const std::shared_ptr<Texture> texture
-            = std::make_shared<Texture>(source_rect.width, source_rect.height, wants_retro);
+    if (needs_own_texture(source_rect.width, source_rect.height, image_flags)) {
+        const std::shared_ptr<Texture> texture = std::make_shared<Texture>(
+            source_rect.width, source_rect.height, wants_retro(image_flags), format);
+        const bool opaque = is_drawn_opaque(source, source_rect, image_flags, format);
 
         // Use the source bitmap directly if the source area completely covers it.
+        std::unique_ptr<TexChunk> chunk;
         if (source_rect == Rect::covering(source)) {
-            return texture->try_alloc(source, 0);
+            chunk = texture->try_alloc(source, 0);
         }
         else {
             Bitmap trimmed_source(source_rect.width, source_rect.height);
             trimmed_source.insert(source, 0, 0, source_rect);
-            return texture->try_alloc(trimmed_source, 0);
+            chunk = texture->try_alloc(trimmed_source, 0);
+        }
+        if (chunk) {
+            chunk->set_opaque(opaque);
         }
+        return chunk;
     }
 
-    const int max_size = MAX_TEXTURE_SIZE;
+    const int max_size = max_atlas_size(format);
 
     // Too large to fit on a single texture? -> Create a tiled representation.
     if (source_rect.width > max_size - 2 || source_rect.height > max_size - 2) {
         return std::make_unique<TiledDrawable>(source, source_rect, max_size - 2, image_flags);
     }
 
-    Bitmap source_with_borders = apply_border_flags(image_flags, source, source_rect);
+    return create_drawable_with_borders(apply_border_flags(image_flags, source, source_rect),
+                                        image_flags);
+}
+
+bool Gosu::uses_border_pixels(int width, int height, unsigned image_flags)
+{
+    if (image_flags == 1) {
+        image_flags = IF_TILEABLE;
+    }
+    if (width <= 0 || height <= 0 || (image_flags & IF_TRIM_TRANSPARENT)
+        || needs_own_texture(width, height, image_flags)) {
+        return false;
+    }
+    const int max_size = max_atlas_size(texture_format(image_flags));
+    return width <= max_size - 2 && height <= max_size - 2;
+}
+
+std::unique_ptr<Gosu::Drawable> Gosu::create_drawable_with_borders(
+    const Bitmap& source_with_borders, unsigned image_flags)
+{
+    if (image_flags == 1) {
+        image_flags = IF_TILEABLE;
+    }
+    const bool retro = wants_retro(image_flags);
+    const TextureFormat format = texture_format(image_flags);
+    const Rect inner_rect { 1, 1, source_with_borders.width() - 2,
+                            source_with_borders.height() - 2 };
+    const bool opaque = is_drawn_opaque(source_with_borders, inner_rect, image_flags, format);
 
     // Try to put the bitmap into one of the already allocated textures.
-    static std::list<std::weak_ptr<Texture>> texture_pool;
-    static std::mutex mutex;
-    std::scoped_lock lock(mutex);
+    const std::scoped_lock lock(texture_pool_mutex);
+    return alloc_in_texture_pool(retro, format, source_with_borders.width(),
+                                 source_with_borders.height(), max_atlas_size(format),
+                                 [&](Texture& texture) -> std::unique_ptr<Drawable> {
+                                     auto chunk = texture.try_alloc(source_with_borders, 1);
+                                     if (chunk) {
+                                         chunk->set_opaque(opaque);
+                                     }
+                                     return chunk;
+                                 });
+}
+
+std::unique_ptr<Gosu::Drawable> Gosu::create_drawable(const CompressedBitmap& source,
+                                                      unsigned image_flags)
+{
+    if (source.width() == 0 || source.height() == 0) {
+        return std::make_unique<EmptyDrawable>(source.width(), source.height());
+    }
+    if (!Texture::supports_format(source.format())) {
+        throw std::runtime_error("The compression format of this image is not supported by the "
+                                 "GPU");
+    }
+
+    if (image_flags == 1) {
+        image_flags = IF_TILEABLE;
+    }
 
-    texture_pool.remove_if([](const auto& weak_ptr) { return weak_ptr.expired(); });
+    // The blocks cannot be premultiplied or split into tiles without decompressing them. In these
+    // cases, let the regular code path compress the pixels again, one texture at a time.
+    const auto create_decompressed_drawable = [&] {
+        return create_drawable(Texture::decompress(source), Rect::covering(source),
+                               image_flags | IF_COMPRESSED);
+    };
+    if (premultiplied_alpha()) {
+        return create_decompressed_drawable();
+    }
 
-    for (const std::weak_ptr<Texture>& weak_texture : texture_pool) {
-        const auto texture = weak_texture.lock();
-        if (!texture || texture->retro() != wants_retro) {
-            continue;
-        }
+    const bool retro = (image_flags & IF_RETRO) || undocumented_retrofication;
 
-        std::unique_ptr<Drawable> data = texture->try_alloc(source_with_borders, 1);
-        if (data) {
-            return data;
-        }
+    if (needs_own_texture(source.width(), source.height(), image_flags)) {
+        const std::shared_ptr<Texture> texture = std::make_shared<Texture>(
+            source.width(), source.height(), retro, source.format());
+        texture->insert(source, 0, 0);
+        return std::make_unique<TexChunk>(texture, Rect::covering(source), nullptr);
     }
 
-    // All textures are full: Create a new one.
+    const int max_size = max_atlas_size(source.format());
+    // try_alloc adds a transparent border of one block on each side.
+    const int width = (source.blocks_x() + 2) * COMPRESSION_BLOCK_SIZE;
+    const int height = (source.blocks_y() + 2) * COMPRESSION_BLOCK_SIZE;
+    if (width > max_size || height > max_size) {
+        return create_decompressed_drawable();
+    }
 
-    std::shared_ptr<Texture> texture
-        = std::make_shared<Texture>(MAX_TEXTURE_SIZE, MAX_TEXTURE_SIZE, wants_retro);
-    texture_pool.push_back(texture);
-    return texture->try_alloc(source_with_borders, 1);
+    const std::scoped_lock lock(texture_pool_mutex);
+    return alloc_in_texture_pool(retro, source.format(), width, height, max_size,
+                                 [&](Texture& texture) { return texture.try_alloc(source); });
 }
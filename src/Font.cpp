@@ -2,12 +2,120 @@
 #include <Gosu/Image.hpp>
 #include <Gosu/Text.hpp>
 #include <Gosu/Utility.hpp>
+#include <Gosu/Bitmap.hpp>
+#include <Gosu/Drawable.hpp>
 #include "GraphicsImpl.hpp"
 #include "MarkupParser.hpp"
-#include <cmath> // for std::ceil
+#include "TexChunk.hpp"
+#include "TrueTypeFont.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath> // for std::ceil, std::sqrt
+#include <future>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    /// Fonts with IF_DISTANCE_FIELD render their glyphs at this height, no matter how large the
+    /// font is.
+    constexpr int DISTANCE_FIELD_GLYPH_HEIGHT = 64;
+    /// The room around each distance field glyph, which is also the distance at which the field
+    /// fades out. This limits how far draw_markup_dilated() can grow a glyph.
+    constexpr int DISTANCE_FIELD_SPREAD = DISTANCE_FIELD_GLYPH_HEIGHT / 8;
+
+    /// Distance field glyphs look the same at every font size, so all fonts with the same name
+    /// and flags share them.
+    struct SharedGlyphKey
+    {
+        std::string font_name;
+        unsigned image_flags;
+        unsigned font_flags;
+        char32_t codepoint;
+        auto operator<=>(const SharedGlyphKey&) const = default;
+    };
+    std::map<SharedGlyphKey, Gosu::Image> shared_distance_fields;
+    std::mutex shared_distance_fields_mutex;
+}
+
+struct Gosu::TextLayout::Impl
+{
+    struct Quad
+    {
+        Image image;
+        /// The glyph image as a TexChunk, if it is one; only these can be drawn with a custom edge.
+        const TexChunk* chunk;
+        /// The corners of the glyph at a scale of 1, relative to the top left corner of the text.
+        double left, top, right, bottom;
+        /// The color that was set through markup.
+        Color color;
+    };
+    std::vector<Quad> quads;
+    double width = 0;
+    double height = 0;
+
+    /// @param edge See TexChunk::draw(); 0.5 draws all glyphs normally.
+    void draw(double x, double y, ZPos z, double scale_x, double scale_y, Color c,
+              BlendMode mode, double edge) const
+    {
+        for (const Quad& quad : quads) {
+            draw_glyph(quad.image, quad.chunk, x + quad.left * scale_x, y + quad.top * scale_y,
+                       x + quad.right * scale_x, y + quad.bottom * scale_y,
+                       multiply(c, quad.color), z, mode, edge);
+        }
+    }
+
+    /// Draws a single glyph image into the given rectangle. Also used by Font to draw text
+    /// without creating a TextLayout first.
+    static void draw_glyph(const Image& image, const TexChunk* chunk, double left, double top,
+                           double right, double bottom, Color color, ZPos z, BlendMode mode,
+                           double edge)
+    {
+        if (edge != 0.5 && chunk) {
+            chunk->draw(left, top, color, right, top, color, left, bottom, color, right, bottom,
+                        color, z, mode, edge);
+        }
+        else {
+            image.drawable().draw(left, top, color, right, top, color, left, bottom, color, right,
+                                  bottom, color, z, mode);
+        }
+    }
+};
+
+Gosu::TextLayout::TextLayout()
+{
+    static const auto empty_layout = std::make_shared<const Impl>();
+    m_impl = empty_layout;
+}
+
+Gosu::TextLayout::TextLayout(std::shared_ptr<const Impl> impl)
+    : m_impl(std::move(impl))
+{
+}
+
+double Gosu::TextLayout::width() const
+{
+    return m_impl->width;
+}
+
+double Gosu::TextLayout::height() const
+{
+    return m_impl->height;
+}
+
+void Gosu::TextLayout::draw(double x, double y, ZPos z, double scale_x, double scale_y, Color c,
+                            BlendMode mode) const
+{
+    m_impl->draw(x, y, z, scale_x, scale_y, c, mode, 0.5);
+}
 
 struct Gosu::Font::Impl : private Gosu::Noncopyable
 {
@@ -43,45 +151,464 @@ struct Gosu::Font::Impl : private Gosu::Noncopyable
         }
     };
 
+    /// A glyph as it is stored in the glyph table. Once published, a Glyph is never modified. If
+    /// set_image() replaces it, it is deleted once no reader can still be using it.
+    struct Glyph
+    {
+        Image image;
+        /// The image as a TexChunk, if it is one; only these can be drawn with a custom edge.
+        const TexChunk* chunk = nullptr;
+        /// Distance field glyphs have this many pixels of room on each side, which do not count
+        /// towards the size of the glyph.
+        int margin = 0;
+        /// The factor by which the image must be scaled to match the font height.
+        double scale = 1;
+        /// The width of the glyph at the font height, without margins.
+        double advance = 0;
+    };
+
     // Font implements copying through its shared_ptr, not by making a true copy. However, Fonts are
     // not immutable: Glyphs are created and cashed on demand, and set_image() enables modifications
     // to the shared data of a font. Having multiple references to the same object, but not being
-    // able to use it from two threads, seems counterintuitive, so introduce a mutex here, even
-    // though most Gosu games/programs will never really require it.
-    // (Could be a shared_mutex, but doesn't seem to be worth the trouble.)
+    // able to use it from two threads, seems counterintuitive, so all writes are protected by this
+    // mutex, even though most Gosu games/programs will never really require it.
     std::mutex glyphs_mutex;
-    std::unordered_map<GlyphKey, Image, GlyphKeyHasher> glyphs;
+    std::unordered_map<GlyphKey, std::unique_ptr<const Glyph>, GlyphKeyHasher> glyphs;
+    /// Glyphs that set_image() has replaced, but that lock-free readers may still be using.
+    /// They are deleted by reclaim_retired_glyphs() as soon as there are no readers.
+    std::vector<std::unique_ptr<const Glyph>> retired_glyphs;
+    std::atomic<bool> has_retired_glyphs = false;
+    /// The number of ReaderScope instances, i.e. of threads that may be using a Glyph&.
+    std::atomic<int> active_readers = 0;
+
+    // Looking up glyphs in the Basic Multilingual Plane does not need glyphs_mutex: These glyphs
+    // are also published in a table per combination of font flags, which is split into pages of
+    // 256 codepoints so that only the pages that are used take up memory. Tables, pages and
+    // entries are only ever added or replaced atomically. Tables and pages are never freed before
+    // the font, and replaced entries are only freed when there are no readers.
+    static constexpr char32_t GLYPH_PAGE_SIZE = 256;
+    static constexpr char32_t GLYPH_TABLE_SIZE = 0x10000;
+    using GlyphPage = std::array<std::atomic<const Glyph*>, GLYPH_PAGE_SIZE>;
+    using GlyphTable = std::array<std::atomic<GlyphPage*>, GLYPH_TABLE_SIZE / GLYPH_PAGE_SIZE>;
+    std::array<std::atomic<GlyphTable*>, FF_COMBINATIONS> glyph_tables {};
+    std::vector<std::unique_ptr<GlyphTable>> glyph_table_storage;
+    std::vector<std::unique_ptr<GlyphPage>> glyph_page_storage;
 
-    const Image& image(char32_t codepoint, unsigned font_flags)
+    /// Must exist while a thread uses glyphs that it has looked up without holding glyphs_mutex.
+    /// The last reader to leave deletes the glyphs that have been retired in the meantime.
+    class ReaderScope : Noncopyable
     {
-        const GlyphKey key { codepoint, font_flags };
-        if (const auto iterator = glyphs.find(key); iterator != glyphs.end()) {
-            return iterator->second;
+        Impl& m_impl;
+
+    public:
+        explicit ReaderScope(Impl& impl)
+            : m_impl(impl)
+        {
+            m_impl.active_readers.fetch_add(1);
+            // Pairs with the fence in reclaim_retired_glyphs(): Either the writer sees this
+            // reader, or this reader sees the new glyph pointers.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        ~ReaderScope()
+        {
+            if (m_impl.active_readers.fetch_sub(1) == 1 && m_impl.has_retired_glyphs) {
+                // If another thread holds the lock, it reclaims the glyphs when it publishes one,
+                // or the next reader will.
+                const std::unique_lock lock(m_impl.glyphs_mutex, std::try_to_lock);
+                if (lock.owns_lock()) {
+                    m_impl.reclaim_retired_glyphs();
+                }
+            }
+        }
+    };
+
+    /// Deletes retired glyphs if no ReaderScope exists. Must be called with a locked glyphs_mutex.
+    void reclaim_retired_glyphs()
+    {
+        if (retired_glyphs.empty()) {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (active_readers.load() == 0) {
+            retired_glyphs.clear();
+            has_retired_glyphs = false;
+        }
+    }
+
+    /// Returns the glyph from the lock-free glyph table, or nullptr if it is not (yet) there.
+    const Glyph* find_published_glyph(char32_t codepoint, unsigned font_flags) const
+    {
+        if (codepoint >= GLYPH_TABLE_SIZE || font_flags >= FF_COMBINATIONS) {
+            return nullptr;
+        }
+        const GlyphTable* table = glyph_tables[font_flags].load(std::memory_order_acquire);
+        if (table == nullptr) {
+            return nullptr;
+        }
+        const GlyphPage* page
+            = (*table)[codepoint / GLYPH_PAGE_SIZE].load(std::memory_order_acquire);
+        if (page == nullptr) {
+            return nullptr;
+        }
+        return (*page)[codepoint % GLYPH_PAGE_SIZE].load(std::memory_order_acquire);
+    }
+
+    /// Stores a glyph and makes it visible to all readers. Must be called with a locked
+    /// glyphs_mutex.
+    /// @param replace Whether an existing glyph for the same key should be replaced.
+    const Glyph& publish_glyph(const GlyphKey& key, Image image, int margin, bool replace)
+    {
+        const auto [iterator, inserted] = glyphs.try_emplace(key, nullptr);
+        if (!inserted && !replace) {
+            return *iterator->second;
+        }
+
+        auto new_glyph = std::make_unique<Glyph>();
+        Glyph& glyph = *new_glyph;
+        const int inner_height = static_cast<int>(image.height()) - 2 * margin;
+        glyph.scale = inner_height > 0 ? 1.0 * height / inner_height : 1.0;
+        glyph.advance = glyph.scale * (static_cast<int>(image.width()) - 2 * margin);
+        glyph.margin = margin;
+        glyph.image = std::move(image);
+        glyph.chunk = dynamic_cast<const TexChunk*>(&glyph.image.drawable());
+        if (iterator->second) {
+            retired_glyphs.push_back(std::move(iterator->second));
+            has_retired_glyphs = true;
+        }
+        iterator->second = std::move(new_glyph);
+
+        if (key.codepoint < GLYPH_TABLE_SIZE && key.font_flags < FF_COMBINATIONS) {
+            std::atomic<GlyphTable*>& table = glyph_tables[key.font_flags];
+            if (table.load(std::memory_order_relaxed) == nullptr) {
+                table.store(glyph_table_storage.emplace_back(new GlyphTable {}).get(),
+                            std::memory_order_release);
+            }
+            std::atomic<GlyphPage*>& page
+                = (*table.load(std::memory_order_relaxed))[key.codepoint / GLYPH_PAGE_SIZE];
+            if (page.load(std::memory_order_relaxed) == nullptr) {
+                page.store(glyph_page_storage.emplace_back(new GlyphPage {}).get(),
+                           std::memory_order_release);
+            }
+            (*page.load(std::memory_order_relaxed))[key.codepoint % GLYPH_PAGE_SIZE].store(
+                &glyph, std::memory_order_release);
+        }
+        reclaim_retired_glyphs();
+        return glyph;
+    }
+
+    bool distance_field() const { return image_flags & IF_DISTANCE_FIELD; }
+
+    int glyph_margin() const { return distance_field() ? DISTANCE_FIELD_SPREAD : 0; }
+
+    int glyph_height() const
+    {
+        if (distance_field()) {
+            return DISTANCE_FIELD_GLYPH_HEIGHT;
         }
 
-        // If this codepoint has not been rendered before, do it now.
         // By default, render each glyph at 200% its size so that we have some wiggle room for
         // changing the font size dynamically without it appearing too blurry.
-        auto scaled_height = height * 2;
         // Optimization: Don't render higher-resolution versions if we use
         // next neighbor interpolation anyway.
-        if (image_flags & IF_RETRO) {
-            scaled_height = height;
-        }
+        return (image_flags & IF_RETRO) ? height : height * 2;
+    }
 
+    /// Renders a glyph into the given bitmap and returns the part of the bitmap that it covers.
+    /// This only reads immutable members, so it can be called without holding glyphs_mutex.
+    /// @param font The result of font_by_name(name, font_flags). preload() looks it up once, so
+    ///             that its worker threads do not contend for the lock in font_by_name().
+    Rect render_glyph(TrueTypeFont& font, char32_t codepoint, Bitmap& bitmap) const
+    {
+        const int scaled_height = glyph_height();
         std::u32string string(1, codepoint);
-        Bitmap bitmap(scaled_height, scaled_height);
-        const int required_width = static_cast<int>(std::ceil(
-            Gosu::draw_text(bitmap, 0, 0, Color::WHITE, string, name, scaled_height, font_flags)));
+        if (distance_field()) {
+            const int width = static_cast<int>(
+                std::ceil(font.draw_text(string, scaled_height, nullptr, 0, 0, Color::NONE)));
+            const int margin = glyph_margin();
+            bitmap = Bitmap(width + 2 * margin, scaled_height + 2 * margin);
+            font.draw_distance_field(codepoint, scaled_height, bitmap, margin, margin, margin);
+            return Rect::covering(bitmap);
+        }
+
+        bitmap = Bitmap(scaled_height, scaled_height);
+        const int required_width = static_cast<int>(
+            std::ceil(font.draw_text(string, scaled_height, &bitmap, 0, 0, Color::WHITE)));
         if (required_width > bitmap.width()) {
             // If the character was wider than high, we need to render it again.
             Bitmap resized_bitmap(required_width, scaled_height);
             std::swap(resized_bitmap, bitmap);
-            Gosu::draw_text(bitmap, 0, 0, Color::WHITE, string, name, scaled_height, font_flags);
+            font.draw_text(string, scaled_height, &bitmap, 0, 0, Color::WHITE);
+        }
+        return Rect { 0, 0, required_width, bitmap.height() };
+    }
+
+    /// Copies a distance field glyph that another font has already rendered into this font.
+    /// Returns false if there is none. Must be called with a locked glyphs_mutex.
+    bool adopt_shared_glyph(const GlyphKey& key)
+    {
+        if (!distance_field()) {
+            return false;
+        }
+        const std::scoped_lock lock(shared_distance_fields_mutex);
+        const auto iterator = shared_distance_fields.find(
+            SharedGlyphKey { name, image_flags, key.font_flags, key.codepoint });
+        if (iterator == shared_distance_fields.end()) {
+            return false;
+        }
+        publish_glyph(key, iterator->second, glyph_margin(), false);
+        return true;
+    }
+
+    /// Makes a distance field glyph available to all other fonts with the same name and flags.
+    void share_glyph(const GlyphKey& key, const Image& image) const
+    {
+        if (distance_field()) {
+            const std::scoped_lock lock(shared_distance_fields_mutex);
+            shared_distance_fields.try_emplace(
+                SharedGlyphKey { name, image_flags, key.font_flags, key.codepoint }, image);
+        }
+    }
+
+    /// Returns the glyph for a codepoint, rendering it first if necessary. Must be called without
+    /// holding glyphs_mutex, and within a ReaderScope.
+    const Glyph& glyph(char32_t codepoint, unsigned font_flags)
+    {
+        if (const Glyph* glyph = find_published_glyph(codepoint, font_flags)) {
+            return *glyph;
+        }
+
+        const std::unique_lock lock(glyphs_mutex);
+        const GlyphKey key { codepoint, font_flags };
+        if (const auto iterator = glyphs.find(key); iterator != glyphs.end()) {
+            return *iterator->second;
+        }
+        if (adopt_shared_glyph(key)) {
+            return *glyphs.at(key);
+        }
+
+        // If this codepoint has not been rendered (or preloaded) before, do it now.
+        Bitmap bitmap;
+        const Rect source_rect = render_glyph(font_by_name(name, font_flags), codepoint, bitmap);
+        Image image(bitmap, source_rect, image_flags);
+        share_glyph(key, image);
+        return publish_glyph(key, std::move(image), glyph_margin(), true);
+    }
+
+    /// Positions the glyphs of the given markup, and calls f(glyph, color, left, top) for each
+    /// of them. The coordinates are those of the glyph image's top left corner at a scale of 1,
+    /// relative to the top left corner of the text.
+    /// @return The width and height of the text at a scale of 1.
+    template<typename F>
+    std::pair<double, double> layout_glyphs(const std::string& markup, const F& f)
+    {
+        const ReaderScope reader(*this);
+        double width = 0, current_y = 0;
+
+        // Split the text into lines (split_words = false) because Font doesn't implement
+        // word-wrapping.
+        MarkupParser parser(base_flags, false, [&](const std::vector<FormattedString>& line) {
+            double current_x = 0;
+            for (const auto& part : line) {
+                for (const auto codepoint : part.text) {
+                    const Glyph& glyph = this->glyph(codepoint, part.flags);
+                    f(glyph, part.color, current_x - glyph.margin * glyph.scale,
+                      current_y - glyph.margin * glyph.scale);
+                    current_x += glyph.advance;
+                }
+            }
+            width = std::max(width, current_x);
+            current_y += height;
+        });
+        parser.parse(markup);
+
+        return { width, current_y };
+    }
+
+    /// Implements prepare_markup().
+    std::shared_ptr<TextLayout::Impl> layout_markup(const std::string& markup)
+    {
+        auto layout = std::make_shared<TextLayout::Impl>();
+        std::tie(layout->width, layout->height)
+            = layout_glyphs(markup, [&](const Glyph& glyph, Color color, double left, double top) {
+                  layout->quads.push_back(TextLayout::Impl::Quad {
+                      .image = glyph.image,
+                      .chunk = glyph.chunk,
+                      .left = left,
+                      .top = top,
+                      .right = left + glyph.image.width() * glyph.scale,
+                      .bottom = top + glyph.image.height() * glyph.scale,
+                      .color = color,
+                  });
+              });
+        return layout;
+    }
+
+    /// Implements draw_markup() and draw_markup_dilated(). This draws the glyphs right away
+    /// instead of going through a TextLayout, which would allocate memory for each call.
+    void draw_markup(const std::string& markup, double dilation, double x, double y, ZPos z,
+                     double scale_x, double scale_y, Color c, BlendMode mode)
+    {
+        // Distance field glyphs are grown by moving their edge. Distances change by 128 / 255 per
+        // DISTANCE_FIELD_SPREAD pixels of the glyph images, which are scaled to this font's height.
+        const double distance_per_pixel = 128.0 / 255 / DISTANCE_FIELD_SPREAD
+            * DISTANCE_FIELD_GLYPH_HEIGHT / height;
+        const double edge = dilation == 0
+            ? 0.5
+            : std::clamp(0.5 - dilation * distance_per_pixel, 0.01, 0.99);
+
+        layout_glyphs(markup, [&](const Glyph& glyph, Color color, double left, double top) {
+            const double right = left + glyph.image.width() * glyph.scale;
+            const double bottom = top + glyph.image.height() * glyph.scale;
+            TextLayout::Impl::draw_glyph(glyph.image, glyph.chunk, x + left * scale_x,
+                                         y + top * scale_y, x + right * scale_x,
+                                         y + bottom * scale_y, multiply(c, color), z, mode,
+                                         edge);
+        });
+    }
+
+    void preload(std::u32string codepoints, unsigned font_flags)
+    {
+        if (font_flags >= FF_COMBINATIONS) {
+            throw std::invalid_argument("Invalid font_flags");
+        }
+
+        std::ranges::sort(codepoints);
+        codepoints.erase(std::ranges::unique(codepoints).begin(), codepoints.end());
+        {
+            const std::unique_lock lock(glyphs_mutex);
+            std::erase_if(codepoints, [&](char32_t codepoint) {
+                return glyphs.contains({ codepoint, font_flags })
+                    || adopt_shared_glyph({ codepoint, font_flags });
+            });
+        }
+        if (codepoints.empty()) {
+            return;
         }
-        const Rect source_rect { 0, 0, required_width, bitmap.height() };
 
-        return glyphs[key] = Image(bitmap, source_rect, image_flags);
+        // Rendering glyphs is the expensive part, so spread it across threads. glyphs_mutex is
+        // not held, so that other threads can keep drawing text with this font in the meantime.
+        // TrueTypeFont::draw_text() only takes a shared lock on its metrics cache, so the workers
+        // really rasterize in parallel.
+        TrueTypeFont& font = font_by_name(name, font_flags);
+        std::vector<Bitmap> bitmaps(codepoints.size());
+        std::vector<Rect> source_rects(codepoints.size());
+        const auto render_every_nth_glyph = [&](std::size_t first, std::size_t step) {
+            for (std::size_t i = first; i < codepoints.size(); i += step) {
+                source_rects[i] = render_glyph(font, codepoints[i], bitmaps[i]);
+            }
+        };
+        // Starting a thread is only worth it if it has a few glyphs to render.
+        static constexpr std::size_t MIN_GLYPHS_PER_THREAD = 16;
+        const std::size_t thread_count
+            = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1,
+                                      (codepoints.size() + MIN_GLYPHS_PER_THREAD - 1)
+                                          / MIN_GLYPHS_PER_THREAD);
+        std::vector<std::future<void>> workers;
+        for (std::size_t i = 1; i < thread_count; ++i) {
+            workers.push_back(std::async(std::launch::async, render_every_nth_glyph, i,
+                                         thread_count));
+        }
+        render_every_nth_glyph(0, thread_count);
+        for (auto& worker : workers) {
+            worker.get();
+        }
+
+        std::vector<Image> images = create_glyph_images(bitmaps, source_rects);
+
+        const std::unique_lock lock(glyphs_mutex);
+        for (std::size_t i = 0; i < codepoints.size(); ++i) {
+            share_glyph({ codepoints[i], font_flags }, images[i]);
+            // Do not replace glyphs that have been created or set in the meantime.
+            publish_glyph({ codepoints[i], font_flags }, std::move(images[i]), glyph_margin(),
+                          false);
+        }
+    }
+
+    /// Turns rendered glyphs into images. Instead of creating one image per glyph, this packs
+    /// the glyphs into as few large bitmaps ("pages") as possible, so that they can be uploaded
+    /// in one go, and then creates the glyph images as subimages of these pages.
+    std::vector<Image> create_glyph_images(const std::vector<Bitmap>& bitmaps,
+                                           const std::vector<Rect>& source_rects) const
+    {
+        std::vector<Image> images(bitmaps.size());
+
+        // Tileable glyphs have no transparent border that could separate them on a page, and
+        // block compression would blur neighboring glyphs into each other.
+        // The legacy value 1 also means IF_TILEABLE, see ImageFlags.
+        const unsigned flags = image_flags == 1 ? static_cast<unsigned>(IF_TILEABLE) : image_flags;
+        if (flags & (IF_TILEABLE | IF_TRIM_TRANSPARENT | IF_COMPRESSED)) {
+            for (std::size_t i = 0; i < bitmaps.size(); ++i) {
+                images[i] = Image(bitmaps[i], source_rects[i], image_flags);
+            }
+            return images;
+        }
+
+        // Each glyph is stored on a page along with the same border that create_drawable would
+        // add around it, so that the glyph looks exactly like a glyph with its own image.
+        // All glyphs have the same height, so they are packed into rows ("shelves").
+        const int max_size = static_cast<int>(max_texture_size()) - 2;
+        const int cell_height = glyph_height() + 2 * glyph_margin() + 2;
+        long long total_area = 0;
+        for (const Rect& rect : source_rects) {
+            total_area += 1LL * (rect.width + 2) * cell_height;
+        }
+        // Aim for square pages, which fit into texture atlases more easily than long rows.
+        const int page_width
+            = std::min(max_size, static_cast<int>(std::ceil(std::sqrt(total_area))));
+
+        struct Placement
+        {
+            std::size_t glyph;
+            int x, y;
+        };
+        std::vector<Placement> placements;
+        int x = 0, y = 0, used_width = 0;
+        const auto create_page = [&] {
+            if (placements.empty()) {
+                return;
+            }
+            Bitmap page(used_width, y + cell_height);
+            for (const Placement& placement : placements) {
+                page.insert(apply_border_flags(image_flags, bitmaps[placement.glyph],
+                                               source_rects[placement.glyph]),
+                            placement.x, placement.y);
+            }
+            const Image page_image(page, image_flags);
+            for (const Placement& placement : placements) {
+                const Rect& source_rect = source_rects[placement.glyph];
+                images[placement.glyph] = Image(page_image.drawable().subimage(
+                    Rect { placement.x + 1, placement.y + 1, source_rect.width,
+                           source_rect.height }));
+            }
+            placements.clear();
+            x = y = used_width = 0;
+        };
+
+        for (std::size_t i = 0; i < bitmaps.size(); ++i) {
+            const int cell_width = source_rects[i].width + 2;
+            if (source_rects[i].empty() || cell_width > max_size || cell_height > max_size) {
+                // Empty glyphs do not need a texture, and huge glyphs need their own.
+                images[i] = Image(bitmaps[i], source_rects[i], image_flags);
+                continue;
+            }
+            if (x > 0 && x + cell_width > page_width) {
+                // Start a new row, or a new page if this page is full.
+                if (y + 2 * cell_height > max_size) {
+                    create_page();
+                }
+                else {
+                    x = 0;
+                    y += cell_height;
+                }
+            }
+            placements.push_back(Placement { i, x, y });
+            x += cell_width;
+            used_width = std::max(used_width, x);
+        }
+        create_page();
+
+        return images;
     }
 };
 
@@ -118,25 +645,7 @@ double Gosu::Font::text_width(const std::string& text) const
 
 double Gosu::Font::markup_width(const std::string& markup) const
 {
-    const std::unique_lock lock(m_impl->glyphs_mutex);
-
-    double width = 0;
-
-    // Split the text into lines (split_words = false) because Font doesn't implement word-wrapping.
-    MarkupParser parser(m_impl->base_flags, false, [&](const std::vector<FormattedString>& line) {
-        double line_width = 0;
-        for (const auto& part : line) {
-            for (const auto codepoint : part.text) {
-                const auto& image = m_impl->image(codepoint, part.flags);
-                double image_scale = image.height() ? 1.0 * height() / image.height() : 1.0;
-                line_width += image_scale * image.width();
-            }
-        }
-        width = std::max(width, line_width);
-    });
-    parser.parse(markup);
-
-    return width;
+    return m_impl->layout_glyphs(markup, [](const auto&...) {}).first;
 }
 
 void Gosu::Font::draw_text(const std::string& text, double x, double y, ZPos z, //
@@ -148,25 +657,28 @@ void Gosu::Font::draw_text(const std::string& text, double x, double y, ZPos z,
 void Gosu::Font::draw_markup(const std::string& markup, double x, double y, ZPos z, //
                              double scale_x, double scale_y, Color c, BlendMode mode) const
 {
-    const std::unique_lock lock(m_impl->glyphs_mutex);
+    m_impl->draw_markup(markup, 0, x, y, z, scale_x, scale_y, c, mode);
+}
 
-    double current_y = y;
-
-    // Split the text into lines (split_words = false) because Font doesn't implement word-wrapping.
-    MarkupParser parser(m_impl->base_flags, false, [&](const std::vector<FormattedString>& line) {
-        double current_x = x;
-        for (const auto& part : line) {
-            for (const auto codepoint : part.text) {
-                const auto& image = m_impl->image(codepoint, part.flags);
-                double image_scale = image.height() ? 1.0 * height() / image.height() : 1.0;
-                image.draw(current_x, current_y, z, image_scale * scale_x, image_scale * scale_y,
-                           multiply(c, part.color), mode);
-                current_x += image_scale * scale_x * image.width();
-            }
-        }
-        current_y += scale_y * height();
-    });
-    parser.parse(markup);
+void Gosu::Font::draw_markup_dilated(const std::string& markup, double dilation, double x,
+                                     double y, ZPos z, double scale_x, double scale_y, Color c,
+                                     BlendMode mode) const
+{
+    if (!m_impl->distance_field()) {
+        throw std::logic_error("Gosu::Font::draw_markup_dilated requires IF_DISTANCE_FIELD");
+    }
+
+    m_impl->draw_markup(markup, dilation, x, y, z, scale_x, scale_y, c, mode);
+}
+
+Gosu::TextLayout Gosu::Font::prepare_text(const std::string& text) const
+{
+    return prepare_markup(escape_markup(text));
+}
+
+Gosu::TextLayout Gosu::Font::prepare_markup(const std::string& markup) const
+{
+    return TextLayout(m_impl->layout_markup(markup));
 }
 
 void Gosu::Font::draw_text_rel(const std::string& text, double x, double y, ZPos z, //
@@ -197,6 +709,35 @@ void Gosu::Font::draw_markup_rel(const std::string& markup, double x, double y,
     draw_markup(markup, x, y, z, scale_x, scale_y, c, mode);
 }
 
+void Gosu::Font::preload(std::string_view characters, unsigned font_flags) const
+{
+    m_impl->preload(utf8_to_composed_utc4(characters), font_flags);
+}
+
+void Gosu::Font::preload(std::string_view characters) const
+{
+    preload(characters, m_impl->base_flags);
+}
+
+void Gosu::Font::preload(char32_t first, char32_t last, unsigned font_flags) const
+{
+    if (first > last || last > 0x10ffff) {
+        throw std::invalid_argument("Invalid codepoint range");
+    }
+
+    std::u32string codepoints;
+    codepoints.reserve(last - first + 1);
+    for (char32_t codepoint = first; codepoint <= last; ++codepoint) {
+        codepoints.push_back(codepoint);
+    }
+    m_impl->preload(std::move(codepoints), font_flags);
+}
+
+void Gosu::Font::preload(char32_t first, char32_t last) const
+{
+    preload(first, last, m_impl->base_flags);
+}
+
 void Gosu::Font::set_image(std::string_view codepoint, unsigned font_flags,
                            const Gosu::Image& image)
 {
@@ -207,7 +748,7 @@ void Gosu::Font::set_image(std::string_view codepoint, unsigned font_flags,
     }
 
     const std::unique_lock lock(m_impl->glyphs_mutex);
-    m_impl->glyphs.insert_or_assign({ .codepoint = utc4[0], .font_flags = font_flags }, image);
+    m_impl->publish_glyph({ .codepoint = utc4[0], .font_flags = font_flags }, image, 0, true);
 }
 
 void Gosu::Font::set_image(std::string_view codepoint, const Gosu::Image& image)
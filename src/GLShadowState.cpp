@@ -0,0 +1,180 @@
+#include "GLShadowState.hpp"
+#include <Gosu/Graphics.hpp>
+#include "OpenGLContext.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Only accessed from the thread that is drawing.
+    Gosu::GLShadowState current_state; // NOLINT(*-avoid-non-const-global-variables)
+
+#ifndef GOSU_IS_OPENGLES
+    int texture_units()
+    {
+        static const int units = [] {
+            GLint units = 1;
+            glGetIntegerv(GL_MAX_TEXTURE_UNITS, &units);
+            return static_cast<int>(units);
+        }();
+        return units;
+    }
+#endif
+}
+
+Gosu::GLShadowState Gosu::GLShadowState::orthographic(int width, int height, bool flipped)
+{
+    const double bottom = flipped ? 0 : height;
+    const double top = flipped ? height : 0;
+
+    GLShadowState state;
+    state.viewport_width = width;
+    state.viewport_height = height;
+    // Transposed compared to the glOrtho documentation, because Gosu applies transforms to row
+    // vectors.
+    state.projection = Transform { {
+        2.0 / width, 0, 0, 0, //
+        0, 2 / (top - bottom), 0, 0, //
+        0, 0, -1, 0, //
+        -1, -(top + bottom) / (top - bottom), 0, 1, //
+    } };
+    return state;
+}
+
+bool Gosu::GLShadowState::visible_rect(const Transform& transform, double& left, double& top,
+                                       double& right, double& bottom) const
+{
+    const auto& m = transform.matrix;
+    if (m[3] != 0 || m[7] != 0 || m[15] != 1) {
+        // Don't bother inverting perspective transforms.
+        left = top = -HUGE_VAL;
+        right = bottom = HUGE_VAL;
+        return true;
+    }
+    const double det = m[0] * m[5] - m[4] * m[1];
+    if (det == 0) {
+        return false;
+    }
+
+    // Map the corners of the framebuffer back by inverting the 2D part of the transform.
+    left = top = HUGE_VAL;
+    right = bottom = -HUGE_VAL;
+    for (double screen_x : { 0, viewport_width }) {
+        for (double screen_y : { 0, viewport_height }) {
+            const double dx = screen_x - m[12], dy = screen_y - m[13];
+            const double x = (m[5] * dx - m[4] * dy) / det;
+            const double y = (m[0] * dy - m[1] * dx) / det;
+            left = std::min(left, x);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y);
+        }
+    }
+    return true;
+}
+
+const Gosu::GLShadowState& Gosu::GLShadowState::current()
+{
+    return current_state;
+}
+
+void Gosu::GLShadowState::set_current(const GLShadowState& state)
+{
+    current_state = state;
+
+    glViewport(0, 0, static_cast<GLsizei>(state.viewport_width),
+               static_cast<GLsizei>(state.viewport_height));
+    // Gosu's row-major matrices for row vectors have the same memory layout as OpenGL's
+    // column-major matrices for column vectors, so no transposition is necessary.
+    GLfloat matrix[16];
+    for (int i = 0; i < 16; ++i) {
+        matrix[i] = static_cast<GLfloat>(state.projection.matrix[i]);
+    }
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(matrix);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void Gosu::GLShadowState::restore(unsigned modified_state)
+{
+#ifndef GOSU_IS_OPENGLES
+    if (modified_state & GLS_BLEND) {
+        GOSU_LOAD_GL_EXT(glBlendEquation, PFNGLBLENDEQUATIONPROC);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+    // Gosu always blends, but gl() disables blending before running custom code.
+    glEnable(GL_BLEND);
+
+    if (modified_state & GLS_TEXTURES) {
+        if (texture_units() > 1) {
+            GOSU_LOAD_GL_EXT(glActiveTexture, PFNGLACTIVETEXTUREPROC);
+            GOSU_LOAD_GL_EXT(glClientActiveTextureARB, PFNGLCLIENTACTIVETEXTUREARBPROC);
+            for (int unit = texture_units() - 1; unit >= 0; --unit) {
+                glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+                glDisable(GL_TEXTURE_2D);
+            }
+            glClientActiveTextureARB(GL_TEXTURE0);
+        }
+        else {
+            glDisable(GL_TEXTURE_2D);
+        }
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+    }
+
+    if (modified_state & GLS_MATRICES) {
+        // This also restores the viewport.
+        set_current(current_state);
+        glLoadIdentity();
+    }
+    glMatrixMode(GL_MODELVIEW);
+
+    if (modified_state & GLS_SCISSOR) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    if (modified_state & GLS_DEPTH_STENCIL) {
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        // Gosu::Viewport::frame clears the depth buffer, which requires it to be writable.
+        glDepthMask(GL_TRUE);
+    }
+
+    if (modified_state & GLS_SHADERS) {
+        static const bool shaders = SDL_GL_ExtensionSupported("GL_ARB_shader_objects");
+        static const bool buffers = SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object");
+        if (shaders) {
+            GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+            glUseProgram(0);
+        }
+        if (buffers) {
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+    }
+
+    if (modified_state & GLS_OTHER) {
+        glDisable(GL_ALPHA_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_FOG);
+        glDisable(GL_COLOR_LOGIC_OP);
+        glDisable(GL_LINE_STIPPLE);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glShadeModel(GL_SMOOTH);
+        glLineWidth(1);
+        // Texture uploads rely on the default unpacking of pixel rows.
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Gosu/Transform.hpp>
+
+namespace Gosu
+{
+    /// Gosu's own copy of the OpenGL state that stays the same while a DrawOpQueue is flushed:
+    /// the size of the current framebuffer and its projection matrix. Knowing these avoids
+    /// glGet* round trips around render targets (see render()), and glPushAttrib around custom
+    /// OpenGL code that declares which parts of the state it modifies (see gl()).
+    struct GLShadowState
+    {
+        /// The size of the current framebuffer (the window or a render target) in pixels.
+        int viewport_width = 0, viewport_height = 0;
+        /// Maps from framebuffer coordinates to OpenGL's normalized device coordinates. This is
+        /// the equivalent of the GL_PROJECTION matrix.
+        Transform projection = { { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+        /// Whether the current framebuffer has a depth buffer, see set_opaque_pass().
+        bool depth_buffer = false;
+
+        /// Returns a state with an orthographic projection for the given framebuffer size.
+        /// @param flipped Whether the Y axis points up instead of down. This is used for render
+        ///                targets, so that the resulting texture does not have to be flipped.
+        static GLShadowState orthographic(int width, int height, bool flipped = false);
+
+        /// Finds the bounding box of this state's framebuffer in the coordinate system that the
+        /// given transform maps into framebuffer coordinates, so that things outside of it can be
+        /// culled. The bounding box is infinite for perspective transforms.
+        /// @return false if the transform is not invertible, so that nothing can be visible.
+        bool visible_rect(const Transform& transform, double& left, double& top, double& right,
+                          double& bottom) const;
+
+        /// Returns the state that has been set most recently.
+        static const GLShadowState& current();
+        /// Stores the given state and applies it to glViewport and the GL_PROJECTION matrix.
+        static void set_current(const GLShadowState& state);
+
+        /// Resets the parts of the OpenGL state that Gosu depends on to what it expects between
+        /// two draw operations: No texturing, no scissor test, an identity GL_MODELVIEW matrix,
+        /// no shader program, and so on.
+        /// The projection and viewport are restored from current().
+        /// @param modified_state A bit mask of GLStateFlags. Only these parts are reset.
+        static void restore(unsigned modified_state);
+    };
+}
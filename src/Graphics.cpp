@@ -4,11 +4,15 @@
 #include <Gosu/Utility.hpp>
 #include "DrawOp.hpp"
 #include "DrawOpQueue.hpp"
+#include "GLShadowState.hpp"
 #include "GraphicsImpl.hpp"
 #include "Macro.hpp"
 #include "OffScreenTarget.hpp"
 #include "OpenGLContext.hpp"
+#include "TexChunk.hpp"
+#include "Texture.hpp"
 #include <algorithm>
+#include <atomic>
 #include <memory>
 
 namespace Gosu
@@ -17,16 +21,12 @@ namespace Gosu
     {
         Viewport* current_viewport_pointer = nullptr;
 
-        Viewport& current_viewport()
-        {
-            if (current_viewport_pointer == nullptr) {
-                throw std::logic_error("Gosu::Graphics can only be drawn to while rendering");
-            }
-            return *current_viewport_pointer;
-        }
-
         DrawOpQueueStack queues;
 
+        std::atomic<bool> premultiplied_alpha_enabled = false;
+
+        std::atomic<bool> opaque_pass_enabled = false;
+
         DrawOpQueue& current_queue()
         {
             if (queues.empty()) {
@@ -34,6 +34,32 @@ namespace Gosu
             }
             return queues.back();
         }
+
+#ifndef GOSU_IS_OPENGLES
+        void begin_gl(unsigned modified_state)
+        {
+            // Unless the custom code declares what it modifies, save all of the state that
+            // glPushAttrib can save, so that the code can change anything without affecting Gosu.
+            if (modified_state == GLS_ALL) {
+                glPushAttrib(GL_ALL_ATTRIB_BITS);
+                glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+            }
+            glDisable(GL_BLEND);
+            // Reset the color to white to avoid surprises.
+            // https://www.libgosu.org/cgi-bin/mwf/topic_show.pl?pid=9115#pid9115
+            glColor4ubv(reinterpret_cast<const GLubyte*>(&Color::WHITE));
+        }
+
+        void end_gl(unsigned modified_state)
+        {
+            if (modified_state == GLS_ALL) {
+                glPopClientAttrib();
+                glPopAttrib();
+            }
+            // The attribute stack does not include matrices, shader programs or buffer bindings.
+            GLShadowState::restore(modified_state);
+        }
+#endif
     }
 }
 
@@ -44,6 +70,9 @@ struct Gosu::Viewport::Impl : private Gosu::Noncopyable
     double black_width = 0.0, black_height = 0.0;
     Transform base_transform;
 
+    DebugView debug_view = DV_OFF;
+    FrameStats frame_stats;
+
     DrawOpQueueStack warmed_up_queues;
 
     void update_base_transform()
@@ -56,36 +85,6 @@ struct Gosu::Viewport::Impl : private Gosu::Noncopyable
         Transform translate_transform = Transform::translate(black_width, black_height);
         base_transform = translate_transform * scale_transform;
     }
-
-#ifndef GOSU_IS_OPENGLES
-    void begin_gl() // NOLINT(readability-convert-member-functions-to-static)
-    {
-        glPushAttrib(GL_ALL_ATTRIB_BITS);
-        glDisable(GL_BLEND);
-        // Reset the color to white to avoid surprises.
-        // https://www.libgosu.org/cgi-bin/mwf/topic_show.pl?pid=9115#pid9115
-        glColor4ubv(reinterpret_cast<const GLubyte*>(&Color::WHITE));
-        while (glGetError() != GL_NO_ERROR)
-            ;
-    }
-
-    void end_gl()
-    {
-        glPopAttrib();
-
-        // Restore matrices.
-        // TODO: Should be merged into RenderState and removed from Graphics.
-
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glViewport(0, 0, static_cast<GLsizei>(phys_width), static_cast<GLsizei>(phys_height));
-        glOrtho(0, phys_width, phys_height, 0, -1, 1);
-
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        glEnable(GL_BLEND);
-    }
-#endif
 };
 
 Gosu::Viewport::Viewport(int phys_width, int phys_height)
@@ -161,6 +160,8 @@ void Gosu::Viewport::frame(const std::function<void()>& f)
 
     queues.back().set_base_transform(m_impl->base_transform);
 
+    m_impl->frame_stats = FrameStats {};
+
     const OpenGLContext current_context(true);
 
     glClearColor(0, 0, 0, 1);
@@ -195,6 +196,16 @@ void Gosu::Viewport::frame(const std::function<void()>& f)
 
     current_viewport_pointer = nullptr;
 
+    if (m_impl->debug_view != DV_OFF) {
+        m_impl->frame_stats.overdraw = m_impl->frame_stats.covered_pixels
+            / (static_cast<double>(m_impl->phys_width) * m_impl->phys_height);
+    }
+
+    // All draw operations of this frame are done, so images can be moved between textures now.
+    compact_texture_atlases_if_requested();
+    // Evict textures that have not been drawn recently if the memory budget is exceeded.
+    Texture::finish_frame();
+
     // Clear leftover transforms, clip rects etc.
     if (queues.size() == 1) {
         queues.swap(m_impl->warmed_up_queues);
@@ -205,13 +216,37 @@ void Gosu::Viewport::frame(const std::function<void()>& f)
     }
 }
 
+void Gosu::Viewport::set_debug_view(DebugView view)
+{
+    m_impl->debug_view = view;
+}
+
+Gosu::DebugView Gosu::Viewport::debug_view() const
+{
+    return m_impl->debug_view;
+}
+
+const Gosu::FrameStats& Gosu::Viewport::frame_stats() const
+{
+    return m_impl->frame_stats;
+}
+
 void Gosu::flush()
 {
-    current_queue().perform_draw_ops_and_code();
-    current_queue().clear_queue();
+    DrawOpQueue& queue = current_queue();
+    // Render targets inside a frame are not part of its debug view.
+    if (current_viewport_pointer != nullptr && queue.mode() == QM_RENDER_TO_SCREEN) {
+        queue.perform_draw_ops_and_code(current_viewport_pointer->m_impl->debug_view,
+                                        &current_viewport_pointer->m_impl->frame_stats);
+    }
+    else {
+        queue.perform_draw_ops_and_code();
+    }
+    queue.clear_queue();
+    Texture::complete_readbacks(false);
 }
 
-void Gosu::gl(const std::function<void()>& f)
+void Gosu::gl(const std::function<void()>& f, unsigned modified_state)
 {
     if (current_queue().mode() == QM_RECORD_MACRO) {
         throw std::logic_error("Custom OpenGL is not allowed while creating a macro");
@@ -220,30 +255,27 @@ void Gosu::gl(const std::function<void()>& f)
 #ifdef GOSU_IS_OPENGLES
     throw std::logic_error("Custom OpenGL ES is not supported yet");
 #else
-    Viewport& cg = current_viewport();
-
     flush();
 
-    cg.m_impl->begin_gl();
+    begin_gl(modified_state);
 
     f();
 
-    cg.m_impl->end_gl();
+    end_gl(modified_state);
 #endif
 }
 
-void Gosu::gl(Gosu::ZPos z, const std::function<void()>& f)
+void Gosu::gl(Gosu::ZPos z, const std::function<void()>& f, unsigned modified_state)
 {
 #ifdef GOSU_IS_OPENGLES
     throw std::logic_error("Custom OpenGL ES is not supported yet");
 #else
-    const auto wrapped_f = [f] {
-        Viewport& cg = current_viewport();
-        cg.m_impl->begin_gl();
+    const auto wrapped_f = [f, modified_state] {
+        begin_gl(modified_state);
         f();
-        cg.m_impl->end_gl();
+        end_gl(modified_state);
     };
-    current_queue().gl(wrapped_f, z);
+    current_queue().gl(wrapped_f, z, modified_state);
 #endif
 }
 
@@ -259,49 +291,65 @@ void Gosu::clip_to(double x, double y, double width, double height, const std::f
     current_queue().end_clipping();
 }
 
+namespace
+{
+    void render_into_target(Gosu::OffScreenTarget& target, const std::function<void()>& f)
+    {
+        using namespace Gosu;
+
+        const int width = target.texture()->width();
+        const int height = target.texture()->height();
+
+        // Prepare for rendering at the requested size. Note the flipped vertical axis, so we
+        // don't have to vertically flip the texture afterward.
+        // Flushing a queue leaves all other OpenGL state as it found it, so only the projection
+        // and viewport need to be restored afterward.
+        const GLShadowState previous_state = GLShadowState::current();
+        GLShadowState state = GLShadowState::orthographic(width, height, true);
+        state.depth_buffer = target.has_depth_buffer();
+        GLShadowState::set_current(state);
+
+        // This is the actual render-to-texture step.
+        target.render([&] {
+            glClearColor(0, 0, 0, 0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glEnable(GL_BLEND);
+            queues.emplace_back(QM_RENDER_TO_TEXTURE);
+            f();
+            queues.back().perform_draw_ops_and_code();
+            queues.pop_back();
+        });
+
+        GLShadowState::set_current(previous_state);
+    }
+}
+
 Gosu::Image Gosu::render(int width, int height, const std::function<void()>& f,
                          unsigned image_flags)
 {
     const OpenGLContext current_context;
 
-    // Prepare for rendering at the requested size, but save the previous matrix and viewport.
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    GLint prev_viewport[4];
-    glGetIntegerv(GL_VIEWPORT, prev_viewport);
-    glViewport(0, 0, width, height);
-    // Note the flipped vertical axis in the glOrtho call, so we don't have to vertically
-    // flip the texture afterward.
-#ifdef GOSU_IS_OPENGLES
-    glOrthof(0, width, 0, height, -1, 1); // NOLINT(readability-suspicious-call-argument)
-#else
-    glOrtho(0, width, 0, height, -1, 1); // NOLINT(readability-suspicious-call-argument)
-#endif
-
-    // This is the actual render-to-texture step.
-    Image result = OffScreenTarget(width, height, image_flags).render([&] {
-#ifndef GOSU_IS_OPENGLES
-        glPushAttrib(GL_ALL_ATTRIB_BITS);
-#endif
-        glClearColor(0, 0, 0, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_BLEND);
-        queues.emplace_back(QM_RENDER_TO_TEXTURE);
-        f();
-        queues.back().perform_draw_ops_and_code();
-        queues.pop_back();
-#ifndef GOSU_IS_OPENGLES
-        glPopAttrib();
-#endif
-    });
+    const std::shared_ptr<OffScreenTarget> target
+        = OffScreenTarget::acquire(width, height, image_flags);
+    render_into_target(*target, f);
+    const std::shared_ptr<Texture>& texture = target->texture();
+    return Image(std::make_unique<TexChunk>(texture, Rect::covering(*texture), nullptr));
+}
 
-    // Restore previous matrix and glViewport.
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+void Gosu::render_into(Image& image, const std::function<void()>& f)
+{
+    const OpenGLContext current_context;
 
-    return result;
+    const auto* tex_chunk = dynamic_cast<const TexChunk*>(&image.drawable());
+    const std::shared_ptr<OffScreenTarget> target
+        = tex_chunk ? OffScreenTarget::find(*tex_chunk->texture()) : nullptr;
+    if (!target) {
+        throw std::invalid_argument("Gosu::render_into: Image was not created by Gosu::render");
+    }
+    // Re-upload the texture if it has been evicted by set_texture_memory_budget(). Otherwise, the
+    // evicted contents would overwrite what is rendered now as soon as the texture is used again.
+    target->texture()->prepare_for_drawing();
+    render_into_target(*target, f);
 }
 
 Gosu::Image Gosu::record(int width, int height, const std::function<void()>& f)
@@ -315,6 +363,18 @@ Gosu::Image Gosu::record(int width, int height, const std::function<void()>& f)
     return Image(std::move(result));
 }
 
+Gosu::VertexArrays Gosu::record_vertex_arrays(const std::function<void()>& f)
+{
+    queues.emplace_back(QM_RECORD_MACRO);
+
+    f();
+
+    VertexArrays result;
+    current_queue().compile_to(result);
+    queues.pop_back();
+    return result;
+}
+
 void Gosu::transform(const Gosu::Transform& transform, const std::function<void()>& f)
 {
     current_queue().push_transform(transform);
@@ -344,6 +404,7 @@ void Gosu::draw_triangle(double x1, double y1, Color c1, double x2, double y2, C
     op.vertices[0] = DrawOp::Vertex(x1, y1, c1);
     op.vertices[1] = DrawOp::Vertex(x2, y2, c2);
     op.vertices[2] = DrawOp::Vertex(x3, y3, c3);
+    op.opaque = true;
 #ifdef GOSU_IS_OPENGLES
     op.vertices_or_block_index = 4;
     op.vertices[3] = op.vertices[2];
@@ -362,6 +423,7 @@ void Gosu::draw_quad(double x1, double y1, Color c1, double x2, double y2, Color
     DrawOp op;
     op.render_state.mode = mode;
     op.vertices_or_block_index = 4;
+    op.opaque = true;
     op.vertices[0] = DrawOp::Vertex(x1, y1, c1);
     op.vertices[1] = DrawOp::Vertex(x2, y2, c2);
 // TODO: Should be harmonized
@@ -392,16 +454,32 @@ void Gosu::Viewport::set_physical_resolution(int phys_width, int phys_height)
 {
     m_impl->phys_width = phys_width;
     m_impl->phys_height = phys_height;
-    // TODO: Should be merged into RenderState and removed from Graphics.
     const OpenGLContext current_context;
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glViewport(0, 0, static_cast<GLsizei>(phys_width), static_cast<GLsizei>(phys_height));
-#ifdef GOSU_IS_OPENGLES
-    glOrthof(0, phys_width, phys_height, 0, -1, 1);
-#else
-    glOrtho(0, phys_width, phys_height, 0, -1, 1);
-#endif
+    GLShadowState state = GLShadowState::orthographic(phys_width, phys_height);
+    GLint depth_bits = 0;
+    glGetIntegerv(GL_DEPTH_BITS, &depth_bits);
+    state.depth_buffer = depth_bits > 0;
+    GLShadowState::set_current(state);
 
     m_impl->update_base_transform();
 }
+
+void Gosu::set_premultiplied_alpha(bool enabled)
+{
+    premultiplied_alpha_enabled = enabled;
+}
+
+bool Gosu::premultiplied_alpha()
+{
+    return premultiplied_alpha_enabled;
+}
+
+void Gosu::set_opaque_pass(bool enabled)
+{
+    opaque_pass_enabled = enabled;
+}
+
+bool Gosu::opaque_pass()
+{
+    return opaque_pass_enabled;
+}
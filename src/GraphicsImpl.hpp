@@ -30,7 +30,18 @@ namespace Gosu
     class Macro;
     struct ArrayVertex
     {
-        float tex_coords[2];
+        // The third texture coordinate is the layer for texture arrays.
+        float tex_coords[3];
+        std::uint32_t color;
+        float vertices[3];
+    };
+    /// A vertex in the fixed-function pipeline's multi-texture batches, see RenderStateManager.
+    struct BatchVertex
+    {
+        // The third texture coordinate is the layer for texture arrays.
+        float tex_coords[3];
+        // The texture unit that FragmentShader::MULTI_TEXTURE samples, as a texture coordinate.
+        float unit;
         std::uint32_t color;
         float vertices[3];
     };
@@ -56,6 +67,26 @@ namespace Gosu
 
     void register_frame();
 
+    /// Returns true if set_premultiplied_alpha() has been enabled.
+    bool premultiplied_alpha();
+
+    /// Returns true if set_opaque_pass() has been enabled.
+    bool opaque_pass();
+
+    /// Returns true if create_drawable() places a whole image of this size on a texture atlas after
+    /// passing it through apply_border_flags(). Only then can create_drawable_with_borders() be
+    /// used instead.
+    bool uses_border_pixels(int width, int height, unsigned image_flags);
+
+    /// Like create_drawable() for a whole image, but expects the result of apply_border_flags().
+    /// This lets the image cache skip that step, see border_cache_variant().
+    std::unique_ptr<Drawable> create_drawable_with_borders(const Bitmap& source_with_borders,
+                                                           unsigned image_flags);
+
+    /// Runs the atlas compaction that create_drawable() has requested since the last call, see
+    /// set_atlas_compaction_threshold(). Must be called on the drawing thread between frames.
+    void compact_texture_atlases_if_requested();
+
     inline std::string escape_markup(const std::string& text) {
         auto markup = text;
         for (std::string::size_type pos = 0; pos < markup.length(); ++pos) {
@@ -4,9 +4,57 @@
 #include <Gosu/Graphics.hpp>
 #include <Gosu/Image.hpp>
 #include <Gosu/Math.hpp>
+#include "CompressedBitmap.hpp"
 #include "EmptyDrawable.hpp"
+#include "GraphicsImpl.hpp"
+#include "ImageCache.hpp"
+#include "TexChunk.hpp"
+#include <algorithm>
 #include <stdexcept>
 
+namespace
+{
+    /// Loads an image file into a Drawable. DDS and KTX2 files are kept in their compressed format.
+    std::unique_ptr<Gosu::Drawable> load_drawable(const std::string& filename,
+                                                  unsigned image_flags)
+    {
+        // Backward compatibility: Treat '1' as IF_TILEABLE, like create_drawable() does.
+        if (image_flags == 1) {
+            image_flags = Gosu::IF_TILEABLE;
+        }
+
+        // Most images end up on a texture atlas with a border around them. Cache them after
+        // apply_border_flags() so that loading them from the cache skips that step, too.
+        const std::uint32_t border_variant = Gosu::border_cache_variant(image_flags);
+        if (const std::optional<Gosu::Bitmap> cached_bitmap
+            = Gosu::load_cached_image(filename, border_variant)) {
+            // The entry cannot be used if max_texture_size() has been lowered since.
+            if (Gosu::uses_border_pixels(cached_bitmap->width() - 2, cached_bitmap->height() - 2,
+                                         image_flags)) {
+                return Gosu::create_drawable_with_borders(*cached_bitmap, image_flags);
+            }
+        }
+        if (const std::optional<Gosu::Bitmap> cached_bitmap = Gosu::load_cached_image(filename)) {
+            return Gosu::create_drawable(*cached_bitmap, Gosu::Rect::covering(*cached_bitmap),
+                                         image_flags);
+        }
+
+        const Gosu::Buffer buffer = Gosu::load_file(filename);
+        if (Gosu::is_compressed_image(buffer)) {
+            return Gosu::create_drawable(Gosu::load_compressed_image(buffer), image_flags);
+        }
+        const Gosu::Bitmap bitmap = Gosu::load_image(buffer);
+        if (Gosu::uses_border_pixels(bitmap.width(), bitmap.height(), image_flags)) {
+            const Gosu::Bitmap bitmap_with_borders
+                = Gosu::apply_border_flags(image_flags, bitmap, Gosu::Rect::covering(bitmap));
+            Gosu::store_cached_image(filename, buffer, bitmap_with_borders, border_variant);
+            return Gosu::create_drawable_with_borders(bitmap_with_borders, image_flags);
+        }
+        Gosu::store_cached_image(filename, buffer, bitmap);
+        return Gosu::create_drawable(bitmap, Gosu::Rect::covering(bitmap), image_flags);
+    }
+}
+
 Gosu::Image::Image()
 {
     static const auto default_data_ptr = std::make_shared<EmptyDrawable>(0, 0);
@@ -14,13 +62,45 @@ Gosu::Image::Image()
 }
 
 Gosu::Image::Image(const std::string& filename, unsigned image_flags)
-    : Image(load_image_file(filename), image_flags)
+    : m_drawable(load_drawable(filename, image_flags))
 {
 }
 
 Gosu::Image::Image(const std::string& filename, const Rect& source_rect, unsigned image_flags)
-    : Image(load_image_file(filename), source_rect, image_flags)
 {
+    if (const std::optional<Bitmap> cached_bitmap = load_cached_image(filename)) {
+        m_drawable = create_drawable(*cached_bitmap, source_rect, image_flags);
+        return;
+    }
+
+    const Buffer buffer = load_file(filename);
+    if (is_compressed_image(buffer)) {
+        const CompressedBitmap compressed = load_compressed_image(buffer);
+        if (!Rect::covering(compressed).contains(source_rect)) {
+            throw std::invalid_argument("Gosu::Image: source_rect exceeds the image file");
+        }
+        // Compressed images can only be cropped to whole blocks. Upload only the blocks that
+        // overlap source_rect, then use a subimage for the exact rectangle.
+        const int block_x = source_rect.x / COMPRESSION_BLOCK_SIZE * COMPRESSION_BLOCK_SIZE;
+        const int block_y = source_rect.y / COMPRESSION_BLOCK_SIZE * COMPRESSION_BLOCK_SIZE;
+        const Rect block_rect { block_x, block_y, source_rect.right() - block_x,
+                                source_rect.bottom() - block_y };
+        std::unique_ptr<Drawable> drawable
+            = create_drawable(compressed.subimage(block_rect), image_flags);
+        if (block_rect == source_rect) {
+            m_drawable = std::move(drawable);
+        }
+        else {
+            m_drawable = drawable->subimage(Rect { source_rect.x - block_rect.x,
+                                                   source_rect.y - block_rect.y,
+                                                   source_rect.width, source_rect.height });
+        }
+    }
+    else {
+        const Bitmap bitmap = load_image(buffer);
+        store_cached_image(filename, buffer, bitmap);
+        m_drawable = create_drawable(bitmap, source_rect, image_flags);
+    }
 }
 
 Gosu::Image::Image(const Bitmap& source, unsigned image_flags)
@@ -96,6 +176,34 @@ void Gosu::Image::draw_rot(double x, double y, ZPos z, double angle, double cent
         z, mode);
 }
 
+void Gosu::Image::draw_mesh(std::span<const double> vertices, std::span<const double> uvs,
+                            std::span<const Color> colors, std::span<const std::uint32_t> indices,
+                            ZPos z, BlendMode mode) const
+{
+    const std::size_t vertex_count = vertices.size() / 2;
+    if (vertices.size() % 2 != 0 || uvs.size() != vertices.size()) {
+        throw std::invalid_argument("Gosu::Image::draw_mesh: Need one x/y and u/v per vertex");
+    }
+    if (colors.size() > 1 && colors.size() != vertex_count) {
+        throw std::invalid_argument("Gosu::Image::draw_mesh: Need one color or one per vertex");
+    }
+    if ((indices.empty() ? vertex_count : indices.size()) % 3 != 0) {
+        throw std::invalid_argument("Gosu::Image::draw_mesh: Incomplete triangle");
+    }
+    if (std::ranges::any_of(indices, [&](std::uint32_t i) { return i >= vertex_count; })) {
+        throw std::invalid_argument("Gosu::Image::draw_mesh: Index out of range");
+    }
+
+    if (dynamic_cast<const EmptyDrawable*>(m_drawable.get())) {
+        return;
+    }
+    const auto* tex_chunk = dynamic_cast<const TexChunk*>(m_drawable.get());
+    if (!tex_chunk) {
+        throw std::logic_error("Gosu::Image::draw_mesh: Image is not stored on a single texture");
+    }
+    tex_chunk->draw_mesh(vertices, uvs, colors, indices, z, mode);
+}
+
 Gosu::Drawable& Gosu::Image::drawable() const
 {
     return *m_drawable;
@@ -0,0 +1,260 @@
+#include "ImageCache.hpp"
+#include <Gosu/Bitmap.hpp>
+#include <Gosu/Buffer.hpp>
+#include <Gosu/GraphicsBase.hpp>
+#include <Gosu/Platform.hpp>
+#include <cstdint>
+#include <cstdio> // for std::snprintf
+#include <cstring> // for std::memcmp, std::memcpy
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <system_error>
+
+#ifdef GOSU_IS_WIN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char CACHE_MAGIC[8] = { 'G', 'o', 's', 'u', 'I', 'm', 'g', '\0' };
+    constexpr std::uint32_t CACHE_VERSION = 2;
+
+    /// Cache files consist of this header, followed by width * height * 4 bytes of RGBA pixels.
+    /// They are written in native byte order because they are never shared between machines.
+    struct CacheHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t width, height;
+        std::uint32_t variant;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        std::uint64_t source_hash;
+    };
+    // The header size is a multiple of 16 so that the pixel data stays aligned.
+    static_assert(sizeof(CacheHeader) == 48);
+
+    std::string cache_directory; // NOLINT(*-avoid-non-const-global-variables)
+    std::mutex cache_directory_mutex;
+
+    /// 64-bit FNV-1a: https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+    std::uint64_t fnv1a_hash(const std::uint8_t* data, std::size_t size)
+    {
+        std::uint64_t hash = 0xcbf2'9ce4'8422'2325;
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 0x0000'0100'0000'01b3;
+        }
+        return hash;
+    }
+
+    std::filesystem::path utf8_path(const std::string& filename)
+    {
+        return std::filesystem::path(std::u8string(filename.begin(), filename.end()));
+    }
+
+    /// Returns the cache file for the given image file and variant, or an empty path if caching is
+    /// disabled.
+    std::filesystem::path cache_path_for(const std::string& filename, std::uint32_t variant)
+    {
+        std::string directory;
+        {
+            const std::scoped_lock lock(cache_directory_mutex);
+            directory = cache_directory;
+        }
+        if (directory.empty()) {
+            return {};
+        }
+
+        std::error_code ec;
+        const std::u8string absolute
+            = std::filesystem::absolute(utf8_path(filename), ec).u8string();
+        const std::uint64_t hash
+            = fnv1a_hash(reinterpret_cast<const std::uint8_t*>(absolute.data()), absolute.size());
+        char name[40];
+        std::snprintf(name, sizeof name, "%016llx.%x.gosuimg",
+                      static_cast<unsigned long long>(hash), static_cast<unsigned>(variant));
+        return utf8_path(directory) / name;
+    }
+
+    /// Returns the size and modification time of a file, or false if it does not exist.
+    bool file_stats(const std::filesystem::path& path, std::uint64_t& size, std::int64_t& mtime)
+    {
+        std::error_code ec;
+        size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return false;
+        }
+        mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        return !ec;
+    }
+
+    /// Writes a cache file through a temporary file that is then renamed, so that other processes
+    /// never map a partial entry, and existing mappings of the old file remain untouched.
+    void write_cache_file(const std::filesystem::path& cache_path, const CacheHeader& header,
+                          const std::uint8_t* pixels, std::size_t pixel_size)
+    {
+        std::filesystem::path temporary_path = cache_path;
+        temporary_path += ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof header);
+        file.write(reinterpret_cast<const char*>(pixels), static_cast<std::streamsize>(pixel_size));
+        file.close();
+
+        std::error_code ec;
+        if (file.fail()) {
+            // The cache is only an optimization, so errors (such as full disks) are ignored.
+            std::filesystem::remove(temporary_path, ec);
+            return;
+        }
+        // On Windows, this fails while the old file is still mapped. The entry is then simply
+        // refreshed at a later time.
+        std::filesystem::rename(temporary_path, cache_path, ec);
+        if (ec) {
+            std::filesystem::remove(temporary_path, ec);
+        }
+    }
+
+    /// Maps a file into memory with copy-on-write semantics. Changes to the returned buffer are
+    /// not written back to the file. Returns an empty buffer on failure.
+    Gosu::Buffer map_file(const std::filesystem::path& path)
+    {
+#ifdef GOSU_IS_WIN
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return {};
+        }
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        }
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            return {};
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        // The view keeps the mapping alive.
+        CloseHandle(mapping);
+        if (view == nullptr) {
+            return {};
+        }
+        return Gosu::Buffer(view, static_cast<std::size_t>(size.QuadPart),
+                            [](void* p) { UnmapViewOfFile(p); });
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return {};
+        }
+        struct stat stats {};
+        void* view = MAP_FAILED;
+        if (fstat(fd, &stats) == 0 && stats.st_size > 0) {
+            view = mmap(nullptr, static_cast<std::size_t>(stats.st_size), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fd, 0);
+        }
+        // The mapping stays valid after closing the file descriptor.
+        close(fd);
+        if (view == MAP_FAILED) {
+            return {};
+        }
+        const auto size = static_cast<std::size_t>(stats.st_size);
+        return Gosu::Buffer(view, size, [size](void* p) { munmap(p, size); });
+#endif
+    }
+}
+
+void Gosu::set_image_cache_directory(const std::string& directory)
+{
+    if (!directory.empty()) {
+        std::filesystem::create_directories(utf8_path(directory));
+    }
+    const std::scoped_lock lock(cache_directory_mutex);
+    cache_directory = directory;
+}
+
+std::optional<Gosu::Bitmap> Gosu::load_cached_image(const std::string& filename,
+                                                    std::uint32_t variant)
+{
+    const std::filesystem::path cache_path = cache_path_for(filename, variant);
+    std::uint64_t source_size;
+    std::int64_t source_mtime;
+    if (cache_path.empty() || !file_stats(utf8_path(filename), source_size, source_mtime)) {
+        return std::nullopt;
+    }
+
+    Buffer mapping = map_file(cache_path);
+    if (mapping.size() < sizeof(CacheHeader)) {
+        return std::nullopt;
+    }
+    CacheHeader header;
+    std::memcpy(&header, mapping.data(), sizeof header);
+    const std::size_t pixel_size = std::size_t { header.width } * header.height * sizeof(Color);
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0
+        || header.version != CACHE_VERSION || header.variant != variant
+        || header.source_size != source_size
+        || mapping.size() != sizeof header + pixel_size) {
+        return std::nullopt;
+    }
+
+    if (header.source_mtime != source_mtime) {
+        // The file may only have been touched, e.g. by a version control system. Reading and
+        // hashing it is still much faster than decoding it.
+        const Buffer source = load_file(filename);
+        if (fnv1a_hash(source.data(), source.size()) != header.source_hash) {
+            return std::nullopt;
+        }
+        // Remember the new modification time so that the next launch can skip the hash. The
+        // file must not be modified in place because its pages are still mapped (below).
+        header.source_mtime = source_mtime;
+        write_cache_file(cache_path, header, mapping.data() + sizeof header, pixel_size);
+    }
+
+    // Hand the mapped pixels to the Bitmap without copying them. The Bitmap's buffer owns the
+    // whole mapping; its deleter unmaps it, starting from the header.
+    std::uint8_t* pixel_data = mapping.data() + sizeof header;
+    Buffer pixels(pixel_data, pixel_size,
+                  [shared_mapping = std::make_shared<Buffer>(std::move(mapping))](void*) mutable {
+                      shared_mapping.reset();
+                  });
+    return Bitmap(static_cast<int>(header.width), static_cast<int>(header.height),
+                  std::move(pixels));
+}
+
+void Gosu::store_cached_image(const std::string& filename, const Buffer& source,
+                              const Bitmap& bitmap, std::uint32_t variant)
+{
+    const std::filesystem::path cache_path = cache_path_for(filename, variant);
+    CacheHeader header {};
+    if (cache_path.empty() || !file_stats(utf8_path(filename), header.source_size,
+                                          header.source_mtime)) {
+        return;
+    }
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC);
+    header.version = CACHE_VERSION;
+    header.width = static_cast<std::uint32_t>(bitmap.width());
+    header.height = static_cast<std::uint32_t>(bitmap.height());
+    header.variant = variant;
+    header.source_hash = fnv1a_hash(source.data(), source.size());
+    write_cache_file(cache_path, header, reinterpret_cast<const std::uint8_t*>(bitmap.data()),
+                     std::size_t { header.width } * header.height * sizeof(Color));
+}
+
+std::uint32_t Gosu::border_cache_variant(unsigned image_flags)
+{
+    // Backward compatibility: Treat '1' as IF_TILEABLE, like create_drawable() does.
+    if (image_flags == 1) {
+        image_flags = IF_TILEABLE;
+    }
+    // Only the tileable edges affect the result of apply_border_flags().
+    return 0x100 | (image_flags & IF_TILEABLE);
+}
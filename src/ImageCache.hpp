@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace Gosu
+{
+    /// Returns the decoded contents of an image file from the cache that has been enabled through
+    /// set_image_cache_directory(), or std::nullopt if the cache is disabled or has no valid entry.
+    /// The returned Bitmap refers to a private, memory-mapped view of the cache file.
+    /// @param variant Selects one of several independent entries for the same file, see
+    ///                border_cache_variant().
+    std::optional<Bitmap> load_cached_image(const std::string& filename,
+                                            std::uint32_t variant = 0);
+
+    /// Stores the decoded contents of an image file in the cache, if it is enabled.
+    /// @param source The contents of the image file, which are used to validate the cache entry.
+    void store_cached_image(const std::string& filename, const Buffer& source,
+                            const Bitmap& bitmap, std::uint32_t variant = 0);
+
+    /// Returns the cache variant for pixels that have already been passed through
+    /// apply_border_flags() with the given image flags. Variant 0 holds the decoded pixels.
+    std::uint32_t border_cache_variant(unsigned image_flags);
+}
@@ -2,13 +2,116 @@
 #include <Gosu/Image.hpp>
 #include <Gosu/Utility.hpp>
 #include "DrawOpQueue.hpp"
+#include "GLShadowState.hpp"
+#include "ShaderPipeline.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
 #include <stdexcept>
+#include <utility>
 
 struct Gosu::Macro::Impl : private Gosu::Noncopyable
 {
     VertexArrays vertex_arrays;
     int width, height;
 
+    // The quads of large macros are sorted into a coarse grid of buckets when they are recorded,
+    // so that draw_vertex_arrays() can skip all buckets that are outside the framebuffer.
+    static constexpr double BUCKET_SIZE = 256;
+
+    struct Bucket
+    {
+        // The bounding box of all quads in this bucket, in macro coordinates.
+        double left = HUGE_VAL, top = HUGE_VAL, right = -HUGE_VAL, bottom = -HUGE_VAL;
+        // The indices of the quads in this bucket, in drawing order.
+        std::vector<std::uint32_t> quads;
+    };
+    // The buckets of each vertex array, or nothing if the macro is too small to be worth culling.
+    std::vector<std::vector<Bucket>> buckets;
+
+    void build_buckets()
+    {
+        if (width <= 2 * BUCKET_SIZE && height <= 2 * BUCKET_SIZE) {
+            return;
+        }
+
+        for (const auto& vertex_array : vertex_arrays) {
+            // Each quad goes into the bucket that contains its top left corner. Quads may extend
+            // into other cells of the grid, which is why each bucket has its own bounding box.
+            std::map<std::pair<int, int>, Bucket> grid;
+            const std::vector<ArrayVertex>& vertices = vertex_array.vertices;
+            for (std::size_t quad = 0; quad * 4 + 3 < vertices.size(); ++quad) {
+                double left = HUGE_VAL, top = HUGE_VAL, right = -HUGE_VAL, bottom = -HUGE_VAL;
+                for (std::size_t i = quad * 4; i < quad * 4 + 4; ++i) {
+                    left = std::min<double>(left, vertices[i].vertices[0]);
+                    right = std::max<double>(right, vertices[i].vertices[0]);
+                    top = std::min<double>(top, vertices[i].vertices[1]);
+                    bottom = std::max<double>(bottom, vertices[i].vertices[1]);
+                }
+                Bucket& bucket = grid[{ static_cast<int>(std::floor(left / BUCKET_SIZE)),
+                                        static_cast<int>(std::floor(top / BUCKET_SIZE)) }];
+                bucket.left = std::min(bucket.left, left);
+                bucket.right = std::max(bucket.right, right);
+                bucket.top = std::min(bucket.top, top);
+                bucket.bottom = std::max(bucket.bottom, bottom);
+                bucket.quads.push_back(static_cast<std::uint32_t>(quad));
+            }
+
+            std::vector<Bucket>& array_buckets = buckets.emplace_back();
+            array_buckets.reserve(grid.size());
+            for (auto& [cell, bucket] : grid) {
+                array_buckets.push_back(std::move(bucket));
+            }
+        }
+    }
+
+    // Collects the quads of the vertex array with the given index that intersect the visible
+    // rectangle, in drawing order. Returns false (without collecting anything) if no bucket is
+    // culled, so that the whole vertex array can be drawn as it is.
+    bool visible_quads(std::size_t array_index, double left, double top, double right,
+                       double bottom, std::vector<std::uint32_t>& quads) const
+    {
+        quads.clear();
+        if (buckets.empty()) {
+            return false;
+        }
+        const std::vector<Bucket>& array_buckets = buckets[array_index];
+        const auto is_visible = [&](const Bucket& bucket) {
+            return bucket.right >= left && bucket.left <= right && bucket.bottom >= top
+                && bucket.top <= bottom;
+        };
+        if (std::ranges::all_of(array_buckets, is_visible)) {
+            return false;
+        }
+
+        // Overlapping quads must still be drawn in the order in which they were recorded. The
+        // quads of each bucket are already in that order, so merging them is enough.
+        using Cursor = std::pair<const std::uint32_t*, const std::uint32_t*>;
+        std::vector<Cursor> heap;
+        for (const Bucket& bucket : array_buckets) {
+            if (is_visible(bucket) && !bucket.quads.empty()) {
+                heap.emplace_back(bucket.quads.data(), bucket.quads.data() + bucket.quads.size());
+            }
+        }
+        const auto later = [](const Cursor& lhs, const Cursor& rhs) {
+            return *lhs.first > *rhs.first;
+        };
+        std::ranges::make_heap(heap, later);
+        while (!heap.empty()) {
+            std::ranges::pop_heap(heap, later);
+            Cursor& cursor = heap.back();
+            quads.push_back(*cursor.first++);
+            if (cursor.first == cursor.second) {
+                heap.pop_back();
+            }
+            else {
+                std::ranges::push_heap(heap, later);
+            }
+        }
+        return true;
+    }
+
     // Solves the 2x2 linear system for x:
     // (a11 a12) (x1) = (b1)
     // (a21 a22) (x2) = (b2)
@@ -129,12 +232,66 @@ struct Gosu::Macro::Impl : private Gosu::Noncopyable
 
         Transform transform = find_transform_for_target(x1, y1, x2, y2, x3, y3, x4, y4);
 
+        // Combine the macro's transform with the one that was set up for this GL block.
+        Transform modelview;
+        glGetDoublev(GL_MODELVIEW_MATRIX, modelview.matrix.data());
+        const Transform full_transform = transform * modelview;
+
+        double left = 0, top = 0, right = 0, bottom = 0;
+        if (!buckets.empty()
+            && !GLShadowState::current().visible_rect(full_transform, left, top, right, bottom)) {
+            return;
+        }
+        std::vector<std::uint32_t> quads;
+
+        if (ShaderPipeline::enabled()) {
+            // Draw all vertex arrays in as few draw calls as possible.
+            ShaderPipeline pipeline;
+            std::size_t array_index = 0;
+            for (const auto& vertex_array : vertex_arrays) {
+                const bool culled = visible_quads(array_index++, left, top, right, bottom, quads);
+                if (!culled) {
+                    pipeline.draw(vertex_array, full_transform);
+                }
+                else if (!quads.empty()) {
+                    pipeline.draw(vertex_array, full_transform, &quads);
+                }
+            }
+            return;
+        }
+
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnableClientState(GL_VERTEX_ARRAY);
+
+        std::vector<GLuint> indices;
+        std::size_t array_index = 0;
         for (const auto& vertex_array : vertex_arrays) {
+            const bool culled = visible_quads(array_index++, left, top, right, bottom, quads);
+            if (culled && quads.empty()) {
+                continue;
+            }
             glPushMatrix();
             vertex_array.render_state.apply();
             glMultMatrixd(transform.matrix.data());
-            glInterleavedArrays(GL_T2F_C4UB_V3F, 0, &vertex_array.vertices[0]);
-            glDrawArrays(GL_QUADS, 0, (GLsizei) vertex_array.vertices.size());
+            // There is no glInterleavedArrays format with three texture coordinates.
+            const ArrayVertex& first = vertex_array.vertices[0];
+            glTexCoordPointer(3, GL_FLOAT, sizeof(ArrayVertex), first.tex_coords);
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ArrayVertex), &first.color);
+            glVertexPointer(3, GL_FLOAT, sizeof(ArrayVertex), first.vertices);
+            if (culled) {
+                indices.clear();
+                for (std::uint32_t quad : quads) {
+                    for (GLuint i = 0; i < 4; ++i) {
+                        indices.push_back(quad * 4 + i);
+                    }
+                }
+                glDrawElements(GL_QUADS, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT,
+                               indices.data());
+            }
+            else {
+                glDrawArrays(GL_QUADS, 0, (GLsizei) vertex_array.vertices.size());
+            }
             glPopMatrix();
         }
 #endif
@@ -147,6 +304,7 @@ Gosu::Macro::Macro(DrawOpQueue& queue, int width, int height)
     pimpl->width = width;
     pimpl->height = height;
     queue.compile_to(pimpl->vertex_arrays);
+    pimpl->build_buckets();
 }
 
 int Gosu::Macro::width() const
@@ -1,28 +1,56 @@
 #include "OffScreenTarget.hpp"
 #include <Gosu/Image.hpp>
 #include <Gosu/Platform.hpp>
+#include "GraphicsImpl.hpp"
 #include "OpenGLContext.hpp"
 #include "Texture.hpp"
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #ifndef GOSU_IS_IPHONE
-#include <SDL3/SDL.h> // for SDL_GL_GetProcAddress
+#include <SDL3/SDL.h> // for SDL_GL_ExtensionSupported
 #endif
 
-#ifdef GOSU_IS_OPENGLES
-#define GOSU_LOAD_GL_EXT(fn, type) static auto fn = fn##OES
-#define GOSU_GL_CONST(name) name##_OES
-#define GOSU_GL_DEPTH_COMPONENT GL_DEPTH_COMPONENT16_OES
-#else
-#define GOSU_LOAD_GL_EXT(fn, type)                                                                 \
-    static auto fn = reinterpret_cast<type>(SDL_GL_GetProcAddress(#fn));                           \
-    if ((fn) == nullptr) {                                                                         \
-        throw std::runtime_error("Unable to load " #fn);                                           \
+namespace
+{
+    /// At most this many unused targets are kept around. Targets that are still referenced by an
+    /// Image do not count towards this limit.
+    constexpr std::size_t MAX_UNUSED_TARGETS = 4;
+
+    /// Targets can only be reused for the same size and settings.
+    struct PoolKey
+    {
+        int width, height;
+        bool retro, depth_buffer, premultiplied;
+
+        auto operator<=>(const PoolKey&) const = default;
+    };
+
+    struct PoolEntry
+    {
+        std::shared_ptr<Gosu::OffScreenTarget> target;
+        /// The value of acquire_counter when this target was last returned by acquire().
+        std::uint64_t last_acquired;
+    };
+
+    /// The pool is intentionally leaked so that its OpenGL objects are not deleted during static
+    /// destruction, when the OpenGL context may already be unusable.
+    std::multimap<PoolKey, PoolEntry>& target_pool = *new std::multimap<PoolKey, PoolEntry>;
+    std::uint64_t acquire_counter = 0;
+    std::mutex target_pool_mutex;
+
+    /// A target is unused if only the pool refers to it and to its texture.
+    bool is_unused(const std::pair<const PoolKey, PoolEntry>& pool_item)
+    {
+        const std::shared_ptr<Gosu::OffScreenTarget>& target = pool_item.second.target;
+        return target.use_count() == 1 && target->texture().use_count() == 1;
     }
-#define GOSU_GL_CONST(name) name
-#define GOSU_GL_DEPTH_COMPONENT GL_DEPTH_COMPONENT
-#endif
+}
 
 Gosu::OffScreenTarget::OffScreenTarget(int width, int height, unsigned image_flags)
-    : r_renderbuffer(static_cast<GLuint>(-1)),
+    : m_renderbuffer(static_cast<GLuint>(-1)),
       m_framebuffer(static_cast<GLuint>(-1))
 {
 #ifndef GOSU_IS_IPHONE
@@ -36,17 +64,20 @@ Gosu::OffScreenTarget::OffScreenTarget(int width, int height, unsigned image_fla
     // Create a new texture that will be our rendering target.
     m_texture = std::make_shared<Texture>(width, height, image_flags & IF_RETRO);
 
-    // Besides the texture, also create a renderbuffer for depth information.
-    // Gosu doesn't use this, but custom OpenGL code might.
-    GOSU_LOAD_GL_EXT(glGenRenderbuffers, PFNGLGENRENDERBUFFERSPROC);
-    glGenRenderbuffers(1, &r_renderbuffer);
+    if (!(image_flags & IF_NO_DEPTH_BUFFER)) {
+        // Besides the texture, also create a renderbuffer for depth information.
+        // Gosu doesn't use this, but custom OpenGL code might.
+        GOSU_LOAD_GL_EXT(glGenRenderbuffers, PFNGLGENRENDERBUFFERSPROC);
+        glGenRenderbuffers(1, &m_renderbuffer);
 
-    GOSU_LOAD_GL_EXT(glBindRenderbuffer, PFNGLBINDRENDERBUFFERPROC);
-    glBindRenderbuffer(GOSU_GL_CONST(GL_RENDERBUFFER), r_renderbuffer);
+        GOSU_LOAD_GL_EXT(glBindRenderbuffer, PFNGLBINDRENDERBUFFERPROC);
+        glBindRenderbuffer(GOSU_GL_CONST(GL_RENDERBUFFER), m_renderbuffer);
 
-    GOSU_LOAD_GL_EXT(glRenderbufferStorage, PFNGLRENDERBUFFERSTORAGEPROC);
-    glRenderbufferStorage(GOSU_GL_CONST(GL_RENDERBUFFER), GOSU_GL_DEPTH_COMPONENT, width, height);
-    glBindRenderbuffer(GOSU_GL_CONST(GL_RENDERBUFFER), 0);
+        GOSU_LOAD_GL_EXT(glRenderbufferStorage, PFNGLRENDERBUFFERSTORAGEPROC);
+        glRenderbufferStorage(GOSU_GL_CONST(GL_RENDERBUFFER), GOSU_GL_DEPTH_COMPONENT, width,
+                              height);
+        glBindRenderbuffer(GOSU_GL_CONST(GL_RENDERBUFFER), 0);
+    }
 
     // Now tie everything together.
     GOSU_LOAD_GL_EXT(glGenFramebuffers, PFNGLGENFRAMEBUFFERSPROC);
@@ -59,16 +90,22 @@ Gosu::OffScreenTarget::OffScreenTarget(int width, int height, unsigned image_fla
     glFramebufferTexture2D(GOSU_GL_CONST(GL_FRAMEBUFFER), GOSU_GL_CONST(GL_COLOR_ATTACHMENT0),
                            GL_TEXTURE_2D, m_texture->tex_name(), 0);
 
-    GOSU_LOAD_GL_EXT(glFramebufferRenderbuffer, PFNGLFRAMEBUFFERRENDERBUFFERPROC);
-    glFramebufferRenderbuffer(GOSU_GL_CONST(GL_FRAMEBUFFER), GOSU_GL_CONST(GL_DEPTH_ATTACHMENT),
-                              GOSU_GL_CONST(GL_RENDERBUFFER), r_renderbuffer);
+    if (has_depth_buffer()) {
+        GOSU_LOAD_GL_EXT(glFramebufferRenderbuffer, PFNGLFRAMEBUFFERRENDERBUFFERPROC);
+        glFramebufferRenderbuffer(GOSU_GL_CONST(GL_FRAMEBUFFER),
+                                  GOSU_GL_CONST(GL_DEPTH_ATTACHMENT),
+                                  GOSU_GL_CONST(GL_RENDERBUFFER), m_renderbuffer);
+    }
+    glBindFramebuffer(GOSU_GL_CONST(GL_FRAMEBUFFER), 0);
 }
 
 Gosu::OffScreenTarget::~OffScreenTarget()
 {
     try {
-        GOSU_LOAD_GL_EXT(glDeleteRenderbuffers, PFNGLDELETERENDERBUFFERSPROC);
-        glDeleteRenderbuffers(1, &r_renderbuffer);
+        if (has_depth_buffer()) {
+            GOSU_LOAD_GL_EXT(glDeleteRenderbuffers, PFNGLDELETERENDERBUFFERSPROC);
+            glDeleteRenderbuffers(1, &m_renderbuffer);
+        }
 
         GOSU_LOAD_GL_EXT(glDeleteFramebuffers, PFNGLDELETEFRAMEBUFFERSPROC);
         glDeleteFramebuffers(1, &m_framebuffer);
@@ -79,7 +116,65 @@ Gosu::OffScreenTarget::~OffScreenTarget()
     // GCOV_EXCL_END
 }
 
-Gosu::Image Gosu::OffScreenTarget::render(const std::function<void ()>& f)
+std::shared_ptr<Gosu::OffScreenTarget> Gosu::OffScreenTarget::acquire(int width, int height,
+                                                                      unsigned image_flags)
+{
+    const PoolKey key { .width = width,
+                        .height = height,
+                        .retro = (image_flags & IF_RETRO) != 0,
+                        .depth_buffer = (image_flags & IF_NO_DEPTH_BUFFER) == 0,
+                        .premultiplied = premultiplied_alpha() };
+
+    const std::scoped_lock lock(target_pool_mutex);
+    ++acquire_counter;
+    std::shared_ptr<OffScreenTarget> result;
+    const auto [begin, end] = target_pool.equal_range(key);
+    if (const auto it = std::find_if(begin, end, is_unused); it != end) {
+        it->second.last_acquired = acquire_counter;
+        result = it->second.target;
+        // Re-upload the texture if it has been evicted by set_texture_memory_budget().
+        result->texture()->prepare_for_drawing();
+    }
+
+    // Only keep a few unused targets around. Delete the least recently used ones first.
+    for (std::size_t unused_targets = std::ranges::count_if(target_pool, is_unused);
+         unused_targets > MAX_UNUSED_TARGETS; --unused_targets) {
+        auto oldest = target_pool.end();
+        for (auto it = target_pool.begin(); it != target_pool.end(); ++it) {
+            if (is_unused(*it)
+                && (oldest == target_pool.end()
+                    || it->second.last_acquired < oldest->second.last_acquired)) {
+                oldest = it;
+            }
+        }
+        target_pool.erase(oldest);
+    }
+
+    if (!result) {
+        result = std::make_shared<OffScreenTarget>(width, height, image_flags);
+        target_pool.emplace(key, PoolEntry { result, acquire_counter });
+    }
+    return result;
+}
+
+std::shared_ptr<Gosu::OffScreenTarget> Gosu::OffScreenTarget::find(const Texture& texture)
+{
+    const std::scoped_lock lock(target_pool_mutex);
+    const auto it = std::ranges::find_if(target_pool, [&](const auto& pool_item) {
+        return pool_item.second.target->texture().get() == &texture;
+    });
+    return it == target_pool.end() ? nullptr : it->second.target;
+}
+
+void Gosu::OffScreenTarget::release_unused()
+{
+    // Deleting the targets deletes their OpenGL objects.
+    const OpenGLContext current_context;
+    const std::scoped_lock lock(target_pool_mutex);
+    std::erase_if(target_pool, is_unused);
+}
+
+void Gosu::OffScreenTarget::render(const std::function<void ()>& f)
 {
     GOSU_LOAD_GL_EXT(glBindFramebuffer, PFNGLBINDFRAMEBUFFERPROC);
     glBindFramebuffer(GOSU_GL_CONST(GL_FRAMEBUFFER), m_framebuffer);
@@ -87,6 +182,7 @@ Gosu::Image Gosu::OffScreenTarget::render(const std::function<void ()>& f)
     GOSU_LOAD_GL_EXT(glCheckFramebufferStatus, PFNGLCHECKFRAMEBUFFERSTATUSPROC);
     GLenum status = glCheckFramebufferStatus(GOSU_GL_CONST(GL_FRAMEBUFFER));
     if (status != GOSU_GL_CONST(GL_FRAMEBUFFER_COMPLETE)) {
+        glBindFramebuffer(GOSU_GL_CONST(GL_FRAMEBUFFER), 0);
         throw std::runtime_error("Incomplete framebuffer");
     }
 
@@ -98,6 +194,4 @@ Gosu::Image Gosu::OffScreenTarget::render(const std::function<void ()>& f)
         throw;
     }
     glBindFramebuffer(GOSU_GL_CONST(GL_FRAMEBUFFER), 0);
-
-    return Image(std::make_unique<TexChunk>(m_texture, Rect::covering(*m_texture), nullptr));
 }
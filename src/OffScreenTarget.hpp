@@ -7,19 +7,36 @@
 
 namespace Gosu
 {
-    class Image;
     class Texture;
 
+    /// A framebuffer object that renders into a texture, used to implement render() and
+    /// render_into(). Targets are kept in a pool after use, so that repeated render() calls of the
+    /// same size do not have to create new OpenGL objects.
     class OffScreenTarget : private Noncopyable
     {
         std::shared_ptr<Texture> m_texture;
-        std::uint32_t r_renderbuffer;
+        std::uint32_t m_renderbuffer;
         std::uint32_t m_framebuffer;
 
     public:
+        /// @param image_flags Only IF_RETRO and IF_NO_DEPTH_BUFFER are taken into account.
         OffScreenTarget(int width, int height, unsigned image_flags);
         ~OffScreenTarget();
 
-        Gosu::Image render(const std::function<void ()>& f);
+        /// Returns a pooled target that can be reused for the given size and flags, or creates a
+        /// new one. A pooled target can be reused once no Image (or draw operation) refers to its
+        /// texture anymore.
+        static std::shared_ptr<OffScreenTarget> acquire(int width, int height,
+                                                        unsigned image_flags);
+        /// Returns the pooled target that renders into the given texture, or nullptr.
+        static std::shared_ptr<OffScreenTarget> find(const Texture& texture);
+        /// Deletes all pooled targets that are currently unused.
+        static void release_unused();
+
+        const std::shared_ptr<Texture>& texture() const { return m_texture; }
+        bool has_depth_buffer() const { return m_renderbuffer != static_cast<std::uint32_t>(-1); }
+
+        /// Runs f while this target is bound as the framebuffer.
+        void render(const std::function<void ()>& f);
     };
 }
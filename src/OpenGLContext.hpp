@@ -13,6 +13,23 @@
 #endif
 
 #include <mutex>
+#include <stdexcept>
+
+// Loads OpenGL functions that are not part of OpenGL 1.1 (or OpenGL ES 1.1) into a local variable.
+// The function pointer is only resolved once per call site.
+#ifdef GOSU_IS_OPENGLES
+#define GOSU_LOAD_GL_EXT(fn, type) static auto fn = fn##OES
+#define GOSU_GL_CONST(name) name##_OES
+#define GOSU_GL_DEPTH_COMPONENT GL_DEPTH_COMPONENT16_OES
+#else
+#define GOSU_LOAD_GL_EXT(fn, type)                                                                 \
+    static auto fn = reinterpret_cast<type>(SDL_GL_GetProcAddress(#fn));                           \
+    if ((fn) == nullptr) {                                                                         \
+        throw std::runtime_error("Unable to load " #fn);                                           \
+    }
+#define GOSU_GL_CONST(name) name
+#define GOSU_GL_DEPTH_COMPONENT GL_DEPTH_COMPONENT
+#endif
 
 namespace Gosu
 {
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <Gosu/Graphics.hpp>
 #include <Gosu/Transform.hpp>
 #include "ClipRectStack.hpp"
 #include "GraphicsImpl.hpp"
 #include "OpenGLContext.hpp"
+#include "Shaders.hpp"
 #include "Texture.hpp"
+#include <algorithm>
+#include <functional>
 #include <optional>
+#include <vector>
 
 // Properties that potentially need to be changed between each draw operation.
 // This does not include the color or vertex data of the actual quads.
@@ -21,28 +26,81 @@ struct Gosu::RenderState
     {
     }
 
+    // Images on different layers of the same texture array can be drawn without rebinding.
+    static bool same_binding(const std::shared_ptr<Texture>& lhs,
+                             const std::shared_ptr<Texture>& rhs)
+    {
+        return lhs == rhs || (lhs && rhs && lhs->array() && lhs->array() == rhs->array());
+    }
+
     bool operator==(const RenderState& rhs) const
     {
-        return texture == rhs.texture &&
+        return same_binding(texture, rhs.texture) &&
             transform == rhs.transform &&
             clip_rect == rhs.clip_rect &&
             mode == rhs.mode;
     }
 
+    // Texture arrays and distance fields need their own fragment shaders, so they cannot be bound
+    // to one of the texture units used by FragmentShader::MULTI_TEXTURE.
+    static bool uses_texture_units(const Texture& texture)
+    {
+        return !texture.array() && texture.format() != TextureFormat::DISTANCE_FIELD;
+    }
+
+    static void bind_texture(const Texture& texture)
+    {
+        #ifndef GOSU_IS_OPENGLES
+        if (texture.array()) {
+            // Fixed-function texturing does not support texture arrays, use a shader instead.
+            glDisable(GL_TEXTURE_2D);
+            use_fragment_shader(FragmentShader::TEXTURE_ARRAY);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture.tex_name());
+            return;
+        }
+        if (texture.format() == TextureFormat::DISTANCE_FIELD) {
+            // Without shaders, distance fields are drawn as blurry alpha masks.
+            static const bool shader_supported
+                = fragment_shader_supported(FragmentShader::DISTANCE_FIELD);
+            if (shader_supported) {
+                use_fragment_shader(premultiplied_alpha()
+                                        ? FragmentShader::DISTANCE_FIELD_PREMULTIPLIED
+                                        : FragmentShader::DISTANCE_FIELD);
+                glEnable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, texture.tex_name());
+                return;
+            }
+        }
+        #endif
+        use_fragment_shader(FragmentShader::NONE);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, texture.tex_name());
+    }
+
+    static void unbind_texture()
+    {
+        use_fragment_shader(FragmentShader::NONE);
+        glDisable(GL_TEXTURE_2D);
+    }
+
     void apply_texture() const
     {
         if (texture) {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, texture->tex_name());
+            texture->prepare_for_drawing();
+            bind_texture(*texture);
         }
         else {
-            glDisable(GL_TEXTURE_2D);
+            unbind_texture();
         }
     }
 
     void apply_alpha_mode() const
     {
-        if (mode == BM_ADD) {
+        if (premultiplied_alpha()) {
+            // DrawOpQueue usually turns BM_ADD into BM_DEFAULT with an alpha value of zero.
+            glBlendFunc(mode == BM_MULTIPLY ? GL_DST_COLOR : GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        else if (mode == BM_ADD) {
             glBlendFunc(GL_SRC_ALPHA, GL_ONE);
         }
         else if (mode == BM_MULTIPLY) {
@@ -79,6 +137,58 @@ struct Gosu::RenderState
 // changes to OpenGL if the new state is really different.
 class Gosu::RenderStateManager : private Gosu::RenderState, private Gosu::Noncopyable
 {
+    // For multi-texture batching: The number of texture units to use (or 0), and the textures
+    // that are currently bound to texture units 0, 1, 2...
+    const int max_texture_units = multi_texture_units();
+    std::vector<std::shared_ptr<Texture>> texture_units;
+    // The texture unit of the current texture, passed along with each vertex in batched_vertices.
+    GLfloat texture_unit = 0;
+    // Triangles that have not been drawn yet; they are all drawn in one call by flush_batch().
+    std::vector<BatchVertex> batched_vertices;
+
+    // Returns true if the vertices of new_texture can be drawn in the same batch as those of the
+    // current texture, without any changes to the OpenGL state.
+    bool can_batch_texture(const std::shared_ptr<Texture>& new_texture) const
+    {
+        if (same_binding(new_texture, texture)) {
+            return true;
+        }
+        if (max_texture_units == 0 || !texture || !new_texture || !uses_texture_units(*texture)
+            || !uses_texture_units(*new_texture)) {
+            return false;
+        }
+        // Only when all units are in use, a texture has to be replaced.
+        return std::ranges::find(texture_units, new_texture) != texture_units.end()
+            || static_cast<int>(texture_units.size()) < max_texture_units;
+    }
+
+    // Binds a texture to a free texture unit unless it is already bound, and selects that unit
+    // for all following vertices. Only when all units are in use, a texture has to be replaced.
+    void bind_to_texture_unit(const std::shared_ptr<Texture>& new_texture)
+    {
+        #ifndef GOSU_IS_OPENGLES
+        auto unit = std::ranges::find(texture_units, new_texture);
+        if (unit == texture_units.end()) {
+            if (static_cast<int>(texture_units.size()) == max_texture_units) {
+                // This ends the current batch; start filling the texture units from scratch.
+                texture_units.clear();
+            }
+            GOSU_LOAD_GL_EXT(glActiveTexture, PFNGLACTIVETEXTUREPROC);
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(texture_units.size()));
+            glBindTexture(GL_TEXTURE_2D, new_texture->tex_name());
+            glActiveTexture(GL_TEXTURE0);
+            texture_units.push_back(new_texture);
+            unit = texture_units.end() - 1;
+        }
+        use_fragment_shader(FragmentShader::MULTI_TEXTURE);
+        // The unit index is passed to the shader as the texture coordinate of texture unit 1.
+        // Batched vertices carry their own, for everything else glMultiTexCoord sets it.
+        texture_unit = static_cast<GLfloat>(unit - texture_units.begin());
+        GOSU_LOAD_GL_EXT(glMultiTexCoord1fARB, PFNGLMULTITEXCOORD1FARBPROC);
+        glMultiTexCoord1fARB(GL_TEXTURE1, texture_unit);
+        #endif
+    }
+
     void apply_transform() const
     {
         glMatrixMode(GL_MODELVIEW);
@@ -107,6 +217,7 @@ public:
 
     ~RenderStateManager()
     {
+        flush_batch();
         set_clip_rect(std::nullopt);
         set_texture(std::shared_ptr<Texture>());
         // Return to previous MV matrix
@@ -127,16 +238,27 @@ public:
         if (new_texture == texture) {
             return;
         }
+        if (!can_batch_texture(new_texture)) {
+            flush_batch();
+        }
 
         if (new_texture) {
-            if (!texture) {
-                glEnable(GL_TEXTURE_2D);
+            // Records the last-drawn frame for LRU eviction, and re-uploads evicted textures.
+            new_texture->prepare_for_drawing();
+            if (max_texture_units > 0 && uses_texture_units(*new_texture)) {
+                bind_to_texture_unit(new_texture);
+            }
+            else if (!same_binding(new_texture, texture)) {
+                if (!new_texture->array()) {
+                    // This replaces the texture on texture unit 0.
+                    texture_units.clear();
+                }
+                bind_texture(*new_texture);
             }
-            glBindTexture(GL_TEXTURE_2D, new_texture->tex_name());
         }
         else {
             // New texture is NO_TEXTURE, disable texturing.
-            glDisable(GL_TEXTURE_2D);
+            unbind_texture();
         }
         texture = new_texture;
     }
@@ -146,6 +268,7 @@ public:
         if (new_transform == transform) {
             return;
         }
+        flush_batch();
 
         transform = new_transform;
         apply_transform();
@@ -156,6 +279,7 @@ public:
         if (clip_rect == new_clip_rect) {
             return;
         }
+        flush_batch();
 
         clip_rect = new_clip_rect;
         apply_clip_rect();
@@ -166,18 +290,78 @@ public:
         if (new_mode == mode) {
             return;
         }
+        flush_batch();
 
         mode = new_mode;
         apply_alpha_mode();
     }
 
-    // The cached values may have been messed with. Reset them again.
-    void enforce_after_untrusted_gL() const
+    // Returns the vertices that will be drawn together by flush_batch(), or nullptr if
+    // multi-texture batching is disabled. Triangles added here use the current render state and
+    // are drawn with texture_unit_for_batch().
+    std::vector<BatchVertex>* batch()
     {
-        apply_texture();
-        apply_transform();
-        apply_clip_rect();
-        apply_alpha_mode();
+        return max_texture_units > 0 ? &batched_vertices : nullptr;
+    }
+
+    GLfloat texture_unit_for_batch() const { return texture_unit; }
+
+    // Draws all batched triangles in one call. This must happen before the OpenGL state changes.
+    void flush_batch()
+    {
+        if (batched_vertices.empty()) {
+            return;
+        }
+        #ifndef GOSU_IS_OPENGLES
+        GOSU_LOAD_GL_EXT(glClientActiveTextureARB, PFNGLCLIENTACTIVETEXTUREARBPROC);
+        const BatchVertex& first = batched_vertices[0];
+        glClientActiveTextureARB(GL_TEXTURE1);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(1, GL_FLOAT, sizeof(BatchVertex), &first.unit);
+        glClientActiveTextureARB(GL_TEXTURE0);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(3, GL_FLOAT, sizeof(BatchVertex), first.tex_coords);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(BatchVertex), &first.color);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(BatchVertex), first.vertices);
+
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(batched_vertices.size()));
+
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glClientActiveTextureARB(GL_TEXTURE1);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glClientActiveTextureARB(GL_TEXTURE0);
+        #endif
+        batched_vertices.clear();
+    }
+
+    // The cached values may have been messed with. Reset them again, but only those that belong
+    // to the given GLStateFlags.
+    void enforce_after_untrusted_gL(unsigned modified_state = GLS_ALL)
+    {
+        // Texturing can involve shaders, see bind_texture.
+        if (modified_state & (GLS_TEXTURES | GLS_SHADERS)) {
+            // Custom OpenGL code may have bound other textures to any texture unit.
+            texture_units.clear();
+            if (texture && max_texture_units > 0 && uses_texture_units(*texture)) {
+                bind_to_texture_unit(texture);
+            }
+            else {
+                apply_texture();
+            }
+        }
+        if (modified_state & GLS_MATRICES) {
+            apply_transform();
+        }
+        if (modified_state & GLS_SCISSOR) {
+            apply_clip_rect();
+        }
+        if (modified_state & GLS_BLEND) {
+            apply_alpha_mode();
+        }
     }
 };
 
@@ -187,6 +371,12 @@ namespace Gosu
     {
         RenderState render_state;
         std::vector<ArrayVertex> vertices;
+        // Other layers of render_state.texture's texture array that are used by the vertices.
+        std::vector<std::shared_ptr<Texture>> other_layers;
     };
     typedef std::list<VertexArray> VertexArrays;
+
+    /// Records everything that is drawn in f like record(), but returns the compiled vertex
+    /// arrays instead of a Macro.
+    VertexArrays record_vertex_arrays(const std::function<void()>& f);
 }
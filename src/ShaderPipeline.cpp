@@ -0,0 +1,464 @@
+#include "ShaderPipeline.hpp"
+#include <Gosu/Graphics.hpp>
+#include "DrawOp.hpp"
+#include "GLShadowState.hpp"
+#include "OpenGLContext.hpp"
+#include "RenderState.hpp"
+#include "Shaders.hpp"
+#include "TextureArray.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef> // for offsetof
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    std::atomic<bool> shader_pipeline = false;
+
+#ifndef GOSU_IS_OPENGLES
+    /// Like in Shaders.cpp, more units would only make the fragment shader slower.
+    constexpr int MAX_TEXTURE_UNITS = 16;
+
+    /// Added to the texture unit of distance field textures, see fragment_source().
+    constexpr int DISTANCE_FIELD_UNIT_OFFSET = 64;
+
+    const char* const VERTEX_SOURCE = R"glsl(#version 120
+uniform mat4 transform;
+attribute vec3 position;
+attribute vec4 tex_coords;
+attribute vec4 color;
+varying vec4 v_tex_coords;
+varying vec4 v_color;
+void main()
+{
+    gl_Position = transform * vec4(position, 1.0);
+    v_tex_coords = tex_coords;
+    v_color = color;
+}
+)glsl";
+
+    /// The fourth texture coordinate selects the sampler: -1 for untextured vertices (which can
+    /// then be batched with textured ones), 0 to units - 1 for 2D textures, and units for the
+    /// texture array (if supported). Distance field textures add DISTANCE_FIELD_UNIT_OFFSET to
+    /// their unit, and pass the distance at the edge of the shape as the third coordinate.
+    std::string fragment_source(int units, bool texture_array)
+    {
+        std::string source = "#version 120\n";
+        if (texture_array) {
+            source += "#extension GL_EXT_texture_array : require\n"
+                      "uniform sampler2DArray atlas;\n";
+        }
+        source += "uniform sampler2D textures[" + std::to_string(units)
+            + "];\n"
+              "uniform bool premultiplied;\n"
+              "varying vec4 v_tex_coords;\n"
+              "varying vec4 v_color;\n"
+              "void main()\n"
+              "{\n"
+              "    float unit = v_tex_coords.w;\n"
+              "    bool distance_field = unit > "
+            + std::to_string(DISTANCE_FIELD_UNIT_OFFSET)
+            + ".0 - 0.5;\n"
+              "    if (distance_field) unit -= "
+            + std::to_string(DISTANCE_FIELD_UNIT_OFFSET)
+            + ".0;\n"
+              "    vec4 texel;\n"
+              "    if (unit < -0.5) texel = vec4(1.0);\n";
+        for (int i = 0; i < units; ++i) {
+            source += "    else if (unit < " + std::to_string(i) + ".5) texel = texture2D(textures["
+                + std::to_string(i) + "], v_tex_coords.xy);\n";
+        }
+        source += texture_array ? "    else texel = texture2DArray(atlas, v_tex_coords.xyz);\n"
+                                : "    else texel = vec4(0.0);\n";
+        // Derivatives are only well-defined outside of branches, like in Shaders.cpp.
+        source += "    float smoothing = max(0.5 * fwidth(texel.a), 0.001);\n"
+                  "    if (distance_field) {\n"
+                  "        float alpha = smoothstep(v_tex_coords.z - smoothing,\n"
+                  "                                 v_tex_coords.z + smoothing, texel.a);\n"
+                  "        texel = premultiplied ? vec4(alpha) : vec4(1.0, 1.0, 1.0, alpha);\n"
+                  "    }\n"
+                  "    gl_FragColor = v_color * texel;\n"
+                  "}\n";
+        return source;
+    }
+
+    /// Like the programs in Shaders.cpp, these are created on first use and never deleted.
+    struct Resources
+    {
+        GLuint program = 0;
+        GLuint vertex_buffer = 0;
+        GLint transform_location = -1;
+        GLint premultiplied_location = -1;
+        /// The number of sampler2D uniforms; the texture array uses the unit after them.
+        int texture_units = 0;
+        bool texture_array = false;
+    };
+
+    /// Returns nullptr if the current OpenGL context does not support the shader pipeline.
+    const Resources* resources()
+    {
+        static const std::optional<Resources> resources = []() -> std::optional<Resources> {
+            const Gosu::OpenGLContext current_context;
+            if (!SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object")
+                || !SDL_GL_ExtensionSupported("GL_ARB_vertex_shader")
+                || !SDL_GL_ExtensionSupported("GL_ARB_fragment_shader")) {
+                return std::nullopt;
+            }
+
+            Resources result;
+            GLint image_units = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &image_units);
+            result.texture_array = SDL_GL_ExtensionSupported("GL_EXT_texture_array")
+                && image_units >= 2;
+            result.texture_units = std::min(static_cast<int>(image_units) - result.texture_array,
+                                            MAX_TEXTURE_UNITS);
+            if (result.texture_units < 1) {
+                return std::nullopt;
+            }
+            try {
+                result.program = Gosu::create_program(
+                    VERTEX_SOURCE, fragment_source(result.texture_units, result.texture_array),
+                    { "position", "tex_coords", "color" });
+            } catch (const std::runtime_error&) {
+                return std::nullopt;
+            }
+
+            GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+            GOSU_LOAD_GL_EXT(glGetUniformLocation, PFNGLGETUNIFORMLOCATIONPROC);
+            GOSU_LOAD_GL_EXT(glUniform1i, PFNGLUNIFORM1IPROC);
+            GOSU_LOAD_GL_EXT(glUniform1iv, PFNGLUNIFORM1IVPROC);
+            GOSU_LOAD_GL_EXT(glGenBuffers, PFNGLGENBUFFERSPROC);
+
+            GLint previous_program = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+            glUseProgram(result.program);
+            std::vector<GLint> samplers(result.texture_units);
+            for (int i = 0; i < result.texture_units; ++i) {
+                samplers[i] = i;
+            }
+            glUniform1iv(glGetUniformLocation(result.program, "textures"), result.texture_units,
+                         samplers.data());
+            if (result.texture_array) {
+                glUniform1i(glGetUniformLocation(result.program, "atlas"), result.texture_units);
+            }
+            result.transform_location = glGetUniformLocation(result.program, "transform");
+            result.premultiplied_location
+                = glGetUniformLocation(result.program, "premultiplied");
+            glUseProgram(static_cast<GLuint>(previous_program));
+
+            glGenBuffers(1, &result.vertex_buffer);
+            return result;
+        }();
+        return resources ? &*resources : nullptr;
+    }
+#endif
+}
+
+bool Gosu::ShaderPipeline::enabled()
+{
+#ifdef GOSU_IS_OPENGLES
+    return false;
+#else
+    return shader_pipeline && resources() != nullptr;
+#endif
+}
+
+int Gosu::ShaderPipeline::max_texture_units()
+{
+#ifdef GOSU_IS_OPENGLES
+    return 1;
+#else
+    return std::clamp(multi_texture_units(), 1, resources()->texture_units);
+#endif
+}
+
+Gosu::ShaderPipeline::ShaderPipeline()
+    : m_primitive(GL_TRIANGLES)
+{
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("The shader pipeline is not supported in OpenGL ES 1");
+#else
+    const Resources* res = resources();
+    if (res == nullptr) {
+        throw std::logic_error("The shader pipeline is not supported by this OpenGL context");
+    }
+    m_max_texture_units = max_texture_units();
+
+    GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+    GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+    GOSU_LOAD_GL_EXT(glEnableVertexAttribArray, PFNGLENABLEVERTEXATTRIBARRAYPROC);
+    GOSU_LOAD_GL_EXT(glVertexAttribPointer, PFNGLVERTEXATTRIBPOINTERPROC);
+
+    // Macros leave the fixed-function vertex arrays enabled, with pointers into RAM.
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glUseProgram(res->program);
+    GOSU_LOAD_GL_EXT(glUniform1i, PFNGLUNIFORM1IPROC);
+    glUniform1i(res->premultiplied_location, premultiplied_alpha() ? 1 : 0);
+    glBindBuffer(GL_ARRAY_BUFFER, res->vertex_buffer);
+    // The attribute locations are the order of the names passed to create_program.
+    for (GLuint location = 0; location < 3; ++location) {
+        glEnableVertexAttribArray(location);
+    }
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<const void*>(offsetof(Vertex, x)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<const void*>(offsetof(Vertex, tex_coords)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                          reinterpret_cast<const void*>(offsetof(Vertex, color)));
+#endif
+}
+
+Gosu::ShaderPipeline::~ShaderPipeline()
+{
+#ifndef GOSU_IS_OPENGLES
+    try {
+        flush();
+
+        GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+        GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+        GOSU_LOAD_GL_EXT(glDisableVertexAttribArray, PFNGLDISABLEVERTEXATTRIBARRAYPROC);
+
+        for (GLuint location = 0; location < 3; ++location) {
+            glDisableVertexAttribArray(location);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+    } catch (...) {
+        // The constructor has already loaded these functions successfully.
+    }
+    // Leave the clip rect and blend mode in the same state as RenderStateManager does.
+    if (m_clip_rect) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    if (m_mode && m_mode != BM_DEFAULT) {
+        RenderState().apply_alpha_mode();
+    }
+#endif
+}
+
+void Gosu::ShaderPipeline::set_transform(const Transform* transform)
+{
+    if (transform == m_transform_ptr) {
+        return;
+    }
+    m_transform_ptr = transform;
+    if (m_transform == *transform) {
+        return;
+    }
+
+    flush();
+    m_transform = *transform;
+#ifndef GOSU_IS_OPENGLES
+    const Transform combined = *transform * GLShadowState::current().projection;
+    // Gosu's row-major matrices for row vectors have the same memory layout as OpenGL's
+    // column-major matrices for column vectors, so no transposition is necessary.
+    GLfloat matrix[16];
+    std::ranges::copy(combined.matrix, matrix);
+    GOSU_LOAD_GL_EXT(glUniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC);
+    glUniformMatrix4fv(resources()->transform_location, 1, GL_FALSE, matrix);
+#endif
+}
+
+void Gosu::ShaderPipeline::set_clip_rect(const std::optional<Rect>& clip_rect)
+{
+    if (m_clip_rect_known && clip_rect == m_clip_rect) {
+        return;
+    }
+
+    flush();
+    m_clip_rect_known = true;
+    m_clip_rect = clip_rect;
+    RenderState render_state;
+    render_state.clip_rect = clip_rect;
+    render_state.apply_clip_rect();
+}
+
+void Gosu::ShaderPipeline::set_mode(BlendMode mode)
+{
+    if (mode == m_mode) {
+        return;
+    }
+
+    flush();
+    m_mode = mode;
+    RenderState render_state;
+    render_state.mode = mode;
+    render_state.apply_alpha_mode();
+}
+
+void Gosu::ShaderPipeline::set_primitive(std::uint32_t primitive)
+{
+    if (primitive == m_primitive) {
+        return;
+    }
+
+    flush();
+    m_primitive = primitive;
+}
+
+float Gosu::ShaderPipeline::texture_unit_for(Texture* texture)
+{
+    if (texture == nullptr) {
+        return -1;
+    }
+    if (texture == m_last_texture) {
+        return m_last_unit;
+    }
+
+#ifndef GOSU_IS_OPENGLES
+    GOSU_LOAD_GL_EXT(glActiveTexture, PFNGLACTIVETEXTUREPROC);
+    // Records the last-drawn frame for LRU eviction, and re-uploads evicted textures.
+    texture->prepare_for_drawing();
+
+    const int array_unit = resources()->texture_units;
+    float unit;
+    if (texture->array()) {
+        if (texture->array().get() != m_texture_array) {
+            // The vertices collected so far may use the previous texture array.
+            flush();
+            glActiveTexture(GL_TEXTURE0 + array_unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture->tex_name());
+            glActiveTexture(GL_TEXTURE0);
+            m_texture_array = texture->array().get();
+        }
+        unit = static_cast<float>(array_unit);
+    }
+    else {
+        auto it = std::ranges::find(m_texture_units, texture);
+        if (it == m_texture_units.end()) {
+            if (static_cast<int>(m_texture_units.size()) == m_max_texture_units) {
+                // This ends the current batch; start filling the texture units from scratch.
+                flush();
+                m_texture_units.clear();
+            }
+            glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(m_texture_units.size()));
+            glBindTexture(GL_TEXTURE_2D, texture->tex_name());
+            glActiveTexture(GL_TEXTURE0);
+            m_texture_units.push_back(texture);
+            it = m_texture_units.end() - 1;
+        }
+        unit = static_cast<float>(it - m_texture_units.begin());
+    }
+    if (texture->format() == TextureFormat::DISTANCE_FIELD) {
+        unit += DISTANCE_FIELD_UNIT_OFFSET;
+    }
+
+    m_last_texture = texture;
+    m_last_unit = unit;
+    return unit;
+#else
+    return -1;
+#endif
+}
+
+void Gosu::ShaderPipeline::draw(const DrawOp& op)
+{
+    // This should not be called on GL code ops.
+    assert(op.vertices_or_block_index >= 2);
+    assert(op.vertices_or_block_index <= 4);
+
+    set_primitive(op.vertices_or_block_index == 2 ? GL_LINES : GL_TRIANGLES);
+    set_transform(op.render_state.transform);
+    set_clip_rect(op.render_state.clip_rect);
+    set_mode(op.render_state.mode);
+    const float unit = texture_unit_for(op.render_state.texture.get());
+
+    if (op.triangles) {
+        m_vertices.reserve(m_vertices.size() + op.triangles->size());
+        for (std::size_t i = 0; i < op.triangles->size(); ++i) {
+            const DrawOp::Vertex& vertex = (*op.triangles)[i];
+            const DrawOp::TexCoord tex_coord
+                = op.triangle_tex_coords ? (*op.triangle_tex_coords)[i] : DrawOp::TexCoord {};
+            m_vertices.push_back(Vertex { vertex.x, vertex.y, op.depth,
+                                          { tex_coord.u, tex_coord.v, op.layer, unit },
+                                          vertex.c.abgr() });
+        }
+        return;
+    }
+
+    // The texture coordinates are only valid for textured ops.
+    float tex_coords[4][2] = {};
+    if (op.render_state.texture) {
+        tex_coords[0][0] = tex_coords[3][0] = op.left;
+        tex_coords[1][0] = tex_coords[2][0] = op.right;
+        tex_coords[0][1] = tex_coords[1][1] = op.top;
+        tex_coords[2][1] = tex_coords[3][1] = op.bottom;
+    }
+    const auto append = [&](int i) {
+        const DrawOp::Vertex& vertex = op.vertices[i];
+        m_vertices.push_back(Vertex { vertex.x, vertex.y, op.depth,
+                                      { tex_coords[i][0], tex_coords[i][1], op.layer, unit },
+                                      vertex.c.abgr() });
+    };
+
+    append(0);
+    append(1);
+    if (op.vertices_or_block_index >= 3) {
+        append(2);
+    }
+    if (op.vertices_or_block_index == 4) {
+        // Split the quad into two triangles.
+        append(0);
+        append(2);
+        append(3);
+    }
+}
+
+void Gosu::ShaderPipeline::draw(const VertexArray& vertex_array, const Transform& transform,
+                                const std::vector<std::uint32_t>* quads)
+{
+    set_primitive(GL_TRIANGLES);
+    set_transform(&transform);
+    set_mode(vertex_array.render_state.mode);
+    // Other layers of the same texture array (see VertexArray::other_layers) share the unit.
+    const float unit = texture_unit_for(vertex_array.render_state.texture.get());
+
+    const std::vector<ArrayVertex>& vertices = vertex_array.vertices;
+    const auto append_quad = [&](std::size_t quad) {
+        for (int i : { 0, 1, 2, 0, 2, 3 }) {
+            const ArrayVertex& vertex = vertices[quad + i];
+            m_vertices.push_back(Vertex { vertex.vertices[0], vertex.vertices[1], 0,
+                                          { vertex.tex_coords[0], vertex.tex_coords[1],
+                                            vertex.tex_coords[2], unit },
+                                          vertex.color });
+        }
+    };
+    if (quads) {
+        m_vertices.reserve(m_vertices.size() + quads->size() * 6);
+        for (std::uint32_t quad : *quads) {
+            append_quad(quad * std::size_t { 4 });
+        }
+        return;
+    }
+    m_vertices.reserve(m_vertices.size() + vertices.size() / 4 * 6);
+    for (std::size_t quad = 0; quad + 3 < vertices.size(); quad += 4) {
+        append_quad(quad);
+    }
+}
+
+void Gosu::ShaderPipeline::flush()
+{
+    if (m_vertices.empty()) {
+        return;
+    }
+
+#ifndef GOSU_IS_OPENGLES
+    GOSU_LOAD_GL_EXT(glBufferData, PFNGLBUFFERDATAPROC);
+    // Respecifying the whole buffer lets the driver hand out new storage instead of waiting for
+    // the GPU to finish drawing the previous batch.
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_vertices.size() * sizeof(Vertex)),
+                 m_vertices.data(), GL_STREAM_DRAW);
+    glDrawArrays(m_primitive, 0, static_cast<GLsizei>(m_vertices.size()));
+#endif
+    m_vertices.clear();
+}
+
+void Gosu::set_shader_pipeline(bool enabled)
+{
+    shader_pipeline = enabled;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Transform.hpp>
+#include <Gosu/Utility.hpp>
+#include "GraphicsImpl.hpp"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Gosu
+{
+    class TextureArray;
+    struct VertexArray;
+
+    /// Draws DrawOps and VertexArrays through a GLSL program instead of the fixed-function
+    /// pipeline, see set_shader_pipeline(). Vertices are collected in RAM and streamed to the GPU
+    /// through a single vertex buffer whenever a state change requires it (different transform,
+    /// clip rect, blend mode, primitive type or texture array), or when all texture units are in
+    /// use. The product of the transform and the GLShadowState's projection is uploaded as a
+    /// uniform, so transforms are applied on the GPU and the OpenGL matrix stacks are never
+    /// touched.
+    ///
+    /// Instances only live while a DrawOpQueue is being flushed: The constructor makes the
+    /// program current and the destructor submits the remaining vertices and restores the
+    /// fixed-function state. Custom OpenGL code must not run while an instance exists.
+    class ShaderPipeline : private Noncopyable
+    {
+        struct Vertex
+        {
+            /// z is only used by the opaque pass, see set_opaque_pass().
+            float x, y, z;
+            /// u, v, texture array layer, texture unit (or -1 for untextured vertices).
+            float tex_coords[4];
+            std::uint32_t color;
+        };
+
+        std::vector<Vertex> m_vertices;
+        std::uint32_t m_primitive;
+
+        const Transform* m_transform_ptr = nullptr;
+        std::optional<Transform> m_transform;
+        bool m_clip_rect_known = false;
+        std::optional<Rect> m_clip_rect;
+        std::optional<BlendMode> m_mode;
+
+        /// The textures that are bound to texture units 0, 1, 2... and the texture array that is
+        /// bound to the last texture unit.
+        std::vector<const Texture*> m_texture_units;
+        int m_max_texture_units = 1;
+        const TextureArray* m_texture_array = nullptr;
+        const Texture* m_last_texture = nullptr;
+        float m_last_unit = -1;
+
+        void set_transform(const Transform* transform);
+        void set_clip_rect(const std::optional<Rect>& clip_rect);
+        void set_mode(BlendMode mode);
+        void set_primitive(std::uint32_t primitive);
+        /// Returns the texture unit to pass to the shader for the given texture.
+        float texture_unit_for(Texture* texture);
+
+    public:
+        /// Returns true if the shader pipeline has been enabled and is supported by the current
+        /// OpenGL context.
+        static bool enabled();
+        /// Returns the number of 2D textures that can be drawn in one batch, in addition to one
+        /// texture array. Must only be called if enabled() returns true.
+        static int max_texture_units();
+
+        ShaderPipeline();
+        ~ShaderPipeline();
+
+        void draw(const DrawOp& op);
+        /// Draws the vertices of a Macro, which are quads. The transform replaces the
+        /// (already applied) transform of the vertex array's render state.
+        /// @param quads If not null, only the quads with these indices are drawn, in this order.
+        void draw(const VertexArray& vertex_array, const Transform& transform,
+                  const std::vector<std::uint32_t>* quads = nullptr);
+        /// Submits all vertices that have been collected so far.
+        void flush();
+    };
+}
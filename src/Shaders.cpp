@@ -0,0 +1,262 @@
+#include "Shaders.hpp"
+#include <Gosu/Graphics.hpp>
+#include "OpenGLContext.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::atomic<bool> multi_texture_batching = false;
+
+#ifndef GOSU_IS_OPENGLES
+    /// More units would only make the shader slower, because every sample is a branch.
+    constexpr int MAX_MULTI_TEXTURE_UNITS = 16;
+
+    const char* const TEXTURE_ARRAY_SOURCE = R"glsl(#version 110
+#extension GL_EXT_texture_array : require
+uniform sampler2DArray atlas;
+void main()
+{
+    gl_FragColor = gl_Color * texture2DArray(atlas, gl_TexCoord[0].stp);
+}
+)glsl";
+
+    /// Derivatives are only well-defined outside of branches, so they are computed first.
+    std::string distance_field_source(bool premultiplied)
+    {
+        return std::string("#version 110\n"
+                           "uniform sampler2D distance_field;\n"
+                           "void main()\n"
+                           "{\n"
+                           "    float distance = texture2D(distance_field, gl_TexCoord[0].st).a;\n"
+                           "    float edge = gl_TexCoord[0].p;\n"
+                           "    float smoothing = max(0.5 * fwidth(distance), 0.001);\n"
+                           "    float alpha = smoothstep(edge - smoothing, edge + smoothing, "
+                           "distance);\n")
+            + (premultiplied ? "    gl_FragColor = gl_Color * alpha;\n"
+                             : "    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * alpha);\n")
+            + "}\n";
+    }
+
+    /// The counts have been added up in steps of 1/255, see DrawOpQueue::apply_debug_view().
+    const char* const OVERDRAW_SOURCE = R"glsl(#version 110
+uniform sampler2D counts;
+void main()
+{
+    float count = floor(texture2D(counts, gl_TexCoord[0].st).r * 255.0 + 0.5);
+    vec3 color = min(vec3(count / 4.0, count / 16.0, count / 64.0), 1.0);
+    gl_FragColor = count > 0.0 ? vec4(color, 1.0) : vec4(0.0);
+}
+)glsl";
+
+    int available_texture_units()
+    {
+        GLint image_units = 0, coords = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &image_units);
+        glGetIntegerv(GL_MAX_TEXTURE_COORDS, &coords);
+        // The texture unit is passed in the second set of texture coordinates.
+        return coords < 2 ? 0 : std::min(static_cast<int>(image_units), MAX_MULTI_TEXTURE_UNITS);
+    }
+
+    /// GLSL 1.10 can only index arrays of samplers with constants, so the texture unit is
+    /// selected by a chain of branches.
+    std::string multi_texture_source(int units)
+    {
+        std::string source = "#version 110\n"
+                             "uniform sampler2D textures["
+            + std::to_string(units)
+            + "];\n"
+              "void main()\n"
+              "{\n"
+              "    float unit = gl_TexCoord[1].s;\n"
+              "    vec2 uv = gl_TexCoord[0].st;\n"
+              "    vec4 color;\n";
+        for (int i = 0; i < units; ++i) {
+            source += i == 0 ? "    if" : "    else if";
+            source += " (unit < " + std::to_string(i) + ".5) color = texture2D(textures["
+                + std::to_string(i) + "], uv);\n";
+        }
+        source += "    else color = vec4(0.0);\n"
+                  "    gl_FragColor = gl_Color * color;\n"
+                  "}\n";
+        return source;
+    }
+
+    /// Programs are created on first use and never deleted, just like the OpenGL context.
+    /// Indexed by Gosu::FragmentShader.
+    GLuint programs[6] = {}; // NOLINT(*-avoid-non-const-global-variables)
+
+    GLuint program_for(Gosu::FragmentShader shader)
+    {
+        GLuint& program = programs[static_cast<int>(shader)];
+        if (program != 0 || shader == Gosu::FragmentShader::NONE) {
+            return program;
+        }
+
+        if (shader == Gosu::FragmentShader::TEXTURE_ARRAY) {
+            program = Gosu::create_program("", TEXTURE_ARRAY_SOURCE);
+        }
+        else if (shader == Gosu::FragmentShader::OVERDRAW) {
+            // The sampler uniform defaults to texture unit 0.
+            program = Gosu::create_program("", OVERDRAW_SOURCE);
+        }
+        else if (shader == Gosu::FragmentShader::DISTANCE_FIELD
+                 || shader == Gosu::FragmentShader::DISTANCE_FIELD_PREMULTIPLIED) {
+            // The sampler uniform defaults to texture unit 0.
+            const bool premultiplied = shader == Gosu::FragmentShader::DISTANCE_FIELD_PREMULTIPLIED;
+            program = Gosu::create_program("", distance_field_source(premultiplied));
+        }
+        else {
+            const int units = available_texture_units();
+            program = Gosu::create_program("", multi_texture_source(units));
+            // Point the samplers at texture units 0, 1, 2...
+            GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+            GOSU_LOAD_GL_EXT(glGetUniformLocation, PFNGLGETUNIFORMLOCATIONPROC);
+            GOSU_LOAD_GL_EXT(glUniform1iv, PFNGLUNIFORM1IVPROC);
+            std::vector<GLint> samplers(units);
+            for (int i = 0; i < units; ++i) {
+                samplers[i] = i;
+            }
+            GLint previous_program = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+            glUseProgram(program);
+            glUniform1iv(glGetUniformLocation(program, "textures"), units, samplers.data());
+            glUseProgram(static_cast<GLuint>(previous_program));
+        }
+        return program;
+    }
+#endif
+}
+
+std::uint32_t Gosu::create_program(const std::string& vertex_source,
+                                   const std::string& fragment_source,
+                                   std::initializer_list<const char*> attributes)
+{
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Shaders are not supported in OpenGL ES 1");
+#else
+    GOSU_LOAD_GL_EXT(glCreateShader, PFNGLCREATESHADERPROC);
+    GOSU_LOAD_GL_EXT(glShaderSource, PFNGLSHADERSOURCEPROC);
+    GOSU_LOAD_GL_EXT(glCompileShader, PFNGLCOMPILESHADERPROC);
+    GOSU_LOAD_GL_EXT(glGetShaderiv, PFNGLGETSHADERIVPROC);
+    GOSU_LOAD_GL_EXT(glDeleteShader, PFNGLDELETESHADERPROC);
+    GOSU_LOAD_GL_EXT(glCreateProgram, PFNGLCREATEPROGRAMPROC);
+    GOSU_LOAD_GL_EXT(glAttachShader, PFNGLATTACHSHADERPROC);
+    GOSU_LOAD_GL_EXT(glBindAttribLocation, PFNGLBINDATTRIBLOCATIONPROC);
+    GOSU_LOAD_GL_EXT(glLinkProgram, PFNGLLINKPROGRAMPROC);
+    GOSU_LOAD_GL_EXT(glGetProgramiv, PFNGLGETPROGRAMIVPROC);
+    GOSU_LOAD_GL_EXT(glDeleteProgram, PFNGLDELETEPROGRAMPROC);
+
+    const auto compile = [&](GLenum type, const std::string& source) {
+        const GLuint shader = glCreateShader(type);
+        const char* source_ptr = source.c_str();
+        glShaderSource(shader, 1, &source_ptr, nullptr);
+        glCompileShader(shader);
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            glDeleteShader(shader);
+            throw std::runtime_error(type == GL_VERTEX_SHADER
+                                         ? "Failed to compile vertex shader"
+                                         : "Failed to compile fragment shader");
+        }
+        return shader;
+    };
+
+    const GLuint program = glCreateProgram();
+    std::vector<GLuint> shaders;
+    try {
+        if (!vertex_source.empty()) {
+            shaders.push_back(compile(GL_VERTEX_SHADER, vertex_source));
+        }
+        shaders.push_back(compile(GL_FRAGMENT_SHADER, fragment_source));
+    } catch (...) {
+        for (GLuint shader : shaders) {
+            glDeleteShader(shader);
+        }
+        glDeleteProgram(program);
+        throw;
+    }
+
+    for (GLuint shader : shaders) {
+        glAttachShader(program, shader);
+        // The shader will be deleted along with the program.
+        glDeleteShader(shader);
+    }
+    GLuint location = 0;
+    for (const char* attribute : attributes) {
+        glBindAttribLocation(program, location++, attribute);
+    }
+    glLinkProgram(program);
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        glDeleteProgram(program);
+        throw std::runtime_error("Failed to link shader program");
+    }
+    return program;
+#endif
+}
+
+bool Gosu::fragment_shader_supported(FragmentShader shader)
+{
+#ifdef GOSU_IS_OPENGLES
+    return shader == FragmentShader::NONE;
+#else
+    if (shader == FragmentShader::NONE) {
+        return true;
+    }
+
+    const OpenGLContext current_context;
+    if (!SDL_GL_ExtensionSupported("GL_ARB_fragment_shader")
+        || (shader == FragmentShader::TEXTURE_ARRAY
+            && !SDL_GL_ExtensionSupported("GL_EXT_texture_array"))
+        || (shader == FragmentShader::MULTI_TEXTURE && available_texture_units() < 2)) {
+        return false;
+    }
+    try {
+        program_for(shader);
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+#endif
+}
+
+void Gosu::use_fragment_shader(FragmentShader shader)
+{
+#ifndef GOSU_IS_OPENGLES
+    // Avoid loading OpenGL 2.0 functions if shaders have never been used.
+    if (shader == FragmentShader::NONE
+        && std::ranges::count(programs, 0u) == std::ssize(programs)) {
+        return;
+    }
+    GOSU_LOAD_GL_EXT(glUseProgram, PFNGLUSEPROGRAMPROC);
+    glUseProgram(program_for(shader));
+#endif
+}
+
+int Gosu::multi_texture_units()
+{
+#ifdef GOSU_IS_OPENGLES
+    return 0;
+#else
+    if (!multi_texture_batching) {
+        return 0;
+    }
+    static const int units = [] {
+        const OpenGLContext current_context;
+        return fragment_shader_supported(FragmentShader::MULTI_TEXTURE) ? available_texture_units()
+                                                                         : 0;
+    }();
+    return units;
+#endif
+}
+
+void Gosu::set_multi_texture_batching(bool enabled)
+{
+    multi_texture_batching = enabled;
+}
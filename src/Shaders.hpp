@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+namespace Gosu
+{
+    /// Fragment shaders that replace fixed-function texturing where it is not sufficient.
+    /// They are combined with the fixed-function vertex stage, which still handles transforms,
+    /// colors and texture coordinates.
+    enum class FragmentShader
+    {
+        /// Fixed-function texturing (no shader).
+        NONE,
+        /// Samples the GL_TEXTURE_2D_ARRAY on texture unit 0 at gl_TexCoord[0].stp, where p is
+        /// the layer.
+        TEXTURE_ARRAY,
+        /// Samples the GL_TEXTURE_2D on one of multi_texture_units() texture units at
+        /// gl_TexCoord[0].st. The texture unit is selected by gl_TexCoord[1].s.
+        MULTI_TEXTURE,
+        /// Samples the distance field (see IF_DISTANCE_FIELD) on texture unit 0 at
+        /// gl_TexCoord[0].st, and antialiases the edge at the distance gl_TexCoord[0].p over
+        /// about one pixel on the screen.
+        DISTANCE_FIELD,
+        /// Like DISTANCE_FIELD, but for set_premultiplied_alpha(true).
+        DISTANCE_FIELD_PREMULTIPLIED,
+        /// Maps the overdraw counts that DV_OVERDRAW stores in the red channel of the texture on
+        /// texture unit 0 to colors. Pixels that have never been drawn become transparent.
+        OVERDRAW,
+    };
+
+    /// Returns true if the current OpenGL context can compile the given shader.
+    bool fragment_shader_supported(FragmentShader shader);
+
+    /// Makes the given shader current. The shader is compiled when it is first used.
+    void use_fragment_shader(FragmentShader shader);
+
+    /// Compiles and links a GLSL program, and throws std::runtime_error if that fails.
+    /// @param vertex_source The source of the vertex shader, or an empty string to use the
+    ///                      fixed-function vertex stage.
+    /// @param attributes Vertex attributes that will be bound to the locations 0, 1, 2...
+    std::uint32_t create_program(const std::string& vertex_source,
+                                 const std::string& fragment_source,
+                                 std::initializer_list<const char*> attributes = {});
+
+    /// Returns the number of texture units that the renderer can use at once, see
+    /// set_multi_texture_batching(). Returns 0 if multi-texture batching is disabled or not
+    /// supported.
+    int multi_texture_units();
+}
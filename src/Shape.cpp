@@ -0,0 +1,451 @@
+#include <Gosu/Shape.hpp>
+#include <Gosu/Graphics.hpp>
+#include <Gosu/Math.hpp>
+#include <Gosu/Transform.hpp>
+#include "DrawOp.hpp"
+#include "GraphicsImpl.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    using Vertex = Gosu::DrawOp::Vertex;
+
+    struct Point
+    {
+        double x, y;
+
+        Point operator+(Point other) const { return { x + other.x, y + other.y }; }
+        Point operator-(Point other) const { return { x - other.x, y - other.y }; }
+        Point operator*(double factor) const { return { x * factor, y * factor }; }
+        bool operator==(const Point&) const = default;
+    };
+
+    double dot(Point a, Point b)
+    {
+        return a.x * b.x + a.y * b.y;
+    }
+
+    double cross(Point a, Point b)
+    {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    Point normalized(Point p)
+    {
+        const double length = std::hypot(p.x, p.y);
+        return length == 0 ? Point {} : p * (1 / length);
+    }
+
+    /// Rotates p around the origin, in the direction from the X axis to the Y axis.
+    Point rotated(Point p, double radians)
+    {
+        const double c = std::cos(radians), s = std::sin(radians);
+        return { p.x * c - p.y * s, p.x * s + p.y * c };
+    }
+
+    /// The maximum distance in pixels between a tessellated curve and the ideal curve.
+    constexpr double CURVE_TOLERANCE = 0.25;
+    /// Miter joins that would be longer than this many times the line width become bevel joins.
+    constexpr double MITER_LIMIT = 2;
+
+    /// Returns into how many segments an arc must be divided to look smooth.
+    int arc_segments(double radius, double radians)
+    {
+        if (radius <= CURVE_TOLERANCE) {
+            return 1;
+        }
+        const double step = 2 * std::acos(1 - CURVE_TOLERANCE / radius);
+        return std::clamp(static_cast<int>(std::ceil(std::abs(radians) / step)), 1, 1024);
+    }
+
+    /// Converts a flat list of coordinates into points, skipping consecutive duplicates.
+    std::vector<Point> to_points(std::span<const double> coordinates, bool closed)
+    {
+        if (coordinates.size() % 2 != 0) {
+            throw std::invalid_argument("Gosu::Shape: Odd number of coordinates");
+        }
+        std::vector<Point> points;
+        points.reserve(coordinates.size() / 2);
+        for (std::size_t i = 0; i < coordinates.size(); i += 2) {
+            const Point p { coordinates[i], coordinates[i + 1] };
+            if (points.empty() || !(points.back() == p)) {
+                points.push_back(p);
+            }
+        }
+        if (closed && points.size() > 1 && points.front() == points.back()) {
+            points.pop_back();
+        }
+        return points;
+    }
+
+    class Tessellator
+    {
+        std::vector<Vertex>& m_vertices;
+        Gosu::Color m_color;
+
+    public:
+        Tessellator(std::vector<Vertex>& vertices, Gosu::Color color)
+        : m_vertices(vertices),
+          m_color(color)
+        {
+        }
+
+        void triangle(Point a, Point b, Point c)
+        {
+            for (Point p : { a, b, c }) {
+                m_vertices.emplace_back(static_cast<float>(p.x), static_cast<float>(p.y), m_color);
+            }
+        }
+
+        /// Adds triangles from center to each pair of consecutive points.
+        void fan(Point center, std::span<const Point> points)
+        {
+            for (std::size_t i = 0; i + 1 < points.size(); ++i) {
+                triangle(center, points[i], points[i + 1]);
+            }
+        }
+
+        /// Returns the points of an arc around center, starting at center + offset.
+        static std::vector<Point> arc(Point center, Point offset, double radians)
+        {
+            const int segments = arc_segments(std::hypot(offset.x, offset.y), radians);
+            std::vector<Point> points;
+            points.reserve(segments + 1);
+            for (int i = 0; i <= segments; ++i) {
+                points.push_back(center + rotated(offset, radians * i / segments));
+            }
+            return points;
+        }
+
+        void polyline(const std::vector<Point>& points, double width, Gosu::LineJoin join,
+                      Gosu::LineCap cap, bool closed)
+        {
+            if (points.size() < 2 || width <= 0) {
+                return;
+            }
+            closed = closed && points.size() > 2;
+            const double half_width = width / 2;
+            const std::size_t n = points.size();
+            const std::size_t segment_count = closed ? n : n - 1;
+
+            // The left and right corners at the start and end of each segment. "Left" is the
+            // side of each segment's normal, (-dy; dx).
+            struct Segment
+            {
+                Point direction, normal;
+                double length;
+                Point start_left, start_right, end_left, end_right;
+            };
+            std::vector<Segment> segments(segment_count);
+            for (std::size_t i = 0; i < segment_count; ++i) {
+                const Point from = points[i], to = points[(i + 1) % n];
+                Segment& s = segments[i];
+                s.length = std::hypot(to.x - from.x, to.y - from.y);
+                s.direction = normalized(to - from);
+                s.normal = Point { -s.direction.y, s.direction.x };
+                s.start_left = from + s.normal * half_width;
+                s.start_right = from - s.normal * half_width;
+                s.end_left = to + s.normal * half_width;
+                s.end_right = to - s.normal * half_width;
+            }
+
+            // At each joint, both segments share a corner on the inner side of the turn. The gap
+            // on the outer side is filled with a fan of triangles around that corner.
+            std::vector<std::pair<Point, std::vector<Point>>> joints;
+            for (std::size_t i = closed ? 0 : 1; i < n - (closed ? 0 : 1); ++i) {
+                Segment& in = segments[(i + segment_count - 1) % segment_count];
+                Segment& out = segments[i % segment_count];
+                const double turn = cross(in.direction, out.direction);
+                if (std::abs(turn) < 1e-9 && dot(in.direction, out.direction) > 0) {
+                    continue;
+                }
+                // +1 if the turn goes towards the normal, which makes the left side the inner side.
+                const double inner_side = turn > 0 ? 1 : -1;
+                Point miter = normalized(in.normal + out.normal);
+                if (miter == Point {}) {
+                    // The line turns around completely.
+                    miter = in.direction;
+                }
+                const double miter_length = half_width / std::max(dot(miter, in.normal), 1e-9);
+                // In very sharp turns, the inner corner must not move past the other end of
+                // either segment.
+                const double inner_length
+                    = std::min(miter_length, std::min(in.length, out.length)
+                                   / std::max(std::abs(dot(miter, in.direction)), 1e-9));
+                const Point inner = points[i] + miter * (inner_length * inner_side);
+                const Point outer_in = points[i] - in.normal * (half_width * inner_side);
+                const Point outer_out = points[i] - out.normal * (half_width * inner_side);
+                (inner_side > 0 ? in.end_left : in.end_right) = inner;
+                (inner_side > 0 ? out.start_left : out.start_right) = inner;
+
+                std::vector<Point> outer;
+                if (join == Gosu::LJ_ROUND) {
+                    const double angle
+                        = std::acos(std::clamp(dot(in.normal, out.normal), -1.0, 1.0));
+                    outer = arc(points[i], outer_in - points[i], angle * inner_side);
+                }
+                else if (join == Gosu::LJ_MITER && miter_length <= half_width * MITER_LIMIT) {
+                    outer = { outer_in, points[i] - miter * (miter_length * inner_side),
+                              outer_out };
+                }
+                else {
+                    outer = { outer_in, outer_out };
+                }
+                joints.emplace_back(inner, std::move(outer));
+            }
+
+            if (!closed) {
+                Segment& first = segments.front();
+                Segment& last = segments.back();
+                if (cap == Gosu::LC_SQUARE) {
+                    first.start_left = first.start_left - first.direction * half_width;
+                    first.start_right = first.start_right - first.direction * half_width;
+                    last.end_left = last.end_left + last.direction * half_width;
+                    last.end_right = last.end_right + last.direction * half_width;
+                }
+                else if (cap == Gosu::LC_ROUND) {
+                    // Fan out from one end of each half circle, so that the only edge on the
+                    // diameter is the one that the half circle shares with the segment.
+                    for (const auto& half_circle :
+                         { arc(points.front(), first.normal * half_width, std::numbers::pi),
+                           arc(points.back(), last.normal * -half_width, std::numbers::pi) }) {
+                        fan(half_circle.front(), std::span(half_circle).subspan(1));
+                    }
+                }
+            }
+
+            for (const Segment& s : segments) {
+                triangle(s.start_left, s.start_right, s.end_right);
+                triangle(s.start_left, s.end_right, s.end_left);
+            }
+            for (const auto& [inner, outer] : joints) {
+                fan(inner, outer);
+            }
+        }
+
+        /// Triangulates a simple polygon by ear clipping.
+        void polygon(const std::vector<Point>& points)
+        {
+            if (points.size() < 3) {
+                return;
+            }
+            double area = 0;
+            for (std::size_t i = 0; i < points.size(); ++i) {
+                area += cross(points[i], points[(i + 1) % points.size()]);
+            }
+            const double orientation = area < 0 ? -1 : 1;
+
+            std::vector<std::size_t> remaining(points.size());
+            for (std::size_t i = 0; i < remaining.size(); ++i) {
+                remaining[i] = i;
+            }
+
+            const auto is_ear = [&](std::size_t i) {
+                const std::size_t count = remaining.size();
+                const Point a = points[remaining[(i + count - 1) % count]];
+                const Point b = points[remaining[i]];
+                const Point c = points[remaining[(i + 1) % count]];
+                if (cross(b - a, c - b) * orientation <= 0) {
+                    return false;
+                }
+                // No other corner may lie inside of the ear.
+                for (std::size_t index : remaining) {
+                    const Point p = points[index];
+                    if (p == a || p == b || p == c) {
+                        continue;
+                    }
+                    if (cross(b - a, p - a) * orientation >= 0
+                        && cross(c - b, p - b) * orientation >= 0
+                        && cross(a - c, p - c) * orientation >= 0) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            while (remaining.size() > 3) {
+                const std::size_t count = remaining.size();
+                std::size_t ear = 0;
+                while (ear < count && !is_ear(ear)) {
+                    ++ear;
+                }
+                if (ear == count) {
+                    // Self-intersecting or degenerate polygon: Fill the rest as well as possible.
+                    break;
+                }
+                triangle(points[remaining[(ear + count - 1) % count]], points[remaining[ear]],
+                         points[remaining[(ear + 1) % count]]);
+                remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>(ear));
+            }
+            for (std::size_t i = 1; i + 1 < remaining.size(); ++i) {
+                triangle(points[remaining[0]], points[remaining[i]], points[remaining[i + 1]]);
+            }
+        }
+    };
+}
+
+struct Gosu::Shape::Impl
+{
+    std::vector<Vertex> triangles;
+    // Copies of the triangles for set_premultiplied_alpha(), for normal (index 0) and additive
+    // (index 1) blending. They are created when they are first drawn.
+    std::optional<std::vector<Vertex>> premultiplied_triangles[2];
+};
+
+Gosu::Shape::Shape()
+: m_impl(std::make_shared<Impl>())
+{
+}
+
+Gosu::Shape::Impl& Gosu::Shape::impl_for_writing()
+{
+    // The triangles are shared with copies of this shape and with queued draw operations.
+    if (m_impl.use_count() > 1) {
+        m_impl = std::make_shared<Impl>(*m_impl);
+    }
+    for (auto& premultiplied_triangles : m_impl->premultiplied_triangles) {
+        premultiplied_triangles.reset();
+    }
+    return *m_impl;
+}
+
+void Gosu::Shape::add_polyline(std::span<const double> points, double width, Color c,
+                               LineJoin join, LineCap cap, bool closed)
+{
+    Tessellator(impl_for_writing().triangles, c)
+        .polyline(to_points(points, closed), width, join, cap, closed);
+}
+
+void Gosu::Shape::add_polygon(std::span<const double> points, Color c)
+{
+    Tessellator(impl_for_writing().triangles, c).polygon(to_points(points, true));
+}
+
+void Gosu::Shape::add_circle(double x, double y, double radius, Color c)
+{
+    if (radius <= 0) {
+        return;
+    }
+    const Point center { x, y };
+    std::vector<Point> points = Tessellator::arc(center, Point { 0, -radius },
+                                                 2 * std::numbers::pi);
+    // Even small circles should not turn into triangles.
+    if (points.size() < 9) {
+        points.clear();
+        for (int i = 0; i <= 8; ++i) {
+            points.push_back(center + rotated(Point { 0, -radius }, std::numbers::pi * i / 4));
+        }
+    }
+    Tessellator(impl_for_writing().triangles, c).fan(center, points);
+}
+
+void Gosu::Shape::add_arc(double x, double y, double radius, double start_angle,
+                          double end_angle, double width, Color c, LineCap cap)
+{
+    if (radius <= 0) {
+        return;
+    }
+    const bool closed = std::abs(end_angle - start_angle) >= 360;
+    if (closed) {
+        end_angle = start_angle + 360;
+    }
+    const Point center { x, y };
+    const Point start { offset_x(start_angle, radius), offset_y(start_angle, radius) };
+    std::vector<Point> points
+        = Tessellator::arc(center, start, degrees_to_radians(end_angle - start_angle));
+    if (closed) {
+        points.pop_back();
+    }
+    Tessellator(impl_for_writing().triangles, c).polyline(points, width, LJ_MITER, cap, closed);
+}
+
+void Gosu::Shape::clear()
+{
+    impl_for_writing().triangles.clear();
+}
+
+std::size_t Gosu::Shape::triangle_count() const
+{
+    return m_impl->triangles.size() / 3;
+}
+
+void Gosu::Shape::draw(double x, double y, ZPos z, BlendMode mode) const
+{
+    if (m_impl->triangles.empty()) {
+        return;
+    }
+
+#ifdef GOSU_IS_OPENGLES
+    const std::vector<Vertex>& triangles = m_impl->triangles;
+    for (std::size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        draw_triangle(x + triangles[i].x, y + triangles[i].y, triangles[i].c,
+                      x + triangles[i + 1].x, y + triangles[i + 1].y, triangles[i + 1].c,
+                      x + triangles[i + 2].x, y + triangles[i + 2].y, triangles[i + 2].c, z, mode);
+    }
+#else
+    const std::vector<Vertex>* triangles = &m_impl->triangles;
+    if (premultiplied_alpha()) {
+        // Premultiply the triangles once instead of every time that the shape is drawn.
+        const bool additive = mode == BM_ADD;
+        auto& premultiplied_triangles = m_impl->premultiplied_triangles[additive ? 1 : 0];
+        if (!premultiplied_triangles) {
+            premultiplied_triangles.emplace(m_impl->triangles);
+            for (Vertex& vertex : *premultiplied_triangles) {
+                DrawOp::premultiply(vertex, additive);
+            }
+        }
+        triangles = &*premultiplied_triangles;
+    }
+
+    DrawOp op;
+    op.render_state.mode = mode;
+    op.vertices_or_block_index = 3;
+    // Later triangles must cover earlier ones, which the front-to-back opaque pass cannot promise.
+    op.opaque = false;
+    op.z = z;
+    // Share the triangles; impl_for_writing() makes sure that they stay unchanged.
+    op.triangles = std::shared_ptr<const std::vector<Vertex>>(m_impl, triangles);
+    if (x == 0 && y == 0) {
+        schedule_draw_op(op);
+    }
+    else {
+        // Move the shape with a transform, so that its triangles do not have to be copied.
+        Gosu::transform(Transform::translate(x, y), [&] { schedule_draw_op(op); });
+    }
+#endif
+}
+
+void Gosu::draw_polyline(std::span<const double> points, double width, Color c, ZPos z,
+                         LineJoin join, LineCap cap, bool closed, BlendMode mode)
+{
+    Shape shape;
+    shape.add_polyline(points, width, c, join, cap, closed);
+    shape.draw(0, 0, z, mode);
+}
+
+void Gosu::draw_polygon(std::span<const double> points, Color c, ZPos z, BlendMode mode)
+{
+    Shape shape;
+    shape.add_polygon(points, c);
+    shape.draw(0, 0, z, mode);
+}
+
+void Gosu::draw_circle(double x, double y, double radius, Color c, ZPos z, BlendMode mode)
+{
+    Shape shape;
+    shape.add_circle(x, y, radius, c);
+    shape.draw(0, 0, z, mode);
+}
+
+void Gosu::draw_arc(double x, double y, double radius, double start_angle, double end_angle,
+                    double width, Color c, ZPos z, LineCap cap, BlendMode mode)
+{
+    Shape shape;
+    shape.add_arc(x, y, radius, start_angle, end_angle, width, c, cap);
+    shape.draw(0, 0, z, mode);
+}
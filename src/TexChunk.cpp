@@ -3,27 +3,72 @@
 #include <Gosu/Graphics.hpp>
 #include "DrawOpQueue.hpp"
 #include "Texture.hpp"
+#include <algorithm>
 #include <stdexcept>
 
 Gosu::TexChunk::TexChunk(const std::shared_ptr<Texture>& texture, const Rect& rect,
                          const std::shared_ptr<const Rect>& rect_handle)
     : m_texture(texture),
       m_rect(rect),
-      m_info { .tex_name = texture->tex_name(),
-               .left = 1.0 * m_rect.x / texture->width(),
-               .right = 1.0 * m_rect.right() / texture->width(),
-               .top = 1.0 * m_rect.y / texture->height(),
-               .bottom = 1.0 * m_rect.bottom() / texture->height() },
+      m_info {},
       m_rect_handle(rect_handle)
 {
     if (!Rect::covering(*texture).contains(rect)) {
         throw std::invalid_argument("Gosu::TexChunk exceeds its Gosu::Texture");
     }
+
+    update_gl_tex_info();
+    m_texture->register_chunk(this);
+}
+
+Gosu::TexChunk::~TexChunk()
+{
+    m_texture->unregister_chunk(this);
+}
+
+void Gosu::TexChunk::update_gl_tex_info()
+{
+    m_info = GLTexInfo { .tex_name = m_texture->tex_name(),
+                         .left = 1.0 * m_rect.x / m_texture->width(),
+                         .right = 1.0 * m_rect.right() / m_texture->width(),
+                         .top = 1.0 * m_rect.y / m_texture->height(),
+                         .bottom = 1.0 * m_rect.bottom() / m_texture->height(),
+                         .layer = m_texture->layer() };
+}
+
+void Gosu::TexChunk::relocate(const std::shared_ptr<Texture>& texture, int offset_x,
+                              int offset_y, const std::shared_ptr<const Rect>& rect_handle)
+{
+    texture->register_chunk(this);
+    m_texture->unregister_chunk(this);
+
+    // This releases the previous rectangle, unless it is still referenced by a queued DrawOp.
+    // It must happen before the previous texture (which owns the BinPacker) can be released.
+    m_rect_handle = rect_handle;
+    m_texture = texture;
+    m_rect.x += offset_x;
+    m_rect.y += offset_y;
+    update_gl_tex_info();
+}
+
+float Gosu::TexChunk::third_tex_coord(double edge) const
+{
+    if (m_texture->format() == TextureFormat::DISTANCE_FIELD) {
+        return static_cast<GLfloat>(edge);
+    }
+    return static_cast<GLfloat>(std::max(m_info.layer, 0));
 }
 
 void Gosu::TexChunk::draw(double x1, double y1, Color c1, double x2, double y2, Color c2, //
                           double x3, double y3, Color c3, double x4, double y4, Color c4, //
                           ZPos z, BlendMode mode) const
+{
+    draw(x1, y1, c1, x2, y2, c2, x3, y3, c3, x4, y4, c4, z, mode, 0.5);
+}
+
+void Gosu::TexChunk::draw(double x1, double y1, Color c1, double x2, double y2, Color c2, //
+                          double x3, double y3, Color c3, double x4, double y4, Color c4, //
+                          ZPos z, BlendMode mode, double edge) const
 {
     DrawOp op;
     op.render_state.texture = m_texture;
@@ -48,9 +93,65 @@ void Gosu::TexChunk::draw(double x1, double y1, Color c1, double x2, double y2,
     op.top = m_info.top;
     op.right = m_info.right;
     op.bottom = m_info.bottom;
+    op.layer = third_tex_coord(edge);
+    op.opaque = m_opaque;
+
+    op.z = z;
+    schedule_draw_op(op);
+}
+
+void Gosu::TexChunk::draw_mesh(std::span<const double> vertices, std::span<const double> uvs,
+                               std::span<const Color> colors,
+                               std::span<const std::uint32_t> indices, ZPos z,
+                               BlendMode mode) const
+{
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Gosu::Image::draw_mesh is not supported on OpenGL ES");
+#else
+    const std::size_t count = indices.empty() ? vertices.size() / 2 : indices.size();
+    if (count == 0) {
+        return;
+    }
+
+    // Expand the indices because DrawOps only store plain triangle lists.
+    auto triangles = std::make_shared<std::vector<DrawOp::Vertex>>();
+    auto tex_coords = std::make_shared<std::vector<DrawOp::TexCoord>>();
+    triangles->reserve(count);
+    tex_coords->reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t vertex = indices.empty() ? i : indices[i];
+        const Color c = colors.empty()  ? Color::WHITE
+                      : colors.size() == 1 ? colors[0]
+                                           : colors[vertex];
+        triangles->emplace_back(static_cast<float>(vertices[vertex * 2]),
+                                static_cast<float>(vertices[vertex * 2 + 1]), c);
+        // Clamping keeps neighboring images on the same texture from showing up.
+        const double u = std::clamp(uvs[vertex * 2], 0.0, 1.0);
+        const double v = std::clamp(uvs[vertex * 2 + 1], 0.0, 1.0);
+        tex_coords->push_back(
+            { static_cast<GLfloat>(m_info.left + u * (m_info.right - m_info.left)),
+              static_cast<GLfloat>(m_info.top + v * (m_info.bottom - m_info.top)) });
+    }
+
+    if (premultiplied_alpha()) {
+        for (DrawOp::Vertex& vertex : *triangles) {
+            DrawOp::premultiply(vertex, mode == BM_ADD);
+        }
+    }
 
+    DrawOp op;
+    op.render_state.texture = m_texture;
+    op.render_state.mode = mode;
+    op.rect_handle = m_rect_handle;
+    op.vertices_or_block_index = 3;
+    op.triangles = std::move(triangles);
+    op.triangle_tex_coords = std::move(tex_coords);
+    op.layer = third_tex_coord(0.5);
+    // Meshes may overlap themselves, and the opaque pass would then draw them in reverse order.
+    op.opaque = false;
     op.z = z;
     schedule_draw_op(op);
+#endif
 }
 
 std::unique_ptr<Gosu::Drawable> Gosu::TexChunk::subimage(const Rect& rect) const
@@ -60,7 +161,9 @@ std::unique_ptr<Gosu::Drawable> Gosu::TexChunk::subimage(const Rect& rect) const
         throw std::invalid_argument("Gosu::TexChunk::subimage cannot exceed parent size");
     }
     const Rect nested_rect { m_rect.x + rect.x, m_rect.y + rect.y, rect.width, rect.height };
-    return std::make_unique<TexChunk>(m_texture, nested_rect, m_rect_handle);
+    auto result = std::make_unique<TexChunk>(m_texture, nested_rect, m_rect_handle);
+    result->set_opaque(m_opaque);
+    return result;
 }
 
 Gosu::Bitmap Gosu::TexChunk::to_bitmap() const
@@ -68,6 +171,11 @@ Gosu::Bitmap Gosu::TexChunk::to_bitmap() const
     return m_texture->to_bitmap(m_rect);
 }
 
+std::future<Gosu::Bitmap> Gosu::TexChunk::to_bitmap_async() const
+{
+    return m_texture->to_bitmap_async(m_rect);
+}
+
 void Gosu::TexChunk::insert(const Bitmap& bitmap, int x, int y)
 {
     Bitmap clipped_bitmap;
@@ -91,4 +199,8 @@ void Gosu::TexChunk::insert(const Bitmap& bitmap, int x, int y)
     }
 
     m_texture->insert(*source, m_rect.x + x + offset_x, m_rect.y + y + offset_y);
+
+    if (m_opaque && !source->opaque()) {
+        m_opaque = false;
+    }
 }
@@ -5,6 +5,7 @@
 #include <Gosu/Utility.hpp>
 #include <cstdint>
 #include <memory>
+#include <span>
 
 namespace Gosu
 {
@@ -14,10 +15,15 @@ namespace Gosu
     /// to store image data.
     class TexChunk : public Drawable
     {
-        const std::shared_ptr<Texture> m_texture;
-        const Rect m_rect;
-        const GLTexInfo m_info;
-        const std::shared_ptr<const Rect> m_rect_handle;
+        std::shared_ptr<Texture> m_texture;
+        Rect m_rect;
+        GLTexInfo m_info;
+        std::shared_ptr<const Rect> m_rect_handle;
+        bool m_opaque = false;
+
+        void update_gl_tex_info();
+        /// The third texture coordinate of all vertices, see DrawOp::layer.
+        float third_tex_coord(double edge) const;
 
     public:
         /// @param texture The texture on which the image data resides.
@@ -29,6 +35,24 @@ namespace Gosu
         ///                    for use by other image data.
         TexChunk(const std::shared_ptr<Texture>& texture, const Rect& rect,
                  const std::shared_ptr<const Rect>& rect_handle);
+        ~TexChunk() override;
+
+        const std::shared_ptr<Texture>& texture() const { return m_texture; }
+        const std::shared_ptr<const Rect>& rect_handle() const { return m_rect_handle; }
+
+        /// Whether every pixel that this TexChunk draws has full opacity, even at the edges
+        /// where the texture is interpolated. Opaque images can be drawn in the opaque pass, see
+        /// set_opaque_pass(). create_drawable sets this flag when it can prove it.
+        bool opaque() const { return m_opaque; }
+        void set_opaque(bool opaque) { m_opaque = opaque; }
+
+        /// Moves this TexChunk onto another texture after its pixels have been copied there.
+        /// The GLTexInfo returned by gl_tex_info() is updated in place.
+        /// @param offset_x The horizontal distance between the old and the new position.
+        /// @param offset_y The vertical distance between the old and the new position.
+        /// @param rect_handle The rectangle that has been allocated on the new texture.
+        void relocate(const std::shared_ptr<Texture>& texture, int offset_x, int offset_y,
+                      const std::shared_ptr<const Rect>& rect_handle);
 
         int width() const override { return m_rect.width; }
         int height() const override { return m_rect.height; }
@@ -39,12 +63,28 @@ namespace Gosu
                   double x4, double y4, Color c4, //
                   ZPos z, BlendMode mode) const override;
 
+        /// Like draw(), but if this TexChunk is on a distance field texture (see
+        /// IF_DISTANCE_FIELD), the edge of the shape is placed at the given distance instead of
+        /// 0.5. Lower values grow the shape, higher values shrink it.
+        void draw(double x1, double y1, Color c1, //
+                  double x2, double y2, Color c2, //
+                  double x3, double y3, Color c3, //
+                  double x4, double y4, Color c4, //
+                  ZPos z, BlendMode mode, double edge) const;
+
+        /// See Image::draw_mesh(), which validates the arguments.
+        void draw_mesh(std::span<const double> vertices, std::span<const double> uvs,
+                       std::span<const Color> colors, std::span<const std::uint32_t> indices,
+                       ZPos z, BlendMode mode) const;
+
         const GLTexInfo* gl_tex_info() const override { return &m_info; }
 
         std::unique_ptr<Drawable> subimage(const Rect& rect) const override;
 
         Bitmap to_bitmap() const override;
 
+        std::future<Bitmap> to_bitmap_async() const override;
+
         void insert(const Bitmap& bitmap, int x, int y) override;
     };
 }
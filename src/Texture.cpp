@@ -1,19 +1,272 @@
 #include "Texture.hpp"
 #include <Gosu/Bitmap.hpp>
+#include <Gosu/Drawable.hpp>
 #include <Gosu/Platform.hpp>
+#include "GraphicsImpl.hpp"
 #include "OpenGLContext.hpp"
 #include "TexChunk.hpp"
+#include <algorithm>
+#include <cstring> // for std::memcpy
+#include <map>
+#include <set>
+#include <span>
 #include <stdexcept>
 
-Gosu::Texture::Texture(int width, int height, bool retro)
-    : m_bin_packer(width, height),
+namespace
+{
+#ifndef GOSU_IS_OPENGLES
+    GLenum gl_internal_format(Gosu::TextureFormat format)
+    {
+        switch (format) {
+        case Gosu::TextureFormat::BC1:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case Gosu::TextureFormat::BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case Gosu::TextureFormat::BC7:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:
+            return GL_RGBA;
+        }
+    }
+
+    /// Temporarily attaches a texture (or a layer of a texture array) to a framebuffer object so
+    /// that glReadPixels can read from it. The previously bound framebuffer (if any) is restored
+    /// in the destructor.
+    class ReadFramebuffer : Gosu::Noncopyable
+    {
+        PFNGLBINDFRAMEBUFFERPROC m_bind_framebuffer = nullptr;
+        PFNGLFRAMEBUFFERTEXTURE2DPROC m_framebuffer_texture_2d = nullptr;
+        GLint m_previous_framebuffer = 0;
+
+    public:
+        /// @param layer The layer of a texture array, or -1 for a GL_TEXTURE_2D.
+        explicit ReadFramebuffer(GLuint tex_name, int layer = -1)
+        {
+            GOSU_LOAD_GL_EXT(glGenFramebuffers, PFNGLGENFRAMEBUFFERSPROC);
+            GOSU_LOAD_GL_EXT(glBindFramebuffer, PFNGLBINDFRAMEBUFFERPROC);
+            GOSU_LOAD_GL_EXT(glFramebufferTexture2D, PFNGLFRAMEBUFFERTEXTURE2DPROC);
+            m_bind_framebuffer = glBindFramebuffer;
+            m_framebuffer_texture_2d = glFramebufferTexture2D;
+
+            // There is only one OpenGL context, so a single framebuffer object can be shared by
+            // all readbacks. It is never deleted.
+            static GLuint framebuffer = 0;
+            if (framebuffer == 0) {
+                glGenFramebuffers(1, &framebuffer);
+            }
+
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_previous_framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            if (layer >= 0) {
+                GOSU_LOAD_GL_EXT(glFramebufferTextureLayer, PFNGLFRAMEBUFFERTEXTURELAYERPROC);
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex_name, 0, layer);
+            }
+            else {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                       tex_name, 0);
+            }
+        }
+
+        ~ReadFramebuffer()
+        {
+            // Detach the texture again so that the framebuffer does not keep it alive.
+            m_framebuffer_texture_2d(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+            m_bind_framebuffer(GL_FRAMEBUFFER, m_previous_framebuffer);
+        }
+    };
+
+    /// A pixel buffer object (PBO) that receives the result of an asynchronous glReadPixels call.
+    class PixelPackBuffer : Gosu::Noncopyable
+    {
+        int m_width, m_height;
+        GLuint m_buffer = 0;
+
+    public:
+        PixelPackBuffer(int width, int height)
+            : m_width(width),
+              m_height(height)
+        {
+            GOSU_LOAD_GL_EXT(glGenBuffers, PFNGLGENBUFFERSPROC);
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            GOSU_LOAD_GL_EXT(glBufferData, PFNGLBUFFERDATAPROC);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size(), nullptr, GL_STREAM_READ);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        ~PixelPackBuffer()
+        {
+            try {
+                const Gosu::OpenGLContext current_context;
+                GOSU_LOAD_GL_EXT(glDeleteBuffers, PFNGLDELETEBUFFERSPROC);
+                glDeleteBuffers(1, &m_buffer);
+            } catch (...)
+            {
+                // Leaking is better than throwing in a destructor.
+            }
+        }
+
+        GLsizeiptr size() const
+        {
+            return static_cast<GLsizeiptr>(m_width) * m_height * sizeof(Gosu::Color);
+        }
+
+        /// Starts transferring pixels from the current read framebuffer into this buffer.
+        void read_pixels(int x, int y) const
+        {
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+            glReadPixels(x, y, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        /// Waits for the transfer to finish (if necessary) and copies the result into a Bitmap.
+        Gosu::Bitmap to_bitmap() const
+        {
+            const Gosu::OpenGLContext current_context;
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            GOSU_LOAD_GL_EXT(glMapBuffer, PFNGLMAPBUFFERPROC);
+            GOSU_LOAD_GL_EXT(glUnmapBuffer, PFNGLUNMAPBUFFERPROC);
+
+            Gosu::Bitmap bitmap(m_width, m_height);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+            const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            if (pixels) {
+                std::memcpy(bitmap.data(), pixels, static_cast<std::size_t>(size()));
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if (!pixels) {
+                throw std::runtime_error("Failed to map OpenGL pixel buffer");
+            }
+            return bitmap;
+        }
+    };
+
+    /// A readback started by Texture::to_bitmap_async() that has not been completed yet.
+    struct PendingReadback
+    {
+        std::unique_ptr<PixelPackBuffer> buffer;
+        /// Signaled by the GPU once the transfer into buffer has finished.
+        GLsync fence = nullptr;
+        bool premultiplied = false;
+        std::promise<Gosu::Bitmap> promise;
+    };
+
+    std::vector<PendingReadback> pending_readbacks;
+    std::mutex pending_readbacks_mutex;
+#endif
+
+    /// Rows of single-byte pixels are not necessarily aligned to four bytes, which OpenGL expects
+    /// by default. This changes the alignment for pixel transfers to one byte until it goes out of
+    /// scope.
+    class ByteAlignment : Gosu::Noncopyable
+    {
+        bool m_enabled;
+        GLint m_previous_pack = 4, m_previous_unpack = 4;
+
+    public:
+        explicit ByteAlignment(bool enabled)
+            : m_enabled(enabled)
+        {
+            if (m_enabled) {
+                glGetIntegerv(GL_PACK_ALIGNMENT, &m_previous_pack);
+                glGetIntegerv(GL_UNPACK_ALIGNMENT, &m_previous_unpack);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            }
+        }
+
+        ~ByteAlignment()
+        {
+            if (m_enabled) {
+                glPixelStorei(GL_PACK_ALIGNMENT, m_previous_pack);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, m_previous_unpack);
+            }
+        }
+    };
+
+    /// All Texture instances, for set_texture_memory_budget() and texture_memory_stats().
+    std::vector<Gosu::Texture*> all_textures;
+    std::mutex all_textures_mutex;
+
+    std::atomic<std::size_t> texture_memory_budget = 0;
+    std::atomic<std::uint64_t> current_frame = 1;
+    std::atomic<std::uint64_t> eviction_count = 0;
+    std::atomic<std::uint64_t> reupload_count = 0;
+
+    /// The format of the pixel data that is transferred to and from uncompressed textures.
+    GLenum gl_pixel_format(Gosu::TextureFormat format)
+    {
+        return format == Gosu::TextureFormat::DISTANCE_FIELD ? GL_ALPHA : GL_RGBA;
+    }
+
+    /// Only RGBA8 textures can be attached to a framebuffer, which glReadPixels and
+    /// glCopyTexSubImage2D require.
+    bool is_color_renderable(Gosu::TextureFormat format)
+    {
+        return format == Gosu::TextureFormat::RGBA8;
+    }
+
+    int round_up_to_block_size(int value)
+    {
+        return (value + Gosu::COMPRESSION_BLOCK_SIZE - 1) / Gosu::COMPRESSION_BLOCK_SIZE
+            * Gosu::COMPRESSION_BLOCK_SIZE;
+    }
+}
+
+Gosu::Texture::Texture(int width, int height, bool retro, TextureFormat format)
+    : m_bin_packer(width, height, is_block_compressed(format) ? COMPRESSION_BLOCK_SIZE : 1),
       m_tex_name(0),
-      m_retro(retro)
+      m_retro(retro),
+      m_format(format),
+      m_premultiplied(premultiplied_alpha()),
+      m_layer(-1)
 {
     if (width <= 0 || height <= 0) {
         throw std::invalid_argument("Gosu::Texture must not be empty");
     }
+    if (!supports_format(format)) {
+        throw std::runtime_error("Compressed texture format is not supported by this GPU");
+    }
+
+    create_gl_texture();
+
+    const std::scoped_lock lock(all_textures_mutex);
+    all_textures.push_back(this);
+}
+
+Gosu::Texture::Texture(int width, int height, Texture& smaller)
+    : m_bin_packer(width, height, smaller.m_bin_packer),
+      m_tex_name(0),
+      m_retro(smaller.m_retro),
+      m_format(smaller.m_format),
+      m_premultiplied(smaller.m_premultiplied),
+      m_layer(-1)
+{
+    create_gl_texture();
+    copy_rect(smaller, Rect::covering(smaller), 0, 0);
+
+    const std::scoped_lock lock(all_textures_mutex);
+    all_textures.push_back(this);
+}
+
+Gosu::Texture::Texture(const std::shared_ptr<TextureArray>& array)
+    : m_bin_packer(array->size(), array->size()),
+      m_tex_name(array->tex_name()),
+      m_retro(array->retro()),
+      m_format(TextureFormat::RGBA8),
+      m_premultiplied(premultiplied_alpha()),
+      m_array(array),
+      m_layer(array->acquire_layer(this))
+{
+    const std::scoped_lock lock(all_textures_mutex);
+    all_textures.push_back(this);
+}
 
+void Gosu::Texture::create_gl_texture()
+{
     const OpenGLContext current_context;
 
     // Create texture name.
@@ -26,10 +279,23 @@ Gosu::Texture::Texture(int width, int height, bool retro)
 
     // Create empty texture.
     glBindTexture(GL_TEXTURE_2D, m_tex_name);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_bin_packer.width(), m_bin_packer.height(), 0, GL_RGBA,
-                 GL_UNSIGNED_BYTE, nullptr);
+#ifndef GOSU_IS_OPENGLES
+    if (is_block_compressed(m_format)) {
+        // Unlike glTexImage2D, glCompressedTexImage2D needs initial data. Start with transparency.
+        GOSU_LOAD_GL_EXT(glCompressedTexImage2D, PFNGLCOMPRESSEDTEXIMAGE2DPROC);
+        const CompressedBitmap transparent(width(), height(), m_format);
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, gl_internal_format(m_format), width(), height(),
+                               0, static_cast<GLsizei>(transparent.size()), transparent.data());
+    }
+    else
+#endif
+    {
+        const GLenum pixel_format = gl_pixel_format(m_format);
+        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(pixel_format), m_bin_packer.width(),
+                     m_bin_packer.height(), 0, pixel_format, GL_UNSIGNED_BYTE, nullptr);
+    }
 
-    if (retro) {
+    if (m_retro) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     }
@@ -49,6 +315,17 @@ Gosu::Texture::Texture(int width, int height, bool retro)
 
 Gosu::Texture::~Texture()
 {
+    {
+        const std::scoped_lock lock(all_textures_mutex);
+        std::erase(all_textures, this);
+    }
+
+    if (m_array) {
+        // The texture name belongs to the texture array.
+        m_array->release_layer(m_layer);
+        return;
+    }
+
     try {
         const OpenGLContext current_context;
         glDeleteTextures(1, &m_tex_name);
@@ -58,6 +335,71 @@ Gosu::Texture::~Texture()
     }
 }
 
+void Gosu::Texture::register_chunk(TexChunk* chunk)
+{
+    const std::scoped_lock lock(m_chunks_mutex);
+    m_chunks.push_back(chunk);
+}
+
+void Gosu::Texture::unregister_chunk(TexChunk* chunk)
+{
+    const std::scoped_lock lock(m_chunks_mutex);
+    std::erase(m_chunks, chunk);
+
+    if (chunk->rect_handle()) {
+        if (m_released_rects.size() == m_released_rects.capacity()) {
+            std::erase_if(m_released_rects, [](const auto& rect) { return rect.expired(); });
+            // If most rectangles are still alive, grow the capacity so that this stays cheap.
+            m_released_rects.reserve(2 * m_released_rects.size());
+        }
+        m_released_rects.push_back(chunk->rect_handle());
+    }
+}
+
+std::size_t Gosu::Texture::byte_size() const
+{
+    const std::size_t pixels = static_cast<std::size_t>(width()) * height();
+    if (is_block_compressed(m_format)) {
+        return pixels / (COMPRESSION_BLOCK_SIZE * COMPRESSION_BLOCK_SIZE)
+            * bytes_per_block(m_format);
+    }
+    return pixels * bytes_per_block(m_format);
+}
+
+bool Gosu::Texture::supports_format(TextureFormat format)
+{
+    if (!is_block_compressed(format)) {
+        return true;
+    }
+#ifdef GOSU_IS_OPENGLES
+    return false;
+#else
+    const OpenGLContext current_context;
+    if (format == TextureFormat::BC7) {
+        return SDL_GL_ExtensionSupported("GL_ARB_texture_compression_bptc");
+    }
+    return SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc");
+#endif
+}
+
+bool Gosu::Texture::supports_copy() const
+{
+#ifdef GOSU_IS_OPENGLES
+    return false;
+#else
+    // Compressed and distance field textures are not color-renderable, so they can only be copied
+    // with glCopyImageSubData, not with glCopyTexSubImage2D.
+    const OpenGLContext current_context;
+    return is_color_renderable(m_format) || SDL_GL_ExtensionSupported("GL_ARB_copy_image");
+#endif
+}
+
+double Gosu::Texture::occupancy()
+{
+    const double area = 1.0 * width() * height();
+    return (area - static_cast<double>(m_bin_packer.free_area())) / area;
+}
+
 std::unique_ptr<Gosu::TexChunk> Gosu::Texture::try_alloc(const Bitmap& bitmap, int padding)
 {
     const std::shared_ptr<const Rect> rect = m_bin_packer.alloc(bitmap.width(), bitmap.height());
@@ -66,25 +408,167 @@ std::unique_ptr<Gosu::TexChunk> Gosu::Texture::try_alloc(const Bitmap& bitmap, i
         return nullptr;
     }
 
-    insert(bitmap, rect->x, rect->y);
+    if (is_block_compressed(m_format) && Rect::covering(bitmap) != *rect) {
+        // Compressed textures can only be updated in whole blocks, so fill the rest of the
+        // rectangle (which has been rounded up to the block size) with transparency.
+        Bitmap aligned_bitmap(rect->width, rect->height);
+        aligned_bitmap.insert(bitmap, 0, 0);
+        insert(aligned_bitmap, rect->x, rect->y);
+    }
+    else {
+        insert(bitmap, rect->x, rect->y);
+    }
 
     const Rect rect_without_padding { rect->x + padding, rect->y + padding,
-                                      rect->width - 2 * padding, rect->height - 2 * padding };
+                                      bitmap.width() - 2 * padding, bitmap.height() - 2 * padding };
     return std::make_unique<TexChunk>(shared_from_this(), rect_without_padding, rect);
 }
 
+std::unique_ptr<Gosu::TexChunk> Gosu::Texture::try_alloc(const CompressedBitmap& bitmap)
+{
+    if (bitmap.format() != m_format) {
+        throw std::invalid_argument("Gosu::Texture::try_alloc: Format mismatch");
+    }
+
+    const std::shared_ptr<const Rect> rect
+        = m_bin_packer.alloc((bitmap.blocks_x() + 2) * COMPRESSION_BLOCK_SIZE,
+                             (bitmap.blocks_y() + 2) * COMPRESSION_BLOCK_SIZE);
+
+    if (!rect) {
+        return nullptr;
+    }
+
+    CompressedBitmap bitmap_with_border(rect->width, rect->height, m_format);
+    bitmap_with_border.insert(bitmap, 1, 1);
+    insert(bitmap_with_border, rect->x, rect->y);
+
+    const Rect image_rect { rect->x + COMPRESSION_BLOCK_SIZE, rect->y + COMPRESSION_BLOCK_SIZE,
+                            bitmap.width(), bitmap.height() };
+    return std::make_unique<TexChunk>(shared_from_this(), image_rect, rect);
+}
+
 void Gosu::Texture::insert(const Gosu::Bitmap& bitmap, int x, int y)
 {
     if (!Rect::covering(*this).contains(Rect { x, y, bitmap.width(), bitmap.height() })) {
         throw std::invalid_argument("Gosu::Texture::insert: Rect exceeds bounds");
     }
+    if (is_block_compressed(m_format)
+        && (x % COMPRESSION_BLOCK_SIZE != 0 || y % COMPRESSION_BLOCK_SIZE != 0
+            || (x + bitmap.width() != width() && bitmap.width() % COMPRESSION_BLOCK_SIZE != 0)
+            || (y + bitmap.height() != height()
+                && bitmap.height() % COMPRESSION_BLOCK_SIZE != 0))) {
+        throw std::invalid_argument("Gosu::Texture::insert: Rect is not aligned to 4x4 blocks");
+    }
 
+    // Distance fields only keep the alpha channel, which premultiplication does not change.
+    if (m_premultiplied && m_format != TextureFormat::DISTANCE_FIELD) {
+        Bitmap premultiplied = bitmap;
+        premultiplied.premultiply_alpha();
+        upload(premultiplied, x, y);
+    }
+    else {
+        upload(bitmap, x, y);
+    }
+}
+
+void Gosu::Texture::upload(const Bitmap& bitmap, int x, int y)
+{
     const OpenGLContext current_context;
+    ensure_resident();
+#ifndef GOSU_IS_OPENGLES
+    if (m_array) {
+        GOSU_LOAD_GL_EXT(glTexSubImage3D, PFNGLTEXSUBIMAGE3DPROC);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_name);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, m_layer, bitmap.width(), bitmap.height(), 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, bitmap.data());
+        return;
+    }
+#endif
     glBindTexture(GL_TEXTURE_2D, m_tex_name);
+    if (m_format == TextureFormat::DISTANCE_FIELD) {
+        const std::span pixels(bitmap.data(),
+                               static_cast<std::size_t>(bitmap.width()) * bitmap.height());
+        std::vector<std::uint8_t> distances;
+        distances.reserve(pixels.size());
+        for (const Color& pixel : pixels) {
+            distances.push_back(pixel.alpha);
+        }
+        const ByteAlignment alignment(true);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bitmap.width(), bitmap.height(), GL_ALPHA,
+                        GL_UNSIGNED_BYTE, distances.data());
+        return;
+    }
     glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bitmap.width(), bitmap.height(), GL_RGBA,
                     GL_UNSIGNED_BYTE, bitmap.data());
 }
 
+void Gosu::Texture::insert(const CompressedBitmap& bitmap, int x, int y)
+{
+    if (bitmap.format() != m_format) {
+        throw std::invalid_argument("Gosu::Texture::insert: Format mismatch");
+    }
+    const int aligned_width = bitmap.blocks_x() * COMPRESSION_BLOCK_SIZE;
+    const int aligned_height = bitmap.blocks_y() * COMPRESSION_BLOCK_SIZE;
+    if (!Rect::covering(*this).contains(Rect { x, y, aligned_width, aligned_height })) {
+        throw std::invalid_argument("Gosu::Texture::insert: Rect exceeds bounds");
+    }
+    if (x % COMPRESSION_BLOCK_SIZE != 0 || y % COMPRESSION_BLOCK_SIZE != 0) {
+        throw std::invalid_argument("Gosu::Texture::insert: Rect is not aligned to 4x4 blocks");
+    }
+
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Compressed textures are not supported in OpenGL ES");
+#else
+    const OpenGLContext current_context;
+    ensure_resident();
+    GOSU_LOAD_GL_EXT(glCompressedTexSubImage2D, PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC);
+    glBindTexture(GL_TEXTURE_2D, m_tex_name);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, aligned_width, aligned_height,
+                              gl_internal_format(m_format), static_cast<GLsizei>(bitmap.size()),
+                              bitmap.data());
+#endif
+}
+
+Gosu::Bitmap Gosu::Texture::decompress(const CompressedBitmap& bitmap)
+{
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Compressed textures are not supported in OpenGL ES");
+#else
+    if (!supports_format(bitmap.format())) {
+        throw std::runtime_error("Compressed texture format is not supported by this GPU");
+    }
+
+    const OpenGLContext current_context;
+    GOSU_LOAD_GL_EXT(glCompressedTexImage2D, PFNGLCOMPRESSEDTEXIMAGE2DPROC);
+    // Not a Texture instance, because the pixels must not be unpremultiplied when reading them.
+    GLuint tex_name = 0;
+    glGenTextures(1, &tex_name);
+    glBindTexture(GL_TEXTURE_2D, tex_name);
+
+    Bitmap result(bitmap.width(), bitmap.height());
+    const int tile_size = static_cast<int>(max_texture_size()) / COMPRESSION_BLOCK_SIZE
+        * COMPRESSION_BLOCK_SIZE;
+    for (int y = 0; y < bitmap.height(); y += tile_size) {
+        for (int x = 0; x < bitmap.width(); x += tile_size) {
+            const CompressedBitmap tile = bitmap.subimage(
+                Rect { x, y, std::min(tile_size, bitmap.width() - x),
+                       std::min(tile_size, bitmap.height() - y) });
+            const int aligned_width = tile.blocks_x() * COMPRESSION_BLOCK_SIZE;
+            const int aligned_height = tile.blocks_y() * COMPRESSION_BLOCK_SIZE;
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, gl_internal_format(tile.format()),
+                                   aligned_width, aligned_height, 0,
+                                   static_cast<GLsizei>(tile.size()), tile.data());
+            Bitmap pixels(aligned_width, aligned_height);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            result.insert(pixels, x, y, Rect::covering(tile));
+        }
+    }
+
+    glDeleteTextures(1, &tex_name);
+    return result;
+#endif
+}
+
 Gosu::Bitmap Gosu::Texture::to_bitmap(const Rect& rect) const
 {
     if (!Rect::covering(*this).contains(rect)) {
@@ -97,17 +581,428 @@ Gosu::Bitmap Gosu::Texture::to_bitmap(const Rect& rect) const
     throw std::logic_error("Gosu::Texture::to_bitmap not supported in OpenGL ES");
 #else
     const OpenGLContext current_context;
-    Bitmap bitmap(width(), height());
-    glBindTexture(GL_TEXTURE_2D, m_tex_name);
-    // This should use glGetTextureSubImage where available: https://stackoverflow.com/a/38148494
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap.data());
+    ensure_resident();
+    Bitmap bitmap(rect.width, rect.height);
+
+    if (m_format == TextureFormat::DISTANCE_FIELD) {
+        // Alpha textures cannot be attached to a framebuffer either, so read the whole texture and
+        // return the distances as the alpha channel of white pixels.
+        std::vector<std::uint8_t> distances(static_cast<std::size_t>(width()) * height());
+        {
+            const ByteAlignment alignment(true);
+            glBindTexture(GL_TEXTURE_2D, m_tex_name);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_ALPHA, GL_UNSIGNED_BYTE, distances.data());
+        }
+        for (int y = 0; y < rect.height; ++y) {
+            for (int x = 0; x < rect.width; ++x) {
+                const std::size_t index
+                    = static_cast<std::size_t>(rect.y + y) * width() + rect.x + x;
+                bitmap.pixel(x, y) = Color::WHITE.with_alpha(distances[index]);
+            }
+        }
+        return bitmap;
+    }
 
-    if (rect != Rect::covering(*this)) {
-        Bitmap smaller_bitmap(rect.width, rect.height);
-        smaller_bitmap.insert(bitmap, -rect.x, -rect.y);
-        bitmap = std::move(smaller_bitmap);
+    if (rect == Rect::covering(*this) && !m_array) {
+        glBindTexture(GL_TEXTURE_2D, m_tex_name);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap.data());
+    }
+    else if (is_block_compressed(m_format)) {
+        // Compressed textures cannot be attached to a framebuffer, and partial reads must be
+        // block-aligned. Let the driver decompress the whole texture instead.
+        Bitmap full_texture = to_bitmap(Rect::covering(*this));
+        bitmap.insert(full_texture, 0, 0, rect);
+        // The recursive call has already converted the pixels to straight alpha.
+        return bitmap;
+    }
+    else if (SDL_GL_ExtensionSupported("GL_ARB_get_texture_sub_image")) {
+        // OpenGL 4.5 can read a portion of a texture directly: https://stackoverflow.com/a/38148494
+        GOSU_LOAD_GL_EXT(glGetTextureSubImage, PFNGLGETTEXTURESUBIMAGEPROC);
+        const auto size = static_cast<GLsizei>(rect.width * rect.height * sizeof(Color));
+        glGetTextureSubImage(m_tex_name, 0, rect.x, rect.y, std::max(m_layer, 0), rect.width,
+                             rect.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, size, bitmap.data());
+    }
+    else {
+        // Otherwise, avoid reading back the whole texture (up to 4 MB) just to crop it afterward.
+        // This is also the only way to read a single layer of a texture array.
+        const ReadFramebuffer framebuffer(m_tex_name, m_layer);
+        glReadPixels(rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                     bitmap.data());
     }
 
+    if (m_premultiplied) {
+        bitmap.unpremultiply_alpha();
+    }
     return bitmap;
 #endif
 }
+
+std::future<Gosu::Bitmap> Gosu::Texture::to_bitmap_async(const Rect& rect) const
+{
+    if (!Rect::covering(*this).contains(rect)) {
+        throw std::invalid_argument("Gosu::Texture::to_bitmap_async: Rect exceeds bounds");
+    }
+
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Gosu::Texture::to_bitmap_async not supported in OpenGL ES");
+#else
+    const OpenGLContext current_context;
+    ensure_resident();
+
+    // Without pixel buffer objects and fences, there is no way to read pixels asynchronously.
+    // Compressed and distance field textures cannot be read through a framebuffer either.
+    if (!is_color_renderable(m_format)
+        || !SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object")
+        || !SDL_GL_ExtensionSupported("GL_ARB_sync")) {
+        std::promise<Bitmap> promise;
+        promise.set_value(to_bitmap(rect));
+        return promise.get_future();
+    }
+
+    PendingReadback readback {
+        .buffer = std::make_unique<PixelPackBuffer>(rect.width, rect.height),
+        .premultiplied = m_premultiplied,
+    };
+    {
+        const ReadFramebuffer framebuffer(m_tex_name, m_layer);
+        readback.buffer->read_pixels(rect.x, rect.y);
+    }
+    GOSU_LOAD_GL_EXT(glFenceSync, PFNGLFENCESYNCPROC);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Make sure that the driver starts the transfer now, not when the fence is first checked.
+    glFlush();
+
+    std::future<Bitmap> future = readback.promise.get_future();
+    const std::scoped_lock lock(pending_readbacks_mutex);
+    pending_readbacks.push_back(std::move(readback));
+    return future;
+#endif
+}
+
+void Gosu::Texture::complete_readbacks(bool wait)
+{
+#ifndef GOSU_IS_OPENGLES
+    {
+        const std::scoped_lock lock(pending_readbacks_mutex);
+        if (pending_readbacks.empty()) {
+            return;
+        }
+    }
+
+    // to_bitmap_async() acquires the context before the mutex, so do the same here.
+    const OpenGLContext current_context;
+    const std::scoped_lock lock(pending_readbacks_mutex);
+    GOSU_LOAD_GL_EXT(glClientWaitSync, PFNGLCLIENTWAITSYNCPROC);
+    GOSU_LOAD_GL_EXT(glDeleteSync, PFNGLDELETESYNCPROC);
+
+    std::erase_if(pending_readbacks, [&](PendingReadback& readback) {
+        const GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+        const GLenum status
+            = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        glDeleteSync(readback.fence);
+        try {
+            if (status == GL_WAIT_FAILED) {
+                throw std::runtime_error("Failed to wait for OpenGL pixel transfer");
+            }
+            Bitmap bitmap = readback.buffer->to_bitmap();
+            if (readback.premultiplied) {
+                bitmap.unpremultiply_alpha();
+            }
+            readback.promise.set_value(std::move(bitmap));
+        } catch (...) {
+            readback.promise.set_exception(std::current_exception());
+        }
+        return true;
+    });
+#endif
+}
+
+void Gosu::Texture::copy_rect(const Texture& source, const Rect& source_rect, int x, int y)
+{
+    if (!Rect::covering(source).contains(source_rect)
+        || !Rect::covering(*this).contains(Rect { x, y, source_rect.width, source_rect.height })) {
+        throw std::invalid_argument("Gosu::Texture::copy_rect: Rect exceeds bounds");
+    }
+    if (source.m_format != m_format || source.m_premultiplied != m_premultiplied) {
+        throw std::invalid_argument("Gosu::Texture::copy_rect: Format mismatch");
+    }
+
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Gosu::Texture::copy_rect not supported in OpenGL ES");
+#else
+    const OpenGLContext current_context;
+    source.ensure_resident();
+    ensure_resident();
+
+    if (SDL_GL_ExtensionSupported("GL_ARB_copy_image")) {
+        GOSU_LOAD_GL_EXT(glCopyImageSubData, PFNGLCOPYIMAGESUBDATAPROC);
+        // For texture arrays, the layer is passed as the z coordinate.
+        const GLenum source_target = source.m_array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        const GLenum target = m_array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        glCopyImageSubData(source.m_tex_name, source_target, 0, source_rect.x, source_rect.y,
+                           std::max(source.m_layer, 0), //
+                           m_tex_name, target, 0, x, y, std::max(m_layer, 0), //
+                           source_rect.width, source_rect.height, 1);
+    }
+    else if (!is_color_renderable(m_format)) {
+        throw std::logic_error("Copying compressed or distance field textures requires "
+                               "GL_ARB_copy_image");
+    }
+    else if (m_array) {
+        GOSU_LOAD_GL_EXT(glCopyTexSubImage3D, PFNGLCOPYTEXSUBIMAGE3DPROC);
+        const ReadFramebuffer framebuffer(source.m_tex_name, source.m_layer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_name);
+        glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, m_layer, source_rect.x, source_rect.y,
+                            source_rect.width, source_rect.height);
+    }
+    else {
+        const ReadFramebuffer framebuffer(source.m_tex_name, source.m_layer);
+        glBindTexture(GL_TEXTURE_2D, m_tex_name);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, x, y, source_rect.x, source_rect.y,
+                            source_rect.width, source_rect.height);
+    }
+#endif
+}
+
+bool Gosu::Texture::resident() const
+{
+    const std::scoped_lock lock(m_residency_mutex);
+    return m_resident;
+}
+
+void Gosu::Texture::ensure_resident() const
+{
+    const std::scoped_lock lock(m_residency_mutex);
+    if (m_resident) {
+        return;
+    }
+
+#ifndef GOSU_IS_OPENGLES
+    const OpenGLContext current_context;
+    // This can happen while drawing, so keep the texture binding of the current texture unit,
+    // which RenderStateManager may rely on.
+    GLint previous_texture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+    glBindTexture(GL_TEXTURE_2D, m_tex_name);
+    if (is_block_compressed(m_format)) {
+        GOSU_LOAD_GL_EXT(glCompressedTexImage2D, PFNGLCOMPRESSEDTEXIMAGE2DPROC);
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, gl_internal_format(m_format), width(), height(),
+                               0, static_cast<GLsizei>(m_evicted_data.size()),
+                               m_evicted_data.data());
+    }
+    else {
+        const GLenum pixel_format = gl_pixel_format(m_format);
+        const ByteAlignment alignment(m_format == TextureFormat::DISTANCE_FIELD);
+        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(pixel_format), width(), height(), 0,
+                     pixel_format, GL_UNSIGNED_BYTE, m_evicted_data.data());
+    }
+    glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous_texture));
+    std::vector<std::uint8_t>().swap(m_evicted_data);
+    m_resident = true;
+    ++reupload_count;
+#endif
+}
+
+void Gosu::Texture::prepare_for_drawing()
+{
+    m_last_drawn_frame = current_frame.load();
+    ensure_resident();
+}
+
+void Gosu::Texture::evict()
+{
+#ifndef GOSU_IS_OPENGLES
+    const std::scoped_lock lock(m_residency_mutex);
+    if (!m_resident || m_array) {
+        return;
+    }
+
+    const OpenGLContext current_context;
+    glBindTexture(GL_TEXTURE_2D, m_tex_name);
+    if (is_block_compressed(m_format)) {
+        // Keep the compressed data as it is; this is also much smaller than decompressed pixels.
+        GOSU_LOAD_GL_EXT(glGetCompressedTexImage, PFNGLGETCOMPRESSEDTEXIMAGEPROC);
+        m_evicted_data.resize(byte_size());
+        glGetCompressedTexImage(GL_TEXTURE_2D, 0, m_evicted_data.data());
+    }
+    else {
+        m_evicted_data.resize(byte_size());
+        const ByteAlignment alignment(m_format == TextureFormat::DISTANCE_FIELD);
+        glGetTexImage(GL_TEXTURE_2D, 0, gl_pixel_format(m_format), GL_UNSIGNED_BYTE,
+                      m_evicted_data.data());
+    }
+    // Replace the texture's storage with a single pixel. This releases the video memory, but keeps
+    // the texture name, which is referenced by GLTexInfo structs and macros.
+    const GLenum pixel_format = gl_pixel_format(m_format);
+    glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(pixel_format), 1, 1, 0, pixel_format,
+                 GL_UNSIGNED_BYTE, nullptr);
+    m_resident = false;
+    ++eviction_count;
+#endif
+}
+
+void Gosu::Texture::finish_frame()
+{
+    complete_readbacks(false);
+
+    const std::uint64_t frame = current_frame++;
+
+    const std::size_t budget = texture_memory_budget;
+    if (budget == 0) {
+        return;
+    }
+
+    const std::scoped_lock lock(all_textures_mutex);
+
+    std::size_t resident_bytes = 0;
+    std::vector<Texture*> candidates;
+    for (Texture* texture : all_textures) {
+        if (texture->resident()) {
+            resident_bytes += texture->byte_size();
+            // Textures that have been drawn in this frame will most likely be drawn again soon.
+            if (texture->last_drawn_frame() < frame && !texture->array()) {
+                candidates.push_back(texture);
+            }
+        }
+    }
+    if (resident_bytes <= budget) {
+        return;
+    }
+
+    std::ranges::sort(candidates, std::less {}, &Texture::last_drawn_frame);
+    for (Texture* texture : candidates) {
+        if (resident_bytes <= budget) {
+            break;
+        }
+        texture->evict();
+        resident_bytes -= texture->byte_size();
+    }
+}
+
+void Gosu::set_texture_memory_budget(std::size_t bytes)
+{
+    texture_memory_budget = bytes;
+}
+
+Gosu::TextureMemoryStats Gosu::texture_memory_stats()
+{
+    TextureMemoryStats stats;
+    {
+        const std::scoped_lock lock(all_textures_mutex);
+        for (const Texture* texture : all_textures) {
+            (texture->resident() ? stats.resident_bytes : stats.evicted_bytes)
+                += texture->byte_size();
+        }
+    }
+    stats.evictions = eviction_count;
+    stats.reuploads = reupload_count;
+    return stats;
+}
+
+std::map<const Gosu::Rect*, std::vector<Gosu::TexChunk*>> Gosu::Texture::chunks_by_rect()
+{
+    const std::scoped_lock lock(m_chunks_mutex);
+
+    // Subimages share the rectangle of their parent image and must be moved along with it.
+    std::map<const Rect*, std::vector<TexChunk*>> result;
+    for (TexChunk* chunk : m_chunks) {
+        result[chunk->rect_handle().get()].push_back(chunk);
+    }
+    return result;
+}
+
+bool Gosu::Texture::evacuate_into(const std::vector<std::shared_ptr<Texture>>& targets)
+{
+    // Keep this texture alive even if the last TexChunk moves away during this method.
+    const std::shared_ptr<Texture> self = shared_from_this();
+    // This is a recursive mutex because TexChunk::relocate will unregister itself from this
+    // texture.
+    const std::scoped_lock lock(m_chunks_mutex);
+
+    if (!supports_copy()) {
+        return m_chunks.empty();
+    }
+
+    // Reserve space for every rectangle before moving anything, so that a texture that cannot be
+    // emptied completely stays as it is, instead of being left half-evacuated for nothing.
+    struct Move
+    {
+        const Rect old_rect;
+        std::shared_ptr<Texture> target;
+        std::shared_ptr<const Rect> new_rect;
+        std::vector<TexChunk*> chunks;
+    };
+    std::vector<Move> moves;
+    for (auto& [rect_handle, chunks] : chunks_by_rect()) {
+        // TexChunks without a rect_handle own the whole texture; they cannot be moved.
+        if (rect_handle == nullptr) {
+            return false;
+        }
+        Move move { *rect_handle, nullptr, nullptr, std::move(chunks) };
+        for (const auto& target : targets) {
+            if (target.get() == this || target->retro() != m_retro
+                || target->m_format != m_format || target->m_premultiplied != m_premultiplied) {
+                continue;
+            }
+            move.new_rect = target->m_bin_packer.alloc(move.old_rect.width, move.old_rect.height);
+            if (move.new_rect) {
+                move.target = target;
+                break;
+            }
+        }
+        if (!move.new_rect) {
+            // Release the reserved rectangles in reverse order, so that they merge back together.
+            while (!moves.empty()) {
+                moves.pop_back();
+            }
+            return false;
+        }
+        moves.push_back(std::move(move));
+    }
+
+    for (const Move& move : moves) {
+        move.target->copy_rect(*this, move.old_rect, move.new_rect->x, move.new_rect->y);
+        for (TexChunk* chunk : move.chunks) {
+            chunk->relocate(move.target, move.new_rect->x - move.old_rect.x,
+                            move.new_rect->y - move.old_rect.y, move.new_rect);
+        }
+    }
+
+    return m_chunks.empty();
+}
+
+std::shared_ptr<Gosu::Texture> Gosu::Texture::grow(int width, int height)
+{
+    const std::shared_ptr<Texture> self = shared_from_this();
+    const std::scoped_lock lock(m_chunks_mutex);
+
+    const auto result = std::make_shared<Texture>(width, height, *this);
+
+    const auto chunks_by_rect = this->chunks_by_rect();
+    for (const auto& [rect_handle, chunks] : chunks_by_rect) {
+        if (rect_handle == nullptr) {
+            throw std::logic_error("Gosu::Texture::grow: Texture is not a texture atlas");
+        }
+        const std::shared_ptr<const Rect> new_rect_handle =
+            result->m_bin_packer.adopt(*rect_handle);
+        for (TexChunk* chunk : chunks) {
+            chunk->relocate(result, 0, 0, new_rect_handle);
+        }
+    }
+
+    // Rectangles whose TexChunks have already been deleted can still be referenced by the draw
+    // queue, which keeps them allocated here and therefore also in the new texture. The queued
+    // DrawOps draw from this texture, not from the new one, so release them there right away.
+    std::set<const Rect*> released;
+    for (const auto& weak_rect : m_released_rects) {
+        const std::shared_ptr<const Rect> rect = weak_rect.lock();
+        if (rect && !chunks_by_rect.contains(rect.get()) && released.insert(rect.get()).second) {
+            result->m_bin_packer.add_free_rect(*rect);
+        }
+    }
+
+    return result;
+}
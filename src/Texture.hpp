@@ -2,9 +2,16 @@
 
 #include <Gosu/Fwd.hpp>
 #include "BinPacker.hpp"
+#include "CompressedBitmap.hpp"
 #include "TexChunk.hpp"
+#include "TextureArray.hpp"
+#include <atomic>
 #include <cstdint>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace Gosu
 {
@@ -13,19 +20,126 @@ namespace Gosu
         BinPacker m_bin_packer;
         std::uint32_t m_tex_name;
         const bool m_retro;
+        const TextureFormat m_format;
+        // Whether the pixels are stored with premultiplied alpha, see set_premultiplied_alpha().
+        const bool m_premultiplied;
+        // Set if this texture is a layer of a texture array instead of a GL_TEXTURE_2D.
+        const std::shared_ptr<TextureArray> m_array;
+        const int m_layer;
+        // All TexChunks that currently refer to this texture, so that they can be relocated.
+        std::vector<TexChunk*> m_chunks;
+        std::recursive_mutex m_chunks_mutex;
+        // The rectangles of TexChunks that have been unregistered. Queued DrawOps may still keep
+        // them allocated after their TexChunks are gone; grow() must not carry them over.
+        std::vector<std::weak_ptr<const Rect>> m_released_rects;
 
+        friend class TexChunk;
+        void register_chunk(TexChunk* chunk);
+        void unregister_chunk(TexChunk* chunk);
+        /// Groups the TexChunks on this texture by the rectangle that was allocated for them.
+        std::map<const Rect*, std::vector<TexChunk*>> chunks_by_rect();
+
+        void create_gl_texture();
+        /// Implements insert() after the bitmap has been converted.
+        void upload(const Bitmap& bitmap, int x, int y);
+
+        // Residency management for set_texture_memory_budget(): Textures that have not been drawn
+        // for a while can be moved into system memory, and are re-uploaded on demand.
+        std::atomic<std::uint64_t> m_last_drawn_frame = 0;
+        mutable std::mutex m_residency_mutex;
+        mutable bool m_resident = true;
+        mutable std::vector<std::uint8_t> m_evicted_data;
+        /// Re-uploads the texture if it has been evicted. Must be called before any access to the
+        /// OpenGL texture's contents.
+        void ensure_resident() const;
     public:
-        Texture(int width, int height, bool retro);
+        /// @param format For block-compressed formats, width and height must be multiples of 4.
+        Texture(int width, int height, bool retro, TextureFormat format = TextureFormat::RGBA8);
+        /// Creates a larger texture with the contents and allocation state of the given texture.
+        /// This is used to implement grow().
+        Texture(int width, int height, Texture& smaller);
+        /// Creates a texture on a new layer of the given texture array. Its size is the size of
+        /// the texture array's layers, and its format is always RGBA8.
+        explicit Texture(const std::shared_ptr<TextureArray>& array);
         ~Texture();
 
         int width() const { return m_bin_packer.width(); }
         int height() const { return m_bin_packer.height(); }
         std::uint32_t tex_name() const { return m_tex_name; }
         bool retro() const { return m_retro; }
+        TextureFormat format() const { return m_format; }
+        bool premultiplied() const { return m_premultiplied; }
+        /// The texture array that this texture is a layer of, or nullptr for a GL_TEXTURE_2D.
+        const std::shared_ptr<TextureArray>& array() const { return m_array; }
+        /// The layer in array(), or -1 for a GL_TEXTURE_2D.
+        int layer() const { return m_layer; }
+        /// The amount of video memory used by this texture, in bytes.
+        std::size_t byte_size() const;
+        /// Returns true if the current OpenGL context can store textures in the given format.
+        static bool supports_format(TextureFormat format);
+        /// Returns true if copy_rect() can copy from and into this texture, which is required for
+        /// evacuate_into() and grow().
+        bool supports_copy() const;
+        /// Returns the portion of this texture that is allocated to images, between 0 and 1.
+        double occupancy();
 
+        bool resident() const;
+        std::uint64_t last_drawn_frame() const { return m_last_drawn_frame; }
+        /// Records that this texture is being drawn in the current frame, and re-uploads it if it
+        /// has been evicted. Called by RenderState whenever the texture is bound for drawing.
+        void prepare_for_drawing();
+        /// Copies the contents of this texture into system memory and releases its video memory.
+        /// The texture name (and therefore all GLTexInfo structs) stays valid.
+        /// Layers of texture arrays cannot be evicted individually; this does nothing for them.
+        void evict();
+        /// Advances the frame counter used for LRU eviction, and evicts the textures that have not
+        /// been drawn for the longest time while the memory budget is exceeded.
+        /// Also completes finished readbacks, see complete_readbacks().
+        /// Called at the end of Viewport::frame.
+        static void finish_frame();
+        /// Fulfills the futures returned by to_bitmap_async() whose transfers have finished.
+        /// Called by finish_frame() and Gosu::flush().
+        /// @param wait If true, blocks until all pending transfers have finished.
+        static void complete_readbacks(bool wait);
+
+        /// If this texture uses a block-compressed format, the bitmap will be compressed by the
+        /// OpenGL driver.
         [[nodiscard]] std::unique_ptr<TexChunk> try_alloc(const Bitmap& bitmap, int padding);
+        /// Allocates an image in the same compressed format as this texture. The image is
+        /// surrounded by a transparent 4px border, because compressed blocks cannot be extended
+        /// like Bitmaps in apply_border_flags().
+        [[nodiscard]] std::unique_ptr<TexChunk> try_alloc(const CompressedBitmap& bitmap);
 
+        /// For block-compressed textures, x and y must be multiples of 4, and so must the size of
+        /// the bitmap, unless it extends to the right or bottom edge of the texture.
+        /// The bitmap is converted to premultiplied alpha if premultiplied() is true.
         void insert(const Bitmap& bitmap, int x, int y);
+        /// Inserts pre-compressed blocks. x and y must be multiples of 4.
+        void insert(const CompressedBitmap& bitmap, int x, int y);
+        /// Lets the OpenGL driver decompress block-compressed pixels, through temporary textures
+        /// no larger than max_texture_size(). The result has straight alpha.
+        static Bitmap decompress(const CompressedBitmap& bitmap);
+        /// Reads back a portion of the texture. Only the requested rectangle is transferred.
+        /// Premultiplied pixels are converted back to straight alpha.
         Bitmap to_bitmap(const Rect& rect) const;
+        /// Starts reading back a portion of the texture through a pixel buffer object. The
+        /// returned future becomes ready in the next call to complete_readbacks() after the GPU
+        /// has finished the transfer, usually at the end of the current or next frame.
+        /// Any thread may call get() on it, but the thread that renders frames must not call
+        /// get() before the future is ready, because it would wait for itself.
+        std::future<Bitmap> to_bitmap_async(const Rect& rect) const;
+
+        /// Copies a portion of another texture into this one, without a roundtrip through RAM.
+        void copy_rect(const Texture& source, const Rect& source_rect, int x, int y);
+        /// Tries to move all TexChunks on this texture onto the given textures, and updates their
+        /// texture coordinates. Only textures with the same retro(), format() and premultiplied()
+        /// settings will be considered.
+        /// Returns true if no TexChunks remain on this texture. If not all images fit onto the
+        /// targets, none of them are moved.
+        bool evacuate_into(const std::vector<std::shared_ptr<Texture>>& targets);
+        /// Creates a larger copy of this texture and moves all TexChunks onto it, keeping their
+        /// positions. This texture stays valid for anything that still references it (e.g. macros
+        /// or the current frame's draw queue), but it should not be used for new images.
+        std::shared_ptr<Texture> grow(int width, int height);
     };
 }
@@ -0,0 +1,148 @@
+#include "TextureArray.hpp"
+#include "OpenGLContext.hpp"
+#include "Shaders.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+#ifndef GOSU_IS_OPENGLES
+    int max_layers()
+    {
+        GLint layers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+        return std::max(layers, 1);
+    }
+#endif
+}
+
+Gosu::TextureArray::TextureArray(int size, bool retro)
+    : m_size(size),
+      m_retro(retro)
+{
+    if (size <= 0) {
+        throw std::invalid_argument("Gosu::TextureArray must not be empty");
+    }
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Texture arrays are not supported in OpenGL ES");
+#else
+    const OpenGLContext current_context;
+    glGenTextures(1, &m_tex_name);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_name);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, retro ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#endif
+}
+
+Gosu::TextureArray::~TextureArray()
+{
+    try {
+        const OpenGLContext current_context;
+        glDeleteTextures(1, &m_tex_name);
+    } catch (...)
+    {
+        // Leaking is better than throwing in a destructor.
+    }
+}
+
+bool Gosu::TextureArray::supported()
+{
+    static const bool supported = fragment_shader_supported(FragmentShader::TEXTURE_ARRAY);
+    return supported;
+}
+
+void Gosu::TextureArray::resize_storage(int layers)
+{
+#ifndef GOSU_IS_OPENGLES
+    GOSU_LOAD_GL_EXT(glTexImage3D, PFNGLTEXIMAGE3DPROC);
+    GOSU_LOAD_GL_EXT(glTexSubImage3D, PFNGLTEXSUBIMAGE3DPROC);
+
+    const int old_layers = static_cast<int>(m_layers.size());
+    const bool can_copy_image = SDL_GL_ExtensionSupported("GL_ARB_copy_image");
+    GLuint temporary_texture = 0;
+    std::vector<std::uint8_t> old_pixels;
+
+    // Save the existing layers, preferably without a roundtrip through RAM.
+    if (old_layers > 0 && can_copy_image) {
+        GOSU_LOAD_GL_EXT(glCopyImageSubData, PFNGLCOPYIMAGESUBDATAPROC);
+        glGenTextures(1, &temporary_texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, temporary_texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, m_size, m_size, old_layers, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+        glCopyImageSubData(m_tex_name, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, //
+                           temporary_texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, //
+                           m_size, m_size, old_layers);
+    }
+    else if (old_layers > 0) {
+        old_pixels.resize(static_cast<std::size_t>(m_size) * m_size * 4 * old_layers);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_name);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, old_pixels.data());
+    }
+
+    // Replacing the storage keeps the texture name, which is referenced by GLTexInfo structs,
+    // queued draw operations and macros.
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_name);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, m_size, m_size, layers, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+
+    if (temporary_texture != 0) {
+        GOSU_LOAD_GL_EXT(glCopyImageSubData, PFNGLCOPYIMAGESUBDATAPROC);
+        glCopyImageSubData(temporary_texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, //
+                           m_tex_name, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, //
+                           m_size, m_size, old_layers);
+        glDeleteTextures(1, &temporary_texture);
+    }
+    else if (!old_pixels.empty()) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, m_size, m_size, old_layers, GL_RGBA,
+                        GL_UNSIGNED_BYTE, old_pixels.data());
+    }
+
+    m_layers.resize(layers, nullptr);
+#endif
+}
+
+bool Gosu::TextureArray::has_free_layer()
+{
+#ifdef GOSU_IS_OPENGLES
+    return false;
+#else
+    const OpenGLContext current_context;
+    const std::scoped_lock lock(m_layers_mutex);
+    return std::ranges::find(m_layers, nullptr) != m_layers.end()
+        || static_cast<int>(m_layers.size()) < max_layers();
+#endif
+}
+
+int Gosu::TextureArray::acquire_layer(Texture* texture)
+{
+#ifdef GOSU_IS_OPENGLES
+    throw std::logic_error("Texture arrays are not supported in OpenGL ES");
+#else
+    const OpenGLContext current_context;
+    const std::scoped_lock lock(m_layers_mutex);
+
+    auto free_layer = std::ranges::find(m_layers, nullptr);
+    if (free_layer == m_layers.end()) {
+        const int layers = static_cast<int>(m_layers.size());
+        if (layers >= max_layers()) {
+            throw std::logic_error("Gosu::TextureArray has no free layers");
+        }
+        // Double the number of layers to make copying existing layers a rare event.
+        resize_storage(std::min(std::max(layers * 2, 1), max_layers()));
+        free_layer = m_layers.begin() + layers;
+    }
+    *free_layer = texture;
+    return static_cast<int>(free_layer - m_layers.begin());
+#endif
+}
+
+void Gosu::TextureArray::release_layer(int layer)
+{
+    const std::scoped_lock lock(m_layers_mutex);
+    if (layer < 0 || layer >= static_cast<int>(m_layers.size())) {
+        throw std::invalid_argument("Gosu::TextureArray::release_layer: Invalid layer");
+    }
+    m_layers[layer] = nullptr;
+}
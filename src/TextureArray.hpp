@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Utility.hpp>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Gosu
+{
+    class Texture;
+
+    /// A GL_TEXTURE_2D_ARRAY whose layers are used as texture atlases, see
+    /// set_texture_array_atlases(). Each layer is represented by a Texture that has its own
+    /// BinPacker. Because all layers share one texture name, images on different layers can be
+    /// drawn without rebinding textures; the layer is passed as the third texture coordinate.
+    class TextureArray : private Noncopyable
+    {
+        const int m_size;
+        const bool m_retro;
+        std::uint32_t m_tex_name = 0;
+        /// One entry per allocated layer; nullptr for layers that are not in use.
+        std::vector<Texture*> m_layers;
+        std::mutex m_layers_mutex;
+
+        void resize_storage(int layers);
+
+    public:
+        /// @param size The width and height of each layer.
+        TextureArray(int size, bool retro);
+        ~TextureArray();
+
+        int size() const { return m_size; }
+        bool retro() const { return m_retro; }
+        /// This name stays the same when more layers are added.
+        std::uint32_t tex_name() const { return m_tex_name; }
+
+        /// Returns true if the current OpenGL context supports texture arrays and the shader that
+        /// is needed to sample them (FragmentShader::TEXTURE_ARRAY).
+        static bool supported();
+
+        /// Returns true if acquire_layer() will succeed.
+        bool has_free_layer();
+        /// Reserves a layer for the given texture, adding layers to the OpenGL texture as needed.
+        /// The contents of the returned layer are undefined.
+        int acquire_layer(Texture* texture);
+        void release_layer(int layer);
+    };
+}
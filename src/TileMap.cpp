@@ -0,0 +1,313 @@
+#include <Gosu/TileMap.hpp>
+#include <Gosu/Graphics.hpp>
+#include <Gosu/Image.hpp>
+#include <Gosu/Transform.hpp>
+#include <Gosu/Utility.hpp>
+#include "GLShadowState.hpp"
+#include "OpenGLContext.hpp"
+#include "RenderState.hpp"
+#include "ShaderPipeline.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+namespace
+{
+    bool vertex_buffers_supported()
+    {
+#ifdef GOSU_IS_OPENGLES
+        return false;
+#else
+        static const bool supported = SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object");
+        return supported;
+#endif
+    }
+
+    /// The tiles of one chunk of a TileMap, compiled into vertex arrays.
+    struct Chunk : private Gosu::Noncopyable
+    {
+        Gosu::VertexArrays vertex_arrays;
+        /// Set when a tile changes; the vertex arrays are then recompiled by the next draw().
+        bool needs_recording = true;
+        /// A vertex buffer that contains the vertices of all vertex arrays, one after another.
+        GLuint buffer = 0;
+        bool needs_upload = true;
+
+        ~Chunk()
+        {
+#ifndef GOSU_IS_OPENGLES
+            if (buffer == 0) {
+                return;
+            }
+            try {
+                const Gosu::OpenGLContext current_context;
+                GOSU_LOAD_GL_EXT(glDeleteBuffers, PFNGLDELETEBUFFERSPROC);
+                glDeleteBuffers(1, &buffer);
+            } catch (...)
+            {
+                // Leaking is better than throwing in a destructor.
+            }
+#endif
+        }
+
+        /// Binds the vertex buffer, uploading the vertex arrays first if they have changed.
+        void bind_buffer()
+        {
+#ifndef GOSU_IS_OPENGLES
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            if (buffer == 0) {
+                GOSU_LOAD_GL_EXT(glGenBuffers, PFNGLGENBUFFERSPROC);
+                glGenBuffers(1, &buffer);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            if (needs_upload) {
+                GOSU_LOAD_GL_EXT(glBufferData, PFNGLBUFFERDATAPROC);
+                std::vector<Gosu::ArrayVertex> vertices;
+                for (const auto& vertex_array : vertex_arrays) {
+                    vertices.insert(vertices.end(), vertex_array.vertices.begin(),
+                                    vertex_array.vertices.end());
+                }
+                glBufferData(GL_ARRAY_BUFFER,
+                             static_cast<GLsizeiptr>(vertices.size() * sizeof(Gosu::ArrayVertex)),
+                             vertices.data(), GL_STATIC_DRAW);
+                needs_upload = false;
+            }
+#endif
+        }
+    };
+}
+
+struct Gosu::TileMap::Impl : private Gosu::Noncopyable
+{
+    std::vector<Image> tiles;
+    int columns, rows, chunk_size;
+    int tile_width, tile_height;
+    std::vector<int> cells;
+    int chunk_columns, chunk_rows;
+    std::vector<Chunk> chunks;
+
+    Impl(std::vector<Image> tiles, int columns, int rows, int chunk_size)
+    : tiles(std::move(tiles)),
+      columns(columns),
+      rows(rows),
+      chunk_size(chunk_size),
+      tile_width(0),
+      tile_height(0),
+      cells(static_cast<std::size_t>(columns) * rows, NO_TILE),
+      chunk_columns((columns + chunk_size - 1) / chunk_size),
+      chunk_rows((rows + chunk_size - 1) / chunk_size),
+      chunks(static_cast<std::size_t>(chunk_columns) * chunk_rows)
+    {
+        tile_width = static_cast<int>(this->tiles.front().width());
+        tile_height = static_cast<int>(this->tiles.front().height());
+    }
+
+    int& cell(int column, int row)
+    {
+        if (column < 0 || column >= columns || row < 0 || row >= rows) {
+            throw std::invalid_argument("Gosu::TileMap: Cell is outside of the map");
+        }
+        return cells[static_cast<std::size_t>(row) * columns + column];
+    }
+
+    Chunk& chunk(int chunk_column, int chunk_row)
+    {
+        return chunks[static_cast<std::size_t>(chunk_row) * chunk_columns + chunk_column];
+    }
+
+    void record_chunk(int chunk_column, int chunk_row)
+    {
+        Chunk& chunk = this->chunk(chunk_column, chunk_row);
+        const int first_column = chunk_column * chunk_size;
+        const int first_row = chunk_row * chunk_size;
+        const int last_column = std::min(first_column + chunk_size, columns);
+        const int last_row = std::min(first_row + chunk_size, rows);
+
+        // All chunks use the same coordinate system, so that the whole map can be drawn with one
+        // transform.
+        chunk.vertex_arrays = record_vertex_arrays([&] {
+            for (int row = first_row; row < last_row; ++row) {
+                for (int column = first_column; column < last_column; ++column) {
+                    const int tile = cell(column, row);
+                    if (tile != NO_TILE) {
+                        tiles[tile].draw(1.0 * column * tile_width, 1.0 * row * tile_height, 0);
+                    }
+                }
+            }
+        });
+        chunk.needs_recording = false;
+        chunk.needs_upload = true;
+    }
+
+    /// Finds the chunks that are visible through the given transform, which maps from map to
+    /// framebuffer coordinates. Returns false if no chunk is visible.
+    bool visible_chunks(const Transform& transform, int& min_column, int& min_row,
+                        int& max_column, int& max_row) const
+    {
+        min_column = min_row = 0;
+        max_column = chunk_columns - 1;
+        max_row = chunk_rows - 1;
+
+        double left, top, right, bottom;
+        if (tile_width == 0 || tile_height == 0
+            || !GLShadowState::current().visible_rect(transform, left, top, right, bottom)) {
+            return false;
+        }
+
+        const double chunk_width = 1.0 * chunk_size * tile_width;
+        const double chunk_height = 1.0 * chunk_size * tile_height;
+        const auto clamp_index = [](double index, int count) {
+            return static_cast<int>(std::clamp(std::floor(index), -1.0, 1.0 * count));
+        };
+        min_column = std::max(min_column, clamp_index(left / chunk_width, chunk_columns));
+        max_column = std::min(max_column, clamp_index(right / chunk_width, chunk_columns));
+        min_row = std::max(min_row, clamp_index(top / chunk_height, chunk_rows));
+        max_row = std::min(max_row, clamp_index(bottom / chunk_height, chunk_rows));
+        return min_column <= max_column && min_row <= max_row;
+    }
+
+    void draw_chunks(const Transform& transform)
+    {
+#ifndef GOSU_IS_OPENGLES
+        glEnable(GL_BLEND);
+        glMatrixMode(GL_MODELVIEW);
+
+        // Combine the map's transform with the one that was set up for this GL block.
+        Transform modelview;
+        glGetDoublev(GL_MODELVIEW_MATRIX, modelview.matrix.data());
+        const Transform full_transform = transform * modelview;
+
+        int min_column, min_row, max_column, max_row;
+        if (!visible_chunks(full_transform, min_column, min_row, max_column, max_row)) {
+            return;
+        }
+
+        if (ShaderPipeline::enabled()) {
+            ShaderPipeline pipeline;
+            for (int row = min_row; row <= max_row; ++row) {
+                for (int column = min_column; column <= max_column; ++column) {
+                    for (const auto& vertex_array : chunk(column, row).vertex_arrays) {
+                        pipeline.draw(vertex_array, full_transform);
+                    }
+                }
+            }
+            return;
+        }
+
+        glMultMatrixd(transform.matrix.data());
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnableClientState(GL_VERTEX_ARRAY);
+
+        const bool use_buffers = vertex_buffers_supported();
+        for (int row = min_row; row <= max_row; ++row) {
+            for (int column = min_column; column <= max_column; ++column) {
+                Chunk& chunk = this->chunk(column, row);
+                if (chunk.vertex_arrays.empty()) {
+                    continue;
+                }
+                if (use_buffers) {
+                    chunk.bind_buffer();
+                }
+                std::size_t first = 0;
+                for (const auto& vertex_array : chunk.vertex_arrays) {
+                    vertex_array.render_state.apply();
+                    // With a vertex buffer, the pointers are byte offsets into the buffer.
+                    const auto pointer = [&](std::size_t member_offset) {
+                        return use_buffers
+                            ? reinterpret_cast<const void*>(first * sizeof(ArrayVertex)
+                                                            + member_offset)
+                            : reinterpret_cast<const char*>(vertex_array.vertices.data())
+                                + member_offset;
+                    };
+                    glTexCoordPointer(3, GL_FLOAT, sizeof(ArrayVertex),
+                                      pointer(offsetof(ArrayVertex, tex_coords)));
+                    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ArrayVertex),
+                                   pointer(offsetof(ArrayVertex, color)));
+                    glVertexPointer(3, GL_FLOAT, sizeof(ArrayVertex),
+                                    pointer(offsetof(ArrayVertex, vertices)));
+                    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(vertex_array.vertices.size()));
+                    first += vertex_array.vertices.size();
+                }
+            }
+        }
+
+        if (use_buffers) {
+            GOSU_LOAD_GL_EXT(glBindBuffer, PFNGLBINDBUFFERPROC);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+#endif
+    }
+};
+
+Gosu::TileMap::TileMap(std::vector<Image> tiles, int columns, int rows, int chunk_size)
+{
+    if (tiles.empty()) {
+        throw std::invalid_argument("Gosu::TileMap needs at least one tile");
+    }
+    for (const Image& tile : tiles) {
+        if (tile.width() != tiles.front().width() || tile.height() != tiles.front().height()) {
+            throw std::invalid_argument("Gosu::TileMap: All tiles must have the same size");
+        }
+    }
+    if (columns < 0 || rows < 0 || chunk_size <= 0) {
+        throw std::invalid_argument("Gosu::TileMap: Invalid size");
+    }
+
+    m_impl = std::make_shared<Impl>(std::move(tiles), columns, rows, chunk_size);
+}
+
+int Gosu::TileMap::columns() const
+{
+    return m_impl->columns;
+}
+
+int Gosu::TileMap::rows() const
+{
+    return m_impl->rows;
+}
+
+int Gosu::TileMap::tile_width() const
+{
+    return m_impl->tile_width;
+}
+
+int Gosu::TileMap::tile_height() const
+{
+    return m_impl->tile_height;
+}
+
+int Gosu::TileMap::tile(int column, int row) const
+{
+    return m_impl->cell(column, row);
+}
+
+void Gosu::TileMap::set_tile(int column, int row, int tile)
+{
+    if (tile < NO_TILE || tile >= static_cast<int>(m_impl->tiles.size())) {
+        throw std::invalid_argument("Gosu::TileMap::set_tile: Invalid tile index");
+    }
+    int& cell = m_impl->cell(column, row);
+    if (cell != tile) {
+        cell = tile;
+        m_impl->chunk(column / m_impl->chunk_size, row / m_impl->chunk_size).needs_recording
+            = true;
+    }
+}
+
+void Gosu::TileMap::draw(double x, double y, ZPos z, double scale_x, double scale_y) const
+{
+    // Recording uses the current draw queue, so it cannot happen inside of the GL block.
+    for (int row = 0; row < m_impl->chunk_rows; ++row) {
+        for (int column = 0; column < m_impl->chunk_columns; ++column) {
+            if (m_impl->chunk(column, row).needs_recording) {
+                m_impl->record_chunk(column, row);
+            }
+        }
+    }
+
+    const Transform transform = Transform::scale(scale_x, scale_y) * Transform::translate(x, y);
+    Gosu::gl(z, [impl = m_impl, transform] { impl->draw_chunks(transform); },
+             GLS_BLEND | GLS_TEXTURES | GLS_MATRICES | GLS_SCISSOR | GLS_SHADERS);
+}
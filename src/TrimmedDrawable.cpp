@@ -0,0 +1,110 @@
+#include "TrimmedDrawable.hpp"
+#include <Gosu/Bitmap.hpp>
+#include "EmptyDrawable.hpp"
+#include "GraphicsImpl.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+Gosu::TrimmedDrawable::TrimmedDrawable(int width, int height, const Rect& rect,
+                                       std::unique_ptr<Drawable> data)
+    : m_width(width),
+      m_height(height),
+      m_rect(rect),
+      m_data(std::move(data))
+{
+    if (!Rect::covering(*this).contains(rect) || rect.empty() || !m_data) {
+        throw std::invalid_argument("Invalid TrimmedDrawable rect");
+    }
+}
+
+void Gosu::TrimmedDrawable::draw(double x1, double y1, Color c1, double x2, double y2, Color c2,
+                                 double x3, double y3, Color c3, double x4, double y4, Color c4,
+                                 ZPos z, BlendMode mode) const
+{
+    normalize_coordinates(x1, y1, x2, y2, x3, y3, c3, x4, y4, c4);
+
+    const double rel_x_l = 1.0 * m_rect.x / m_width;
+    const double rel_x_r = 1.0 * m_rect.right() / m_width;
+    const double rel_y_t = 1.0 * m_rect.y / m_height;
+    const double rel_y_b = 1.0 * m_rect.bottom() / m_height;
+
+    // Same as in TiledDrawable: Interpolate between the four corners of the full image.
+    const auto lerp_2d = [](const auto& v1, const auto& v2, const auto& v3, const auto& v4,
+                            double x_weight, double y_weight) {
+        using std::lerp;
+        return lerp(lerp(v1, v3, y_weight), lerp(v2, v4, y_weight), x_weight);
+    };
+    const auto corner = [&](double rel_x, double rel_y, double& x, double& y, Color& c) {
+        x = lerp_2d(x1, x2, x3, x4, rel_x, rel_y);
+        y = lerp_2d(y1, y2, y3, y4, rel_x, rel_y);
+        c = lerp_2d(c1, c2, c3, c4, rel_x, rel_y);
+    };
+
+    double x_t_l, y_t_l, x_t_r, y_t_r, x_b_l, y_b_l, x_b_r, y_b_r;
+    Color c_t_l, c_t_r, c_b_l, c_b_r;
+    corner(rel_x_l, rel_y_t, x_t_l, y_t_l, c_t_l);
+    corner(rel_x_r, rel_y_t, x_t_r, y_t_r, c_t_r);
+    corner(rel_x_l, rel_y_b, x_b_l, y_b_l, c_b_l);
+    corner(rel_x_r, rel_y_b, x_b_r, y_b_r, c_b_r);
+
+    m_data->draw(x_t_l, y_t_l, c_t_l, x_t_r, y_t_r, c_t_r, //
+                 x_b_l, y_b_l, c_b_l, x_b_r, y_b_r, c_b_r, z, mode);
+}
+
+std::unique_ptr<Gosu::Drawable> Gosu::TrimmedDrawable::subimage(const Rect& rect) const
+{
+    if (!Rect::covering(*this).contains(rect)) {
+        throw std::invalid_argument("Gosu::TrimmedDrawable::subimage cannot exceed parent size");
+    }
+
+    // The part of the subimage that is stored, relative to this image.
+    Rect stored_rect = m_rect;
+    stored_rect.clip_to(rect);
+    if (stored_rect.empty()) {
+        return std::make_unique<EmptyDrawable>(rect.width, rect.height);
+    }
+
+    std::unique_ptr<Drawable> data = m_data->subimage(Rect { stored_rect.x - m_rect.x,
+                                                             stored_rect.y - m_rect.y,
+                                                             stored_rect.width,
+                                                             stored_rect.height });
+    if (!data || stored_rect == rect) {
+        return data;
+    }
+    const Rect relative_rect { stored_rect.x - rect.x, stored_rect.y - rect.y, stored_rect.width,
+                               stored_rect.height };
+    return std::make_unique<TrimmedDrawable>(rect.width, rect.height, relative_rect,
+                                             std::move(data));
+}
+
+Gosu::Bitmap Gosu::TrimmedDrawable::to_bitmap() const
+{
+    Bitmap bitmap(m_width, m_height);
+    bitmap.insert(m_data->to_bitmap(), m_rect.x, m_rect.y);
+    return bitmap;
+}
+
+void Gosu::TrimmedDrawable::insert(const Bitmap& bitmap, int x, int y)
+{
+    m_data->insert(bitmap, x - m_rect.x, y - m_rect.y);
+}
+
+Gosu::Rect Gosu::visible_bounds(const Bitmap& bitmap, const Rect& rect)
+{
+    int left = rect.right(), right = rect.x, top = rect.bottom(), bottom = rect.y;
+    for (int y = rect.y; y < rect.bottom(); ++y) {
+        for (int x = rect.x; x < rect.right(); ++x) {
+            if (bitmap.pixel(x, y).alpha != 0) {
+                left = std::min(left, x);
+                right = std::max(right, x + 1);
+                top = std::min(top, y);
+                bottom = std::max(bottom, y + 1);
+            }
+        }
+    }
+    if (left >= right) {
+        return Rect { rect.x, rect.y, 0, 0 };
+    }
+    return Rect { left, top, right - left, bottom - top };
+}
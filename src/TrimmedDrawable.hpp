@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Drawable.hpp>
+#include <Gosu/Utility.hpp>
+#include <memory>
+
+namespace Gosu
+{
+    /// An image that only stores the part of its bitmap that is not fully transparent, see
+    /// IF_TRIM_TRANSPARENT. Drawing it only draws that part, but width() and height() still
+    /// return the full size.
+    class TrimmedDrawable : public Drawable
+    {
+        int m_width, m_height;
+        /// The part of this image that is stored in m_data.
+        Rect m_rect;
+        std::unique_ptr<Drawable> m_data;
+
+    public:
+        /// @param width The full width of the image.
+        /// @param height The full height of the image.
+        /// @param rect The part of the image that data represents.
+        TrimmedDrawable(int width, int height, const Rect& rect, std::unique_ptr<Drawable> data);
+
+        int width() const override { return m_width; }
+        int height() const override { return m_height; }
+
+        void draw(double x1, double y1, Color c1, //
+                  double x2, double y2, Color c2, //
+                  double x3, double y3, Color c3, //
+                  double x4, double y4, Color c4, //
+                  ZPos z, BlendMode mode) const override;
+
+        /// The texture coordinates of the stored part would not match the full image.
+        const GLTexInfo* gl_tex_info() const override { return nullptr; }
+
+        std::unique_ptr<Drawable> subimage(const Rect& rect) const override;
+
+        Bitmap to_bitmap() const override;
+
+        /// Only the part of the bitmap that overlaps the stored part of the image is inserted.
+        void insert(const Bitmap& bitmap, int x, int y) override;
+    };
+
+    /// Returns the smallest rectangle within rect that contains all pixels of the bitmap that are
+    /// not fully transparent. The result is empty if all pixels are transparent.
+    Rect visible_bounds(const Bitmap& bitmap, const Rect& rect);
+}
@@ -3,13 +3,99 @@
 #include <Gosu/Text.hpp>
 #include <Gosu/Utility.hpp>
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GOSU_HAS_SSE2
+#include <emmintrin.h>
+#endif
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
+namespace
+{
+    /// Blends a color into a row of pixels, weighted by 8-bit coverage values, with the same
+    /// results as calling Bitmap::blend_pixel for each pixel.
+    void blend_coverage_row(Gosu::Bitmap& bitmap, int x, int y, const std::uint8_t* coverage,
+                            int count, Gosu::Color c)
+    {
+        int i = 0;
+#ifdef GOSU_HAS_SSE2
+        // Blend four pixels at a time. All intermediate values are integers below 2^17, which are
+        // exact in single precision. Truncating their quotients gives the same results as integer
+        // division, because quotients are either integers or at least 1/255 away from the next one.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i byte_mask = _mm_set1_epi32(0xff);
+        const __m128 max_channel = _mm_set1_ps(255);
+        const __m128 color_alpha = _mm_set1_ps(c.alpha);
+        const __m128 red = _mm_set1_ps(c.red);
+        const __m128 green = _mm_set1_ps(c.green);
+        const __m128 blue = _mm_set1_ps(c.blue);
+        const __m128i color_rgb = _mm_set1_epi32(c.red | c.green << 8 | c.blue << 16);
+        const auto select = [](__m128i mask, __m128i if_true, __m128i if_false) {
+            return _mm_or_si128(_mm_and_si128(mask, if_true), _mm_andnot_si128(mask, if_false));
+        };
+
+        for (; i + 4 <= count; i += 4) {
+            std::int32_t coverage4;
+            std::memcpy(&coverage4, coverage + i, sizeof coverage4);
+            const __m128i coverage32 = _mm_unpacklo_epi16(
+                _mm_unpacklo_epi8(_mm_cvtsi32_si128(coverage4), zero), zero);
+            // src_alpha = coverage * c.alpha / 255
+            const __m128i src_alpha = _mm_cvttps_epi32(_mm_div_ps(
+                _mm_mul_ps(_mm_cvtepi32_ps(coverage32), color_alpha), max_channel));
+            const __m128 src_alpha_f = _mm_cvtepi32_ps(src_alpha);
+
+            auto* pixels = reinterpret_cast<__m128i*>(&bitmap.pixel(x + i, y));
+            const __m128i dst = _mm_loadu_si128(pixels);
+            const __m128i dst_alpha = _mm_srli_epi32(dst, 24);
+            // inv_alpha = dst_alpha * (255 - src_alpha) / 255
+            const __m128 inv_alpha_f = _mm_cvtepi32_ps(_mm_cvttps_epi32(
+                _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(dst_alpha),
+                                      _mm_sub_ps(max_channel, src_alpha_f)),
+                           max_channel)));
+            const __m128 out_alpha_f = _mm_add_ps(src_alpha_f, inv_alpha_f);
+
+            // channel = (source * src_alpha + dst_channel * inv_alpha) / out_alpha
+            const auto blend_channel = [&](__m128 source, int shift) {
+                const __m128 dst_channel = _mm_cvtepi32_ps(
+                    _mm_and_si128(_mm_srl_epi32(dst, _mm_cvtsi32_si128(shift)), byte_mask));
+                const __m128 sum = _mm_add_ps(_mm_mul_ps(source, src_alpha_f),
+                                              _mm_mul_ps(dst_channel, inv_alpha_f));
+                return _mm_sll_epi32(_mm_cvttps_epi32(_mm_div_ps(sum, out_alpha_f)),
+                                     _mm_cvtsi32_si128(shift));
+            };
+            __m128i result = _mm_or_si128(
+                _mm_or_si128(blend_channel(red, 0), blend_channel(green, 8)),
+                _mm_or_si128(blend_channel(blue, 16),
+                             _mm_slli_epi32(_mm_cvttps_epi32(out_alpha_f), 24)));
+
+            // Transparent pixels and opaque colors are replaced instead of blended.
+            const __m128i replace = _mm_or_si128(_mm_cmpeq_epi32(dst_alpha, zero),
+                                                 _mm_cmpeq_epi32(src_alpha, byte_mask));
+            result = select(replace, _mm_or_si128(color_rgb, _mm_slli_epi32(src_alpha, 24)),
+                            result);
+            // Pixels that are not covered at all stay as they are. This also discards the lanes in
+            // which out_alpha was 0.
+            result = select(_mm_cmpeq_epi32(src_alpha, zero), dst, result);
+            _mm_storeu_si128(pixels, result);
+        }
+#endif
+        for (; i < count; ++i) {
+            bitmap.blend_pixel(x + i, y, c.with_alpha(coverage[i] * c.alpha / 255));
+        }
+    }
+}
+
 struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
 {
     stbtt_fontinfo info {};
@@ -23,6 +109,28 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
     // height = 1px.
     double base_scale;
 
+    /// The horizontal metrics of a glyph, in internal font metrics.
+    struct GlyphMetrics
+    {
+        /// The index of the glyph, or 0 if this font does not contain the codepoint.
+        int glyph = 0;
+        int advance = 0;
+        /// Whether the glyph has an outline at all, which whitespace does not.
+        bool has_box = false;
+        /// The horizontal extent of the outline.
+        int x0 = 0, x1 = 0;
+    };
+
+    // Text is measured much more often than it is drawn (e.g. for word-wrapping), and looking up
+    // glyph indices, metrics and kerning in the font tables is comparatively slow, so all of these
+    // are cached. Latin-1 glyphs are looked up in advance and can be read without locking.
+    std::array<GlyphMetrics, 256> latin1_metrics;
+    std::shared_mutex cache_mutex;
+    std::unordered_map<char32_t, GlyphMetrics> metrics_cache;
+    // Keys are pairs of glyph indices, which TrueType limits to 16 bits each.
+    std::unordered_map<std::uint32_t, int> kerning_cache;
+    bool has_kerning = false;
+
     Impl(const std::uint8_t* ttf_data, std::shared_ptr<TrueTypeFont> fallback)
         : fallback(std::move(fallback))
     {
@@ -37,6 +145,60 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
         stbtt_GetFontVMetrics(&info, &ascent, &descent, &line_gap);
         int height = ascent - descent + line_gap;
         base_scale = 1.0 / height;
+
+        for (char32_t codepoint = 0; codepoint < latin1_metrics.size(); ++codepoint) {
+            latin1_metrics[codepoint] = look_up_metrics(codepoint);
+        }
+        has_kerning = info.kern != 0 || info.gpos != 0;
+    }
+
+    GlyphMetrics look_up_metrics(char32_t codepoint) const
+    {
+        GlyphMetrics metrics;
+        metrics.glyph = stbtt_FindGlyphIndex(&info, static_cast<int>(codepoint));
+        if (metrics.glyph != 0) {
+            stbtt_GetGlyphHMetrics(&info, metrics.glyph, &metrics.advance, nullptr);
+            metrics.has_box = stbtt_GetGlyphBox(&info, metrics.glyph, &metrics.x0, nullptr,
+                                                &metrics.x1, nullptr);
+        }
+        return metrics;
+    }
+
+    GlyphMetrics metrics(char32_t codepoint)
+    {
+        if (codepoint < latin1_metrics.size()) {
+            return latin1_metrics[codepoint];
+        }
+        {
+            const std::shared_lock lock(cache_mutex);
+            if (const auto iterator = metrics_cache.find(codepoint);
+                iterator != metrics_cache.end()) {
+                return iterator->second;
+            }
+        }
+        const GlyphMetrics metrics = look_up_metrics(codepoint);
+        const std::unique_lock lock(cache_mutex);
+        metrics_cache.try_emplace(codepoint, metrics);
+        return metrics;
+    }
+
+    int kerning(int left_glyph, int right_glyph)
+    {
+        if (!has_kerning) {
+            return 0;
+        }
+        const std::uint32_t key = static_cast<std::uint32_t>(left_glyph) << 16
+            | static_cast<std::uint32_t>(right_glyph);
+        {
+            const std::shared_lock lock(cache_mutex);
+            if (const auto iterator = kerning_cache.find(key); iterator != kerning_cache.end()) {
+                return iterator->second;
+            }
+        }
+        const int kerning = stbtt_GetGlyphKernAdvance(&info, left_glyph, right_glyph);
+        const std::unique_lock lock(cache_mutex);
+        kerning_cache.try_emplace(key, kerning);
+        return kerning;
     }
 
     // This method always measures text, and also draws it if (bitmap != nullptr).
@@ -51,7 +213,7 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
 
         double scale = base_scale * height;
         int last_glyph = 0;
-        int last_advance = 0;
+        GlyphMetrics last_metrics;
 
         for (std::size_t index = 0; index < text.size(); ++index) {
             auto codepoint = text[index];
@@ -60,7 +222,8 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
                 continue;
             }
 
-            int glyph = stbtt_FindGlyphIndex(&info, static_cast<int>(codepoint));
+            const GlyphMetrics metrics = this->metrics(codepoint);
+            const int glyph = metrics.glyph;
             // Handle missing characters in this font...
             if (glyph == 0) {
                 if (fallback) {
@@ -77,7 +240,7 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
             }
 
             if (last_glyph) {
-                x += stbtt_GetGlyphKernAdvance(&info, last_glyph, glyph) * scale;
+                x += kerning(last_glyph, glyph) * scale;
             }
 
             // Now finally draw the glyph (if a bitmap was passed).
@@ -89,12 +252,9 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
                 draw_glyph(*bitmap, x, y, c, glyph, scale);
             }
 
-            int advance;
-            stbtt_GetGlyphHMetrics(&info, glyph, &advance, nullptr);
-
-            x += advance * scale;
+            x += metrics.advance * scale;
             last_glyph = glyph;
-            last_advance = advance;
+            last_metrics = metrics;
         }
 
         // If this is the end of the string, we need to take another look at the last glyph to avoid
@@ -103,20 +263,21 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
             int ix = static_cast<int>(x);
             float shift_x = static_cast<float>(x - ix);
             float fscale = static_cast<float>(scale);
-            int last_xoff, last_width;
-            // TODO: Don't allocate a buffer just to get metrics!
-            std::shared_ptr<std::uint8_t> unused_data {
-                stbtt_GetGlyphBitmapSubpixel(&info, fscale, fscale, shift_x, 0, last_glyph,
-                                             &last_width, nullptr, &last_xoff, nullptr),
-                std::free
-            };
+            // This calculates the same horizontal bounding box as stbtt_GetGlyphBitmapBoxSubpixel,
+            // but from the cached metrics.
+            int last_xoff = 0, last_width = 0;
+            if (last_metrics.has_box) {
+                last_xoff = static_cast<int>(std::floor(last_metrics.x0 * fscale + shift_x));
+                last_width
+                    = static_cast<int>(std::ceil(last_metrics.x1 * fscale + shift_x)) - last_xoff;
+            }
             // Move the cursor to the right if pixels have been touched by draw_glyph that are
             // to the right of the current cursor.
             // If the last character extends to the right of the cursor, then this prevents the
             // rightmost pixels from being truncated.
             // If the last character was whitespace, then last_width will be 0 (no pixel data)
             // and the cursor is what counts.
-            x = std::max<double>(x, x - last_advance * scale + last_xoff + last_width);
+            x = std::max<double>(x, x - last_metrics.advance * scale + last_xoff + last_width);
         }
 
         // Never return a negative value from this method because it is used to determine bitmap
@@ -131,7 +292,7 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
         for (std::size_t index = from_index; index < text.size(); ++index) {
             auto codepoint = text[index];
             // Stop as soon as a glyph (except control characters) is available in the current font.
-            if (codepoint >= ' ' && stbtt_FindGlyphIndex(&info, static_cast<int>(codepoint)) != 0) {
+            if (codepoint >= ' ' && metrics(codepoint).glyph != 0) {
                 break;
             }
 
@@ -149,16 +310,61 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
         float shift_x = static_cast<float>(fx - x);
         float shift_y = static_cast<float>(fy - y);
 
+        int x0, y0, x1, y1;
+        stbtt_GetGlyphBitmapBoxSubpixel(&info, glyph, fscale, fscale, shift_x, shift_y, //
+                                        &x0, &y0, &x1, &y1);
+        const int w = x1 - x0, h = y1 - y0;
+        if (w <= 0 || h <= 0) {
+            return;
+        }
+
+        // Rasterize into a buffer that is reused by all draw_glyph calls on the same thread,
+        // instead of having stb_truetype allocate a fresh one for each glyph.
+        thread_local std::vector<std::uint8_t> coverage;
+        coverage.resize(static_cast<std::size_t>(w) * h);
+        stbtt_MakeGlyphBitmapSubpixel(&info, coverage.data(), w, h, w, fscale, fscale, shift_x,
+                                      shift_y, glyph);
+
+        int target_y = static_cast<int>(y + ascent * scale + y0);
+        blend_into_bitmap(bitmap, coverage.data(), x + x0, target_y, w, h, c);
+    }
+
+    double draw_distance_field(char32_t codepoint, double height, Bitmap& bitmap, double x,
+                               double y, int spread)
+    {
+        const std::u32string text(1, codepoint);
+        // Like draw_text(), skip control characters.
+        const int glyph = codepoint < ' ' ? 0 : metrics(codepoint).glyph;
+        if (glyph == 0) {
+            return fallback ? fallback->m_impl->draw_distance_field(codepoint, height, bitmap, x, y,
+                                                                    spread)
+                            : draw_text(text, true, height, nullptr, x, y, Color::NONE);
+        }
+
+        const double scale = base_scale * height;
         int w, h, xoff, yoff;
-        // As an optimization, this method/class could try to re-use a buffer for rasterization
-        // instead of having stb_truetype allocate a fresh one for each draw_glyph call.
-        std::shared_ptr<std::uint8_t> pixels(stbtt_GetGlyphBitmapSubpixel(&info, fscale, fscale, //
-                                                                          shift_x, shift_y, glyph,
-                                                                          &w, &h, &xoff, &yoff),
-                                             std::free);
-
-        int target_y = static_cast<int>(y + ascent * scale + yoff);
-        blend_into_bitmap(bitmap, pixels.get(), x + xoff, target_y, w, h, c);
+        // Each step of 128 / spread corresponds to one pixel, so that the distances reach 0 at the
+        // end of the padding that stb_truetype adds around the glyph.
+        const std::shared_ptr<std::uint8_t> distances(
+            stbtt_GetGlyphSDF(&info, static_cast<float>(scale), glyph, spread, 128,
+                              128.0f / static_cast<float>(spread), &w, &h, &xoff, &yoff),
+            std::free);
+        // Whitespace has no distance field at all.
+        if (distances) {
+            const int left = static_cast<int>(x) + xoff;
+            const int top = static_cast<int>(y + ascent * scale) + yoff;
+            for (int rel_y = 0; rel_y < h; ++rel_y) {
+                for (int rel_x = 0; rel_x < w; ++rel_x) {
+                    if (left + rel_x >= 0 && left + rel_x < bitmap.width() && top + rel_y >= 0
+                        && top + rel_y < bitmap.height()) {
+                        bitmap.pixel(left + rel_x, top + rel_y)
+                            = Color::WHITE.with_alpha(distances.get()[rel_y * w + rel_x]);
+                    }
+                }
+            }
+        }
+
+        return draw_text(text, true, height, nullptr, x, y, Color::NONE);
     }
 
     static void blend_into_bitmap(Bitmap& bitmap, const std::uint8_t* pixels, //
@@ -186,12 +392,12 @@ struct Gosu::TrueTypeFont::Impl : private Gosu::Noncopyable
         w = std::min<int>(w, bitmap.width() - x);
         h = std::min<int>(h, bitmap.height() - y);
 
+        if (c.alpha == 0 || w <= 0) {
+            return;
+        }
         for (int rel_y = 0; rel_y < h; ++rel_y) {
-            for (int rel_x = 0; rel_x < w; ++rel_x) {
-                int pixel = pixels[(src_y + rel_y) * stride + src_x + rel_x];
-                Color c_with_alpha = c.with_alpha(pixel * c.alpha / 255);
-                bitmap.blend_pixel(x + rel_x, y + rel_y, c_with_alpha);
-            }
+            blend_coverage_row(bitmap, x, y + rel_y, pixels + (src_y + rel_y) * stride + src_x, w,
+                               c);
         }
     }
 };
@@ -208,6 +414,12 @@ double Gosu::TrueTypeFont::draw_text(const std::u32string& text, double height,
     return m_impl->draw_text(text, true, height, bitmap, x, y, c);
 }
 
+double Gosu::TrueTypeFont::draw_distance_field(char32_t codepoint, double height, Bitmap& bitmap,
+                                               double x, double y, int spread)
+{
+    return m_impl->draw_distance_field(codepoint, height, bitmap, x, y, spread);
+}
+
 bool Gosu::TrueTypeFont::matches(const std::uint8_t* ttf_data, const std::string& font_name,
                                  unsigned font_flags)
 {
@@ -20,9 +20,18 @@ namespace Gosu
         /// Returns the right edge of a string when rendered onto a bitmap at the given position,
         /// and with the given height.
         /// If (bitmap != nullptr), the text is also rendered onto the bitmap.
+        /// Several threads can call this at the same time, as long as they use different bitmaps.
         double draw_text(const std::u32string& text, double height, //
                          Bitmap* bitmap, double x, double y, Color c);
 
+        /// Renders a single character as a signed distance field, see IF_DISTANCE_FIELD: The alpha
+        /// channel of the white pixels is 128 at the edge of the glyph, and changes by 128 / spread
+        /// per pixel towards the inside (up) and the outside (down) of the glyph, so the bitmap
+        /// needs spread pixels of room around the glyph. Pixels are overwritten, not blended.
+        /// Returns the same value as draw_text().
+        double draw_distance_field(char32_t codepoint, double height, //
+                                   Bitmap& bitmap, double x, double y, int spread);
+
         /// Returns true if the supplied buffer seems to be a font of the given name.
         static bool matches(const std::uint8_t* ttf_data, //
                             const std::string& font_name, unsigned font_flags);
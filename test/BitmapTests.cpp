@@ -3,6 +3,7 @@
 #include <Gosu/Bitmap.hpp>
 #include "TestHelper.hpp"
 #include <algorithm> // for std::copy_n
+#include <chrono>
 #include <climits> // for INT_MAX
 #include <filesystem>
 #include <numeric> // for std::iota
@@ -229,6 +230,37 @@ TEST_F(BitmapTests, apply_color_key)
     ASSERT_EQ(bitmap, expected_result);
 }
 
+TEST_F(BitmapTests, premultiply_alpha)
+{
+    Gosu::Bitmap bitmap(4, 1);
+    assign_pixels(bitmap, { 0xff'ff8000, 0x80'ffffff, 0x40'804020, 0x00'ffffff });
+    bitmap.premultiply_alpha();
+
+    Gosu::Bitmap expected_result(4, 1);
+    assign_pixels(expected_result, { 0xff'ff8000, 0x80'808080, 0x40'201008, 0x00'000000 });
+    ASSERT_EQ(bitmap, expected_result);
+
+    // Converting back restores all opaque pixels exactly, and other visible pixels within the
+    // precision that is left. Invisible pixels lose their color.
+    bitmap.unpremultiply_alpha();
+    assign_pixels(expected_result, { 0xff'ff8000, 0x80'ffffff, 0x40'804020, 0x00'000000 });
+    ASSERT_EQ(bitmap, expected_result);
+}
+
+TEST_F(BitmapTests, opaque)
+{
+    Gosu::Bitmap bitmap(3, 2, Gosu::Color::RED);
+    ASSERT_TRUE(bitmap.opaque());
+    bitmap.pixel(2, 1).alpha = 254;
+    ASSERT_FALSE(bitmap.opaque());
+    ASSERT_TRUE(Gosu::Bitmap().opaque());
+
+    ASSERT_TRUE(bitmap.opaque(Gosu::Rect { 0, 0, 2, 2 }));
+    ASSERT_FALSE(bitmap.opaque(Gosu::Rect { 1, 1, 2, 1 }));
+    ASSERT_TRUE(bitmap.opaque(Gosu::Rect { 2, 1, 0, 0 }));
+    ASSERT_THROW(bitmap.opaque(Gosu::Rect { 1, 1, 3, 1 }), std::invalid_argument);
+}
+
 TEST_F(BitmapTests, insert_fuzzing)
 {
     std::random_device rd;
@@ -319,6 +351,45 @@ TEST_F(BitmapTests, image_format_roundtrips)
     }
 }
 
+TEST_F(BitmapTests, image_cache)
+{
+    const auto temp_dir = std::filesystem::temp_directory_path();
+    const auto cache_dir = temp_dir / "gosu_image_cache_test";
+    std::filesystem::remove_all(cache_dir);
+    const std::string temp_filename = temp_dir / "image_cache_test.png";
+    const Gosu::Bitmap original = Gosu::load_image_file("test_image_io/alpha-png32.png");
+    Gosu::save_image_file(original, temp_filename);
+
+    Gosu::set_image_cache_directory(cache_dir.string());
+    const ScopeGuard disable_cache([&] {
+        Gosu::set_image_cache_directory("");
+        std::filesystem::remove_all(cache_dir);
+        std::filesystem::remove(temp_filename);
+    });
+    // The first call decodes the file and fills the cache, the second one uses the cache entry.
+    ASSERT_EQ(Gosu::load_image_file(temp_filename), original);
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(cache_dir),
+                            std::filesystem::directory_iterator()),
+              1);
+    Gosu::Bitmap cached_image = Gosu::load_image_file(temp_filename);
+    ASSERT_EQ(cached_image, original);
+    // Changes to a cached bitmap are not written back into the cache.
+    cached_image.pixel(0, 0) = Gosu::Color::FUCHSIA;
+    ASSERT_EQ(Gosu::load_image_file(temp_filename), original);
+
+    // Touching the source file refreshes the entry, even while it is still mapped.
+    std::filesystem::last_write_time(temp_filename, std::filesystem::file_time_type::clock::now()
+                                                        + std::chrono::seconds(1));
+    ASSERT_EQ(Gosu::load_image_file(temp_filename), original);
+    ASSERT_EQ(cached_image.pixel(0, 0), Gosu::Color::FUCHSIA);
+    ASSERT_EQ(Gosu::load_image_file(temp_filename), original);
+
+    // Changing the source file invalidates the cache entry.
+    const Gosu::Bitmap red(3, 3, Gosu::Color::RED);
+    Gosu::save_image_file(red, temp_filename);
+    ASSERT_EQ(Gosu::load_image_file(temp_filename), red);
+}
+
 TEST_F(BitmapTests, image_io_errors)
 {
     ASSERT_THROW(Gosu::load_image_file(""), std::runtime_error);
@@ -7,8 +7,13 @@
 #include <Gosu/Transform.hpp>
 #include <Gosu/Utility.hpp>
 #include <Gosu/Window.hpp>
+#include "TestHelper.hpp"
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
+#include <vector>
 
 class DrawableTests : public testing::Test
 {
@@ -80,8 +85,14 @@ TEST_F(DrawableTests, texture_allocation)
 
 TEST_F(DrawableTests, large_texture_allocation)
 {
-    // This bitmap can only be represented by a tiled drawable because it exceeds MAX_TEXTURE_SIZE.
-    const Gosu::Bitmap red(Gosu::MAX_TEXTURE_SIZE + 5, Gosu::MAX_TEXTURE_SIZE * 3, 0xff'ff0000);
+    // Use a small texture size limit so that this test does not require huge bitmaps.
+    Gosu::set_max_texture_size(1024);
+    const ScopeGuard restore_max_texture_size([] { Gosu::set_max_texture_size(4096); });
+    const int max_size = static_cast<int>(Gosu::max_texture_size());
+    ASSERT_EQ(max_size, 1024);
+
+    // This bitmap can only be represented by a tiled drawable because it exceeds max_size.
+    const Gosu::Bitmap red(max_size + 5, max_size * 3, 0xff'ff0000);
     auto tiled_drawable
         = Gosu::create_drawable(red, Gosu::Rect::covering(red), Gosu::IF_TILEABLE_TOP);
 
@@ -107,6 +118,96 @@ TEST_F(DrawableTests, large_texture_allocation)
     }
 }
 
+TEST_F(DrawableTests, texture_atlas_compaction)
+{
+    // Use small texture atlases so that the images are spread across several of them.
+    Gosu::set_max_texture_size(256);
+    const ScopeGuard restore_max_texture_size([] { Gosu::set_max_texture_size(4096); });
+
+    std::vector<std::unique_ptr<Gosu::Drawable>> drawables;
+    std::vector<Gosu::Bitmap> bitmaps;
+    for (int i = 0; i < 24; ++i) {
+        bitmaps.emplace_back(90 + i % 3 * 5, 100 - i % 4 * 5,
+                             Gosu::Color(0xff'000000 | (i * 0x08'10'18)));
+        drawables.push_back(
+            Gosu::create_drawable(bitmaps.back(), Gosu::Rect::covering(bitmaps.back()), 0));
+    }
+    // Free every other image so that the texture atlases become sparsely populated.
+    for (int i = 23; i >= 0; i -= 2) {
+        drawables.erase(drawables.begin() + i);
+        bitmaps.erase(bitmaps.begin() + i);
+    }
+    const auto count_textures = [&] {
+        std::set<std::uint32_t> tex_names;
+        for (const auto& drawable : drawables) {
+            tex_names.insert(drawable->gl_tex_info()->tex_name);
+        }
+        return tex_names.size();
+    };
+    const std::size_t textures_before = count_textures();
+    ASSERT_GE(textures_before, 2);
+    const Gosu::GLTexInfo* first_tex_info = drawables[0]->gl_tex_info();
+
+    ASSERT_GT(Gosu::compact_texture_atlases(), 0);
+    ASSERT_LT(count_textures(), textures_before);
+
+    // The images may have moved, but their contents and GLTexInfo objects are the same.
+    ASSERT_EQ(drawables[0]->gl_tex_info(), first_tex_info);
+    for (std::size_t i = 0; i < drawables.size(); ++i) {
+        ASSERT_EQ(drawables[i]->to_bitmap(), bitmaps[i]);
+    }
+}
+
+TEST_F(DrawableTests, automatic_atlas_compaction)
+{
+    Gosu::set_max_texture_size(256);
+    const ScopeGuard restore_max_texture_size([] { Gosu::set_max_texture_size(4096); });
+    Gosu::set_atlas_compaction_threshold(0.9);
+    const ScopeGuard restore_threshold([] { Gosu::set_atlas_compaction_threshold(0); });
+
+    std::vector<std::unique_ptr<Gosu::Drawable>> drawables;
+    const Gosu::Bitmap bitmap(100, 100, Gosu::Color::RED);
+    for (int i = 0; i < 16; ++i) {
+        drawables.push_back(Gosu::create_drawable(bitmap, Gosu::Rect::covering(bitmap), 0));
+    }
+    for (int i = 15; i >= 0; i -= 2) {
+        drawables.erase(drawables.begin() + i);
+    }
+    const auto tex_names = [&] {
+        std::vector<std::uint32_t> result;
+        for (const auto& drawable : drawables) {
+            result.push_back(drawable->gl_tex_info()->tex_name);
+        }
+        return result;
+    };
+    const std::vector<std::uint32_t> tex_names_before = tex_names();
+
+    // This image does not fit into the gaps, which requests a compaction. Images are only moved
+    // at the end of the next frame, not on whatever thread is loading images.
+    const Gosu::Bitmap large(200, 200, Gosu::Color::BLUE);
+    const auto large_drawable = Gosu::create_drawable(large, Gosu::Rect::covering(large), 0);
+    ASSERT_EQ(tex_names(), tex_names_before);
+
+    Gosu::Viewport(8, 8).frame([] {});
+    const std::vector<std::uint32_t> tex_names_after = tex_names();
+    ASSERT_LT(std::set(tex_names_after.begin(), tex_names_after.end()).size(),
+              std::set(tex_names_before.begin(), tex_names_before.end()).size());
+    for (const auto& drawable : drawables) {
+        ASSERT_EQ(drawable->to_bitmap(), bitmap);
+    }
+}
+
+TEST_F(DrawableTests, compressed_textures)
+{
+    // Solid colors survive the lossy compression unchanged.
+    const Gosu::Bitmap blue(70, 30, Gosu::Color::BLUE);
+    const auto drawable
+        = Gosu::create_drawable(blue, Gosu::Rect::covering(blue), Gosu::IF_COMPRESSED);
+    ASSERT_EQ(drawable->width(), 70);
+    ASSERT_EQ(drawable->height(), 30);
+    ASSERT_EQ(drawable->to_bitmap(), blue);
+}
+
 // Gosu is not actually ready for multithreading yet, but it turns out that Ruby's garbage collector
 // happily tries to delete images and other objects from background threads. This test verifies that
 // we don't outright crash when this happens.
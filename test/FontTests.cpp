@@ -1,15 +1,45 @@
 #include <gtest/gtest.h>
 
+#include <Gosu/Bitmap.hpp>
 #include <Gosu/Drawable.hpp>
 #include <Gosu/Font.hpp>
 #include <Gosu/Graphics.hpp>
 #include <Gosu/Image.hpp>
 #include "TestHelper.hpp"
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 class FontTests : public testing::Test
 {
 };
 
+/// A drawable that only has a size, and records when it is destroyed.
+class TrackedDrawable : public Gosu::Drawable
+{
+    bool& m_destroyed;
+
+public:
+    explicit TrackedDrawable(bool& destroyed)
+        : m_destroyed(destroyed)
+    {
+    }
+    ~TrackedDrawable() override { m_destroyed = true; }
+
+    int width() const override { return 10; }
+    int height() const override { return 10; }
+    void draw(double, double, Gosu::Color, double, double, Gosu::Color, double, double,
+              Gosu::Color, double, double, Gosu::Color, Gosu::ZPos, Gosu::BlendMode) const override
+    {
+    }
+    const Gosu::GLTexInfo* gl_tex_info() const override { return nullptr; }
+    Gosu::Bitmap to_bitmap() const override { return Gosu::Bitmap(10, 10); }
+    std::unique_ptr<Gosu::Drawable> subimage(const Gosu::Rect&) const override { return nullptr; }
+    void insert(const Gosu::Bitmap&, int, int) override {}
+};
+
 TEST_F(FontTests, text_width)
 {
     const Gosu::Font regular_font(12);
@@ -92,6 +122,40 @@ TEST_F(FontTests, draw_markup_rel)
                                          10, 0));
 }
 
+TEST_F(FontTests, prepare_markup)
+{
+    const Gosu::Font font(10, "media/daniel.otf");
+    const std::string markup = "Hi! <c=f00>Red.\r\nNew   line! Äöß\n";
+
+    const Gosu::TextLayout empty_layout;
+    ASSERT_EQ(empty_layout.width(), 0);
+    ASSERT_EQ(empty_layout.height(), 0);
+
+    const Gosu::TextLayout layout = font.prepare_markup(markup);
+    ASSERT_EQ(layout.width(), font.markup_width(markup));
+    ASSERT_EQ(font.prepare_text("Hallo").width(), font.text_width("Hallo"));
+    ASSERT_EQ(font.prepare_text("&lt;").width(), font.text_width("&lt;"));
+    ASSERT_EQ(font.prepare_text("Two\nlines").height(), 2 * font.height());
+
+    // A prepared layout looks exactly like the markup that it was created from.
+    const Gosu::Bitmap expected = Gosu::render(200, 100, [&] {
+        font.draw_markup(markup, 5, 5, 0, 2.0, 4.0, Gosu::Color::FUCHSIA);
+    }).drawable().to_bitmap();
+    const Gosu::Bitmap actual = Gosu::render(200, 100, [&] {
+        layout.draw(5, 5, 0, 2.0, 4.0, Gosu::Color::FUCHSIA);
+    }).drawable().to_bitmap();
+    ASSERT_EQ(actual, expected);
+
+    // Replacing a glyph (through a copy of the font, which shares its glyphs) only affects the
+    // layouts that are created afterwards.
+    Gosu::Font font_copy = font;
+    font_copy.set_image("H", Gosu::Image());
+    ASSERT_LT(font.prepare_markup(markup).width(), layout.width());
+    ASSERT_EQ(Gosu::render(200, 100, [&] {
+        layout.draw(5, 5, 0, 2.0, 4.0, Gosu::Color::FUCHSIA);
+    }).drawable().to_bitmap(), expected);
+}
+
 TEST_F(FontTests, set_image)
 {
     Gosu::Font font(10, "media/daniel.otf", 0, Gosu::IF_RETRO);
@@ -104,3 +168,109 @@ TEST_F(FontTests, set_image)
     font.set_image("ß", Gosu::Image());
     ASSERT_EQ(font.text_width("ßßß"), 0);
 }
+
+TEST_F(FontTests, set_image_frees_replaced_glyphs)
+{
+    Gosu::Font font(10, "media/daniel.otf");
+
+    bool destroyed = false;
+    font.set_image("a", Gosu::Image(std::make_unique<TrackedDrawable>(destroyed)));
+    ASSERT_EQ(font.text_width("a"), 10);
+
+    // No other thread is using the glyph, so it can be deleted right away.
+    font.set_image("a", Gosu::Image());
+    ASSERT_TRUE(destroyed);
+    ASSERT_EQ(font.text_width("a"), 0);
+}
+
+TEST_F(FontTests, concurrent_text_width)
+{
+    Gosu::Font font(10, "media/daniel.otf");
+    // Glyphs from the Basic Multilingual Plane and beyond, which are stored differently.
+    const std::string text = "Hallo Welt! Äöß 遊戲寫完了沒？ 𝄞";
+    const double width = font.text_width(text);
+
+    std::vector<std::future<double>> widths;
+    for (int i = 0; i < 4; ++i) {
+        widths.push_back(std::async(std::launch::async, [&] {
+            double last_width = 0;
+            for (int j = 0; j < 1000; ++j) {
+                last_width = font.text_width(text);
+            }
+            return last_width;
+        }));
+    }
+    for (auto& future : widths) {
+        ASSERT_EQ(future.get(), width);
+    }
+
+    // Replacing a glyph is visible to all later lookups.
+    font.set_image("W", Gosu::Image());
+    font.set_image("𝄞", Gosu::Image());
+    ASSERT_LT(font.text_width(text), width);
+    ASSERT_EQ(font.text_width("W𝄞"), 0);
+}
+
+TEST_F(FontTests, preload)
+{
+    const Gosu::Font font(10, "media/daniel.otf");
+    ASSERT_THROW(font.preload(0x7f, 0x20), std::invalid_argument);
+    ASSERT_THROW(font.preload("abc", Gosu::FF_COMBINATIONS), std::invalid_argument);
+
+    const std::string markup = "Hallo <b>Hallo</b> Welt! Äöß\n遊戲寫完了沒？";
+    // 1 is the legacy value for IF_TILEABLE, which cannot pack glyphs into shared pages.
+    for (const unsigned image_flags : { 0u, unsigned { Gosu::IF_RETRO }, 1u }) {
+        const Gosu::Font on_demand_font(10, "media/daniel.otf", 0, image_flags);
+        const Gosu::Font preloaded_font(10, "media/daniel.otf", 0, image_flags);
+        ASSERT_EQ(preloaded_font.image_flags(), image_flags);
+        preloaded_font.preload(0x20, 0xff);
+        preloaded_font.preload("遊戲寫完了沒？");
+        preloaded_font.preload("Hallo", Gosu::FF_BOLD);
+
+        // Preloaded glyphs look exactly like the ones that are rendered on demand.
+        ASSERT_EQ(preloaded_font.markup_width(markup), on_demand_font.markup_width(markup));
+        const auto render = [&](const Gosu::Font& font_to_draw) {
+            return Gosu::render(200, 30, [&] {
+                font_to_draw.draw_markup(markup, 5, 5, 0);
+            }).drawable().to_bitmap();
+        };
+        // Allow for rounding differences in texture coordinates when interpolating.
+        ASSERT_TRUE(visible_pixels_are_equal(render(preloaded_font), render(on_demand_font),
+                                             image_flags == Gosu::IF_RETRO ? 0 : 1));
+    }
+}
+
+TEST_F(FontTests, distance_field)
+{
+    const Gosu::Font bitmap_font(20, "media/daniel.otf");
+    ASSERT_THROW(bitmap_font.draw_markup_dilated("Hallo", 2, 0, 0, 0), std::logic_error);
+
+    // All sizes share the same glyphs, so the width of a text grows with the font height.
+    const Gosu::Font small_font(20, "media/daniel.otf", 0, Gosu::IF_DISTANCE_FIELD);
+    const Gosu::Font large_font(60, "media/daniel.otf", 0, Gosu::IF_DISTANCE_FIELD);
+    ASSERT_NEAR(large_font.text_width("Hallo Welt!"), 3 * small_font.text_width("Hallo Welt!"),
+                1e-6);
+
+    // Growing or shrinking the glyphs changes the number of pixels that they fully cover.
+    const auto opaque_pixels = [&](double dilation) {
+        const Gosu::Bitmap bitmap = Gosu::render(300, 120, [&] {
+            if (dilation == 0) {
+                large_font.draw_text("Hallo", 10, 10, 0, 1.5, 1.5);
+            }
+            else {
+                large_font.draw_markup_dilated("Hallo", dilation, 10, 10, 0, 1.5, 1.5);
+            }
+        }).drawable().to_bitmap();
+        int count = 0;
+        for (int y = 0; y < bitmap.height(); ++y) {
+            for (int x = 0; x < bitmap.width(); ++x) {
+                count += bitmap.pixel(x, y).alpha == 255;
+            }
+        }
+        return count;
+    };
+    const int regular = opaque_pixels(0);
+    ASSERT_GT(regular, 0);
+    ASSERT_GT(opaque_pixels(3), regular);
+    ASSERT_LT(opaque_pixels(-2), regular);
+}
@@ -4,9 +4,22 @@
 #include <Gosu/Drawable.hpp>
 #include <Gosu/Graphics.hpp>
 #include <Gosu/Image.hpp>
+#include <Gosu/Transform.hpp>
+#include "../src/OffScreenTarget.hpp"
+#include "../src/OpenGLContext.hpp"
+#include "TestHelper.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 class ImageTests : public testing::Test
 {
+protected:
+    // Render targets that other tests have left in the pool would otherwise be reused.
+    void SetUp() override { Gosu::OffScreenTarget::release_unused(); }
 };
 
 TEST_F(ImageTests, empty_image)
@@ -93,6 +106,389 @@ TEST_F(ImageTests, delete_tex_chunk_during_rendering)
     ASSERT_EQ(result.drawable().to_bitmap(), bitmap);
 }
 
+TEST_F(ImageTests, multi_texture_batching)
+{
+    // Tileable images with a power-of-two size get their own textures. Use more textures than
+    // there are texture units, so that the renderer has to replace some of them.
+    const Gosu::Color colors[] = { Gosu::Color::RED, Gosu::Color::GREEN, Gosu::Color::BLUE };
+    std::vector<Gosu::Image> images;
+    for (int i = 0; i < 20; ++i) {
+        images.emplace_back(Gosu::Bitmap(64, 64, colors[i % 3]), Gosu::IF_TILEABLE);
+    }
+    const auto render_scene = [&] {
+        return Gosu::render(20 * 4, 8, [&] {
+            for (int i = 0; i < 20; ++i) {
+                images[i].draw(i * 4, 0, 0, 4 / 64.0, 4 / 64.0);
+            }
+            // Untextured quads, triangles and lines end the batch, and a new one starts after them.
+            Gosu::draw_rect(0, 4, 8, 4, Gosu::Color::YELLOW, 0);
+            Gosu::draw_triangle(8, 4, Gosu::Color::CYAN, 16, 4, Gosu::Color::CYAN, 8, 8,
+                                Gosu::Color::CYAN, 0);
+            Gosu::draw_line(16, 6, Gosu::Color::WHITE, 24, 6, Gosu::Color::WHITE, 0);
+            images[0].draw(24, 4, 0, 4 / 64.0, 4 / 64.0);
+            images[1].draw(28, 4, 0, 4 / 64.0, 4 / 64.0, Gosu::Color::WHITE, Gosu::BM_ADD);
+        }).drawable().to_bitmap();
+    };
+    const Gosu::Bitmap expected = render_scene();
+
+    Gosu::set_multi_texture_batching(true);
+    const ScopeGuard restore_multi_texture_batching([] {
+        Gosu::set_multi_texture_batching(false);
+    });
+    const Gosu::Bitmap bitmap = render_scene();
+    ASSERT_EQ(bitmap, expected);
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQ(bitmap.pixel(i * 4 + 2, 2), colors[i % 3]);
+    }
+}
+
+TEST_F(ImageTests, shader_pipeline)
+{
+    const Gosu::Image image(Gosu::Bitmap(8, 8, Gosu::Color::RED), Gosu::IF_RETRO);
+    const Gosu::Image macro = Gosu::record(16, 16, [&] {
+        image.draw(0, 0, 0);
+        Gosu::draw_rect(8, 8, 8, 8, Gosu::Color::BLUE, 0);
+    });
+    const auto render_scene = [&] {
+        return Gosu::render(64, 64, [&] {
+            Gosu::draw_rect(0, 0, 64, 8, Gosu::Color::GREEN, 0);
+            Gosu::transform(Gosu::Transform::translate(8, 8), [&] {
+                image.draw(0, 0, 0, 2, 2);
+                Gosu::clip_to(16, 0, 8, 8, [&] { image.draw(16, 0, 0, 2, 2); });
+            });
+            macro.draw(32, 32, 1, 2, 2);
+        }).drawable().to_bitmap();
+    };
+
+    const Gosu::Bitmap expected = render_scene();
+    Gosu::set_shader_pipeline(true);
+    const ScopeGuard restore_shader_pipeline([] { Gosu::set_shader_pipeline(false); });
+    const Gosu::Bitmap actual = render_scene();
+
+    ASSERT_EQ(actual, expected);
+    ASSERT_EQ(actual.pixel(16, 16), Gosu::Color::RED);
+    ASSERT_EQ(actual.pixel(60, 60), Gosu::Color::BLUE);
+}
+
+TEST_F(ImageTests, macro_culling)
+{
+    // Large enough for the macro to sort its quads into buckets.
+    const auto draw_scene = [] {
+        for (int y = 0; y < 2048; y += 128) {
+            for (int x = 0; x < 2048; x += 128) {
+                Gosu::draw_rect(x, y, 96, 96, (x + y) % 256 ? Gosu::Color::RED : Gosu::Color::BLUE,
+                                0);
+            }
+        }
+        // Later quads that overlap several buckets must still be drawn on top.
+        Gosu::draw_rect(200, 200, 700, 40, Gosu::Color::GREEN, 0);
+        Gosu::draw_rect(600, 0, 40, 2048, Gosu::Color::YELLOW, 0);
+    };
+    const Gosu::Image macro = Gosu::record(2048, 2048, draw_scene);
+
+    const ScopeGuard restore_shader_pipeline([] { Gosu::set_shader_pipeline(false); });
+    for (const bool shader_pipeline : { false, true }) {
+        Gosu::set_shader_pipeline(shader_pipeline);
+        for (const auto& [x, y] : { std::pair { 0, 0 }, std::pair { -580, -190 },
+                                    std::pair { -1990, -1990 }, std::pair { 100, -700 } }) {
+            const Gosu::Bitmap expected = Gosu::render(96, 64, [&] {
+                Gosu::transform(Gosu::Transform::translate(x, y), draw_scene);
+            }).drawable().to_bitmap();
+            const Gosu::Bitmap actual = Gosu::render(96, 64, [&] {
+                macro.draw(x, y, 0);
+            }).drawable().to_bitmap();
+            ASSERT_EQ(actual, expected);
+        }
+    }
+}
+
+TEST_F(ImageTests, premultiplied_alpha)
+{
+    Gosu::set_premultiplied_alpha(true);
+    const ScopeGuard restore_premultiplied_alpha([] { Gosu::set_premultiplied_alpha(false); });
+    Gosu::Bitmap bitmap(2, 1);
+    bitmap.pixel(0, 0) = Gosu::Color::RED;
+    const Gosu::Image image(bitmap, Gosu::IF_RETRO);
+    // Reading the image back undoes the conversion.
+    ASSERT_EQ(image.drawable().to_bitmap(), bitmap);
+
+    const Gosu::Bitmap result = Gosu::render(2, 2, [&] {
+        Gosu::draw_rect(0, 0, 2, 2, Gosu::Color::BLUE, 0);
+        image.draw(0, 0, 1);
+        Gosu::draw_rect(0, 1, 2, 1, Gosu::Color::RED, 1, Gosu::BM_ADD);
+    }).drawable().to_bitmap();
+
+    ASSERT_EQ(result.pixel(0, 0), Gosu::Color::RED);
+    ASSERT_EQ(result.pixel(1, 0), Gosu::Color::BLUE);
+    ASSERT_EQ(result.pixel(0, 1), Gosu::Color::FUCHSIA);
+}
+
+TEST_F(ImageTests, render_target_pool)
+{
+    std::uint32_t tex_name;
+    {
+        const Gosu::Image image = Gosu::render(32, 16, [] {});
+        tex_name = image.drawable().gl_tex_info()->tex_name;
+    }
+    // The texture of the deleted image is recycled...
+    Gosu::Image image = Gosu::render(32, 16, [] {
+        Gosu::draw_rect(0, 0, 32, 16, Gosu::Color::RED, 0);
+    });
+    ASSERT_EQ(image.drawable().gl_tex_info()->tex_name, tex_name);
+    // ...but not the texture of an image that is still in use.
+    const Gosu::Image other_image = Gosu::render(32, 16, [] {});
+    ASSERT_NE(other_image.drawable().gl_tex_info()->tex_name, tex_name);
+
+    Gosu::render_into(image, [] { Gosu::draw_rect(0, 0, 10, 16, Gosu::Color::BLUE, 0); });
+    ASSERT_EQ(image.drawable().gl_tex_info()->tex_name, tex_name);
+    const Gosu::Bitmap bitmap = image.drawable().to_bitmap();
+    ASSERT_EQ(bitmap.pixel(5, 8), Gosu::Color::BLUE);
+    ASSERT_EQ(bitmap.pixel(20, 8), Gosu::Color::NONE);
+
+    Gosu::Image loaded_image(Gosu::Bitmap(4, 4, Gosu::Color::RED));
+    ASSERT_THROW(Gosu::render_into(loaded_image, [] {}), std::invalid_argument);
+}
+
+TEST_F(ImageTests, gl_modified_state)
+{
+    const Gosu::Image image(Gosu::Bitmap(4, 4, Gosu::Color::RED), Gosu::IF_RETRO);
+    const auto render_scene = [&](const std::function<void()>& custom_gl) {
+        return Gosu::render(16, 16, [&] {
+            Gosu::transform(Gosu::Transform::translate(2, 2), [&] {
+                Gosu::clip_to(0, 0, 8, 8, [&] {
+                    image.draw(0, 0, 0, 2, 2);
+                    custom_gl();
+                    image.draw(4, 4, 2, 2, 2);
+                    Gosu::draw_rect(6, 0, 4, 4, Gosu::Color::BLUE, 3, Gosu::BM_ADD);
+                });
+            });
+        }).drawable().to_bitmap();
+    };
+    // Custom OpenGL code that changes the state that Gosu depends on, and does not clean up.
+    const auto change_state = [] {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ZERO);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, 0, 1, 1);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glScaled(0.5, 0.5, 1);
+        glEnable(GL_TEXTURE_2D);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    };
+    const unsigned declared_state =
+        Gosu::GLS_BLEND | Gosu::GLS_TEXTURES | Gosu::GLS_MATRICES | Gosu::GLS_SCISSOR;
+
+    const Gosu::Bitmap expected = render_scene([] {});
+    ASSERT_EQ(expected.pixel(3, 3), Gosu::Color::RED);
+    ASSERT_EQ(expected.pixel(12, 12), Gosu::Color::NONE);
+    // Custom OpenGL code must not affect Gosu's rendering, both when Gosu saves the whole state
+    // (the default), and when the code declares what it modifies.
+    ASSERT_EQ(render_scene([&] { Gosu::gl(1, change_state); }), expected);
+    ASSERT_EQ(render_scene([&] { Gosu::gl(change_state); }), expected);
+    ASSERT_EQ(render_scene([&] { Gosu::gl(1, change_state, declared_state); }), expected);
+    ASSERT_EQ(render_scene([&] { Gosu::gl(change_state, declared_state); }), expected);
+}
+
+TEST_F(ImageTests, opaque_pass)
+{
+    const Gosu::Image opaque(Gosu::Bitmap(8, 8, Gosu::Color::RED), Gosu::IF_RETRO);
+    const Gosu::Image translucent(Gosu::Bitmap(8, 8, Gosu::Color::BLUE.with_alpha(128)),
+                                  Gosu::IF_RETRO);
+    const auto render_scene = [&] {
+        return Gosu::render(32, 32, [&] {
+            Gosu::draw_rect(0, 0, 32, 32, Gosu::Color::GREEN, 0);
+            // Same Z: The later image must still be drawn on top.
+            opaque.draw(4, 4, 1, 2, 2);
+            translucent.draw(8, 8, 1, 2, 2);
+            opaque.draw(12, 12, 1);
+            // Opaque image behind a translucent one, and a tinted (translucent) opaque image.
+            translucent.draw(0, 16, 3);
+            opaque.draw(4, 20, 2);
+            opaque.draw(20, 0, 4, 1, 1, Gosu::Color::WHITE.with_alpha(100));
+            Gosu::gl(5, [] {});
+            Gosu::draw_rect(24, 24, 4, 4, Gosu::Color::YELLOW, 6);
+        }).drawable().to_bitmap();
+    };
+
+    const Gosu::Bitmap expected = render_scene();
+    Gosu::set_opaque_pass(true);
+    const ScopeGuard restore_opaque_pass([] { Gosu::set_opaque_pass(false); });
+    const Gosu::Bitmap actual = render_scene();
+
+    ASSERT_EQ(actual, expected);
+    ASSERT_EQ(actual.pixel(14, 14), Gosu::Color::RED);
+    ASSERT_EQ(actual.pixel(1, 1), Gosu::Color::GREEN);
+    ASSERT_EQ(actual.pixel(25, 25), Gosu::Color::YELLOW);
+}
+
+TEST_F(ImageTests, debug_view_frame_stats)
+{
+    const Gosu::Image image(Gosu::Bitmap(8, 8, Gosu::Color::RED), Gosu::IF_RETRO);
+    Gosu::Viewport viewport(32, 16);
+    const auto draw_scene = [&] {
+        Gosu::draw_rect(0, 0, 32, 16, Gosu::Color::GRAY, 0);       // First batch
+        image.draw(0, 0, 0);                                        // Texture
+        image.draw(8, 0, 0);                                        // Same batch
+        Gosu::draw_rect(0, 0, 4, 4, Gosu::Color::RED, 0);           // Texture
+        Gosu::draw_rect(0, 0, 4, 4, Gosu::Color::RED, 0, Gosu::BM_ADD); // Blend mode
+        Gosu::gl(0, [] {});
+        Gosu::draw_rect(0, 0, 2, 2, Gosu::Color::RED, 0);           // GL code
+        Gosu::transform(Gosu::Transform::translate(1, 1), [] {
+            Gosu::draw_rect(0, 0, 2, 2, Gosu::Color::RED, 0);       // Transform
+            Gosu::clip_to(0, 0, 8, 8, [] {
+                Gosu::draw_rect(0, 0, 2, 2, Gosu::Color::RED, 0);   // Clip rect
+            });
+        });
+    };
+
+    viewport.frame(draw_scene);
+    ASSERT_EQ(viewport.frame_stats().draw_ops, 0);
+
+    for (Gosu::DebugView view : { Gosu::DV_STATS, Gosu::DV_OVERDRAW, Gosu::DV_BATCH_BREAKS }) {
+        viewport.set_debug_view(view);
+        viewport.frame(draw_scene);
+        const Gosu::FrameStats& stats = viewport.frame_stats();
+        ASSERT_EQ(stats.draw_ops, 8);
+        ASSERT_EQ(stats.gl_blocks, 1);
+        ASSERT_EQ(stats.batches, 7);
+        ASSERT_EQ(stats.texture_breaks, 2);
+        ASSERT_EQ(stats.transform_breaks, 1);
+        ASSERT_EQ(stats.clip_breaks, 1);
+        ASSERT_EQ(stats.blend_breaks, 1);
+        ASSERT_EQ(stats.primitive_breaks, 0);
+        ASSERT_EQ(stats.gl_block_breaks, 1);
+        ASSERT_DOUBLE_EQ(stats.covered_pixels, 512 + 2 * 64 + 2 * 16 + 3 * 4);
+        ASSERT_DOUBLE_EQ(stats.overdraw, stats.covered_pixels / 512);
+    }
+
+    // The shader pipeline draws textured and untextured shapes in the same batch.
+    Gosu::set_shader_pipeline(true);
+    const ScopeGuard restore_shader_pipeline([] { Gosu::set_shader_pipeline(false); });
+    viewport.set_debug_view(Gosu::DV_BATCH_BREAKS);
+    viewport.frame(draw_scene);
+    const Gosu::FrameStats& stats = viewport.frame_stats();
+    ASSERT_EQ(stats.batches, 5);
+    ASSERT_EQ(stats.texture_breaks, 0);
+    ASSERT_EQ(stats.transform_breaks, 1);
+    ASSERT_EQ(stats.clip_breaks, 1);
+    ASSERT_EQ(stats.blend_breaks, 1);
+    ASSERT_EQ(stats.gl_block_breaks, 1);
+}
+
+TEST_F(ImageTests, trim_transparent)
+{
+    Gosu::Bitmap bitmap(16, 12);
+    bitmap.insert(Gosu::Bitmap(3, 2, Gosu::Color::RED), 5, 7);
+    const Gosu::Image image(bitmap, Gosu::IF_RETRO | Gosu::IF_TRIM_TRANSPARENT);
+    ASSERT_EQ(image.width(), 16);
+    ASSERT_EQ(image.height(), 12);
+    ASSERT_EQ(image.drawable().gl_tex_info(), nullptr);
+    ASSERT_EQ(image.drawable().to_bitmap(), bitmap);
+    // Subimages that only contain transparent pixels do not store anything either.
+    ASSERT_EQ(image.drawable().subimage(Gosu::Rect { 0, 0, 4, 4 })->gl_tex_info(), nullptr);
+    // Subimages that lie completely within the visible part are normal images.
+    ASSERT_NE(image.drawable().subimage(Gosu::Rect { 6, 7, 2, 2 })->gl_tex_info(), nullptr);
+
+    const Gosu::Image untrimmed(bitmap, Gosu::IF_RETRO);
+    const auto draw_scaled = [](const Gosu::Image& image) {
+        return Gosu::render(40, 30, [&] {
+            image.draw(4, 3, 0, 2, 2, Gosu::Color::FUCHSIA);
+        }).drawable().to_bitmap();
+    };
+    ASSERT_EQ(draw_scaled(image), draw_scaled(untrimmed));
+
+    // Images without any visible pixels do not need a texture at all.
+    const Gosu::Image invisible(Gosu::Bitmap(8, 8), Gosu::IF_TRIM_TRANSPARENT);
+    ASSERT_EQ(invisible.width(), 8);
+    ASSERT_EQ(invisible.drawable().gl_tex_info(), nullptr);
+}
+
+TEST_F(ImageTests, image_cache)
+{
+    const auto cache_dir = std::filesystem::temp_directory_path() / "gosu_image_cache_image_test";
+    std::filesystem::remove_all(cache_dir);
+    const std::string filename = "test_image_io/alpha-png32.png";
+    const Gosu::Bitmap original = Gosu::load_image_file(filename);
+
+    Gosu::set_image_cache_directory(cache_dir.string());
+    const ScopeGuard disable_cache([&] {
+        Gosu::set_image_cache_directory("");
+        std::filesystem::remove_all(cache_dir);
+    });
+    const auto cache_entries = [&] {
+        return std::distance(std::filesystem::directory_iterator(cache_dir),
+                             std::filesystem::directory_iterator());
+    };
+
+    // Whole images are cached with their borders, once per combination of tileable edges.
+    const Gosu::Image image(filename, Gosu::IF_TILEABLE_LEFT);
+    ASSERT_EQ(cache_entries(), 1);
+    const Gosu::Image cached_image(filename, Gosu::IF_TILEABLE_LEFT | Gosu::IF_RETRO);
+    ASSERT_EQ(cache_entries(), 1);
+    ASSERT_TRUE(visible_pixels_are_equal(cached_image.drawable().to_bitmap(), original));
+    const Gosu::Image smooth_image(filename);
+    ASSERT_EQ(cache_entries(), 2);
+    ASSERT_TRUE(visible_pixels_are_equal(smooth_image.drawable().to_bitmap(), original));
+}
+
+TEST_F(ImageTests, draw_mesh)
+{
+    Gosu::Bitmap bitmap(4, 4, Gosu::Color::RED);
+    bitmap.insert(Gosu::Bitmap(2, 2, Gosu::Color::GREEN), 2, 0);
+    bitmap.insert(Gosu::Bitmap(2, 2, Gosu::Color::BLUE), 0, 2);
+    const Gosu::Image image(bitmap, Gosu::IF_RETRO);
+
+    // Two indexed triangles that cover the same area as the scaled image.
+    const std::vector<double> vertices { 0, 0, 8, 0, 8, 8, 0, 8 };
+    const std::vector<double> uvs { 0, 0, 1, 0, 1, 1, 0, 1 };
+    const std::vector<std::uint32_t> indices { 0, 1, 2, 0, 2, 3 };
+    const Gosu::Bitmap expected = Gosu::render(8, 8, [&] {
+        image.draw(0, 0, 0, 2, 2);
+    }).drawable().to_bitmap();
+    {
+        const ScopeGuard restore_shader_pipeline([] { Gosu::set_shader_pipeline(false); });
+        for (const bool shader_pipeline : { false, true }) {
+            Gosu::set_shader_pipeline(shader_pipeline);
+            const auto draw_mesh = [&] { image.draw_mesh(vertices, uvs, {}, indices, 0); };
+            ASSERT_EQ(Gosu::render(8, 8, draw_mesh).drawable().to_bitmap(), expected);
+            const Gosu::Image macro = Gosu::record(8, 8, draw_mesh);
+            ASSERT_EQ(Gosu::render(8, 8, [&] { macro.draw(0, 0, 0); }).drawable().to_bitmap(),
+                      expected);
+        }
+    }
+
+    // Without indices, every three vertices form a triangle. The UVs are relative to the image,
+    // not to the texture atlas that it is stored on.
+    const std::vector<double> triangle { 0, 0, 8, 0, 0, 8 };
+    const std::vector<double> mirrored_uvs { 1, 0, 0, 0, 1, 1 };
+    const std::vector<Gosu::Color> colors { Gosu::Color::WHITE };
+    const Gosu::Bitmap mirrored = Gosu::render(8, 8, [&] {
+        image.draw_mesh(triangle, mirrored_uvs, colors, {}, 0);
+    }).drawable().to_bitmap();
+    ASSERT_EQ(mirrored.pixel(1, 1), Gosu::Color::GREEN);
+    ASSERT_EQ(mirrored.pixel(5, 1), Gosu::Color::RED);
+    ASSERT_EQ(mirrored.pixel(7, 7), Gosu::Color::NONE);
+
+    const std::vector<double> odd { 0, 0, 8 };
+    const std::vector<std::uint32_t> incomplete { 0, 1 };
+    const std::vector<std::uint32_t> out_of_range { 0, 1, 4 };
+    const std::vector<Gosu::Color> two_colors { Gosu::Color::RED, Gosu::Color::BLUE };
+    ASSERT_THROW(image.draw_mesh(odd, odd, {}, {}, 0), std::invalid_argument);
+    ASSERT_THROW(image.draw_mesh(vertices, triangle, {}, indices, 0), std::invalid_argument);
+    ASSERT_THROW(image.draw_mesh(vertices, uvs, two_colors, indices, 0), std::invalid_argument);
+    ASSERT_THROW(image.draw_mesh(vertices, uvs, {}, incomplete, 0), std::invalid_argument);
+    ASSERT_THROW(image.draw_mesh(vertices, uvs, {}, out_of_range, 0), std::invalid_argument);
+
+    // Trimmed images are not stored on a texture of their own size.
+    Gosu::Bitmap sprite(4, 4);
+    sprite.pixel(1, 1) = Gosu::Color::RED;
+    const Gosu::Image trimmed(sprite, Gosu::IF_TRIM_TRANSPARENT);
+    ASSERT_THROW(trimmed.draw_mesh(vertices, uvs, {}, indices, 0), std::logic_error);
+    ASSERT_NO_THROW(Gosu::Image().draw_mesh(vertices, uvs, {}, indices, 0));
+}
+
 TEST_F(ImageTests, load_tiles_from_tile)
 {
     const std::vector<Gosu::Image> tiles
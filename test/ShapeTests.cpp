@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+
+#include <Gosu/Bitmap.hpp>
+#include <Gosu/Drawable.hpp>
+#include <Gosu/Graphics.hpp>
+#include <Gosu/Image.hpp>
+#include <Gosu/Shape.hpp>
+#include "TestHelper.hpp"
+#include <cmath>
+#include <functional>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+class ShapeTests : public testing::Test
+{
+protected:
+    static Gosu::Bitmap render(const std::function<void()>& f)
+    {
+        return Gosu::render(32, 32, f).drawable().to_bitmap();
+    }
+
+    static int count_pixels(const Gosu::Bitmap& bitmap, Gosu::Color c)
+    {
+        int count = 0;
+        for (int y = 0; y < bitmap.height(); ++y) {
+            for (int x = 0; x < bitmap.width(); ++x) {
+                count += bitmap.pixel(x, y) == c;
+            }
+        }
+        return count;
+    }
+};
+
+TEST_F(ShapeTests, tessellation)
+{
+    Gosu::Shape shape;
+    ASSERT_THROW(shape.add_polygon(std::vector<double> { 1, 2, 3 }, Gosu::Color::RED),
+                 std::invalid_argument);
+    ASSERT_EQ(shape.triangle_count(), 0);
+    // A concave quadrilateral (an arrowhead pointing right, explicitly closed) needs two
+    // triangles.
+    shape.add_polygon(std::vector<double> { 0, 0, 10, 5, 0, 10, 3, 5, 0, 0 }, Gosu::Color::RED);
+    ASSERT_EQ(shape.triangle_count(), 2);
+    shape.add_polyline(std::vector<double> { 0, 0, 10, 0 }, 2, Gosu::Color::RED);
+    ASSERT_EQ(shape.triangle_count(), 4);
+    // Larger circles need more segments.
+    Gosu::Shape small, large;
+    small.add_circle(0, 0, 2, Gosu::Color::RED);
+    large.add_circle(0, 0, 200, Gosu::Color::RED);
+    ASSERT_GE(small.triangle_count(), 8);
+    ASSERT_GT(large.triangle_count(), small.triangle_count() * 4);
+    shape.clear();
+    ASSERT_EQ(shape.triangle_count(), 0);
+}
+
+TEST_F(ShapeTests, polylines)
+{
+    // A thick line with a mitered right angle is the same as two rectangles.
+    const Gosu::Bitmap expected = render([] {
+        Gosu::draw_rect(4, 2, 18, 4, Gosu::Color::RED, 0);
+        Gosu::draw_rect(18, 6, 4, 14, Gosu::Color::RED, 0);
+    });
+    const std::vector<double> corner { 4, 4, 20, 4, 20, 20 };
+    ASSERT_EQ(render([&] { Gosu::draw_polyline(corner, 4, Gosu::Color::RED, 0); }), expected);
+    // Square caps extend the line by half its width.
+    const Gosu::Bitmap square = render([] {
+        Gosu::draw_polyline(std::vector<double> { 4, 8, 28, 8 }, 4, Gosu::Color::RED, 0,
+                            Gosu::LJ_MITER, Gosu::LC_SQUARE);
+    });
+    ASSERT_EQ(count_pixels(square, Gosu::Color::RED), 28 * 4);
+
+    // No part of a translucent line may be drawn twice, whatever its joins and caps.
+    const Gosu::Color translucent(0x80'ff0000);
+    const std::vector<double> zigzag { 2, 2, 30, 6, 4, 14, 28, 28, 6, 30 };
+    const std::vector<double> triangle { 4, 4, 28, 10, 10, 28 };
+    for (const auto join : { Gosu::LJ_MITER, Gosu::LJ_BEVEL, Gosu::LJ_ROUND }) {
+        for (const auto cap : { Gosu::LC_BUTT, Gosu::LC_SQUARE, Gosu::LC_ROUND }) {
+            for (const auto& bitmap :
+                 { render([&] { Gosu::draw_polyline(zigzag, 3, translucent, 0, join, cap); }),
+                   render([&] {
+                       Gosu::draw_polyline(triangle, 3, translucent, 0, join, cap, true);
+                   }) }) {
+                ASSERT_GT(count_pixels(bitmap, translucent), 50);
+                for (int y = 0; y < 32; ++y) {
+                    for (int x = 0; x < 32; ++x) {
+                        ASSERT_LE(bitmap.pixel(x, y).alpha, 0x80);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_F(ShapeTests, circles_and_polygons)
+{
+    const Gosu::Bitmap circle = render([] { Gosu::draw_circle(16, 16, 12, Gosu::Color::RED, 0); });
+    ASSERT_NEAR(count_pixels(circle, Gosu::Color::RED), std::numbers::pi * 12 * 12, 25);
+    ASSERT_EQ(circle.pixel(16, 16), Gosu::Color::RED);
+    ASSERT_EQ(circle.pixel(3, 3), Gosu::Color::NONE);
+
+    // A ring is a circle without its center.
+    const Gosu::Bitmap ring = render([] {
+        Gosu::draw_arc(16, 16, 10, 0, 360, 4, Gosu::Color::RED, 0);
+    });
+    ASSERT_NEAR(count_pixels(ring, Gosu::Color::RED), std::numbers::pi * (12 * 12 - 8 * 8), 25);
+    ASSERT_EQ(ring.pixel(16, 16), Gosu::Color::NONE);
+    ASSERT_EQ(ring.pixel(16, 5), Gosu::Color::RED);
+    // The right half of the ring: Angles run clockwise from the top.
+    const Gosu::Bitmap arc = render([] {
+        Gosu::draw_arc(16, 16, 10, 0, 180, 4, Gosu::Color::RED, 0);
+    });
+    ASSERT_EQ(arc.pixel(26, 16), Gosu::Color::RED);
+    ASSERT_EQ(arc.pixel(5, 16), Gosu::Color::NONE);
+
+    // An L-shaped, concave polygon.
+    const Gosu::Bitmap polygon = render([] {
+        Gosu::draw_polygon(std::vector<double> { 2, 2, 10, 2, 10, 20, 30, 20, 30, 28, 2, 28 },
+                           Gosu::Color::RED, 0);
+    });
+    ASSERT_EQ(count_pixels(polygon, Gosu::Color::RED), 8 * 18 + 28 * 8);
+}
+
+TEST_F(ShapeTests, cached_shapes)
+{
+    Gosu::Shape shape;
+    shape.add_circle(4, 4, 4, Gosu::Color::RED);
+    shape.add_polyline(std::vector<double> { 0, 10, 8, 10 }, 2, Gosu::Color::BLUE);
+
+    const auto draw_twice = [&] {
+        shape.draw(0, 0, 0);
+        shape.draw(16, 16, 0);
+    };
+    const Gosu::Bitmap expected = render(draw_twice);
+    ASSERT_EQ(expected.pixel(4, 4), Gosu::Color::RED);
+    ASSERT_EQ(expected.pixel(20, 26), Gosu::Color::BLUE);
+
+    // Changing a shape after drawing it does not affect the queued draw operation.
+    const Gosu::Bitmap changed = render([&] {
+        shape.draw(0, 0, 0);
+        shape.draw(16, 16, 0);
+        shape.add_polygon(std::vector<double> { 0, 0, 32, 0, 32, 32, 0, 32 }, Gosu::Color::GREEN);
+    });
+    ASSERT_EQ(changed, expected);
+    shape.clear();
+    shape.add_circle(4, 4, 4, Gosu::Color::RED);
+    shape.add_polyline(std::vector<double> { 0, 10, 8, 10 }, 2, Gosu::Color::BLUE);
+
+    // The shader pipeline and macros draw shapes the same way.
+    {
+        Gosu::set_shader_pipeline(true);
+        const ScopeGuard restore_shader_pipeline([] { Gosu::set_shader_pipeline(false); });
+        ASSERT_EQ(render(draw_twice), expected);
+    }
+    const Gosu::Image macro = Gosu::record(32, 32, draw_twice);
+    ASSERT_EQ(render([&] { macro.draw(0, 0, 0); }), expected);
+}
+
+TEST_F(ShapeTests, overlapping_shape_in_opaque_pass)
+{
+    // The triangles of a shape are drawn in the order in which they were added, even if the shape
+    // is opaque and would otherwise be drawn front-to-back.
+    Gosu::Shape shape;
+    shape.add_polygon(std::vector<double> { 0, 0, 32, 0, 32, 32, 0, 32 }, Gosu::Color::RED);
+    shape.add_circle(16, 16, 8, Gosu::Color::GREEN);
+    const auto draw = [&] { shape.draw(0, 0, 0); };
+    const Gosu::Bitmap expected = render(draw);
+    ASSERT_EQ(expected.pixel(2, 2), Gosu::Color::RED);
+    ASSERT_EQ(expected.pixel(16, 16), Gosu::Color::GREEN);
+
+    Gosu::set_opaque_pass(true);
+    const ScopeGuard restore_opaque_pass([] { Gosu::set_opaque_pass(false); });
+    ASSERT_EQ(render(draw), expected);
+}
+
+TEST_F(ShapeTests, premultiplied_alpha)
+{
+    Gosu::Shape shape;
+    shape.add_polygon(std::vector<double> { 0, 0, 16, 0, 16, 16, 0, 16 },
+                      Gosu::Color::RED.with_alpha(128));
+    const auto draw = [&] {
+        Gosu::draw_rect(0, 0, 32, 32, Gosu::Color::BLUE, 0);
+        shape.draw(0, 0, 1);
+        shape.draw(16, 16, 1, Gosu::BM_ADD);
+    };
+    const Gosu::Bitmap expected = render(draw);
+
+    Gosu::set_premultiplied_alpha(true);
+    const ScopeGuard restore_premultiplied_alpha([] { Gosu::set_premultiplied_alpha(false); });
+    // Draw twice to make sure that the premultiplied triangles are not premultiplied again.
+    ASSERT_TRUE(visible_pixels_are_equal(render(draw), expected, 2));
+    ASSERT_TRUE(visible_pixels_are_equal(render(draw), expected, 2));
+    // Changing the shape also changes its premultiplied triangles.
+    shape.add_circle(8, 8, 4, Gosu::Color::GREEN);
+    ASSERT_EQ(render(draw).pixel(8, 8), Gosu::Color::GREEN);
+}
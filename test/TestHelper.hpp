@@ -3,7 +3,25 @@
 #include <gtest/gtest.h>
 
 #include <Gosu/Bitmap.hpp>
+#include <Gosu/Utility.hpp>
+#include <functional>
 #include <numeric>
+#include <utility>
+
+/// Calls a function when it goes out of scope. Tests use this to reset process-wide settings, so
+/// that a failed assertion does not leave them changed for all following tests.
+class ScopeGuard : private Gosu::Noncopyable
+{
+    std::function<void()> m_f;
+
+public:
+    explicit ScopeGuard(std::function<void()> f)
+        : m_f(std::move(f))
+    {
+    }
+
+    ~ScopeGuard() { m_f(); }
+};
 
 /// Compares two bitmaps, with parameters allowing for different kinds of tolerances.
 /// This is a bit more specific than the Gosu::Bitmap#similar? method from test_helper.rb.
@@ -3,6 +3,7 @@
 #include <Gosu/Bitmap.hpp>
 #include <Gosu/Text.hpp>
 #include "TestHelper.hpp"
+#include <cstdint>
 
 class TextTests : public testing::Test
 {
@@ -80,3 +81,57 @@ TEST_F(TextTests, markup)
         = Gosu::load_image_file("test_text/text-markup-1.png");
     ASSERT_TRUE(visible_pixels_are_equal(centered, centered_expected));
 }
+
+TEST_F(TextTests, text_width_matches_draw_text)
+{
+    // Kerning pairs, whitespace at the end, and characters outside of Latin-1 that are cached
+    // separately (or come from the fallback font).
+    for (const std::u32string text :
+         { U"AVAWAT To Yo", U"Hallo Welt! ", U"Ärger über ħłœ€ƒ", U"遊戲寫完了沒？", U"" }) {
+        for (const char* font_name : { "media/daniel.ttf", "media/daniel.otf" }) {
+            const double width = Gosu::text_width(text, font_name, 30);
+            // Measuring the same text again uses the cached metrics.
+            ASSERT_EQ(Gosu::text_width(text, font_name, 30), width);
+            Gosu::Bitmap bitmap(400, 40);
+            ASSERT_EQ(Gosu::draw_text(bitmap, 0, 0, Gosu::Color::WHITE, text, font_name, 30),
+                      width);
+        }
+    }
+}
+
+TEST_F(TextTests, draw_text_blends_like_blend_pixel)
+{
+    // Characters are drawn one by one, far apart, so that their pixels do not overlap.
+    const auto draw_characters = [](Gosu::Bitmap& bitmap, Gosu::Color c) {
+        const std::u32string characters = U"BÄöW@ÿ!";
+        for (std::size_t i = 0; i < characters.size(); ++i) {
+            Gosu::draw_text(bitmap, 3.5 + 40.0 * i, 2, c, characters.substr(i, 1),
+                            "media/daniel.ttf", 30);
+        }
+    };
+
+    // Drawing opaque white text onto an empty bitmap stores the coverage of each pixel in alpha.
+    Gosu::Bitmap coverage(300, 40);
+    draw_characters(coverage, Gosu::Color::WHITE);
+
+    // Use a background with all kinds of alpha values, and a translucent color.
+    Gosu::Bitmap background(300, 40);
+    for (int y = 0; y < background.height(); ++y) {
+        for (int x = 0; x < background.width(); ++x) {
+            background.pixel(x, y) = static_cast<std::uint32_t>(x) * 0x07'03'05'01u
+                + static_cast<std::uint32_t>(y) * 0x05'06u;
+        }
+    }
+    const Gosu::Color color = 0x80'ff'40'20;
+    Gosu::Bitmap expected = background;
+    for (int y = 0; y < expected.height(); ++y) {
+        for (int x = 0; x < expected.width(); ++x) {
+            expected.blend_pixel(x, y,
+                                 color.with_alpha(coverage.pixel(x, y).alpha * color.alpha / 255));
+        }
+    }
+
+    Gosu::Bitmap actual = background;
+    draw_characters(actual, color);
+    ASSERT_EQ(actual, expected);
+}
@@ -1,16 +1,42 @@
 #include <gtest/gtest.h>
 
 #include <Gosu/Bitmap.hpp>
+#include <Gosu/Buffer.hpp>
 #include <Gosu/Graphics.hpp>
+#include <Gosu/Image.hpp>
 #include "../src/BinPacker.hpp"
+#include "../src/CompressedBitmap.hpp"
+#include "../src/OffScreenTarget.hpp"
 #include "../src/TexChunk.hpp"
 #include "../src/Texture.hpp"
+#include "TestHelper.hpp"
+#include <cstring>
+#include <filesystem>
 #include <random>
 
 class TextureTests : public testing::Test
 {
+protected:
+    // Render targets that other tests have left in the pool would otherwise be reused.
+    void SetUp() override { Gosu::OffScreenTarget::release_unused(); }
 };
 
+namespace
+{
+    /// Creates a BC1 image in which every block has the given RGB565 color.
+    Gosu::CompressedBitmap solid_bc1_image(int width, int height, std::uint16_t rgb565)
+    {
+        const Gosu::CompressedBitmap empty(width, height, Gosu::TextureFormat::BC1);
+        std::vector<std::uint8_t> blocks;
+        for (int i = 0; i < empty.blocks_x() * empty.blocks_y(); ++i) {
+            const auto low = static_cast<std::uint8_t>(rgb565 & 0xff);
+            const auto high = static_cast<std::uint8_t>(rgb565 >> 8);
+            blocks.insert(blocks.end(), { low, high, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });
+        }
+        return Gosu::CompressedBitmap(width, height, Gosu::TextureFormat::BC1, std::move(blocks));
+    }
+}
+
 TEST_F(TextureTests, creation)
 {
     ASSERT_THROW(Gosu::Texture(2, -5, false), std::invalid_argument);
@@ -77,6 +103,331 @@ TEST_F(TextureTests, tex_chunks)
                  std::invalid_argument);
 }
 
+TEST_F(TextureTests, sub_rect_readback)
+{
+    const auto texture_ptr = std::make_shared<Gosu::Texture>(256, 256, false);
+    Gosu::Bitmap bitmap(30, 20, Gosu::Color::BLUE);
+    bitmap.pixel(3, 4) = Gosu::Color::RED;
+    bitmap.pixel(29, 19) = Gosu::Color::GREEN;
+    texture_ptr->insert(bitmap, 100, 50);
+
+    const Gosu::Rect rect { 100, 50, 30, 20 };
+    ASSERT_EQ(texture_ptr->to_bitmap(rect), bitmap);
+
+    std::future<Gosu::Bitmap> future = texture_ptr->to_bitmap_async(rect);
+    // There is no frame that would complete the readback, so wait for it explicitly.
+    Gosu::Texture::complete_readbacks(true);
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    ASSERT_EQ(future.get(), bitmap);
+
+    const Gosu::Bitmap pixel = texture_ptr->to_bitmap(Gosu::Rect { 129, 69, 1, 1 });
+    ASSERT_EQ(pixel.pixel(0, 0), Gosu::Color::GREEN);
+
+    ASSERT_THROW(texture_ptr->to_bitmap_async(Gosu::Rect { 250, 250, 10, 10 }),
+                 std::invalid_argument);
+}
+
+TEST_F(TextureTests, grow)
+{
+    const auto texture_ptr = std::make_shared<Gosu::Texture>(64, 64, false);
+    const Gosu::Bitmap bitmap(40, 30, Gosu::Color::FUCHSIA);
+    const auto chunk_ptr = texture_ptr->try_alloc(bitmap, 1);
+    ASSERT_NE(chunk_ptr, nullptr);
+    ASSERT_EQ(texture_ptr->try_alloc(Gosu::Bitmap(100, 20), 1), nullptr);
+    const Gosu::GLTexInfo* info = chunk_ptr->gl_tex_info();
+
+    ASSERT_THROW(texture_ptr->grow(32, 128), std::invalid_argument);
+    const auto grown_ptr = texture_ptr->grow(128, 128);
+    ASSERT_EQ(grown_ptr->width(), 128);
+    ASSERT_EQ(grown_ptr->height(), 128);
+
+    // The existing chunk has moved into the new texture, keeping its GLTexInfo object.
+    ASSERT_EQ(chunk_ptr->gl_tex_info(), info);
+    ASSERT_EQ(info->tex_name, grown_ptr->tex_name());
+    ASSERT_EQ(chunk_ptr->to_bitmap(), bitmap);
+    // The space that was added to the texture is available for new allocations.
+    ASSERT_NE(grown_ptr->try_alloc(Gosu::Bitmap(100, 20), 1), nullptr);
+}
+
+TEST_F(TextureTests, grow_releases_queued_rects)
+{
+    const auto texture_ptr = std::make_shared<Gosu::Texture>(64, 64, false);
+    const auto kept_ptr = texture_ptr->try_alloc(Gosu::Bitmap(20, 20), 0);
+    auto deleted_ptr = texture_ptr->try_alloc(Gosu::Bitmap(30, 30), 0);
+    // Simulate a DrawOp that keeps the rectangle of a deleted image allocated until it is drawn.
+    const std::shared_ptr<const Gosu::Rect> queued_rect = deleted_ptr->rect_handle();
+    deleted_ptr.reset();
+
+    const auto grown_ptr = texture_ptr->grow(128, 128);
+    // Only the image that still exists takes up space in the new texture.
+    ASSERT_EQ(grown_ptr->occupancy(), 20.0 * 20 / (128 * 128));
+    // The old texture, which the DrawOp would draw from, still holds the rectangle.
+    ASSERT_EQ(texture_ptr->occupancy(), 30.0 * 30 / (64 * 64));
+}
+
+TEST_F(TextureTests, evacuate_into)
+{
+    const auto sparse_ptr = std::make_shared<Gosu::Texture>(128, 128, false);
+    const auto target_ptr = std::make_shared<Gosu::Texture>(128, 128, false);
+    const Gosu::Bitmap red(50, 50, Gosu::Color::RED), blue(20, 70, Gosu::Color::BLUE);
+    const auto red_ptr = sparse_ptr->try_alloc(red, 1);
+    const auto blue_ptr = sparse_ptr->try_alloc(blue, 1);
+    ASSERT_NE(target_ptr->try_alloc(Gosu::Bitmap(100, 30), 1), nullptr);
+    ASSERT_GT(sparse_ptr->occupancy(), 0);
+
+    ASSERT_TRUE(sparse_ptr->evacuate_into({ target_ptr }));
+    ASSERT_EQ(red_ptr->gl_tex_info()->tex_name, target_ptr->tex_name());
+    ASSERT_EQ(blue_ptr->gl_tex_info()->tex_name, target_ptr->tex_name());
+    ASSERT_EQ(red_ptr->to_bitmap(), red);
+    ASSERT_EQ(blue_ptr->to_bitmap(), blue);
+
+    // There is no room for another 128x128 texture's worth of images in a full target.
+    const auto full_ptr = std::make_shared<Gosu::Texture>(128, 128, false);
+    ASSERT_NE(full_ptr->try_alloc(Gosu::Bitmap(120, 120), 1), nullptr);
+    ASSERT_FALSE(full_ptr->evacuate_into({ target_ptr }));
+}
+
+TEST_F(TextureTests, evacuate_into_all_or_nothing)
+{
+    const auto source_ptr = std::make_shared<Gosu::Texture>(128, 128, false);
+    const auto target_ptr = std::make_shared<Gosu::Texture>(64, 64, false);
+    const Gosu::Bitmap red(30, 30, Gosu::Color::RED), blue(100, 20, Gosu::Color::BLUE);
+    const auto red_ptr = source_ptr->try_alloc(red, 1);
+    const auto blue_ptr = source_ptr->try_alloc(blue, 1);
+    const double target_occupancy = target_ptr->occupancy();
+
+    // The red image would fit onto the target, but the blue one does not, so neither moves.
+    ASSERT_FALSE(source_ptr->evacuate_into({ target_ptr }));
+    ASSERT_EQ(red_ptr->gl_tex_info()->tex_name, source_ptr->tex_name());
+    ASSERT_EQ(blue_ptr->gl_tex_info()->tex_name, source_ptr->tex_name());
+    ASSERT_EQ(red_ptr->to_bitmap(), red);
+    ASSERT_EQ(blue_ptr->to_bitmap(), blue);
+    // The space that was reserved on the target has been released again.
+    ASSERT_EQ(target_ptr->occupancy(), target_occupancy);
+    ASSERT_NE(target_ptr->try_alloc(Gosu::Bitmap(62, 62), 1), nullptr);
+}
+
+TEST_F(TextureTests, block_aligned_bin_packing)
+{
+    ASSERT_THROW(Gosu::BinPacker(30, 32, 4), std::invalid_argument);
+    Gosu::BinPacker bin_packer(32, 32, 4);
+    const auto first = bin_packer.alloc(5, 3);
+    const auto second = bin_packer.alloc(7, 7);
+    ASSERT_EQ(first->width, 8);
+    ASSERT_EQ(first->height, 4);
+    for (const auto& rect : { first, second }) {
+        ASSERT_EQ(rect->x % 4, 0);
+        ASSERT_EQ(rect->y % 4, 0);
+    }
+    ASSERT_EQ(bin_packer.free_area(), 32 * 32 - 8 * 4 - 8 * 8);
+}
+
+TEST_F(TextureTests, compressed_image_loading)
+{
+    // A DDS file with a single 4x4 BC1 block (solid red).
+    std::vector<std::uint8_t> dds(128 + 8);
+    std::memcpy(dds.data(), "DDS ", 4);
+    dds[12] = 4; // height
+    dds[16] = 4; // width
+    std::memcpy(dds.data() + 84, "DXT1", 4);
+    dds[128] = 0x00;
+    dds[129] = 0xf8;
+
+    const Gosu::Buffer buffer { std::vector<std::uint8_t>(dds) };
+    ASSERT_TRUE(Gosu::is_compressed_image(buffer));
+    const Gosu::CompressedBitmap bitmap = Gosu::load_compressed_image(buffer);
+    ASSERT_EQ(bitmap.width(), 4);
+    ASSERT_EQ(bitmap.height(), 4);
+    ASSERT_EQ(bitmap.format(), Gosu::TextureFormat::BC1);
+    ASSERT_EQ(bitmap.size(), 8u);
+
+    dds.pop_back();
+    ASSERT_THROW(Gosu::load_compressed_image(Gosu::Buffer(std::move(dds))), std::runtime_error);
+    ASSERT_FALSE(Gosu::is_compressed_image(Gosu::Buffer(std::vector<std::uint8_t>(16))));
+}
+
+TEST_F(TextureTests, compressed_textures)
+{
+    if (!Gosu::Texture::supports_format(Gosu::TextureFormat::BC1)) {
+        GTEST_SKIP() << "S3TC texture compression is not supported";
+    }
+
+    const auto texture_ptr
+        = std::make_shared<Gosu::Texture>(64, 64, false, Gosu::TextureFormat::BC1);
+    ASSERT_EQ(texture_ptr->byte_size(), 64u * 64 / 2);
+
+    // 3x2 blocks of solid red (RGB565: 0xf800) on a 10x6 image.
+    std::vector<std::uint8_t> blocks;
+    for (int i = 0; i < 6; ++i) {
+        blocks.insert(blocks.end(), { 0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });
+    }
+    const Gosu::CompressedBitmap red(10, 6, Gosu::TextureFormat::BC1, std::move(blocks));
+    const auto chunk_ptr = texture_ptr->try_alloc(red);
+    ASSERT_NE(chunk_ptr, nullptr);
+    ASSERT_EQ(chunk_ptr->width(), 10);
+    ASSERT_EQ(chunk_ptr->height(), 6);
+    ASSERT_EQ(chunk_ptr->to_bitmap(), Gosu::Bitmap(10, 6, Gosu::Color::RED));
+
+    // The image is surrounded by transparent pixels.
+    const Gosu::Rect rect_handle = *chunk_ptr->rect_handle();
+    const Gosu::Bitmap with_border = texture_ptr->to_bitmap(rect_handle);
+    ASSERT_EQ(with_border.pixel(0, 0).alpha, 0);
+    ASSERT_EQ(with_border.pixel(4, 4), Gosu::Color::RED);
+
+    ASSERT_THROW(texture_ptr->insert(Gosu::Bitmap(4, 4), 2, 0), std::invalid_argument);
+    ASSERT_THROW(texture_ptr->try_alloc(Gosu::CompressedBitmap(4, 4, Gosu::TextureFormat::BC3)),
+                 std::invalid_argument);
+}
+
+TEST_F(TextureTests, oversized_compressed_image)
+{
+    if (!Gosu::Texture::supports_format(Gosu::TextureFormat::BC1)) {
+        GTEST_SKIP() << "S3TC texture compression is not supported";
+    }
+
+    Gosu::set_max_texture_size(64);
+    const ScopeGuard restore_max_texture_size([] { Gosu::set_max_texture_size(4096); });
+
+    // The image is decompressed and split into tiles instead of being rejected.
+    const auto drawable = Gosu::create_drawable(solid_bc1_image(100, 30, 0xf800), 0);
+    ASSERT_EQ(drawable->width(), 100);
+    ASSERT_EQ(drawable->height(), 30);
+    ASSERT_EQ(drawable->to_bitmap(), Gosu::Bitmap(100, 30, Gosu::Color::RED));
+}
+
+TEST_F(TextureTests, compressed_image_source_rect)
+{
+    if (!Gosu::Texture::supports_format(Gosu::TextureFormat::BC1)) {
+        GTEST_SKIP() << "S3TC texture compression is not supported";
+    }
+
+    // An 8x4 DDS file with a red and a blue BC1 block.
+    std::vector<std::uint8_t> dds(128);
+    std::memcpy(dds.data(), "DDS ", 4);
+    dds[12] = 4; // height
+    dds[16] = 8; // width
+    std::memcpy(dds.data() + 84, "DXT1", 4);
+    const Gosu::CompressedBitmap red = solid_bc1_image(4, 4, 0xf800);
+    dds.insert(dds.end(), red.data(), red.data() + red.size());
+    const Gosu::CompressedBitmap blue = solid_bc1_image(4, 4, 0x001f);
+    dds.insert(dds.end(), blue.data(), blue.data() + blue.size());
+
+    const std::string filename = std::filesystem::temp_directory_path() / "source_rect_test.dds";
+    Gosu::save_file(Gosu::Buffer(std::move(dds)), filename);
+    const ScopeGuard remove_file([&] { std::filesystem::remove(filename); });
+
+    const Gosu::Image image(filename, Gosu::Rect { 5, 1, 3, 2 }, 0);
+    ASSERT_EQ(image.drawable().to_bitmap(), Gosu::Bitmap(3, 2, Gosu::Color::BLUE));
+    // Only the blue block has been uploaded, with a border of one block on each side.
+    const auto* chunk = dynamic_cast<const Gosu::TexChunk*>(&image.drawable());
+    ASSERT_NE(chunk, nullptr);
+    ASSERT_EQ(chunk->rect_handle()->width, 12);
+    ASSERT_EQ(chunk->rect_handle()->height, 12);
+}
+
+TEST_F(TextureTests, premultiplied_compressed_image)
+{
+    if (!Gosu::Texture::supports_format(Gosu::TextureFormat::BC3)) {
+        GTEST_SKIP() << "S3TC texture compression is not supported";
+    }
+
+    // A BC3 block with an alpha of 128 everywhere, and gray color (RGB565: 0x8410).
+    const Gosu::CompressedBitmap gray(4, 4, Gosu::TextureFormat::BC3,
+                                      { 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //
+                                        0x10, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });
+    const Gosu::Bitmap straight = Gosu::create_drawable(gray, 0)->to_bitmap();
+    ASSERT_EQ(straight.pixel(0, 0).alpha, 0x80);
+
+    Gosu::set_premultiplied_alpha(true);
+    const ScopeGuard restore_premultiplied_alpha([] { Gosu::set_premultiplied_alpha(false); });
+    // The blocks are premultiplied before they reach the texture, so reading them back (which
+    // converts them back to straight alpha) yields the same color, up to BC3 quantization.
+    const Gosu::Bitmap premultiplied = Gosu::create_drawable(gray, 0)->to_bitmap();
+    ASSERT_TRUE(visible_pixels_are_equal(premultiplied, straight, 6));
+}
+
+TEST_F(TextureTests, eviction)
+{
+    const auto texture_ptr = std::make_shared<Gosu::Texture>(128, 64, false);
+    const Gosu::Bitmap bitmap(20, 10, Gosu::Color::CYAN);
+    const auto chunk_ptr = texture_ptr->try_alloc(bitmap, 0);
+    const Gosu::GLTexInfo info = *chunk_ptr->gl_tex_info();
+    const Gosu::TextureMemoryStats stats_before = Gosu::texture_memory_stats();
+
+    texture_ptr->evict();
+    ASSERT_FALSE(texture_ptr->resident());
+    Gosu::TextureMemoryStats stats = Gosu::texture_memory_stats();
+    ASSERT_EQ(stats.evictions, stats_before.evictions + 1);
+    ASSERT_EQ(stats.evicted_bytes, stats_before.evicted_bytes + texture_ptr->byte_size());
+    ASSERT_EQ(stats.resident_bytes, stats_before.resident_bytes - texture_ptr->byte_size());
+
+    // Reading from the texture uploads it again, without changing its name.
+    ASSERT_EQ(chunk_ptr->to_bitmap(), bitmap);
+    ASSERT_TRUE(texture_ptr->resident());
+    ASSERT_EQ(chunk_ptr->gl_tex_info()->tex_name, info.tex_name);
+    stats = Gosu::texture_memory_stats();
+    ASSERT_EQ(stats.reuploads, stats_before.reuploads + 1);
+    ASSERT_EQ(stats.resident_bytes, stats_before.resident_bytes);
+}
+
+TEST_F(TextureTests, render_into_evicted_target)
+{
+    Gosu::Image image = Gosu::render(16, 16, [] {
+        Gosu::draw_rect(0, 0, 16, 16, Gosu::Color::RED, 0);
+    });
+    const auto* chunk = dynamic_cast<const Gosu::TexChunk*>(&image.drawable());
+    ASSERT_NE(chunk, nullptr);
+    chunk->texture()->evict();
+    ASSERT_FALSE(chunk->texture()->resident());
+
+    Gosu::render_into(image, [] { Gosu::draw_rect(0, 0, 5, 16, Gosu::Color::BLUE, 0); });
+    ASSERT_TRUE(chunk->texture()->resident());
+    const Gosu::Bitmap bitmap = image.drawable().to_bitmap();
+    ASSERT_EQ(bitmap.pixel(2, 8), Gosu::Color::BLUE);
+    // render_into() starts from a cleared texture, not from the evicted contents.
+    ASSERT_EQ(bitmap.pixel(10, 8), Gosu::Color::NONE);
+}
+
+TEST_F(TextureTests, texture_arrays)
+{
+    if (!Gosu::TextureArray::supported()) {
+        GTEST_SKIP() << "Texture arrays are not supported";
+    }
+
+    const auto array_ptr = std::make_shared<Gosu::TextureArray>(64, false);
+    const auto first_ptr = std::make_shared<Gosu::Texture>(array_ptr);
+    const Gosu::Bitmap red(30, 20, Gosu::Color::RED), blue(10, 40, Gosu::Color::BLUE);
+    const auto red_ptr = first_ptr->try_alloc(red, 0);
+
+    // Adding layers replaces the storage of the texture array, but keeps its name and contents.
+    auto second_ptr = std::make_shared<Gosu::Texture>(array_ptr);
+    const auto third_ptr = std::make_shared<Gosu::Texture>(array_ptr);
+    ASSERT_EQ(second_ptr->width(), 64);
+    ASSERT_EQ(third_ptr->layer(), 2);
+    const auto blue_ptr = third_ptr->try_alloc(blue, 0);
+    ASSERT_EQ(red_ptr->gl_tex_info()->tex_name, array_ptr->tex_name());
+    ASSERT_EQ(red_ptr->gl_tex_info()->layer, 0);
+    ASSERT_EQ(blue_ptr->gl_tex_info()->tex_name, array_ptr->tex_name());
+    ASSERT_EQ(blue_ptr->gl_tex_info()->layer, 2);
+    ASSERT_EQ(red_ptr->to_bitmap(), red);
+    ASSERT_EQ(blue_ptr->to_bitmap(), blue);
+
+    // Layers are reused once their Texture has been released.
+    const int second_layer = second_ptr->layer();
+    second_ptr.reset();
+    ASSERT_EQ(Gosu::Texture(array_ptr).layer(), second_layer);
+
+    // Images can be moved between texture arrays and regular textures.
+    const auto regular_ptr = std::make_shared<Gosu::Texture>(64, 64, false);
+    ASSERT_TRUE(first_ptr->evacuate_into({ regular_ptr }));
+    ASSERT_EQ(red_ptr->gl_tex_info()->layer, -1);
+    ASSERT_EQ(red_ptr->to_bitmap(), red);
+    ASSERT_TRUE(regular_ptr->evacuate_into({ third_ptr }));
+    ASSERT_EQ(red_ptr->gl_tex_info()->layer, 2);
+    ASSERT_EQ(red_ptr->to_bitmap(), red);
+    ASSERT_EQ(blue_ptr->to_bitmap(), blue);
+}
+
 TEST_F(TextureTests, bin_packing_benchmark)
 {
     std::random_device rd;
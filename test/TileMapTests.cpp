@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <Gosu/Bitmap.hpp>
+#include <Gosu/Drawable.hpp>
+#include <Gosu/Graphics.hpp>
+#include <Gosu/Image.hpp>
+#include <Gosu/TileMap.hpp>
+#include <Gosu/Transform.hpp>
+#include <stdexcept>
+#include <vector>
+
+class TileMapTests : public testing::Test
+{
+protected:
+    static std::vector<Gosu::Image> tiles()
+    {
+        Gosu::Bitmap bitmap(8, 2, Gosu::Color::RED);
+        bitmap.insert(Gosu::Bitmap(2, 2, Gosu::Color::GREEN), 2, 0);
+        bitmap.insert(Gosu::Bitmap(2, 2, Gosu::Color::BLUE), 4, 0);
+        bitmap.insert(Gosu::Bitmap(2, 2), 6, 0);
+        return Gosu::load_tiles(bitmap, 2, 2, Gosu::IF_RETRO);
+    }
+};
+
+TEST_F(TileMapTests, invalid_arguments)
+{
+    ASSERT_THROW(Gosu::TileMap({}, 4, 4), std::invalid_argument);
+    ASSERT_THROW(Gosu::TileMap(tiles(), -1, 4), std::invalid_argument);
+    ASSERT_THROW(Gosu::TileMap(tiles(), 4, 4, 0), std::invalid_argument);
+    ASSERT_THROW(Gosu::TileMap({ Gosu::Image(Gosu::Bitmap(2, 2)), Gosu::Image(Gosu::Bitmap(2, 3)) },
+                               4, 4),
+                 std::invalid_argument);
+
+    Gosu::TileMap map(tiles(), 5, 3);
+    ASSERT_EQ(map.columns(), 5);
+    ASSERT_EQ(map.rows(), 3);
+    ASSERT_EQ(map.tile_width(), 2);
+    ASSERT_EQ(map.tile_height(), 2);
+    ASSERT_EQ(map.tile(4, 2), Gosu::TileMap::NO_TILE);
+    ASSERT_THROW(map.tile(5, 0), std::invalid_argument);
+    ASSERT_THROW(map.set_tile(0, -1, 0), std::invalid_argument);
+    ASSERT_THROW(map.set_tile(0, 0, 4), std::invalid_argument);
+    ASSERT_THROW(map.set_tile(0, 0, -2), std::invalid_argument);
+    map.set_tile(4, 2, 3);
+    ASSERT_EQ(map.tile(4, 2), 3);
+}
+
+TEST_F(TileMapTests, draw_and_update_chunks)
+{
+    const std::vector<Gosu::Image> images = tiles();
+    // 7x5 tiles in chunks of 3x3, so that the chunks at the right and bottom are incomplete.
+    Gosu::TileMap map(images, 7, 5, 3);
+    for (int row = 0; row < 5; ++row) {
+        for (int column = 0; column < 7; ++column) {
+            map.set_tile(column, row, (column + row) % 4);
+        }
+    }
+
+    const auto render_both = [&](double x, double y, double scale) {
+        const Gosu::Bitmap expected = Gosu::render(16, 12, [&] {
+            for (int row = 0; row < 5; ++row) {
+                for (int column = 0; column < 7; ++column) {
+                    images[map.tile(column, row)].draw(x + column * 2 * scale,
+                                                       y + row * 2 * scale, 0, scale, scale);
+                }
+            }
+        }).drawable().to_bitmap();
+        const Gosu::Bitmap actual = Gosu::render(16, 12, [&] {
+            map.draw(x, y, 0, scale, scale);
+        }).drawable().to_bitmap();
+        return expected == actual;
+    };
+
+    ASSERT_TRUE(render_both(0, 0, 1));
+    // Partially outside of the render target, so that some chunks are culled.
+    ASSERT_TRUE(render_both(-8, 4, 2));
+    ASSERT_TRUE(render_both(10, -6, 1));
+
+    // Changing a tile only affects the following draw() calls.
+    map.set_tile(6, 4, 2);
+    map.set_tile(0, 0, Gosu::TileMap::NO_TILE);
+    const Gosu::Bitmap result = Gosu::render(16, 12, [&] { map.draw(0, 0, 0); })
+                                    .drawable().to_bitmap();
+    ASSERT_EQ(result.pixel(13, 9), Gosu::Color::BLUE);
+    ASSERT_EQ(result.pixel(1, 1), Gosu::Color::NONE);
+    ASSERT_EQ(result.pixel(3, 1), Gosu::Color::GREEN);
+
+    // Transforms are taken into account when culling.
+    const Gosu::Bitmap moved = Gosu::render(16, 12, [&] {
+        Gosu::transform(Gosu::Transform::translate(-10, 0), [&] { map.draw(0, 0, 0); });
+    }).drawable().to_bitmap();
+    ASSERT_EQ(moved.pixel(3, 9), Gosu::Color::BLUE);
+}